@@ -2,11 +2,10 @@ MUSIC_DAEMON_VERSION = 1.0
 MUSIC_DAEMON_SITE = $(BR2_EXTERNAL_final_project_PATH)/package/music-daemon/src
 MUSIC_DAEMON_SITE_METHOD = local
 MUSIC_DAEMON_LICENSE = MIT
+MUSIC_DAEMON_DEPENDENCIES = alsa-lib host-pkgconf
 
 define MUSIC_DAEMON_BUILD_CMDS
-	$(TARGET_CC) $(TARGET_CFLAGS) \
-		-o $(@D)/music_daemon \
-		$(MUSIC_DAEMON_SITE)/music_daemon.c
+	$(TARGET_MAKE_ENV) $(MAKE) $(TARGET_CONFIGURE_OPTS) -C $(@D)
 endef
 
 define MUSIC_DAEMON_INSTALL_TARGET_CMDS
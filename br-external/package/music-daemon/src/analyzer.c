@@ -0,0 +1,462 @@
+/*
+ * analyzer.c
+ *
+ * Background loudness and silence analysis of library tracks and cached
+ * cloud files (see analyzer.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#include "analyzer.h"
+#include "decoder.h"
+#include "mp3info.h"
+#include "pcm.h"
+#include "r128.h"
+#include "rt.h"
+#include "waveform.h"
+
+#define ANALYZER_RESULTS 16             /* Measurements not collected yet */
+#define ANALYZER_NICE    19
+
+/* ioprio_set(2): no glibc wrapper */
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_CLASS_SHIFT  13
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wake = PTHREAD_COND_INITIALIZER;
+static int             rescan;          /* Library changed since the walk began */
+static char            files[ANALYZER_FILES][PATH_MAX];
+static int             nfiles;
+static char            file_busy[PATH_MAX];     /* Being analyzed right now  */
+static struct analyzer_result results[ANALYZER_RESULTS];
+static int             nresults;
+static void          (*notify)(void);
+static int             started;
+static int             silence_level;   /* Loudest sample still counted silent */
+
+static _Atomic unsigned long analyzed, failed;
+static _Atomic int           busy;
+
+/* Owned by the analyzer thread */
+static struct r128     meter;
+static struct waveform_builder wave;
+static struct waveform overview;
+static unsigned char   pcm[64 * 1024];
+
+/* ------------------------------------------------------- */
+/*                       MEASURING                         */
+/* ------------------------------------------------------- */
+
+static int clamp16(long v)
+{
+    if (v > INT16_MAX) return INT16_MAX;
+    if (v < INT16_MIN + 1) return INT16_MIN + 1;
+    return (int)v;
+}
+
+/*
+ * Audible frames of samples, numbered from base: the first one lowers *first,
+ * the last one sets *end (one past it).
+ */
+static void scan_audible(const int16_t *samples, size_t frames, uint64_t base,
+                         uint64_t *first, uint64_t *end)
+{
+    size_t i, k = 0;
+
+    /* Only the ends matter: look for the first from the front... */
+    if (*first == UINT64_MAX) {
+        for (i = 0; i < frames * PCM_CHANNELS; i++)
+            if (abs(samples[i]) > silence_level)
+                break;
+        if (i == frames * PCM_CHANNELS)
+            return;
+        *first = base + i / PCM_CHANNELS;
+        k = i / PCM_CHANNELS;
+    }
+
+    /* ...and for the last from the back */
+    for (i = frames * PCM_CHANNELS; i > k * PCM_CHANNELS; i--)
+        if (abs(samples[i - 1]) > silence_level)
+            break;
+    if (i > k * PCM_CHANNELS)
+        *end = base + (i - 1) / PCM_CHANNELS + 1;
+}
+
+static uint32_t frames_ms(uint64_t frames)
+{
+    return (uint32_t)(frames * 1000 / PCM_RATE);
+}
+
+/*
+ * Decode path to the end through the meter, the silence scan and the peak
+ * overview builder.  Returns 0; 1 if the decoder produced nothing, with a
+ * filled in as a track that has nothing to measure; or -1 if no decoder
+ * could be started, which is worth trying again later.
+ */
+static int measure(const char *path, int track, struct lib_analysis *a)
+{
+    struct decoder d;
+    size_t have = 0;
+    uint64_t total = 0, first = UINT64_MAX, end = 0;
+    double lufs, dbtp;
+
+    if (decoder_open(&d, path, -1, track, 0) < 0)
+        return -1;
+
+    atomic_store(&busy, 1);
+    r128_init(&meter);
+    waveform_begin(&wave);
+
+    for (;;) {
+        ssize_t n = read(d.fd, pcm + have, sizeof(pcm) - have);
+        size_t frames;
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        have  += (size_t)n;
+        frames = have / PCM_FRAME_BYTES;
+        r128_feed(&meter, (const int16_t *)pcm, frames);
+        scan_audible((const int16_t *)pcm, frames, total, &first, &end);
+        waveform_feed(&wave, (const int16_t *)pcm, frames);
+        total += frames;
+
+        /* Keep a partial frame for the next read */
+        have -= frames * PCM_FRAME_BYTES;
+        memmove(pcm, pcm + frames * PCM_FRAME_BYTES, have);
+    }
+    decoder_close(&d);
+    atomic_store(&busy, 0);
+
+    /* Corrupt or truncated: stored like this, so it is not decoded again */
+    if (!total) {
+        atomic_fetch_add(&failed, 1);
+        *a = (struct lib_analysis){ .loudness = LIB_LOUDNESS_NONE };
+        return 1;
+    }
+
+    /* Silence or shorter than one gating block: nothing to normalize */
+    if (r128_result(&meter, &lufs, &dbtp) < 0)
+        a->loudness = LIB_LOUDNESS_NONE;
+    else
+        a->loudness = clamp16(lrint(lufs * 100.0));
+    a->peak = clamp16(lrint(dbtp * 100.0));
+
+    if (first == UINT64_MAX)
+        first = end = total;
+    a->lead_ms   = frames_ms(first);
+    a->trail_ms  = frames_ms(total - end);
+    a->length_ms = frames_ms(total);
+
+    atomic_fetch_add(&analyzed, 1);
+    return 0;
+}
+
+/*
+ * Seek table of path as the library knows it (size, mtime), into r.
+ * Returns 0, or -1 if the file changed or holds no frames.
+ */
+static int walk_frames(const char *path, struct analyzer_result *r)
+{
+    struct mp3_info mi;
+    struct stat st;
+    long frames;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size != r->size ||
+        (int64_t)st.st_mtime != r->mtime || mp3info_read(fd, st.st_size, &mi) < 0 ||
+        (frames = mp3info_frames(fd, &mi, LIB_SEEK_STEP, &r->offsets, &r->nseek)) <= 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    r->frames      = (uint32_t)frames;
+    r->duration_ms = mp3info_duration_ms(&mi, r->frames);
+    return 0;
+}
+
+/*
+ * Next live track from *cursor on that has not been analyzed, has no
+ * overview yet while they can be stored, or has no seek table; -1 if
+ * there is none.  *decode is set if it needs more than its seek table.
+ */
+static int next_track(unsigned *cursor, char *path, size_t len, uint64_t *id,
+                      uint64_t *size, int64_t *mtime, int *decode)
+{
+    const struct lib_view *v = library_acquire();
+    unsigned n = lib_count(v);
+    unsigned done = LIB_ANALYZED | (waveform_enabled() ? LIB_WAVEFORM : 0);
+    int found = -1;
+
+    for (; *cursor < n && found < 0; (*cursor)++) {
+        const struct lib_track *t = lib_track(v, *cursor);
+        int measured;
+
+        if (!t)
+            continue;
+
+        /* Decoding to nothing leaves no overview or seek table to make */
+        if (t->flags & LIB_NOAUDIO)
+            continue;
+        measured = (t->flags & done) == done;
+        if ((measured && t->seek_count) || lib_path(v, *cursor, path, len) < 0)
+            continue;
+        *id     = t->id;
+        *size   = t->size;
+        *mtime  = t->mtime;
+        *decode = !measured;
+        found   = (int)*cursor;
+    }
+
+    library_release(v);
+    return found;
+}
+
+static void analyze_track(int track, const char *path, uint64_t id,
+                          uint64_t size, int64_t mtime, int decode)
+{
+    struct analyzer_result r = { .track = track, .size = size, .mtime = mtime };
+    int rc = 0;
+
+    if (decode) {
+        if ((rc = measure(path, track, &r.a)) < 0)
+            return;
+        r.decoded    = 1;
+        r.a.waveform = rc == 0 && waveform_end(&wave, &overview) == 0 &&
+                       waveform_save(id, size, mtime, &overview) == 0;
+    }
+
+    /* Mostly from the page cache when the decode just read the file */
+    if (walk_frames(path, &r) < 0) {
+        r.offsets = NULL;
+        if (!decode)
+            return;
+    }
+
+    pthread_mutex_lock(&lock);
+    while (nresults == ANALYZER_RESULTS)
+        pthread_cond_wait(&wake, &lock);
+    results[nresults++] = r;
+    pthread_mutex_unlock(&lock);
+
+    notify();
+}
+
+/*
+ * Sidecar: "<loudness> <peak> <lead> <trail> <length> <size> <mtime>",
+ * written whole or not at all
+ */
+static void analyze_file(const char *path)
+{
+    char side[PATH_MAX + 16], tmp[PATH_MAX + 24];
+    struct lib_analysis a;
+    struct stat st;
+    FILE *f;
+
+    /* Cloud tracks have no library id, so no overview either */
+    if (stat(path, &st) < 0 || measure(path, -1, &a) < 0)
+        return;
+
+    snprintf(side, sizeof(side), "%s%s", path, ANALYZER_EXT);
+    snprintf(tmp, sizeof(tmp), "%s.part", side);
+    if (!(f = fopen(tmp, "we"))) {
+        perror("analyzer: sidecar");
+        return;
+    }
+    fprintf(f, "%d %d %u %u %u %lld %lld\n", a.loudness, a.peak,
+            a.lead_ms, a.trail_ms, a.length_ms,
+            (long long)st.st_size, (long long)st.st_mtime);
+    if (fclose(f) != 0 || rename(tmp, side) < 0) {
+        perror("analyzer: sidecar");
+        unlink(tmp);
+    }
+}
+
+/* ------------------------------------------------------- */
+/*                    ANALYZER THREAD                      */
+/* ------------------------------------------------------- */
+
+static void *analyzer_thread(void *arg)
+{
+    unsigned cursor = 0;
+    int walking = 0;
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+
+    (void)arg;
+    pthread_setname_np(pthread_self(), "analyzer");
+
+    /* Per thread on Linux, and inherited by the decoders forked from here */
+    if (setpriority(PRIO_PROCESS, (id_t)tid, ANALYZER_NICE) < 0)
+        perror("analyzer: setpriority");
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid,
+                IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0)
+        perror("analyzer: ioprio_set");
+
+    for (;;) {
+        char path[PATH_MAX];
+        uint64_t id, size;
+        int64_t mtime;
+        int track, decode;
+
+        pthread_mutex_lock(&lock);
+        while (!nfiles && !rescan && !walking)
+            pthread_cond_wait(&wake, &lock);
+
+        /* Cloud files first: one of them is likely to play soon */
+        if (nfiles) {
+            memcpy(file_busy, files[0], sizeof(file_busy));
+            memmove(files, files + 1, --nfiles * sizeof(files[0]));
+            pthread_mutex_unlock(&lock);
+
+            analyze_file(file_busy);
+
+            pthread_mutex_lock(&lock);
+            file_busy[0] = '\0';
+            pthread_mutex_unlock(&lock);
+            continue;
+        }
+        if (rescan) {
+            rescan  = 0;
+            walking = 1;
+            cursor  = 0;
+        }
+        pthread_mutex_unlock(&lock);
+
+        if ((track = next_track(&cursor, path, sizeof(path), &id, &size,
+                                &mtime, &decode)) < 0) {
+            walking = 0;
+            continue;
+        }
+        analyze_track(track, path, id, size, mtime, decode);
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------- */
+/*                     CONTROL THREAD                      */
+/* ------------------------------------------------------- */
+
+void analyzer_kick(void)
+{
+    if (!started)
+        return;
+
+    pthread_mutex_lock(&lock);
+    rescan = 1;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+void analyzer_add_file(const char *path)
+{
+    int dup;
+
+    if (!started || strlen(path) >= PATH_MAX)
+        return;
+
+    pthread_mutex_lock(&lock);
+    dup = strcmp(file_busy, path) == 0;
+    for (int k = 0; k < nfiles; k++)
+        dup |= strcmp(files[k], path) == 0;
+    if (!dup && nfiles < ANALYZER_FILES) {
+        strcpy(files[nfiles++], path);
+        pthread_cond_broadcast(&wake);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+int analyzer_result(struct analyzer_result *out)
+{
+    int got = 0;
+
+    pthread_mutex_lock(&lock);
+    if (nresults) {
+        *out = results[0];
+        memmove(results, results + 1, --nresults * sizeof(results[0]));
+        pthread_cond_broadcast(&wake);
+        got = 1;
+    }
+    pthread_mutex_unlock(&lock);
+    return got;
+}
+
+/* ------------------------------------------------------- */
+/*                       ANY THREAD                        */
+/* ------------------------------------------------------- */
+
+int analyzer_read_file(const char *path, struct lib_analysis *a)
+{
+    char side[PATH_MAX + 16];
+    long long size, mtime;
+    struct stat st;
+    FILE *f;
+    int n;
+
+    snprintf(side, sizeof(side), "%s%s", path, ANALYZER_EXT);
+    if (stat(path, &st) < 0 || !(f = fopen(side, "re")))
+        return -1;
+    n = fscanf(f, "%d %d %u %u %u %lld %lld", &a->loudness, &a->peak,
+               &a->lead_ms, &a->trail_ms, &a->length_ms, &size, &mtime);
+    fclose(f);
+
+    /* Written for an older download of the same track, or by an older daemon */
+    if (n != 7 || size != (long long)st.st_size || mtime != (long long)st.st_mtime)
+        return -1;
+    return 0;
+}
+
+void analyzer_get_stats(struct analyzer_stats *st)
+{
+    st->analyzed = atomic_load(&analyzed);
+    st->failed   = atomic_load(&failed);
+    st->busy     = atomic_load(&busy);
+}
+
+/* ------------------------------------------------------- */
+/*                         SETUP                           */
+/* ------------------------------------------------------- */
+
+int analyzer_init(void (*done_fn)(void), int silence_db)
+{
+    pthread_attr_t attr;
+    pthread_t t;
+    int err;
+
+    notify = done_fn;
+    silence_level = (int)lrint(32768.0 * pow(10.0, silence_db / 20.0));
+    rescan = 1;
+    rt_thread_attr(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&t, &attr, analyzer_thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (err) {
+        fprintf(stderr, "analyzer: pthread_create: %s\n", strerror(err));
+        return -1;
+    }
+    started = 1;
+    return 0;
+}
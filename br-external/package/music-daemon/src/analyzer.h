@@ -0,0 +1,92 @@
+/*
+ * analyzer.h
+ *
+ * Background analysis for volume normalization, silence trimming and
+ * scrub bar overviews.
+ *
+ * An analyzer thread walks the library for tracks without LIB_ANALYZED or
+ * LIB_WAVEFORM, decodes each one through an mpg123 child as fast as the
+ * CPU allows and runs the PCM through an EBU R128 meter (r128.h).  The
+ * same pass finds the first and last sample above the silence threshold
+ * and builds the track's peak overview (waveform.h), which it stores right
+ * away.  The integrated loudness, true peak and the silence at both ends
+ * go back to the control thread, which stores them with
+ * library_set_analysis(); from then on the index has them and the track
+ * never has to be decoded for analysis again.  That goes for a corrupt or
+ * truncated file too: decoding it to nothing is stored (LIB_NOAUDIO), and
+ * it is only tried again once the file changes.
+ *
+ * The walk also measures the seek table (see library_set_seek()) of every
+ * track that has none, reading the frame headers right after the decode
+ * has pulled the file into the page cache; an analyzed track that only
+ * lacks its table costs just that read.  So every track becomes seekable
+ * by table within one pass over the library, not only once it has played.
+ * The walk starts once at startup and again after every library change.
+ *
+ * Cloud tracks are not in the library; each one is analyzed once the
+ * download scheduler has put it in the cache, and its result is written
+ * next to it as a small ANALYZER_EXT sidecar file.
+ *
+ * The thread and the mpg123 children it starts run at nice 19 in the idle
+ * I/O class, so analysis only ever uses CPU and SD card time that playback
+ * does not need.  None of it is on the audio path: playback just reads two
+ * numbers from the index when it opens a track.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <stdint.h>
+
+#include "library.h"
+
+#define ANALYZER_EXT   ".r128"          /* Sidecar of a cached cloud track */
+#define ANALYZER_FILES 8                /* Cloud files waiting at once     */
+
+/* A measured library track, see library_set_analysis() and _set_seek() */
+struct analyzer_result {
+    int                 track;
+    uint64_t            size;           /* File at the time of the decode  */
+    int64_t             mtime;
+    int                 decoded;        /* a was measured                  */
+    struct lib_analysis a;
+    uint32_t            frames;         /* Seek table walk, if offsets is  */
+    uint32_t            duration_ms;    /*  not NULL                       */
+    uint32_t           *offsets;        /* malloc()ed seek table           */
+    unsigned            nseek;
+};
+
+struct analyzer_stats {
+    unsigned long analyzed;             /* Tracks and files this run       */
+    unsigned long failed;               /* Decodes that produced nothing   */
+    int           busy;                 /* Decoding right now              */
+};
+
+/*
+ * Start the analyzer thread and its first walk of the library; it calls
+ * done() whenever a result is ready for analyzer_result().  Samples below
+ * silence_db dBFS count as silence.  Returns 0, or -1 if it could not start.
+ */
+int  analyzer_init(void (*done)(void), int silence_db);
+
+/* Control thread: the library changed, walk it again for new tracks */
+void analyzer_kick(void);
+
+/* Control thread: analyze a cached cloud file into its sidecar */
+void analyzer_add_file(const char *path);
+
+/* Control thread: the next finished measurement, 0 if there is none */
+int  analyzer_result(struct analyzer_result *out);
+
+/*
+ * Any thread: the sidecar of path, if it was written for the file as it
+ * is now.  Returns 0, or -1 if the file has not been analyzed.
+ */
+int  analyzer_read_file(const char *path, struct lib_analysis *a);
+
+/* Any thread */
+void analyzer_get_stats(struct analyzer_stats *st);
+
+#endif /* ANALYZER_H */
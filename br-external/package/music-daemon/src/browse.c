@@ -0,0 +1,339 @@
+/*
+ * browse.c
+ *
+ * Sorted listings of the library and the track id hash (see browse.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+
+#include "browse.h"
+
+static int       built;
+static uint64_t  built_shape;       /* lib_shape() of the listings        */
+static unsigned  n;                 /* Live tracks                        */
+static uint32_t *by_artist;         /* Slots by artist, album, no., title */
+static uint32_t *by_path;           /* Slots by path                      */
+static uint32_t *artist_run;        /* Start of each artist in by_artist  */
+static unsigned  nartist;
+static uint32_t *album_run;         /* Start of each artist's album       */
+static unsigned  nalbum;
+static uint32_t *ids;               /* Slot + 1 by track id, 0 = free     */
+static size_t    ids_cap;
+
+static const struct lib_view *sort_view;
+
+/* ------------------------------------------------------- */
+/*                        BUILDING                         */
+/* ------------------------------------------------------- */
+
+static const char *artist_of(const struct lib_view *v, unsigned idx)
+{
+    return lib_str(v, idx, lib_track(v, idx)->artist);
+}
+
+static const char *album_of(const struct lib_view *v, unsigned idx)
+{
+    return lib_str(v, idx, lib_track(v, idx)->album);
+}
+
+static int cmp_album_order(const void *a, const void *b)
+{
+    unsigned x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    const struct lib_track *tx = lib_track(sort_view, x);
+    const struct lib_track *ty = lib_track(sort_view, y);
+    int c;
+
+    if ((c = strcasecmp(artist_of(sort_view, x), artist_of(sort_view, y))) ||
+        (c = strcasecmp(album_of(sort_view, x), album_of(sort_view, y))))
+        return c;
+    if (tx->track_no != ty->track_no)
+        return (int)tx->track_no - (int)ty->track_no;
+    if ((c = strcasecmp(lib_title(sort_view, x), lib_title(sort_view, y))))
+        return c;
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_path_order(const void *a, const void *b)
+{
+    return strcmp(lib_relpath(sort_view, *(const uint32_t *)a),
+                  lib_relpath(sort_view, *(const uint32_t *)b));
+}
+
+static void release(void)
+{
+    free(by_artist);
+    free(by_path);
+    free(artist_run);
+    free(album_run);
+    free(ids);
+    by_artist = by_path = artist_run = album_run = ids = NULL;
+    n = nartist = nalbum = 0;
+    ids_cap = 0;
+    built = 0;
+}
+
+/*
+ * Rebuild the listings if tracks came, went or changed since they were
+ * made; seek tables and analysis results leave every key in place.
+ */
+static int refresh(const struct lib_view *v)
+{
+    unsigned live = lib_live(v), k = 0;
+
+    if (built && built_shape == lib_shape(v))
+        return 0;
+
+    release();
+    for (ids_cap = 1024; ids_cap < (size_t)live * 2; ids_cap *= 2)
+        ;
+
+    if (!(by_artist  = malloc((live + 1) * sizeof(*by_artist))) ||
+        !(by_path    = malloc((live + 1) * sizeof(*by_path))) ||
+        !(artist_run = malloc((live + 1) * sizeof(*artist_run))) ||
+        !(album_run  = malloc((live + 1) * sizeof(*album_run))) ||
+        !(ids        = calloc(ids_cap, sizeof(*ids)))) {
+        perror("browse: alloc");
+        release();
+        return -1;
+    }
+
+    for (unsigned i = 0; i < lib_count(v) && k < live; i++) {
+        const struct lib_track *t = lib_track(v, i);
+        size_t j;
+
+        if (!t)
+            continue;
+        by_artist[k] = by_path[k] = i;
+        k++;
+
+        for (j = t->id & (ids_cap - 1); ids[j]; j = (j + 1) & (ids_cap - 1))
+            ;
+        ids[j] = i + 1;
+    }
+    n = k;
+
+    sort_view = v;
+    qsort(by_artist, n, sizeof(*by_artist), cmp_album_order);
+    qsort(by_path, n, sizeof(*by_path), cmp_path_order);
+
+    for (unsigned p = 0; p < n; p++) {
+        int new_artist = !p || strcasecmp(artist_of(v, by_artist[p]),
+                                          artist_of(v, by_artist[p - 1])) != 0;
+
+        if (new_artist)
+            artist_run[nartist++] = p;
+        if (new_artist || strcasecmp(album_of(v, by_artist[p]),
+                                     album_of(v, by_artist[p - 1])) != 0)
+            album_run[nalbum++] = p;
+    }
+    artist_run[nartist] = n;
+    album_run[nalbum] = n;
+
+    built = 1;
+    built_shape = lib_shape(v);
+    return 0;
+}
+
+/* ------------------------------------------------------- */
+/*                        LISTINGS                         */
+/* ------------------------------------------------------- */
+
+/* First run starting at or after position pos */
+static unsigned run_at(const uint32_t *run, unsigned nrun, uint32_t pos)
+{
+    unsigned lo = 0, hi = nrun;
+
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (run[mid] < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* by_artist positions [*lo, *hi) of artist (all if NULL); -1 if none */
+static int artist_range(const struct lib_view *v, const char *artist,
+                        unsigned *lo, unsigned *hi)
+{
+    unsigned l = 0, h = nartist;
+
+    if (!artist) {
+        *lo = 0;
+        *hi = n;
+        return 0;
+    }
+
+    while (l < h) {
+        unsigned mid = (l + h) / 2;
+        if (strcasecmp(artist_of(v, by_artist[artist_run[mid]]), artist) < 0)
+            l = mid + 1;
+        else
+            h = mid;
+    }
+    if (l == nartist || strcasecmp(artist_of(v, by_artist[artist_run[l]]), artist) != 0)
+        return -1;
+
+    *lo = artist_run[l];
+    *hi = artist_run[l + 1];
+    return 0;
+}
+
+unsigned browse_artists(const struct lib_view *v, unsigned offset, unsigned limit,
+                        browse_fn fn, void *arg)
+{
+    if (refresh(v) < 0)
+        return 0;
+
+    if (offset >= nartist)
+        return nartist;
+
+    for (unsigned k = offset; k < nartist && k - offset < limit; k++) {
+        struct browse_item it = {
+            .name   = artist_of(v, by_artist[artist_run[k]]),
+            .tracks = artist_run[k + 1] - artist_run[k],
+            .albums = run_at(album_run, nalbum, artist_run[k + 1]) -
+                      run_at(album_run, nalbum, artist_run[k]),
+        };
+        fn(&it, arg);
+    }
+    return nartist;
+}
+
+unsigned browse_albums(const struct lib_view *v, const char *artist,
+                       unsigned offset, unsigned limit, browse_fn fn, void *arg)
+{
+    unsigned lo, hi, a0, a1;
+
+    if (refresh(v) < 0 || artist_range(v, artist, &lo, &hi) < 0)
+        return 0;
+
+    a0 = run_at(album_run, nalbum, lo);
+    a1 = run_at(album_run, nalbum, hi);
+
+    /* Checked before adding: a0 + offset could wrap past a1 */
+    if (offset >= a1 - a0)
+        return a1 - a0;
+
+    for (unsigned k = a0 + offset; k < a1 && k - a0 - offset < limit; k++) {
+        unsigned first = by_artist[album_run[k]];
+        struct browse_item it = {
+            .name   = album_of(v, first),
+            .artist = artist_of(v, first),
+            .tracks = album_run[k + 1] - album_run[k],
+        };
+        fn(&it, arg);
+    }
+    return a1 - a0;
+}
+
+unsigned browse_tracks(const struct lib_view *v, const char *artist, const char *album,
+                       unsigned offset, unsigned limit, browse_fn fn, void *arg)
+{
+    unsigned lo, hi, total = 0;
+
+    if (refresh(v) < 0 || artist_range(v, artist, &lo, &hi) < 0)
+        return 0;
+
+    for (unsigned k = run_at(album_run, nalbum, lo); k < nalbum && album_run[k] < hi; k++) {
+        unsigned len = album_run[k + 1] - album_run[k];
+
+        if (album && strcasecmp(album_of(v, by_artist[album_run[k]]), album) != 0)
+            continue;
+
+        /* Only the part of the run that falls on the page is visited */
+        if (offset < total + len) {
+            unsigned skip = total < offset ? offset - total : 0;
+            unsigned seen = total + skip - offset;
+
+            for (unsigned p = skip; p < len && seen < limit; p++, seen++) {
+                struct browse_item it = { .idx = by_artist[album_run[k] + p] };
+                fn(&it, arg);
+            }
+        }
+        total += len;
+    }
+    return total;
+}
+
+/* First by_path position whose path is not below key */
+static unsigned path_at(const struct lib_view *v, const char *key)
+{
+    unsigned lo = 0, hi = n;
+
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (strcmp(lib_relpath(v, by_path[mid]), key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+unsigned browse_folder(const struct lib_view *v, const char *path,
+                       unsigned offset, unsigned limit, browse_fn fn, void *arg)
+{
+    char prefix[PATH_MAX], name[NAME_MAX + 1], key[PATH_MAX];
+    size_t plen = 0;
+    unsigned total = 0, p;
+
+    if (refresh(v) < 0)
+        return 0;
+
+    if (path[0])
+        plen = (size_t)snprintf(prefix, sizeof(prefix), "%s/", path);
+    prefix[plen] = '\0';
+
+    for (p = path_at(v, prefix); p < n; total++) {
+        const char *rel = lib_relpath(v, by_path[p]);
+        const char *rest = rel + plen;
+        const char *slash = strchr(rest, '/');
+        int on_page = total >= offset && total - offset < limit;
+
+        if (strncmp(rel, prefix, plen) != 0)
+            break;
+
+        if (!slash) {
+            struct browse_item it = { .idx = by_path[p] };
+            if (on_page)
+                fn(&it, arg);
+            p++;
+            continue;
+        }
+
+        /* A subfolder: everything up to "<name>0" ('0' follows '/') */
+        snprintf(name, sizeof(name), "%.*s", (int)(slash - rest), rest);
+        snprintf(key, sizeof(key), "%.*s0", (int)(slash - rel), rel);
+        unsigned end = path_at(v, key);
+
+        if (on_page) {
+            struct browse_item it = { .name = name, .tracks = end - p };
+            fn(&it, arg);
+        }
+        p = end;
+    }
+    return total;
+}
+
+int browse_find(const struct lib_view *v, uint64_t id)
+{
+    if (refresh(v) < 0)
+        return -1;
+
+    for (size_t j = id & (ids_cap - 1); ids[j]; j = (j + 1) & (ids_cap - 1)) {
+        const struct lib_track *t = lib_track(v, ids[j] - 1);
+        if (t && t->id == id)
+            return (int)(ids[j] - 1);
+    }
+    return -1;
+}
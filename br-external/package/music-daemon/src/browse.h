@@ -0,0 +1,58 @@
+/*
+ * browse.h
+ *
+ * Listings of the local library for remote browsing: artists, their
+ * albums, tracks, and the folder tree, in display order and a page at a
+ * time, plus the track of a stable id (lib_track.id).
+ *
+ * Two orders of the live slots are kept, by artist/album/track number and
+ * by path, with the runs of each artist and album marked, and a hash from
+ * track id to slot.  They are rebuilt, once, after each change to the
+ * tracks themselves (lib_shape), not after seek tables or analysis results;
+ * the strings stay in the library view, so a page costs a walk over the
+ * entries it covers and the caller can stream them as they come.
+ *
+ * Not thread-safe: the network thread owns the listings.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef BROWSE_H
+#define BROWSE_H
+
+#include "library.h"
+
+struct browse_item {
+    const char *name;           /* Artist, album or folder; NULL: track  */
+    const char *artist;         /* Albums: their artist                  */
+    unsigned    albums;         /* Artists                               */
+    unsigned    tracks;         /* Artists, albums, folders              */
+    unsigned    idx;            /* Tracks: library slot                  */
+};
+
+typedef void (*browse_fn)(const struct browse_item *it, void *arg);
+
+/*
+ * Each listing calls fn for its items offset .. offset + limit - 1 and
+ * returns how many items there are in total.  Empty artist and album names
+ * are listed as "".
+ */
+unsigned browse_artists(const struct lib_view *v, unsigned offset, unsigned limit,
+                        browse_fn fn, void *arg);
+
+/* Albums of artist, or of everyone if artist is NULL */
+unsigned browse_albums(const struct lib_view *v, const char *artist,
+                       unsigned offset, unsigned limit, browse_fn fn, void *arg);
+
+/* Tracks of artist and album (either may be NULL), in album order */
+unsigned browse_tracks(const struct lib_view *v, const char *artist, const char *album,
+                       unsigned offset, unsigned limit, browse_fn fn, void *arg);
+
+/* Subfolders and tracks directly in folder path ("" is the top), by name */
+unsigned browse_folder(const struct lib_view *v, const char *path,
+                       unsigned offset, unsigned limit, browse_fn fn, void *arg);
+
+/* Slot of the live track with this id, or -1 */
+int      browse_find(const struct lib_view *v, uint64_t id);
+
+#endif /* BROWSE_H */
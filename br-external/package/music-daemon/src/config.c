@@ -0,0 +1,114 @@
+/*
+ * config.c
+ *
+ * Minimal key/value configuration parser.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "config.h"
+
+#define MAX_ENTRIES 64
+#define MAX_KEY     48
+#define MAX_VALUE   208
+
+struct entry {
+    char key[MAX_KEY];
+    char value[MAX_VALUE];
+};
+
+static struct entry entries[MAX_ENTRIES];
+static int num_entries;
+
+/* Strip leading and trailing whitespace in place */
+static char *trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+
+    return s;
+}
+
+int config_load(const char *path)
+{
+    char line[320];
+    int lineno = 0;
+
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return errno == ENOENT ? 0 : -1;
+
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+
+        char *s = trim(line);
+        if (!*s)
+            continue;
+
+        char *eq = strchr(s, '=');
+        if (!eq) {
+            fprintf(stderr, "%s:%d: expected key = value\n", path, lineno);
+            continue;
+        }
+        *eq = '\0';
+
+        char *key = trim(s);
+        char *val = trim(eq + 1);
+
+        /* Later lines override earlier ones */
+        struct entry *e = NULL;
+        for (int i = 0; i < num_entries; i++)
+            if (strcmp(entries[i].key, key) == 0)
+                e = &entries[i];
+
+        if (!e) {
+            if (num_entries == MAX_ENTRIES) {
+                fprintf(stderr, "%s:%d: too many entries\n", path, lineno);
+                break;
+            }
+            e = &entries[num_entries++];
+        }
+
+        snprintf(e->key, sizeof(e->key), "%s", key);
+        snprintf(e->value, sizeof(e->value), "%s", val);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+const char *config_str(const char *key, const char *def)
+{
+    for (int i = 0; i < num_entries; i++)
+        if (strcmp(entries[i].key, key) == 0)
+            return entries[i].value;
+    return def;
+}
+
+long config_int(const char *key, long def)
+{
+    const char *v = config_str(key, NULL);
+    char *end;
+
+    if (!v || !*v)
+        return def;
+
+    long n = strtol(v, &end, 0);
+    return *end ? def : n;
+}
@@ -0,0 +1,24 @@
+/*
+ * config.h
+ *
+ * Daemon configuration file (/etc/music_daemon.conf).
+ *
+ * Plain "key = value" lines; '#' starts a comment.  A missing file or key
+ * simply means the built-in default is used.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define CONFIG_PATH "/etc/music_daemon.conf"
+
+/* Parse the file; returns 0 (also when it does not exist), -1 on error */
+int         config_load(const char *path);
+
+/* Lookups fall back to def when the key is absent or malformed */
+const char *config_str(const char *key, const char *def);
+long        config_int(const char *key, long def);
+
+#endif /* CONFIG_H */
@@ -0,0 +1,112 @@
+/*
+ * decoder.c
+ *
+ * mpg123-based decoder children producing raw PCM on a pipe.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "decoder.h"
+#include "pcm.h"
+#include "proc.h"
+
+#define MPG123_PATH   "/usr/bin/mpg123"
+#define DECODE_AHEAD  (1024 * 1024)     /* Pipe size: ~6 s of decoded PCM */
+
+/*
+ * Runs on the control thread once mpg123 has been reaped.  The player sees
+ * end of track as EOF on the pipe; this only reports a decoder that died
+ * instead of finishing, since decoder_close() detaches the ones we stop.
+ */
+static void decoder_exited(pid_t pid, int status, void *arg)
+{
+    int track = (int)(intptr_t)arg;
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        return;
+
+    if (WIFSIGNALED(status))
+        fprintf(stderr, "decoder: mpg123 (pid %d, track %d) killed by signal %d\n",
+                (int)pid, track, WTERMSIG(status));
+    else
+        fprintf(stderr, "decoder: mpg123 (pid %d, track %d) exited with status %d\n",
+                (int)pid, track, WEXITSTATUS(status));
+}
+
+int decoder_open(struct decoder *d, const char *path, int in_fd,
+                 int track, unsigned gen)
+{
+    int p[2];
+    char rate[16];
+
+    *d = DECODER_NONE;
+
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        perror("decoder: pipe");
+        if (in_fd >= 0)
+            close(in_fd);
+        return -1;
+    }
+
+    /*
+     * A large pipe lets mpg123 run ahead of playback.  For the pre-opened
+     * next track this is the pre-decode buffer: by the time the current
+     * track ends, its first seconds are already waiting in the pipe.
+     */
+    fcntl(p[0], F_SETPIPE_SZ, DECODE_AHEAD);
+
+    snprintf(rate, sizeof(rate), "%d", PCM_RATE);
+
+    /* Fixed output format so every track splices onto the last one */
+    char *const argv[] = {
+        "mpg123", "-q", "-s", "-r", rate, "--stereo", "-e", "s16",
+        in_fd >= 0 ? "-" : (char *)path, NULL
+    };
+    struct proc_spec spec = {
+        .path    = MPG123_PATH,
+        .argv    = argv,
+        .in_fd   = in_fd,
+        .out_fd  = p[1],
+        .on_exit = decoder_exited,
+        .arg     = (void *)(intptr_t)track,
+    };
+
+    pid_t pid = proc_spawn(&spec);
+    if (pid < 0) {
+        close(p[0]);
+        close(p[1]);
+        if (in_fd >= 0)
+            close(in_fd);
+        return -1;
+    }
+
+    close(p[1]);
+    if (in_fd >= 0)
+        close(in_fd);
+
+    d->pid   = pid;
+    d->fd    = p[0];
+    d->track = track;
+    d->gen   = gen;
+    return 0;
+}
+
+void decoder_close(struct decoder *d)
+{
+    if (d->fd >= 0)
+        close(d->fd);
+
+    if (d->pid > 0)
+        proc_terminate(d->pid);
+
+    *d = DECODER_NONE;
+}
@@ -0,0 +1,59 @@
+/*
+ * decoder.h
+ *
+ * MP3 decoder stage.  Each track is decoded by an mpg123 child that writes
+ * raw PCM (see pcm.h) to a pipe read by the player thread.  mpg123's
+ * gapless mode trims the LAME encoder delay and end padding, so decoded
+ * tracks can be concatenated sample-exactly.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+struct decoder {
+    pid_t    pid;       /* mpg123 child, -1 if none                       */
+    int      fd;        /* PCM output pipe, -1 if closed                  */
+    int      track;     /* Playlist index this decoder is playing         */
+    unsigned gen;       /* Play generation, used to drop stale events     */
+    uint64_t key;       /* Intro cache key of the file, 0 = not cached    */
+    uint64_t skip;      /* PCM bytes to drop first: a seek's run-up, or   */
+                        /*  leading silence                               */
+    uint64_t limit;     /* PCM bytes to play after them, 0 = up to EOF    */
+    uint32_t start_ms;  /* Track position of the first byte played        */
+    int      gain_mb;   /* Loudness normalization, 1/100 dB, <= 0         */
+};
+
+/*
+ * Samples of MP3 synthesis delay.  With a LAME tag, mpg123 trims them on
+ * top of the encoder delay at the start and leaves them of the padding
+ * at the end; a stream decoded from mid-file is not trimmed at all.
+ */
+#define DECODER_DELAY 529
+
+/* An unused decoder slot */
+#define DECODER_NONE ((struct decoder){ .pid = -1, .fd = -1, .track = -1 })
+
+/*
+ * Start decoding.  Exactly one source is used:
+ *   path  – local file (in_fd must be -1)
+ *   in_fd – MP3 byte stream, e.g. a pipe fed by the download scheduler;
+ *           the fd is handed to the child and closed in the caller
+ * Returns 0 on success, -1 on failure (d is left as DECODER_NONE).
+ */
+int  decoder_open(struct decoder *d, const char *path, int in_fd,
+                  int track, unsigned gen);
+
+/* Terminate the child and close the pipe; the child is reaped later */
+void decoder_close(struct decoder *d);
+
+static inline int decoder_active(const struct decoder *d)
+{
+    return d->fd >= 0;
+}
+
+#endif /* DECODER_H */
@@ -0,0 +1,593 @@
+/*
+ * dlsched.c
+ *
+ * Prioritized background download scheduler for cloud tracks.
+ *
+ * Three priority classes share the Wi-Fi link:
+ *   DL_ACTIVE   – the stream that is playing; never throttled
+ *   DL_PREFETCH – the next track, so a skip can start from the cache
+ *   DL_FILL     – the rest of the catalog, filled while nothing else runs
+ *
+ * Shaping:
+ *   - Each background class has its own token bucket (bytes/second).
+ *   - A shared link bucket caps the total; the active stream draws from it
+ *     too (it may go into debt), so background traffic backs off as soon as
+ *     the active stream needs the bandwidth.
+ *   - While the active stream's buffered data (daemon ring + decoder pipe)
+ *     is below DL_ACTIVE_WATERMARK, the lower classes are not read at all.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+
+#include "dlsched.h"
+#include "proc.h"
+
+/* ------------------------------------------------------- */
+/*                        CONSTANTS                        */
+/* ------------------------------------------------------- */
+
+#define WGET_PATH            "/usr/bin/wget"
+
+#define DL_LINK_RATE         (1536 * 1024)  /* Total budget for all classes (B/s)  */
+#define DL_PREFETCH_RATE     (256 * 1024)   /* Next-track prefetch budget (B/s)    */
+#define DL_FILL_RATE         (64 * 1024)    /* Catalog fill budget (B/s)           */
+
+#define DL_ACTIVE_RING       (512 * 1024)   /* Daemon-side buffer for active job   */
+#define DL_ACTIVE_WATERMARK  (192 * 1024)   /* ~12 s of 128 kbps audio             */
+#define DL_CHUNK             (16 * 1024)    /* Max bytes moved per read/write      */
+#define DL_MIN_GRANT         (4 * 1024)     /* Don't wake up for less than this    */
+#define DL_RECHECK_MS        100            /* Preempted jobs re-check the watermark */
+
+/* ------------------------------------------------------- */
+/*                     SCHEDULER STATE                     */
+/* ------------------------------------------------------- */
+
+/* Token bucket, all values in bytes */
+struct bucket {
+    long tokens;
+    long rate;          /* Refill rate per second, 0 = unlimited */
+    long burst;         /* Upper bound for tokens                */
+};
+
+enum job_state { JOB_FREE = 0, JOB_QUEUED, JOB_RUNNING, JOB_DRAINING };
+
+struct dl_job {
+    enum job_state state;
+    enum dl_class  cls;
+    unsigned long  seq;             /* Submission order inside a class   */
+
+    char url[512];
+    char cache_path[256];
+    char part_path[264];
+
+    pid_t pid;                      /* wget child, -1 once reaped        */
+    int   exit_ok;                  /* wget exited with status 0         */
+    int   in_fd;                    /* wget stdout                       */
+    int   out_fd;                   /* Decoder pipe (DL_ACTIVE only)     */
+    int   cache_fd;                 /* <cache_path>.part                 */
+
+    unsigned char *ring;            /* DL_ACTIVE only                    */
+    size_t ring_head;               /* Next byte to write to out_fd      */
+    size_t ring_len;                /* Bytes buffered                    */
+};
+
+static struct dl_job jobs[DL_MAX_JOBS];
+static struct bucket link_bucket;
+static struct bucket class_bucket[DL_NCLASSES];
+static unsigned long last_refill_ms;
+static unsigned long next_seq;
+static unsigned long completions;       /* Downloads promoted into the cache */
+
+/* pollfd slot -> job mapping, rebuilt by dlsched_pollfds() */
+static struct dl_job *pfd_job[DL_MAX_POLLFDS];
+static int            pfd_is_out[DL_MAX_POLLFDS];
+static int            pfd_count;
+
+/* ------------------------------------------------------- */
+/*                        HELPERS                          */
+/* ------------------------------------------------------- */
+
+static unsigned long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+static void bucket_setup(struct bucket *b, long rate)
+{
+    b->rate   = rate;
+    b->burst  = rate ? rate / 4 : 0;   /* 250 ms worth of data */
+    b->tokens = b->burst;
+}
+
+/* Top up every bucket for the time elapsed since the last call */
+static void refill_buckets(void)
+{
+    unsigned long now = now_ms();
+    unsigned long dt  = now - last_refill_ms;
+    if (dt == 0)
+        return;
+    last_refill_ms = now;
+
+    struct bucket *all[DL_NCLASSES + 1];
+    all[0] = &link_bucket;
+    for (int c = 0; c < DL_NCLASSES; c++)
+        all[c + 1] = &class_bucket[c];
+
+    for (int i = 0; i <= DL_NCLASSES; i++) {
+        struct bucket *b = all[i];
+        if (!b->rate)
+            continue;
+        b->tokens += (long)((unsigned long long)b->rate * dt / 1000);
+        if (b->tokens > b->burst)
+            b->tokens = b->burst;
+    }
+}
+
+static struct dl_job *active_job(void)
+{
+    for (int i = 0; i < DL_MAX_JOBS; i++)
+        if (jobs[i].state >= JOB_RUNNING && jobs[i].cls == DL_ACTIVE)
+            return &jobs[i];
+    return NULL;
+}
+
+/* Bytes the decoder can still consume before it runs dry */
+static long active_buffered(const struct dl_job *j)
+{
+    int in_pipe = 0;
+    if (j->out_fd >= 0)
+        ioctl(j->out_fd, FIONREAD, &in_pipe);
+    return (long)j->ring_len + in_pipe;
+}
+
+/*
+ * Lower classes are preempted while the active stream is still fetching and
+ * its buffer sits below the watermark.  Once the whole active track has
+ * arrived there is nothing left to protect.
+ */
+static int background_preempted(void)
+{
+    struct dl_job *a = active_job();
+    if (!a || a->in_fd < 0)
+        return 0;
+    return active_buffered(a) < DL_ACTIVE_WATERMARK;
+}
+
+/* How many bytes a job may read right now */
+static long read_grant(const struct dl_job *j)
+{
+    if (j->state != JOB_RUNNING || j->in_fd < 0)
+        return 0;
+
+    if (j->cls == DL_ACTIVE) {
+        long space = DL_ACTIVE_RING - (long)j->ring_len;
+        return space < DL_CHUNK ? space : DL_CHUNK;
+    }
+
+    if (background_preempted())
+        return 0;
+
+    long grant = DL_CHUNK;
+    if (class_bucket[j->cls].tokens < grant)
+        grant = class_bucket[j->cls].tokens;
+    if (link_bucket.tokens < grant)
+        grant = link_bucket.tokens;
+    return grant > 0 ? grant : 0;
+}
+
+static void charge(enum dl_class cls, long bytes)
+{
+    if (class_bucket[cls].rate)
+        class_bucket[cls].tokens -= bytes;
+
+    /* Active traffic may push the link bucket into debt, but bound it */
+    link_bucket.tokens -= bytes;
+    if (link_bucket.tokens < -link_bucket.burst)
+        link_bucket.tokens = -link_bucket.burst;
+}
+
+static void close_fd(int *fd)
+{
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+/* ------------------------------------------------------- */
+/*                     JOB LIFECYCLE                       */
+/* ------------------------------------------------------- */
+
+/* Release a job; keep_cache != 0 promotes the .part file into the cache */
+static void job_finish(struct dl_job *j, int keep_cache)
+{
+    if (j->pid > 0) {
+        proc_terminate(j->pid);
+        j->pid = -1;
+    }
+
+    close_fd(&j->in_fd);
+    close_fd(&j->out_fd);
+    close_fd(&j->cache_fd);
+
+    if (keep_cache && rename(j->part_path, j->cache_path) == 0)
+        completions++;
+    else
+        unlink(j->part_path);
+
+    free(j->ring);
+    memset(j, 0, sizeof(*j));
+    j->state = JOB_FREE;
+}
+
+/*
+ * wget was reaped (control thread).  job_finish() detaches the callback, so
+ * the job is still the one this child was started for.
+ */
+static void wget_exited(pid_t pid, int status, void *arg)
+{
+    struct dl_job *j = arg;
+
+    if (j->pid != pid)
+        return;
+
+    j->exit_ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    j->pid = -1;
+}
+
+/* Start wget for a queued job; stdout goes to a non-blocking pipe */
+static int job_start(struct dl_job *j)
+{
+    int p[2];
+
+    j->cache_fd = open(j->part_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (j->cache_fd < 0) {
+        perror("dlsched: open cache");
+        return -1;
+    }
+
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        perror("dlsched: pipe");
+        return -1;
+    }
+
+    char *const argv[] = { "wget", "-qO-", j->url, NULL };
+    struct proc_spec spec = {
+        .path    = WGET_PATH,
+        .argv    = argv,
+        .in_fd   = -1,
+        .out_fd  = p[1],
+        .on_exit = wget_exited,
+        .arg     = j,
+    };
+
+    pid_t pid = proc_spawn(&spec);
+    if (pid < 0) {
+        close(p[0]);
+        close(p[1]);
+        return -1;
+    }
+
+    close(p[1]);
+    fcntl(p[0], F_SETFL, O_NONBLOCK);
+
+    j->pid   = pid;
+    j->in_fd = p[0];
+    j->state = JOB_RUNNING;
+    return 0;
+}
+
+/* Start queued jobs: DL_ACTIVE always, other classes one at a time */
+static void schedule(void)
+{
+    for (int c = 0; c < DL_NCLASSES; c++) {
+        int running = 0;
+        struct dl_job *oldest = NULL;
+
+        for (int i = 0; i < DL_MAX_JOBS; i++) {
+            struct dl_job *j = &jobs[i];
+            if (j->cls != (enum dl_class)c || j->state == JOB_FREE)
+                continue;
+            if (j->state == JOB_QUEUED) {
+                if (!oldest || j->seq < oldest->seq)
+                    oldest = j;
+            } else {
+                running++;
+            }
+        }
+
+        if (oldest && (c == DL_ACTIVE || running == 0)) {
+            if (job_start(oldest) < 0)
+                job_finish(oldest, 0);
+        }
+    }
+}
+
+/* wget stdout is readable: move bytes into the ring and/or cache file */
+static void job_read(struct dl_job *j)
+{
+    unsigned char tmp[DL_CHUNK];
+    long grant = read_grant(j);
+    if (grant <= 0)
+        return;
+
+    unsigned char *dst = tmp;
+    if (j->cls == DL_ACTIVE) {
+        /* Read straight into the ring, contiguous part only */
+        size_t tail = (j->ring_head + j->ring_len) % DL_ACTIVE_RING;
+        size_t contig = DL_ACTIVE_RING - tail;
+        if ((size_t)grant > contig)
+            grant = (long)contig;
+        dst = j->ring + tail;
+    }
+
+    ssize_t n = read(j->in_fd, dst, (size_t)grant);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EINTR)
+            return;
+        n = 0;
+    }
+
+    if (n == 0) {
+        /* Download finished; collect the exit status before trusting it */
+        close_fd(&j->in_fd);
+        j->state = JOB_DRAINING;
+        return;
+    }
+
+    charge(j->cls, n);
+
+    if (j->cls == DL_ACTIVE)
+        j->ring_len += (size_t)n;
+
+    if (j->cache_fd >= 0 && write(j->cache_fd, dst, (size_t)n) != n) {
+        /*
+         * Cache is best effort: a full tmpfs must not stop playback.  For
+         * the other classes the cache file is the only output, so the
+         * rest of the transfer would only take bandwidth from the stream.
+         */
+        if (j->cls != DL_ACTIVE) {
+            job_finish(j, 0);
+            return;
+        }
+        close_fd(&j->cache_fd);
+        unlink(j->part_path);
+    }
+}
+
+/* Decoder pipe is writable: flush buffered bytes */
+static void job_write(struct dl_job *j)
+{
+    while (j->ring_len > 0) {
+        size_t contig = DL_ACTIVE_RING - j->ring_head;
+        if (contig > j->ring_len)
+            contig = j->ring_len;
+
+        ssize_t n = write(j->out_fd, j->ring + j->ring_head, contig);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                job_finish(j, 0);   /* Decoder went away */
+            return;
+        }
+
+        j->ring_head = (j->ring_head + (size_t)n) % DL_ACTIVE_RING;
+        j->ring_len -= (size_t)n;
+    }
+}
+
+/* Retire jobs whose download ended and whose data has been delivered */
+static void check_draining(void)
+{
+    for (int i = 0; i < DL_MAX_JOBS; i++) {
+        struct dl_job *j = &jobs[i];
+        if (j->state != JOB_DRAINING)
+            continue;
+
+        if (j->pid <= 0 && j->ring_len == 0)
+            job_finish(j, j->exit_ok && j->cache_fd >= 0);
+    }
+}
+
+/* ------------------------------------------------------- */
+/*                       PUBLIC API                        */
+/* ------------------------------------------------------- */
+
+int dlsched_init(const char *cache_dir)
+{
+    if (mkdir(cache_dir, 0755) < 0 && errno != EEXIST) {
+        perror("dlsched: mkdir cache");
+        return -1;
+    }
+
+    memset(jobs, 0, sizeof(jobs));
+    bucket_setup(&link_bucket, DL_LINK_RATE);
+    bucket_setup(&class_bucket[DL_ACTIVE], 0);
+    bucket_setup(&class_bucket[DL_PREFETCH], DL_PREFETCH_RATE);
+    bucket_setup(&class_bucket[DL_FILL], DL_FILL_RATE);
+    last_refill_ms = now_ms();
+    return 0;
+}
+
+void dlsched_shutdown(void)
+{
+    for (int i = 0; i < DL_MAX_JOBS; i++)
+        if (jobs[i].state != JOB_FREE)
+            job_finish(&jobs[i], 0);
+}
+
+int dlsched_submit(enum dl_class cls, const char *url,
+                   const char *cache_path, int out_fd)
+{
+    struct dl_job *slot = NULL;
+
+    for (int i = 0; i < DL_MAX_JOBS; i++) {
+        struct dl_job *j = &jobs[i];
+        if (j->state == JOB_FREE) {
+            if (!slot)
+                slot = j;
+            continue;
+        }
+        if (strcmp(j->cache_path, cache_path) != 0)
+            continue;
+
+        /* Already fetching this file in the background */
+        if (cls != DL_ACTIVE)
+            return 0;
+
+        /* The active stream needs the bytes itself: restart it on top */
+        job_finish(j, 0);
+        if (!slot)
+            slot = j;
+    }
+
+    if (!slot) {
+        if (cls == DL_ACTIVE && out_fd >= 0)
+            close(out_fd);
+        return -1;
+    }
+
+    slot->state    = JOB_QUEUED;
+    slot->cls      = cls;
+    slot->seq      = next_seq++;
+    slot->pid      = -1;
+    slot->in_fd    = -1;
+    slot->out_fd   = -1;
+    slot->cache_fd = -1;
+    snprintf(slot->url, sizeof(slot->url), "%s", url);
+    snprintf(slot->cache_path, sizeof(slot->cache_path), "%s", cache_path);
+    snprintf(slot->part_path, sizeof(slot->part_path), "%s.part", cache_path);
+
+    if (cls == DL_ACTIVE) {
+        slot->ring = malloc(DL_ACTIVE_RING);
+        if (!slot->ring) {
+            if (out_fd >= 0)
+                close(out_fd);
+            slot->state = JOB_FREE;
+            return -1;
+        }
+        slot->out_fd = out_fd;
+        fcntl(out_fd, F_SETFL, O_NONBLOCK);
+    }
+
+    schedule();
+    return 0;
+}
+
+void dlsched_cancel_class(enum dl_class cls)
+{
+    for (int i = 0; i < DL_MAX_JOBS; i++)
+        if (jobs[i].state != JOB_FREE && jobs[i].cls == cls)
+            job_finish(&jobs[i], 0);
+    schedule();
+}
+
+unsigned long dlsched_completions(void)
+{
+    return completions;
+}
+
+int dlsched_pollfds(struct pollfd *pfd, int max)
+{
+    refill_buckets();
+    pfd_count = 0;
+
+    for (int i = 0; i < DL_MAX_JOBS && pfd_count < max; i++) {
+        struct dl_job *j = &jobs[i];
+
+        if (read_grant(j) > 0 && pfd_count < max) {
+            pfd[pfd_count].fd = j->in_fd;
+            pfd[pfd_count].events = POLLIN;
+            pfd[pfd_count].revents = 0;
+            pfd_job[pfd_count] = j;
+            pfd_is_out[pfd_count] = 0;
+            pfd_count++;
+        }
+
+        if (j->out_fd >= 0 && j->ring_len > 0 && pfd_count < max) {
+            pfd[pfd_count].fd = j->out_fd;
+            pfd[pfd_count].events = POLLOUT;
+            pfd[pfd_count].revents = 0;
+            pfd_job[pfd_count] = j;
+            pfd_is_out[pfd_count] = 1;
+            pfd_count++;
+        }
+    }
+
+    return pfd_count;
+}
+
+void dlsched_service(const struct pollfd *pfd, int n)
+{
+    refill_buckets();
+
+    for (int i = 0; i < n && i < pfd_count; i++) {
+        struct dl_job *j = pfd_job[i];
+        if (j->state == JOB_FREE || !pfd[i].revents)
+            continue;
+
+        if (pfd_is_out[i]) {
+            if (pfd[i].revents & (POLLERR | POLLHUP))
+                job_finish(j, 0);
+            else
+                job_write(j);
+        } else {
+            job_read(j);
+        }
+    }
+
+    /* Active stream finished downloading: close the pipe so mpg123 sees EOF */
+    for (int i = 0; i < DL_MAX_JOBS; i++) {
+        struct dl_job *j = &jobs[i];
+        if (j->state == JOB_DRAINING && j->ring_len == 0)
+            close_fd(&j->out_fd);
+    }
+
+    check_draining();
+    schedule();
+}
+
+int dlsched_timeout_ms(void)
+{
+    int timeout = -1;
+
+    refill_buckets();
+
+    for (int i = 0; i < DL_MAX_JOBS; i++) {
+        struct dl_job *j = &jobs[i];
+
+        if (j->state != JOB_RUNNING || j->cls == DL_ACTIVE || read_grant(j) > 0)
+            continue;
+
+        /* Throttled: wake when the emptier of the two buckets has refilled */
+        long ms = DL_RECHECK_MS;
+        if (!background_preempted()) {
+            const struct bucket *b = &class_bucket[j->cls];
+            if (link_bucket.tokens < b->tokens)
+                b = &link_bucket;
+            ms = (DL_MIN_GRANT - b->tokens) * 1000 / b->rate + 1;
+        }
+
+        if (timeout < 0 || ms < timeout)
+            timeout = (int)ms;
+    }
+
+    return timeout;
+}
@@ -0,0 +1,62 @@
+/*
+ * dlsched.h
+ *
+ * Prioritized background download scheduler for cloud tracks.
+ *
+ * Every download is a wget child whose stdout is drained by the daemon.
+ * Bytes are only read from a job when its class is allowed to run, so a
+ * throttled or preempted job simply stops being read and TCP flow control
+ * slows the sender down – no data is dropped and wget never needs to be
+ * restarted.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef DLSCHED_H
+#define DLSCHED_H
+
+#include <poll.h>
+
+/* Priority classes, highest first */
+enum dl_class {
+    DL_ACTIVE = 0,      /* Track that is playing right now               */
+    DL_PREFETCH,        /* Next track in the list                        */
+    DL_FILL,            /* Remaining catalog entries, cache warm-up only */
+    DL_NCLASSES
+};
+
+#define DL_MAX_JOBS     8       /* Concurrent jobs across all classes       */
+#define DL_MAX_POLLFDS  (DL_MAX_JOBS * 2)
+
+/* Create the cache directory and reset all token buckets */
+int  dlsched_init(const char *cache_dir);
+
+/* Cancel every job, kill the wget children and drop partial cache files */
+void dlsched_shutdown(void);
+
+/*
+ * Queue a download.
+ *   url        – remote MP3
+ *   cache_path – final location in the cache; written as <path>.part and
+ *                renamed once wget exits cleanly
+ *   out_fd     – DL_ACTIVE only: pipe into the decoder (ownership passes to
+ *                the scheduler, it is closed when the download ends)
+ * Returns 0 on success, -1 on failure.
+ */
+int  dlsched_submit(enum dl_class cls, const char *url,
+                    const char *cache_path, int out_fd);
+
+/* Cancel all jobs of one class (e.g. DL_ACTIVE on stop/skip) */
+void dlsched_cancel_class(enum dl_class cls);
+
+/* Number of downloads that have completed into the cache so far */
+unsigned long dlsched_completions(void);
+
+/* Event loop integration: fill pollfds, then service them after poll() */
+int  dlsched_pollfds(struct pollfd *pfd, int max);
+void dlsched_service(const struct pollfd *pfd, int n);
+
+/* Milliseconds until the scheduler needs to run again, -1 = no deadline */
+int  dlsched_timeout_ms(void);
+
+#endif /* DLSCHED_H */
@@ -0,0 +1,187 @@
+/*
+ * introcache.c
+ *
+ * RAM cache of decoded track intros (see introcache.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "introcache.h"
+#include "pcm.h"
+
+#define INTRO_MAX_SLOTS 1024
+
+enum slot_state { SLOT_FREE, SLOT_RECORDING, SLOT_READY };
+
+struct slot {
+    _Atomic uint64_t key;           /* Read by introcache_has()          */
+    int              state;
+    int              pins;          /* Streams playing from it           */
+    size_t           len;
+    unsigned         plays;
+    uint64_t         used;          /* Tick of the last find or record   */
+};
+
+static struct slot   *slots;
+static unsigned       nslots;
+static unsigned char *pcm;          /* nslots * slot_bytes               */
+static size_t         slot_bytes;
+static unsigned       intro_len_ms;
+static uint64_t       tick;
+static unsigned       evictions;
+
+static _Atomic unsigned long hits, misses;
+static _Atomic unsigned      nready;
+
+int introcache_init(size_t budget, unsigned intro_ms)
+{
+    slot_bytes = PCM_MS_TO_FRAMES(intro_ms) * PCM_FRAME_BYTES;
+    if (!slot_bytes || budget < slot_bytes) {
+        slot_bytes = 0;
+        return 0;
+    }
+
+    nslots = (unsigned)(budget / slot_bytes);
+    if (nslots > INTRO_MAX_SLOTS)
+        nslots = INTRO_MAX_SLOTS;
+
+    slots = calloc(nslots, sizeof(*slots));
+    pcm = malloc(nslots * slot_bytes);
+    if (!slots || !pcm) {
+        perror("introcache: malloc");
+        free(slots);
+        free(pcm);
+        slots = NULL;
+        pcm = NULL;
+        nslots = 0;
+        slot_bytes = 0;
+        return -1;
+    }
+
+    intro_len_ms = intro_ms;
+    return 0;
+}
+
+size_t introcache_slot_bytes(void)
+{
+    return slot_bytes;
+}
+
+unsigned char *introcache_pcm(int slot)
+{
+    return pcm + (size_t)slot * slot_bytes;
+}
+
+int introcache_find(uint64_t key, size_t *len)
+{
+    if (!nslots || !key)
+        return -1;
+
+    for (unsigned i = 0; i < nslots; i++) {
+        struct slot *s = &slots[i];
+
+        if (s->state == SLOT_READY &&
+            atomic_load_explicit(&s->key, memory_order_relaxed) == key) {
+            s->pins++;
+            s->plays++;
+            s->used = ++tick;
+            *len = s->len;
+            atomic_fetch_add_explicit(&hits, 1, memory_order_relaxed);
+            return (int)i;
+        }
+    }
+
+    atomic_fetch_add_explicit(&misses, 1, memory_order_relaxed);
+    return -1;
+}
+
+/* Free slot, else the unpinned ready one played least, then used longest ago */
+static int victim(void)
+{
+    int best = -1;
+
+    for (unsigned i = 0; i < nslots; i++) {
+        struct slot *s = &slots[i];
+
+        if (s->state == SLOT_FREE)
+            return (int)i;
+        if (s->state != SLOT_READY || s->pins)
+            continue;
+        if (best < 0 || s->plays < slots[best].plays ||
+            (s->plays == slots[best].plays && s->used < slots[best].used))
+            best = (int)i;
+    }
+    return best;
+}
+
+int introcache_record(uint64_t key)
+{
+    int v;
+
+    if (!nslots || !key || introcache_has(key) || (v = victim()) < 0)
+        return -1;
+
+    if (slots[v].state == SLOT_READY) {
+        atomic_fetch_sub_explicit(&nready, 1, memory_order_relaxed);
+
+        /* Age the counts, so a burst of old plays does not stick forever */
+        if (++evictions % nslots == 0)
+            for (unsigned i = 0; i < nslots; i++)
+                slots[i].plays /= 2;
+    }
+
+    slots[v].state = SLOT_RECORDING;
+    slots[v].len = 0;
+    slots[v].plays = 1;
+    slots[v].used = ++tick;
+    atomic_store_explicit(&slots[v].key, key, memory_order_relaxed);
+    return v;
+}
+
+void introcache_done(int slot, size_t len)
+{
+    if (len == 0) {
+        introcache_abort(slot);
+        return;
+    }
+
+    slots[slot].len = len;
+    slots[slot].state = SLOT_READY;
+    atomic_fetch_add_explicit(&nready, 1, memory_order_relaxed);
+}
+
+void introcache_abort(int slot)
+{
+    slots[slot].state = SLOT_FREE;
+    atomic_store_explicit(&slots[slot].key, 0, memory_order_relaxed);
+}
+
+void introcache_unpin(int slot)
+{
+    slots[slot].pins--;
+}
+
+int introcache_has(uint64_t key)
+{
+    if (!key)
+        return 0;
+    for (unsigned i = 0; i < nslots; i++)
+        if (atomic_load_explicit(&slots[i].key, memory_order_relaxed) == key)
+            return 1;
+    return 0;
+}
+
+void introcache_get_stats(struct introcache_stats *st)
+{
+    st->hits     = atomic_load_explicit(&hits, memory_order_relaxed);
+    st->misses   = atomic_load_explicit(&misses, memory_order_relaxed);
+    st->ready    = atomic_load_explicit(&nready, memory_order_relaxed);
+    st->slots    = nslots;
+    st->intro_ms = intro_len_ms;
+}
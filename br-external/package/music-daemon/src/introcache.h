@@ -0,0 +1,67 @@
+/*
+ * introcache.h
+ *
+ * RAM cache of the first seconds of decoded PCM of local tracks, so a
+ * track can start playing from memory while its decoder is still being
+ * spawned and warming up.
+ *
+ * The whole memory budget is allocated once and cut into equal slots of
+ * one intro each.  A slot is filled as a track's decoder output is read
+ * for playback (or by a warm-up decoder for a track likely to come next)
+ * and is found again by a key that changes when the file does.  A stream
+ * playing from a slot pins it; the slot evicted to make room is the least
+ * played of the rest, the least recently used among equals.  Play counts
+ * are halved every few evictions so old favourites eventually give way.
+ *
+ * Not thread-safe, except introcache_has() and introcache_get_stats():
+ * after introcache_init() the player thread owns the cache.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef INTROCACHE_H
+#define INTROCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct introcache_stats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned      ready;            /* Slots holding an intro           */
+    unsigned      slots;
+    unsigned      intro_ms;
+};
+
+/* Budget in bytes (0 disables the cache) and length of an intro */
+int    introcache_init(size_t budget, unsigned intro_ms);
+
+/* Bytes of PCM one slot holds, 0 if the cache is disabled */
+size_t introcache_slot_bytes(void);
+
+/*
+ * Slot with the intro of key, pinned, or -1.  *len is its length in bytes:
+ * shorter than a slot when it is the whole track.
+ */
+int    introcache_find(uint64_t key, size_t *len);
+
+/* Slot to record key into, or -1 if every slot is pinned or busy */
+int    introcache_record(uint64_t key);
+
+/* A recording is complete (len bytes) or given up */
+void   introcache_done(int slot, size_t len);
+void   introcache_abort(int slot);
+
+/* A stream no longer plays from slot */
+void   introcache_unpin(int slot);
+
+/* PCM of a slot */
+unsigned char *introcache_pcm(int slot);
+
+/* Any thread: whether key is cached (or being recorded) right now */
+int    introcache_has(uint64_t key);
+
+/* Any thread */
+void   introcache_get_stats(struct introcache_stats *st);
+
+#endif /* INTROCACHE_H */
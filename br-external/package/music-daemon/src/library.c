@@ -0,0 +1,1558 @@
+/*
+ * library.c
+ *
+ * Library scanner and memory-mapped index (see library.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "library.h"
+#include "mp3info.h"
+#include "timer.h"
+
+#define SCAN_MAX_DEPTH    16         /* Also stops symlink loops           */
+#define LIB_SAVE_DELAY_MS 2000       /* Index write after the last change  */
+#define LIB_SAVE_LAZY_MS  300000     /* ... if it only added derived data  */
+#define LIB_RECLAIM_MS    100        /* Retry for views readers still hold */
+
+#define SEG_MASK (LIB_SEG_SIZE - 1)
+
+/* An index file mapping, shared by the segments that point into it */
+struct lib_map {
+    void    *base;
+    size_t   len;
+    unsigned refs;
+};
+
+/*
+ * LIB_SEG_SIZE track slots and the strings and seek tables they refer to.
+ * Segments of the mapped index point into it; the others own their data.
+ * A segment is immutable once published; only the draft's writable ones
+ * change.  refs counts views and is only touched by the control thread.
+ */
+struct lib_seg {
+    uint64_t          serial;       /* Unique: derived data is keyed on it */
+    unsigned          refs;
+    unsigned          n;            /* Slots in use                       */
+    int               writable;     /* Belongs to the draft alone         */
+    struct lib_track *rec;
+    char             *strs;
+    size_t            strs_len, strs_cap;
+    uint32_t         *seek;         /* Seek table entries                 */
+    size_t            seek_len, seek_cap;
+    struct lib_map   *map;          /* NULL when the arrays are owned     */
+};
+
+struct lib_view {
+    atomic_uint      refs;          /* Readers holding it                 */
+    uint64_t         generation;
+    uint64_t         shape;         /* Generation of the last change that
+                                       added, removed or retagged a slot  */
+    unsigned         count;         /* Slots, deleted ones included       */
+    unsigned         live;
+    unsigned         nsegs, cap;
+    struct lib_view *retired_next;
+    struct lib_seg  *segs[];
+};
+
+static char                      lib_dir[256];
+static char                      lib_index[PATH_MAX];
+static struct lib_view *_Atomic  cur_view;
+static atomic_uint               acquiring;     /* Readers between loads   */
+
+/* Control thread only */
+static struct lib_view *draft;      /* Unpublished changes                */
+static int              draft_changed;
+static int              draft_reshaped; /* Beyond seek tables and analysis */
+static struct lib_view *retired;    /* Replaced, possibly still read      */
+static uint64_t         seg_serial;
+
+static void save_index(void *arg);
+static void reclaim(void *arg);
+
+static struct timer save_timer    = TIMER_INIT(save_index, NULL);
+static struct timer reclaim_timer = TIMER_INIT(reclaim, NULL);
+
+/* ------------------------------------------------------- */
+/*                      VIEW ACCESS                        */
+/* ------------------------------------------------------- */
+
+static struct lib_track *slot(const struct lib_view *v, unsigned idx)
+{
+    return &v->segs[idx >> LIB_SEG_SHIFT]->rec[idx & SEG_MASK];
+}
+
+/*
+ * A reader announces itself in acquiring before it loads the pointer, so
+ * the control thread, which swaps the pointer before it checks acquiring
+ * and refs, never frees a view that a reader is about to take.
+ */
+const struct lib_view *library_acquire(void)
+{
+    struct lib_view *v;
+
+    atomic_fetch_add(&acquiring, 1);
+    v = atomic_load(&cur_view);
+    if (v)
+        atomic_fetch_add(&v->refs, 1);
+    atomic_fetch_sub(&acquiring, 1);
+    return v;
+}
+
+void library_release(const struct lib_view *v)
+{
+    if (v)
+        atomic_fetch_sub(&((struct lib_view *)v)->refs, 1);
+}
+
+const struct lib_view *library_view(void)
+{
+    return atomic_load_explicit(&cur_view, memory_order_relaxed);
+}
+
+unsigned lib_count(const struct lib_view *v)
+{
+    return v ? v->count : 0;
+}
+
+unsigned lib_live(const struct lib_view *v)
+{
+    return v ? v->live : 0;
+}
+
+uint64_t lib_generation(const struct lib_view *v)
+{
+    return v ? v->generation : 0;
+}
+
+uint64_t lib_shape(const struct lib_view *v)
+{
+    return v ? v->shape : 0;
+}
+
+unsigned lib_nsegs(const struct lib_view *v)
+{
+    return lib_count(v) ? v->nsegs : 0;
+}
+
+uint64_t lib_seg_serial(const struct lib_view *v, unsigned k)
+{
+    return k < lib_nsegs(v) ? v->segs[k]->serial : 0;
+}
+
+const struct lib_track *lib_track(const struct lib_view *v, unsigned idx)
+{
+    if (idx >= lib_count(v))
+        return NULL;
+
+    const struct lib_track *t = slot(v, idx);
+    return t->flags & LIB_DELETED ? NULL : t;
+}
+
+const char *lib_str(const struct lib_view *v, unsigned idx, uint32_t off)
+{
+    if (idx >= lib_count(v))
+        return "";
+
+    const struct lib_seg *s = v->segs[idx >> LIB_SEG_SHIFT];
+    return off < s->strs_len ? s->strs + off : "";
+}
+
+/* Also answers for deleted slots, which keep their path */
+const char *lib_relpath(const struct lib_view *v, unsigned idx)
+{
+    return idx < lib_count(v) ? lib_str(v, idx, slot(v, idx)->path) : "";
+}
+
+/* t's seek table in s, NULL if it has none or it is out of bounds */
+static const uint32_t *seg_seek(const struct lib_seg *s, const struct lib_track *t,
+                                unsigned *n)
+{
+    *n = 0;
+    if (!t->seek_count || t->seek > s->seek_len || t->seek_count > s->seek_len - t->seek)
+        return NULL;
+    *n = t->seek_count;
+    return s->seek + t->seek;
+}
+
+const uint32_t *lib_seek_table(const struct lib_view *v, unsigned idx, unsigned *n)
+{
+    const struct lib_track *t = lib_track(v, idx);
+
+    *n = 0;
+    return t ? seg_seek(v->segs[idx >> LIB_SEG_SHIFT], t, n) : NULL;
+}
+
+int lib_path(const struct lib_view *v, unsigned idx, char *buf, size_t len)
+{
+    const struct lib_track *t = lib_track(v, idx);
+
+    if (!t)
+        return -1;
+    snprintf(buf, len, "%s/%s", lib_dir, lib_str(v, idx, t->path));
+    return 0;
+}
+
+const char *lib_title(const struct lib_view *v, unsigned idx)
+{
+    const struct lib_track *t = lib_track(v, idx);
+    return t ? lib_str(v, idx, t->title) : "";
+}
+
+const char *lib_artist(const struct lib_view *v, unsigned idx)
+{
+    const struct lib_track *t = lib_track(v, idx);
+    const char *a = t ? lib_str(v, idx, t->artist) : "";
+    return a[0] ? a : "Unknown Artist";
+}
+
+/* ------------------------------------------------------- */
+/*                  SEGMENTS AND VIEWS                     */
+/* ------------------------------------------------------- */
+
+/* Empty writable segment owning its records, "" at string offset 0 */
+static struct lib_seg *seg_new(void)
+{
+    struct lib_seg *s = calloc(1, sizeof(*s));
+
+    if (!s)
+        return NULL;
+
+    s->strs_cap = 16 * 1024;
+    s->rec  = malloc(LIB_SEG_SIZE * sizeof(*s->rec));
+    s->strs = malloc(s->strs_cap);
+    if (!s->rec || !s->strs) {
+        free(s->rec);
+        free(s->strs);
+        free(s);
+        return NULL;
+    }
+
+    s->strs[0]  = '\0';
+    s->strs_len = 1;
+    s->serial   = ++seg_serial;
+    s->refs     = 1;
+    s->writable = 1;
+    return s;
+}
+
+/* Offset of a copy of str in s's strings; 0 ("") on failure */
+static uint32_t seg_addstr(struct lib_seg *s, const char *str)
+{
+    size_t n = strlen(str) + 1;
+
+    if (n == 1)
+        return 0;
+
+    if (s->strs_len + n > s->strs_cap) {
+        size_t cap = s->strs_cap;
+        while (s->strs_len + n > cap)
+            cap *= 2;
+        char *b = realloc(s->strs, cap);
+        if (!b)
+            return 0;
+        s->strs = b;
+        s->strs_cap = cap;
+    }
+
+    uint32_t off = (uint32_t)s->strs_len;
+    memcpy(s->strs + off, str, n);
+    s->strs_len += n;
+    return off;
+}
+
+static const char *seg_str(const struct lib_seg *s, uint32_t off)
+{
+    return off < s->strs_len ? s->strs + off : "";
+}
+
+/* Point t at a copy of n seek table entries in s; no table on failure */
+static int seg_addseek(struct lib_seg *s, struct lib_track *t, const uint32_t *e,
+                       unsigned n)
+{
+    t->seek = t->seek_count = 0;
+    if (!n)
+        return 0;
+
+    if (s->seek_len + n > s->seek_cap) {
+        size_t cap = s->seek_cap ? s->seek_cap : 1024;
+        while (s->seek_len + n > cap)
+            cap *= 2;
+        uint32_t *b = realloc(s->seek, cap * sizeof(*b));
+        if (!b)
+            return -1;
+        s->seek = b;
+        s->seek_cap = cap;
+    }
+
+    memcpy(s->seek + s->seek_len, e, n * sizeof(*e));
+    t->seek = (uint32_t)s->seek_len;
+    t->seek_count = n;
+    s->seek_len += n;
+    return 0;
+}
+
+static void seg_unref(struct lib_seg *s)
+{
+    if (--s->refs)
+        return;
+
+    if (s->map) {
+        if (--s->map->refs == 0) {
+            munmap(s->map->base, s->map->len);
+            free(s->map);
+        }
+    } else {
+        free(s->rec);
+        free(s->strs);
+        free(s->seek);
+    }
+    free(s);
+}
+
+/*
+ * Writable copy of s with only the strings and seek tables its records
+ * use.  Neighbouring tracks are mostly of one album, so repeats of the
+ * previous record's artist and album are shared.
+ */
+static struct lib_seg *seg_copy(const struct lib_seg *s)
+{
+    struct lib_seg *c = seg_new();
+
+    if (!c)
+        return NULL;
+
+    for (unsigned i = 0; i < s->n; i++) {
+        const struct lib_track *o = &s->rec[i];
+        struct lib_track *t = &c->rec[i];
+
+        *t = *o;
+        t->path   = seg_addstr(c, seg_str(s, o->path));
+        t->title  = seg_addstr(c, seg_str(s, o->title));
+        t->artist = i && o->artist == o[-1].artist ? t[-1].artist
+                                                   : seg_addstr(c, seg_str(s, o->artist));
+        t->album  = i && o->album == o[-1].album ? t[-1].album
+                                                 : seg_addstr(c, seg_str(s, o->album));
+
+        unsigned n;
+        const uint32_t *e = seg_seek(s, o, &n);
+        seg_addseek(c, t, e, n);
+    }
+    c->n = s->n;
+    return c;
+}
+
+static struct lib_view *view_new(unsigned cap)
+{
+    struct lib_view *v = calloc(1, sizeof(*v) + cap * sizeof(v->segs[0]));
+
+    if (v)
+        v->cap = cap;
+    return v;
+}
+
+static void view_free(struct lib_view *v)
+{
+    for (unsigned i = 0; i < v->nsegs; i++)
+        seg_unref(v->segs[i]);
+    free(v);
+}
+
+/* Free the retired views no reader holds any more, retry later otherwise */
+static void reclaim(void *arg)
+{
+    struct lib_view **pp = &retired;
+
+    (void)arg;
+    if (atomic_load(&acquiring) == 0) {
+        while (*pp) {
+            struct lib_view *v = *pp;
+            if (atomic_load(&v->refs) == 0) {
+                *pp = v->retired_next;
+                view_free(v);
+            } else {
+                pp = &v->retired_next;
+            }
+        }
+    }
+
+    if (retired)
+        timer_arm(&reclaim_timer, LIB_RECLAIM_MS, LIB_RECLAIM_MS / 2);
+}
+
+/* Make v the current view; the previous one is freed once unused */
+static void publish(struct lib_view *v)
+{
+    struct lib_view *old = atomic_exchange(&cur_view, v);
+
+    if (old) {
+        old->retired_next = retired;
+        retired = old;
+        reclaim(NULL);
+    }
+}
+
+/*
+ * Map an index file, check that everything it points at is inside it and
+ * wrap it in a view
+ */
+static struct lib_view *index_map(const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct lib_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    const struct lib_header *h = base;
+    uint64_t size = (uint64_t)st.st_size;
+    uint64_t recs = (uint64_t)h->count * sizeof(struct lib_track);
+
+    if (memcmp(h->magic, LIB_MAGIC, 8) != 0 || h->version != LIB_VERSION ||
+        h->record_size != sizeof(struct lib_track) ||
+        h->records_off > size || recs > size - h->records_off ||
+        h->records_off % 8 != 0 ||
+        h->strings_off > size || h->strings_size == 0 ||
+        h->strings_size > size - h->strings_off ||
+        ((const char *)base)[h->strings_off + h->strings_size - 1] != '\0' ||
+        h->seek_off > size || h->seek_off % 4 != 0 ||
+        h->seek_count > (size - h->seek_off) / sizeof(uint32_t)) {
+        munmap(base, (size_t)st.st_size);
+        return NULL;
+    }
+
+    unsigned nsegs = (h->count + SEG_MASK) >> LIB_SEG_SHIFT;
+    struct lib_map *m = calloc(1, sizeof(*m));
+    struct lib_view *v = view_new(nsegs);
+
+    if (!m || !v)
+        goto fail;
+
+    m->base = base;
+    m->len  = (size_t)st.st_size;
+
+    for (unsigned k = 0; k < nsegs; k++) {
+        struct lib_seg *s = calloc(1, sizeof(*s));
+        if (!s)
+            goto fail;
+
+        s->serial   = ++seg_serial;
+        s->refs     = 1;
+        s->rec      = (struct lib_track *)((char *)base + h->records_off) +
+                      (size_t)k * LIB_SEG_SIZE;
+        s->n        = k + 1 < nsegs ? LIB_SEG_SIZE
+                                    : h->count - k * LIB_SEG_SIZE;
+        s->strs     = (char *)base + h->strings_off;
+        s->strs_len = h->strings_size;
+        s->seek     = (uint32_t *)((char *)base + h->seek_off);
+        s->seek_len = h->seek_count;
+        s->map      = m;
+        m->refs++;
+        v->segs[v->nsegs++] = s;
+    }
+
+    v->count = v->live = h->count;
+    v->generation = v->shape = h->generation;
+    if (!m->refs) {
+        /* Empty library: no segment keeps the mapping */
+        munmap(base, m->len);
+        free(m);
+    }
+    return v;
+
+fail:
+    perror("library: map index");
+    if (v && v->nsegs) {
+        view_free(v);       /* Unmaps with the last segment */
+    } else {
+        free(v);
+        free(m);
+        munmap(base, (size_t)st.st_size);
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------- */
+/*                     STRING TABLE                        */
+/* ------------------------------------------------------- */
+
+/* Append-only, de-duplicated: artists and albums repeat a lot */
+struct strtab {
+    char     *buf;
+    size_t    len, cap;
+    uint32_t *slots;            /* Offsets + 1, open addressing, 0 = free */
+    size_t    nslots, used;
+};
+
+static uint32_t fnv1a32(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s)
+        h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+static uint64_t fnv1a64(const char *s)
+{
+    uint64_t h = 14695981039346656037ULL;
+    while (*s)
+        h = (h ^ (unsigned char)*s++) * 1099511628211ULL;
+    return h;
+}
+
+static int strtab_grow_slots(struct strtab *st)
+{
+    size_t n = st->nslots ? st->nslots * 2 : 1024;
+    uint32_t *s = calloc(n, sizeof(*s));
+
+    if (!s)
+        return -1;
+
+    for (size_t i = 0; i < st->nslots; i++) {
+        if (!st->slots[i])
+            continue;
+        size_t j = fnv1a32(st->buf + st->slots[i] - 1) & (n - 1);
+        while (s[j])
+            j = (j + 1) & (n - 1);
+        s[j] = st->slots[i];
+    }
+
+    free(st->slots);
+    st->slots  = s;
+    st->nslots = n;
+    return 0;
+}
+
+/* Empty table holding just "" at offset 0 */
+static int strtab_init(struct strtab *st)
+{
+    st->cap = 64 * 1024;
+    if (!(st->buf = malloc(st->cap)) || strtab_grow_slots(st) < 0)
+        return -1;
+    st->buf[0] = '\0';
+    st->len = 1;
+    return 0;
+}
+
+/* Offset of s in the table, adding it if needed; 0 on failure or "" */
+static uint32_t strtab_add(struct strtab *st, const char *s)
+{
+    if (!s[0])
+        return 0;
+
+    if ((st->used + 1) * 2 > st->nslots && strtab_grow_slots(st) < 0)
+        return 0;
+
+    size_t j = fnv1a32(s) & (st->nslots - 1);
+    while (st->slots[j]) {
+        if (strcmp(st->buf + st->slots[j] - 1, s) == 0)
+            return st->slots[j] - 1;
+        j = (j + 1) & (st->nslots - 1);
+    }
+
+    size_t n = strlen(s) + 1;
+    if (st->len + n > st->cap) {
+        size_t cap = st->cap;
+        while (st->len + n > cap)
+            cap *= 2;
+        char *b = realloc(st->buf, cap);
+        if (!b)
+            return 0;
+        st->buf = b;
+        st->cap = cap;
+    }
+
+    uint32_t off = (uint32_t)st->len;
+    memcpy(st->buf + off, s, n);
+    st->len += n;
+    st->slots[j] = off + 1;
+    st->used++;
+    return off;
+}
+
+/* Seek tables of the records being written, back to back */
+struct seektab {
+    uint32_t *buf;
+    size_t    len, cap;
+};
+
+/* Append the seek table of slot idx of v and point t at it; none on failure */
+static void seektab_add(struct seektab *st, struct lib_track *t,
+                        const struct lib_view *v, unsigned idx)
+{
+    unsigned n;
+    const uint32_t *e = lib_seek_table(v, idx, &n);
+
+    t->seek = t->seek_count = 0;
+    if (!n)
+        return;
+
+    if (st->len + n > st->cap) {
+        size_t cap = st->cap ? st->cap : 64 * 1024;
+        while (st->len + n > cap)
+            cap *= 2;
+        uint32_t *b = realloc(st->buf, cap * sizeof(*b));
+        if (!b)
+            return;
+        st->buf = b;
+        st->cap = cap;
+    }
+
+    memcpy(st->buf + st->len, e, n * sizeof(*e));
+    t->seek = (uint32_t)st->len;
+    t->seek_count = n;
+    st->len += n;
+}
+
+/* ------------------------------------------------------- */
+/*                     PATH LOOKUP                         */
+/* ------------------------------------------------------- */
+
+/*
+ * Control thread: slot of every path (by its id) in the latest view or
+ * draft, built on first use.  A key whose slot went elsewhere maps to
+ * ID_NONE; removed files keep theirs so a file that comes back reuses it.
+ */
+#define ID_FREE 0xffffffffu
+#define ID_NONE 0xfffffffeu
+
+static struct {
+    uint64_t *keys;
+    uint32_t *slots;
+    size_t    cap, used;
+} ids;
+
+static void ids_reset(void)
+{
+    free(ids.keys);
+    free(ids.slots);
+    memset(&ids, 0, sizeof(ids));
+}
+
+static void ids_insert(uint64_t id, uint32_t idx)
+{
+    size_t j = id & (ids.cap - 1);
+
+    while (ids.slots[j] != ID_FREE && ids.keys[j] != id)
+        j = (j + 1) & (ids.cap - 1);
+
+    if (ids.slots[j] == ID_FREE)
+        ids.used++;
+    ids.keys[j]  = id;
+    ids.slots[j] = idx;
+}
+
+static int ids_put(uint64_t id, uint32_t idx)
+{
+    if ((ids.used + 1) * 2 > ids.cap) {
+        size_t cap = ids.cap ? ids.cap * 2 : 1024;
+        uint64_t *k = malloc(cap * sizeof(*k));
+        uint32_t *s = malloc(cap * sizeof(*s));
+
+        if (!k || !s) {
+            free(k);
+            free(s);
+            return -1;
+        }
+        memset(s, 0xff, cap * sizeof(*s));
+
+        uint64_t *ok = ids.keys;
+        uint32_t *os = ids.slots;
+        size_t ocap = ids.cap;
+
+        ids.keys = k;
+        ids.slots = s;
+        ids.cap = cap;
+        ids.used = 0;
+        for (size_t j = 0; j < ocap; j++)
+            if (os[j] != ID_FREE)
+                ids_insert(ok[j], os[j]);
+        free(ok);
+        free(os);
+    }
+
+    ids_insert(id, idx);
+    return 0;
+}
+
+/* Slot of rel in v (deleted ones included), or -1 */
+static int find_slot(const struct lib_view *v, const char *rel)
+{
+    uint64_t id = fnv1a64(rel);
+
+    if (!ids.cap) {
+        for (unsigned i = 0; i < lib_count(v); i++)
+            if (ids_put(slot(v, i)->id, i) < 0)
+                return -1;
+        if (!ids.cap)
+            return -1;
+    }
+
+    for (size_t j = id & (ids.cap - 1); ids.slots[j] != ID_FREE;
+         j = (j + 1) & (ids.cap - 1)) {
+        if (ids.keys[j] != id)
+            continue;
+        uint32_t idx = ids.slots[j];
+        if (idx == ID_NONE || strcmp(lib_relpath(v, idx), rel) != 0)
+            return -1;
+        return (int)idx;
+    }
+    return -1;
+}
+
+/* ------------------------------------------------------- */
+/*                     DIRECTORY SCAN                      */
+/* ------------------------------------------------------- */
+
+struct pathlist {
+    char  **v;
+    size_t  n, cap;
+};
+
+static int has_mp3_ext(const char *name)
+{
+    size_t n = strlen(name);
+    return n > 4 && strcasecmp(name + n - 4, ".mp3") == 0;
+}
+
+static void walk(const char *root, const char *rel, int depth, struct pathlist *pl)
+{
+    char dir[PATH_MAX];
+    DIR *d;
+    struct dirent *e;
+
+    if (depth > SCAN_MAX_DEPTH)
+        return;
+
+    snprintf(dir, sizeof(dir), "%s%s%s", root, rel[0] ? "/" : "", rel);
+    if (!(d = opendir(dir)))
+        return;
+
+    while ((e = readdir(d))) {
+        char sub[PATH_MAX];
+        int is_dir = e->d_type == DT_DIR;
+        int is_reg = e->d_type == DT_REG;
+
+        if (e->d_name[0] == '.')
+            continue;       /* ., .., and hidden files */
+
+        if (e->d_type == DT_UNKNOWN || e->d_type == DT_LNK) {
+            struct stat st;
+            if (fstatat(dirfd(d), e->d_name, &st, 0) < 0)
+                continue;
+            is_dir = S_ISDIR(st.st_mode);
+            is_reg = S_ISREG(st.st_mode);
+        }
+
+        if (snprintf(sub, sizeof(sub), "%s%s%s", rel, rel[0] ? "/" : "",
+                     e->d_name) >= (int)sizeof(sub))
+            continue;
+
+        if (is_dir) {
+            walk(root, sub, depth + 1, pl);
+        } else if (is_reg && has_mp3_ext(e->d_name)) {
+            if (pl->n == pl->cap) {
+                size_t cap = pl->cap ? pl->cap * 2 : 256;
+                char **v = realloc(pl->v, cap * sizeof(*v));
+                if (!v)
+                    break;
+                pl->v = v;
+                pl->cap = cap;
+            }
+            if ((pl->v[pl->n] = strdup(sub)))
+                pl->n++;
+        }
+    }
+
+    closedir(d);
+}
+
+static int cmp_path(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* File name without directory and extension, the title of untagged files */
+static void title_from_path(const char *rel, char *buf, size_t len)
+{
+    const char *base = strrchr(rel, '/');
+    base = base ? base + 1 : rel;
+    snprintf(buf, len, "%.*s", (int)(strlen(base) - 4), base);
+}
+
+/*
+ * Fill t, all but its string offsets, from the file's tags and headers;
+ * the strings are left in mi, with the file name as the fallback title.
+ * Returns -1 if the file holds no MPEG audio.
+ */
+static int parse_track(const char *abs, const char *rel, const struct stat *st,
+                       struct lib_track *t, struct mp3_info *mi)
+{
+    int fd = open(abs, O_RDONLY | O_CLOEXEC);
+    int rc;
+
+    if (fd < 0)
+        return -1;
+    rc = mp3info_read(fd, st->st_size, mi);
+    close(fd);
+
+    if (rc < 0) {
+        fprintf(stderr, "library: %s: no MPEG audio, skipped\n", rel);
+        return -1;
+    }
+
+    if (!mi->title[0])
+        title_from_path(rel, mi->title, sizeof(mi->title));
+
+    memset(t, 0, sizeof(*t));
+    t->id            = fnv1a64(rel);
+    t->size          = (uint64_t)st->st_size;
+    t->mtime         = (int64_t)st->st_mtime;
+    t->duration_ms   = mi->duration_ms;
+    t->audio_offset  = mi->audio_offset;
+    t->sample_rate   = mi->sample_rate;
+    t->bitrate       = (uint16_t)mi->bitrate;
+    t->channels      = (uint8_t)mi->channels;
+    t->track_no      = (uint16_t)mi->track_no;
+    t->year          = (uint16_t)mi->year;
+    t->frames        = mi->frames;
+    t->frame_samples = (uint16_t)mi->samples_per_frame;
+    t->enc_delay     = (uint16_t)mi->enc_delay;
+    t->enc_padding   = (uint16_t)mi->enc_padding;
+    t->flags         = (mi->flags & MP3INFO_VBR     ? LIB_VBR     : 0) |
+                       (mi->flags & MP3INFO_ID3V1   ? LIB_ID3V1   : 0) |
+                       (mi->flags & MP3INFO_ID3V2   ? LIB_ID3V2   : 0) |
+                       (mi->flags & MP3INFO_GAPLESS ? LIB_GAPLESS : 0);
+    return 0;
+}
+
+static int index_write(const char *path, const struct lib_track *recs,
+                       uint32_t count, const struct strtab *strs,
+                       const struct seektab *seeks, uint64_t generation)
+{
+    static const char zero[4];
+    char tmp[PATH_MAX];
+    struct lib_header h;
+    FILE *f;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LIB_MAGIC, 8);
+    h.version      = LIB_VERSION;
+    h.record_size  = sizeof(struct lib_track);
+    h.count        = count;
+    h.strings_size = (uint32_t)strs->len;
+    h.records_off  = sizeof(h);
+    h.strings_off  = sizeof(h) + (uint64_t)count * sizeof(struct lib_track);
+    h.seek_off     = (h.strings_off + strs->len + 3) & ~(uint64_t)3;
+    h.seek_count   = seeks->len;
+    h.generation   = generation;
+    h.built        = (int64_t)time(NULL);
+
+    /* The index usually lives in a cache directory that may not exist yet */
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    char *slash = strrchr(tmp, '/');
+    if (slash && slash != tmp) {
+        *slash = '\0';
+        mkdir(tmp, 0755);
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (!(f = fopen(tmp, "w"))) {
+        perror("library: create index");
+        return -1;
+    }
+
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(recs, sizeof(*recs), count, f) == count &&
+             fwrite(strs->buf, 1, strs->len, f) == strs->len &&
+             fwrite(zero, 1, h.seek_off - h.strings_off - strs->len, f) ==
+                 h.seek_off - h.strings_off - strs->len &&
+             fwrite(seeks->buf, sizeof(uint32_t), seeks->len, f) == seeks->len &&
+             fflush(f) == 0 && fsync(fileno(f)) == 0;
+
+    if (fclose(f) != 0 || !ok) {
+        perror("library: write index");
+        unlink(tmp);
+        return -1;
+    }
+
+    /* Atomic replace: a crash leaves the old index or the new one */
+    if (rename(tmp, path) < 0) {
+        perror("library: rename index");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Scan music_dir into a new index.  Files whose size and mtime match their
+ * record in the current view keep it without being opened.
+ */
+static int library_scan(const char *music_dir, const char *index_path)
+{
+    const struct lib_view *v = library_view();
+    struct pathlist pl = { 0 };
+    struct strtab strs = { 0 };
+    struct seektab seeks = { 0 };
+    struct lib_track *recs = NULL;
+    uint32_t count = 0, parsed = 0;
+    int rc = -1;
+
+    walk(music_dir, "", 0, &pl);
+    qsort(pl.v, pl.n, sizeof(*pl.v), cmp_path);
+
+    if (strtab_init(&strs) < 0 ||
+        (pl.n && !(recs = calloc(pl.n, sizeof(*recs))))) {
+        perror("library: alloc");
+        goto out;
+    }
+
+    for (size_t i = 0; i < pl.n; i++) {
+        char abs[PATH_MAX];
+        struct stat st;
+        struct mp3_info mi;
+        struct lib_track *t = &recs[count];
+        int old = find_slot(v, pl.v[i]);
+        const struct lib_track *o = old >= 0 ? lib_track(v, (unsigned)old) : NULL;
+
+        snprintf(abs, sizeof(abs), "%s/%s", music_dir, pl.v[i]);
+        if (stat(abs, &st) < 0)
+            continue;
+
+        if (o && o->size == (uint64_t)st.st_size &&
+            o->mtime == (int64_t)st.st_mtime) {
+            *t = *o;
+            t->path   = strtab_add(&strs, pl.v[i]);
+            t->title  = strtab_add(&strs, lib_str(v, (unsigned)old, o->title));
+            t->artist = strtab_add(&strs, lib_str(v, (unsigned)old, o->artist));
+            t->album  = strtab_add(&strs, lib_str(v, (unsigned)old, o->album));
+            seektab_add(&seeks, t, v, (unsigned)old);
+        } else {
+            parsed++;
+            if (parse_track(abs, pl.v[i], &st, t, &mi) < 0)
+                continue;
+            t->path   = strtab_add(&strs, pl.v[i]);
+            t->title  = strtab_add(&strs, mi.title);
+            t->artist = strtab_add(&strs, mi.artist);
+            t->album  = strtab_add(&strs, mi.album);
+        }
+        count++;
+    }
+
+    if (index_write(index_path, recs, count, &strs, &seeks, lib_generation(v) + 1) == 0) {
+        printf("library: %u tracks indexed (%u parsed) from %s\n",
+               count, parsed, music_dir);
+        rc = 0;
+    }
+
+out:
+    for (size_t i = 0; i < pl.n; i++)
+        free(pl.v[i]);
+    free(pl.v);
+    free(recs);
+    free(strs.buf);
+    free(strs.slots);
+    free(seeks.buf);
+    return rc;
+}
+
+/* Index of the current view: live tracks only, in path order again */
+static const struct lib_view *sort_view;
+
+static int cmp_slot(const void *a, const void *b)
+{
+    return strcmp(lib_relpath(sort_view, *(const unsigned *)a),
+                  lib_relpath(sort_view, *(const unsigned *)b));
+}
+
+static void save_index(void *arg)
+{
+    const struct lib_view *v = library_view();
+    struct strtab strs = { 0 };
+    struct seektab seeks = { 0 };
+    struct lib_track *recs = NULL;
+    unsigned *order = NULL;
+    unsigned n = 0;
+
+    (void)arg;
+    if (strtab_init(&strs) < 0 ||
+        (v->live && (!(order = malloc(v->live * sizeof(*order))) ||
+                     !(recs = malloc(v->live * sizeof(*recs)))))) {
+        perror("library: alloc");
+        goto out;
+    }
+
+    for (unsigned i = 0; i < v->count; i++)
+        if (lib_track(v, i) && n < v->live)
+            order[n++] = i;
+
+    sort_view = v;
+    qsort(order, n, sizeof(*order), cmp_slot);
+
+    for (unsigned k = 0; k < n; k++) {
+        unsigned i = order[k];
+        const struct lib_track *t = lib_track(v, i);
+
+        recs[k] = *t;
+        recs[k].path   = strtab_add(&strs, lib_str(v, i, t->path));
+        recs[k].title  = strtab_add(&strs, lib_str(v, i, t->title));
+        recs[k].artist = strtab_add(&strs, lib_str(v, i, t->artist));
+        recs[k].album  = strtab_add(&strs, lib_str(v, i, t->album));
+        seektab_add(&seeks, &recs[k], v, i);
+    }
+
+    index_write(lib_index, recs, n, &strs, &seeks, v->generation);
+
+out:
+    free(order);
+    free(recs);
+    free(strs.buf);
+    free(strs.slots);
+    free(seeks.buf);
+}
+
+void library_sync(void)
+{
+    if (timer_pending(&save_timer)) {
+        timer_cancel(&save_timer);
+        save_index(NULL);
+    }
+}
+
+/* ------------------------------------------------------- */
+/*                        CHANGES                          */
+/* ------------------------------------------------------- */
+
+/* The draft, created as a copy of the current view on first use */
+static struct lib_view *draft_get(void)
+{
+    const struct lib_view *cur = library_view();
+    unsigned n = lib_count(cur) ? cur->nsegs : 0;
+
+    if (draft)
+        return draft;
+
+    if (!(draft = view_new(n + 4))) {
+        perror("library: alloc");
+        return NULL;
+    }
+
+    if (cur) {
+        memcpy(draft->segs, cur->segs, n * sizeof(cur->segs[0]));
+        draft->nsegs      = n;
+        draft->count      = cur->count;
+        draft->live       = cur->live;
+        draft->generation = cur->generation;
+        draft->shape      = cur->shape;
+        for (unsigned k = 0; k < n; k++)
+            draft->segs[k]->refs++;
+    }
+    return draft;
+}
+
+/* Slot idx of the draft, copying its segment first if it is shared */
+static struct lib_track *draft_slot(unsigned idx)
+{
+    struct lib_seg **sp = &draft->segs[idx >> LIB_SEG_SHIFT];
+
+    if (!(*sp)->writable) {
+        struct lib_seg *c = seg_copy(*sp);
+        if (!c) {
+            perror("library: alloc");
+            return NULL;
+        }
+        seg_unref(*sp);
+        *sp = c;
+    }
+    return &(*sp)->rec[idx & SEG_MASK];
+}
+
+/* New slot at the end of the draft, marked deleted until filled in */
+static int draft_append(void)
+{
+    unsigned idx = draft->count;
+    struct lib_track *t;
+
+    if ((idx & SEG_MASK) == 0) {
+        if (draft->nsegs == draft->cap) {
+            struct lib_view *v = realloc(draft, sizeof(*v) +
+                                         (draft->cap * 2) * sizeof(v->segs[0]));
+            if (!v)
+                return -1;
+            draft = v;
+            draft->cap *= 2;
+        }
+        if (!(draft->segs[draft->nsegs] = seg_new()))
+            return -1;
+        draft->nsegs++;
+    } else if (!draft_slot(idx - 1)) {
+        return -1;
+    }
+
+    t = &draft->segs[idx >> LIB_SEG_SHIFT]->rec[idx & SEG_MASK];
+    memset(t, 0, sizeof(*t));
+    t->flags = LIB_DELETED;
+    draft->segs[idx >> LIB_SEG_SHIFT]->n++;
+    draft->count++;
+    return (int)idx;
+}
+
+/* Store t in slot idx of the draft, with copies of its strings and seek table */
+static int draft_store(unsigned idx, const struct lib_track *t, const uint32_t *seek,
+                       const char *path, const char *title, const char *artist,
+                       const char *album)
+{
+    struct lib_track *d = draft_slot(idx);
+    struct lib_seg *s = draft->segs[idx >> LIB_SEG_SHIFT];
+
+    if (!d)
+        return -1;
+
+    if (d->flags & LIB_DELETED)
+        draft->live++;
+
+    *d = *t;
+    d->flags &= ~LIB_DELETED;
+    d->path   = seg_addstr(s, path);
+    d->title  = seg_addstr(s, title);
+    d->artist = seg_addstr(s, artist);
+    d->album  = seg_addstr(s, album);
+    seg_addseek(s, d, seek, seek ? t->seek_count : 0);
+    draft_changed = draft_reshaped = 1;
+    return 0;
+}
+
+static void slot_delete(unsigned idx)
+{
+    const struct lib_track *t = lib_track(draft, idx);
+    struct lib_track *d;
+
+    if (!t || !(d = draft_slot(idx)))
+        return;
+    d->flags |= LIB_DELETED;
+    draft->live--;
+    draft_changed = draft_reshaped = 1;
+}
+
+int library_track_name(const char *rel)
+{
+    const char *base = strrchr(rel, '/');
+    base = base ? base + 1 : rel;
+    return base[0] != '.' && has_mp3_ext(base);
+}
+
+int library_read(const char *rel, struct lib_file *f)
+{
+    char abs[PATH_MAX];
+    struct stat st;
+
+    if (!library_track_name(rel))
+        return -1;
+
+    snprintf(abs, sizeof(abs), "%s/%s", lib_dir, rel);
+    if (stat(abs, &st) < 0 || !S_ISREG(st.st_mode))
+        return -1;
+
+    return parse_track(abs, rel, &st, &f->t, &f->mi) < 0 ? 1 : 0;
+}
+
+void library_store(const char *rel, const struct lib_file *f)
+{
+    int idx;
+
+    if (!draft_get())
+        return;
+
+    idx = find_slot(draft, rel);
+    if (!f) {
+        if (idx >= 0)
+            slot_delete((unsigned)idx);
+        return;
+    }
+
+    const struct lib_track *o = idx >= 0 ? lib_track(draft, (unsigned)idx) : NULL;
+    if (o && o->size == f->t.size && o->mtime == f->t.mtime)
+        return;
+
+    if (idx < 0) {
+        if ((idx = draft_append()) < 0 || ids_put(f->t.id, (uint32_t)idx) < 0) {
+            perror("library: alloc");
+            return;
+        }
+    }
+    draft_store((unsigned)idx, &f->t, NULL, rel, f->mi.title, f->mi.artist, f->mi.album);
+}
+
+void library_remove(const char *rel, int is_dir)
+{
+    size_t n = strlen(rel);
+
+    if (!draft_get())
+        return;
+
+    if (!is_dir) {
+        int idx = find_slot(draft, rel);
+        if (idx >= 0)
+            slot_delete((unsigned)idx);
+        return;
+    }
+
+    for (unsigned i = 0; i < draft->count; i++) {
+        const char *p = lib_relpath(draft, i);
+        if (strncmp(p, rel, n) == 0 && p[n] == '/')
+            slot_delete(i);
+    }
+}
+
+/* Move one track's record to a new path without re-reading the file */
+static void rename_track(const char *from, const char *to)
+{
+    int src = find_slot(draft, from);
+    int dst = find_slot(draft, to);
+    const struct lib_track *o = src >= 0 ? lib_track(draft, (unsigned)src) : NULL;
+
+    /* Not a track before: libwatch reads it like a new file */
+    if (!o)
+        return;
+    if (!library_track_name(to)) {
+        slot_delete((unsigned)src);
+        return;
+    }
+    if (dst == src)
+        return;
+
+    /* Copies: the strings may move when the target segment grows */
+    struct lib_track t = *o;
+    char title[MP3INFO_TEXT], artist[MP3INFO_TEXT], album[MP3INFO_TEXT];
+    unsigned n;
+    const uint32_t *e = lib_seek_table(draft, (unsigned)src, &n);
+    uint32_t *seek = n ? malloc(n * sizeof(*seek)) : NULL;
+
+    if (seek)
+        memcpy(seek, e, n * sizeof(*seek));
+    t.seek_count = seek ? n : 0;
+
+    snprintf(title,  sizeof(title),  "%s", lib_str(draft, (unsigned)src, o->title));
+    snprintf(artist, sizeof(artist), "%s", lib_str(draft, (unsigned)src, o->artist));
+    snprintf(album,  sizeof(album),  "%s", lib_str(draft, (unsigned)src, o->album));
+    t.id = fnv1a64(to);
+
+    if (dst < 0) {
+        /* Same slot, new path: the track keeps its index */
+        if (ids_put(fnv1a64(from), ID_NONE) == 0 &&
+            ids_put(t.id, (uint32_t)src) == 0)
+            draft_store((unsigned)src, &t, seek, to, title, artist, album);
+    } else {
+        /* Replaces another track (or a removed one): that slot takes it */
+        slot_delete((unsigned)src);
+        draft_store((unsigned)dst, &t, seek, to, title, artist, album);
+    }
+    free(seek);
+}
+
+void library_rename(const char *from, const char *to, int is_dir)
+{
+    size_t n = strlen(from);
+
+    if (!draft_get())
+        return;
+
+    if (!is_dir) {
+        rename_track(from, to);
+        return;
+    }
+
+    for (unsigned i = 0; i < draft->count; i++) {
+        char old[PATH_MAX], new[PATH_MAX];
+        const char *p = lib_relpath(draft, i);
+
+        if (!lib_track(draft, i) || strncmp(p, from, n) != 0 || p[n] != '/')
+            continue;
+        snprintf(old, sizeof(old), "%s", p);
+        snprintf(new, sizeof(new), "%s%s", to, p + n);
+        rename_track(old, new);
+    }
+}
+
+/* Publish the draft; the index is written save_ms later at the latest */
+static int commit(uint64_t save_ms, int lazy)
+{
+    struct lib_view *v = draft;
+
+    draft = NULL;
+    if (!v)
+        return 0;
+
+    if (!draft_changed) {
+        view_free(v);
+        return 0;
+    }
+
+    for (unsigned k = 0; k < v->nsegs; k++)
+        v->segs[k]->writable = 0;
+    v->generation++;
+    if (draft_reshaped)
+        v->shape = v->generation;
+    draft_changed = draft_reshaped = 0;
+
+    publish(v);
+    if (!lazy || !timer_pending(&save_timer))
+        timer_arm(&save_timer, save_ms, (unsigned)(save_ms / 4));
+    return 1;
+}
+
+int library_commit(void)
+{
+    return commit(LIB_SAVE_DELAY_MS, 0);
+}
+
+int library_commit_lazy(void)
+{
+    return commit(LIB_SAVE_LAZY_MS, 1);
+}
+
+int library_set_seek(unsigned idx, uint64_t size, int64_t mtime, uint32_t frames,
+                     uint32_t duration_ms, const uint32_t *offsets, unsigned n)
+{
+    const struct lib_track *o;
+    struct lib_track *d;
+
+    if (!draft_get() || !(o = lib_track(draft, idx)) ||
+        o->size != size || o->mtime != mtime)
+        return -1;
+
+    if (!(d = draft_slot(idx)))
+        return -1;
+
+    d->frames = frames;
+    if (!(d->flags & LIB_ANALYZED))
+        d->duration_ms = duration_ms;
+    if (seg_addseek(draft->segs[idx >> LIB_SEG_SHIFT], d, offsets, n) < 0) {
+        perror("library: alloc");
+        return -1;
+    }
+    draft_changed = 1;
+    return 0;
+}
+
+/* Silence too long to store is not trimmed at all, rather than partly */
+static uint16_t silence_ms16(uint32_t ms)
+{
+    return ms > UINT16_MAX ? 0 : (uint16_t)ms;
+}
+
+int library_set_analysis(unsigned idx, uint64_t size, int64_t mtime,
+                         const struct lib_analysis *a)
+{
+    const struct lib_track *o;
+    struct lib_track *d;
+
+    if (!draft_get() || !(o = lib_track(draft, idx)) ||
+        o->size != size || o->mtime != mtime)
+        return -1;
+
+    if (!(d = draft_slot(idx)))
+        return -1;
+
+    d->loudness = (int16_t)a->loudness;
+    d->peak     = (int16_t)a->peak;
+    d->lead_ms  = silence_ms16(a->lead_ms);
+    d->trail_ms = silence_ms16(a->trail_ms);
+    d->flags   |= LIB_ANALYZED | (a->waveform ? LIB_WAVEFORM : 0) |
+                  (a->length_ms ? 0 : LIB_NOAUDIO);
+    if (a->length_ms)
+        d->duration_ms = a->length_ms;
+    draft_changed = 1;
+    return 0;
+}
+
+/* ------------------------------------------------------- */
+/*                         RESCAN                          */
+/* ------------------------------------------------------- */
+
+/* A file the walk found; f is NULL unless it was read again */
+struct rescan_file {
+    char            *rel;
+    int              no_audio;      /* Read again, and not a track now  */
+    struct lib_file *f;
+};
+
+struct lib_rescan {
+    struct rescan_file *v;
+    size_t              n;
+};
+
+/* A live track of the view being walked against, by id */
+struct id_slot {
+    uint64_t id;
+    uint32_t idx;
+};
+
+static int cmp_id(const void *a, const void *b)
+{
+    uint64_t x = ((const struct id_slot *)a)->id;
+    uint64_t y = ((const struct id_slot *)b)->id;
+    return x < y ? -1 : x > y;
+}
+
+/* rel is a track of v and still has the size and mtime it was read at */
+static int unchanged(const struct lib_view *v, const struct id_slot *ids_v, unsigned n,
+                     const char *rel)
+{
+    char abs[PATH_MAX];
+    struct stat st;
+    uint64_t id = fnv1a64(rel);
+    unsigned lo = 0, hi = n;
+
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (ids_v[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    snprintf(abs, sizeof(abs), "%s/%s", lib_dir, rel);
+    if (stat(abs, &st) < 0)
+        return 0;
+
+    for (; lo < n && ids_v[lo].id == id; lo++) {
+        const struct lib_track *t = slot(v, ids_v[lo].idx);
+        if (strcmp(lib_relpath(v, ids_v[lo].idx), rel) == 0)
+            return t->size == (uint64_t)st.st_size && t->mtime == (int64_t)st.st_mtime;
+    }
+    return 0;
+}
+
+/*
+ * Walk the whole tree against v: unchanged files cost a stat(), and only
+ * the others are parsed.  Runs off the control thread, so the ids table
+ * of the draft is not used; v gets a sorted table of its own.
+ */
+struct lib_rescan *library_rescan_read(const struct lib_view *v)
+{
+    struct pathlist pl = { 0 };
+    struct lib_rescan *r = calloc(1, sizeof(*r));
+    struct id_slot *ids_v = malloc((lib_count(v) + 1) * sizeof(*ids_v));
+    unsigned n = 0;
+
+    walk(lib_dir, "", 0, &pl);
+    if (!r || !ids_v || !(r->v = calloc(pl.n + 1, sizeof(r->v[0])))) {
+        perror("library: alloc");
+        for (size_t i = 0; i < pl.n; i++)
+            free(pl.v[i]);
+        free(pl.v);
+        free(ids_v);
+        free(r);
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < lib_count(v); i++) {
+        const struct lib_track *t = lib_track(v, i);
+        if (t)
+            ids_v[n++] = (struct id_slot){ t->id, i };
+    }
+    qsort(ids_v, n, sizeof(ids_v[0]), cmp_id);
+
+    for (size_t i = 0; i < pl.n; i++) {
+        struct rescan_file *e = &r->v[r->n++];
+        int rc;
+
+        e->rel = pl.v[i];
+        if (unchanged(v, ids_v, n, e->rel) || !(e->f = malloc(sizeof(*e->f))))
+            continue;
+
+        /* Unreadable for now: left as it is, like an unchanged file */
+        if ((rc = library_read(e->rel, e->f)) != 0) {
+            free(e->f);
+            e->f = NULL;
+            e->no_audio = rc > 0;
+        }
+    }
+
+    free(pl.v);
+    free(ids_v);
+    return r;
+}
+
+void library_rescan_store(struct lib_rescan *r)
+{
+    unsigned char *seen = NULL;
+
+    if (draft_get() && !(seen = calloc(draft->count + r->n + 1, 1)))
+        perror("library: alloc");
+
+    for (size_t i = 0; i < r->n; i++) {
+        struct rescan_file *e = &r->v[i];
+        int idx;
+
+        if (e->f || e->no_audio)
+            library_store(e->rel, e->f);
+        if (seen && (idx = find_slot(draft, e->rel)) >= 0)
+            seen[idx] = 1;
+        free(e->rel);
+        free(e->f);
+    }
+
+    for (unsigned i = 0; seen && i < draft->count; i++)
+        if (!seen[i])
+            slot_delete(i);
+
+    free(seen);
+    free(r->v);
+    free(r);
+}
+
+/* ------------------------------------------------------- */
+/*                        LOADING                          */
+/* ------------------------------------------------------- */
+
+int library_load(const char *music_dir, const char *index_path, int rescan)
+{
+    struct lib_view *v;
+
+    snprintf(lib_dir, sizeof(lib_dir), "%s", music_dir);
+    snprintf(lib_index, sizeof(lib_index), "%s", index_path);
+
+    /* Even when rescanning, the old index spares re-parsing most files */
+    if ((v = index_map(index_path))) {
+        publish(v);
+        if (!rescan)
+            return (int)v->count;
+    }
+
+    if (library_scan(music_dir, index_path) < 0 || !(v = index_map(index_path))) {
+        fprintf(stderr, "library: no usable index at %s\n", index_path);
+        return -1;
+    }
+
+    ids_reset();
+    publish(v);
+    return (int)v->count;
+}
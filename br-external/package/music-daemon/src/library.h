@@ -0,0 +1,262 @@
+/*
+ * library.h
+ *
+ * The local music library: every MP3 below the music directory, with its
+ * tags and stream parameters, in a compact binary index file.
+ *
+ * The index is built by a directory scan (library_scan) and mapped
+ * read-only at startup, so opening even a very large library costs one
+ * mmap() and a header check; no audio file is touched.  A rescan re-parses
+ * only files whose size or mtime changed since the previous index.
+ *
+ * File layout, native byte order (the index never leaves the device):
+ *   struct lib_header
+ *   struct lib_track[count]     sorted by path
+ *   string table                NUL-terminated UTF-8, offset 0 is ""
+ *   seek tables                 uint32_t file offsets, see below
+ *
+ * LIB_VERSION is bumped whenever the layout changes; an index of another
+ * version is treated as missing and rebuilt.
+ *
+ * At run time the library is a lib_view: an immutable snapshot made of
+ * LIB_SEG_SIZE-track segments.  Segments of the mapped index are used in
+ * place.  The control thread applies file changes (libwatch.c) to a draft
+ * that copies only the segments it touches, then publishes the draft with
+ * one pointer store, so readers on other threads never wait for a change
+ * and never see half of one.  A view stays valid for as long as a reader
+ * holds it; the old one is freed once the last reader releases it.
+ *
+ * Track indexes are stable while the daemon runs: a removed file leaves a
+ * LIB_DELETED slot behind (reused if the same path comes back) and new files
+ * are appended.  The index file written a little after each change holds
+ * only live tracks, sorted by path again.
+ *
+ * A track's seek table holds the file offset of every LIB_SEEK_STEP-th
+ * audio frame, so a seek is one lookup plus decoding at most that many
+ * frames.  Building it means reading every frame header of the file, far
+ * too slow for a scan, so tables are measured in the background: by the
+ * analyzer's walk over the library (see analyzer.h), and sooner for a
+ * track that starts playing before the walk got to it (see prefetch.h).
+ * Both store them with library_set_seek() along with the exact frame count
+ * and duration the walk yields.  Until then a track cannot be seeked.
+ *
+ * EBU R128 integrated loudness and true peak are measured by a background
+ * decode of every track (see analyzer.h), along with the silence before the
+ * first and after the last audible sample, and stored with
+ * library_set_analysis(); playback turns them into a normalization gain and
+ * trims the silence off both ends.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mp3info.h"
+
+#define LIB_MAGIC   "MDLIBIDX"
+#define LIB_VERSION 4
+
+struct lib_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;       /* sizeof(struct lib_track)             */
+    uint32_t count;
+    uint32_t strings_size;
+    uint64_t records_off;
+    uint64_t strings_off;
+    uint64_t seek_off;
+    uint64_t seek_count;        /* Entries of all seek tables           */
+    uint64_t generation;        /* Bumped by every index write          */
+    int64_t  built;             /* time() of the scan                   */
+};
+
+/* Track flags */
+#define LIB_VBR     0x01        /* Duration from a VBR header or count   */
+#define LIB_ID3V1   0x02
+#define LIB_ID3V2   0x04
+#define LIB_GAPLESS 0x08        /* LAME tag: enc_delay/enc_padding valid */
+#define LIB_ANALYZED 0x10       /* Loudness, peak and silence measured   */
+#define LIB_WAVEFORM 0x20       /* Peak overview stored (waveform.h)     */
+#define LIB_NOAUDIO 0x40        /* Analyzed, but decoded to nothing      */
+#define LIB_DELETED 0x80        /* In-memory only: slot of a removed file */
+
+#define LIB_SEG_SHIFT 10
+#define LIB_SEG_SIZE  (1u << LIB_SEG_SHIFT)
+
+#define LIB_SEEK_STEP 64        /* Frames per seek table entry (~1.7 s)  */
+
+#define LIB_LOUDNESS_NONE INT16_MIN /* Analyzed, but nothing to measure  */
+
+struct lib_track {
+    uint64_t id;                /* Hash of the path: stable across scans */
+    uint64_t size;
+    int64_t  mtime;
+    uint32_t path;              /* String offsets; path is relative      */
+    uint32_t title;
+    uint32_t artist;
+    uint32_t album;
+    uint32_t duration_ms;
+    uint32_t audio_offset;      /* First MPEG frame                      */
+    uint32_t sample_rate;
+    uint16_t bitrate;           /* kbit/s, average for VBR               */
+    uint8_t  channels;
+    uint8_t  flags;             /* LIB_*                                 */
+    uint16_t track_no;
+    uint16_t year;
+    uint32_t frames;            /* Audio frames, 0 if not counted        */
+    uint16_t enc_delay;         /* Samples trimmed off the start and end */
+    uint16_t enc_padding;       /*  by the decoder (LIB_GAPLESS)         */
+    uint32_t seek;              /* First entry of the seek table         */
+    uint32_t seek_count;        /* Entries, 0 = not measured yet         */
+    uint16_t frame_samples;     /* Per channel, 1152 for MPEG-1 layer 3  */
+    int16_t  loudness;          /* Integrated, 1/100 LUFS (LIB_ANALYZED) */
+    int16_t  peak;              /* True peak, 1/100 dBTP                 */
+    uint16_t lead_ms;           /* Silence before the first audible and  */
+    uint16_t trail_ms;          /*  after the last one (LIB_ANALYZED)    */
+};
+
+/* What a full decode of a track yields, see library_set_analysis() */
+struct lib_analysis {
+    int      loudness;          /* 1/100 LUFS or LIB_LOUDNESS_NONE       */
+    int      peak;              /* 1/100 dBTP                            */
+    uint32_t lead_ms;           /* Below the silence threshold at either */
+    uint32_t trail_ms;          /*  end; all of it if nothing is above   */
+    uint32_t length_ms;         /* Decoded, trimmed like playback; 0 if  */
+                                /*  nothing could be (LIB_NOAUDIO)       */
+    int      waveform;          /* Its peak overview was stored          */
+};
+
+struct lib_view;
+
+/*
+ * Map the index of music_dir, scanning first if it is missing, unreadable,
+ * of another version, or if rescan is set.  Returns the track count or -1.
+ */
+int  library_load(const char *music_dir, const char *index_path, int rescan);
+
+/* Any thread: take and drop a reference to the current view */
+const struct lib_view *library_acquire(void);
+void library_release(const struct lib_view *v);
+
+/* Control thread: the current view, valid until its next library change */
+const struct lib_view *library_view(void);
+
+unsigned lib_count(const struct lib_view *v);       /* Slots, deleted ones too */
+unsigned lib_live(const struct lib_view *v);        /* Tracks actually there   */
+uint64_t lib_generation(const struct lib_view *v);  /* Bumped by every change  */
+
+/*
+ * Changed only when a commit added, removed, renamed or re-read a track,
+ * not by seek tables and analysis results, so orders and lookups over the
+ * slots can outlive commits of derived data.
+ */
+uint64_t lib_shape(const struct lib_view *v);
+
+/*
+ * Segment k holds slots k * LIB_SEG_SIZE onwards.  Its serial is unique
+ * for the life of the process and changes whenever a change touches it,
+ * so data derived from a segment can be cached by serial.
+ */
+unsigned lib_nsegs(const struct lib_view *v);
+uint64_t lib_seg_serial(const struct lib_view *v, unsigned k);
+
+/* NULL if idx is out of range or its file was removed */
+const struct lib_track *lib_track(const struct lib_view *v, unsigned idx);
+
+/* String off of track idx ("" if out of range), and its relative path */
+const char *lib_str(const struct lib_view *v, unsigned idx, uint32_t off);
+const char *lib_relpath(const struct lib_view *v, unsigned idx);
+
+/*
+ * Seek table of track idx: the file offsets of audio frames 0,
+ * LIB_SEEK_STEP, 2 * LIB_SEEK_STEP...  NULL (and *n = 0) if it has none.
+ */
+const uint32_t *lib_seek_table(const struct lib_view *v, unsigned idx, unsigned *n);
+
+/* Absolute path of track idx; returns -1 if there is no such track */
+int  lib_path(const struct lib_view *v, unsigned idx, char *buf, size_t len);
+
+/* Display fallbacks for untagged files: file name, "Unknown Artist" */
+const char *lib_title(const struct lib_view *v, unsigned idx);
+const char *lib_artist(const struct lib_view *v, unsigned idx);
+
+/*
+ * A track file as library_read() found it: its record, all but the string
+ * offsets, and its tags, with the file name as the fallback title.
+ */
+struct lib_file {
+    struct lib_track t;
+    struct mp3_info  mi;
+};
+
+/* Any thread: rel is a visible MP3 file name, one a scan would pick up */
+int  library_track_name(const char *rel);
+
+/*
+ * Any thread: stat and parse rel below music_dir, the slow part of a
+ * change.  Returns 0 with f filled in, 1 if the file holds no MPEG audio,
+ * or -1 if it is not a track file or cannot be read.
+ */
+int  library_read(const char *rel, struct lib_file *f);
+
+/*
+ * Control thread: changes below music_dir, by relative path.  They collect
+ * in a draft until library_commit() publishes them as one new view, which
+ * returns 1 if anything changed.  library_store() takes what library_read()
+ * found (NULL: no MPEG audio, the track goes); a track of the same size and
+ * mtime keeps its record.  A directory rename or removal covers every
+ * track below it; a rename keeps the tracks' records and slots.
+ */
+void library_store(const char *rel, const struct lib_file *f);
+void library_remove(const char *rel, int is_dir);
+void library_rename(const char *from, const char *to, int is_dir);
+int  library_commit(void);
+
+/*
+ * Control thread: the frame count, exact duration and seek table measured
+ * on track idx as it was at size and mtime; ignored if the file changed
+ * since.  The decoded length of an analyzed track is kept as its duration.
+ * Part of the draft, like the changes above.
+ */
+int  library_set_seek(unsigned idx, uint64_t size, int64_t mtime, uint32_t frames,
+                      uint32_t duration_ms, const uint32_t *offsets, unsigned n);
+
+/*
+ * Control thread: the analysis of track idx as it was at size and mtime.
+ * Marks it LIB_ANALYZED; its decoded length becomes the exact duration.
+ * A track that decoded to nothing is marked LIB_NOAUDIO as well, and is
+ * only analyzed again once the file changes.
+ * Part of the draft, like the changes above.
+ */
+int  library_set_analysis(unsigned idx, uint64_t size, int64_t mtime,
+                          const struct lib_analysis *a);
+
+/*
+ * Control thread: library_commit() for derived data only (analysis
+ * results), which is cheap to measure again: the index is written within
+ * minutes rather than seconds, unless a real change comes along first.
+ */
+int  library_commit_lazy(void);
+
+struct lib_rescan;
+
+/*
+ * Any thread: walk music_dir and read again the files whose size or mtime
+ * differ from their track in v.  Returns NULL if out of memory.
+ */
+struct lib_rescan *library_rescan_read(const struct lib_view *v);
+
+/*
+ * Control thread: apply a walk to the draft, removing the tracks it did
+ * not find; no slot moves.  Frees r.
+ */
+void library_rescan_store(struct lib_rescan *r);
+
+/* Control thread: write the index now if a change is still unsaved */
+void library_sync(void);
+
+#endif /* LIBRARY_H */
@@ -0,0 +1,546 @@
+/*
+ * libwatch.c
+ *
+ * inotify watcher of the music directory (see libwatch.h).  Everything
+ * but libwatch_rescan() and libwatch_service() runs on the watcher thread.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "libwatch.h"
+#include "library.h"
+#include "rt.h"
+
+#define WATCH_MAX_DEPTH 16          /* As deep as the library scan goes   */
+#define WATCH_CHANGES   256         /* Read ahead of the control thread   */
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                    IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+static int    ifd = -1;
+static int    kick_fd = -1;         /* eventfd: libwatch_rescan()         */
+static char   root[256];
+static char **dirs;                 /* Relative directory of each wd      */
+static int    ndirs;
+static int    overflowed;
+
+enum change_type { CHANGE_STORE, CHANGE_REMOVE, CHANGE_RENAME, CHANGE_RESCAN };
+
+/* Watcher thread -> control thread, applied in order */
+struct change {
+    struct change     *next;
+    enum change_type   type;
+    int                is_dir;
+    char              *rel, *to;
+    struct lib_file   *file;        /* STORE: NULL if no MPEG audio       */
+    struct lib_rescan *scan;
+};
+
+static pthread_mutex_t lock    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  applied = PTHREAD_COND_INITIALIZER;
+static struct change  *changes, **changes_tail = &changes;
+static unsigned        nchanges;    /* Handed over and not applied yet    */
+static int             fresh;       /* Handed over since the last ready() */
+static void          (*notify)(void);
+
+/*
+ * IN_MOVED_FROM waiting for the IN_MOVED_TO with the same cookie.  The
+ * pair normally arrives back to back; a lone half means the file moved
+ * out of (or into) the library.
+ */
+static struct {
+    int      set;
+    int      is_dir;
+    uint32_t cookie;
+    char     rel[PATH_MAX];
+} moved;
+
+/* ------------------------------------------------------- */
+/*                        CHANGES                          */
+/* ------------------------------------------------------- */
+
+/*
+ * Wait until the control thread has applied all but max changes.  The
+ * ready() command is dropped when the control queue is full, so it is
+ * repeated every second while waiting.
+ */
+static void wait_applied(unsigned max)
+{
+    pthread_mutex_lock(&lock);
+    while (nchanges > max) {
+        struct timespec ts;
+
+        notify();
+        fresh = 0;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec++;
+        pthread_cond_timedwait(&applied, &lock, &ts);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static struct change *change_new(enum change_type type, const char *rel, int is_dir)
+{
+    struct change *c = calloc(1, sizeof(*c));
+
+    if (!c || !(c->rel = strdup(rel))) {
+        perror("libwatch: alloc");
+        free(c);
+        return NULL;
+    }
+    c->type   = type;
+    c->is_dir = is_dir;
+    return c;
+}
+
+static void hand_over(struct change *c)
+{
+    wait_applied(WATCH_CHANGES - 1);
+
+    pthread_mutex_lock(&lock);
+    *changes_tail = c;
+    changes_tail  = &c->next;
+    nchanges++;
+    fresh = 1;
+    pthread_mutex_unlock(&lock);
+}
+
+/* A file written or moved in: parsed here, stored by the control thread */
+static void change_store(const char *rel)
+{
+    struct lib_file *f = malloc(sizeof(*f));
+    struct change *c;
+    int rc;
+
+    if (!f || (rc = library_read(rel, f)) < 0 || !(c = change_new(CHANGE_STORE, rel, 0))) {
+        free(f);
+        return;
+    }
+    if (rc > 0) {
+        free(f);
+        f = NULL;
+    }
+    c->file = f;
+    hand_over(c);
+}
+
+static void change_remove(const char *rel, int is_dir)
+{
+    struct change *c = change_new(CHANGE_REMOVE, rel, is_dir);
+
+    if (c)
+        hand_over(c);
+}
+
+static void change_rename(const char *from, const char *to, int is_dir)
+{
+    struct change *c;
+
+    /* A file that was not a track before is read like a new one */
+    if (!is_dir && !library_track_name(from)) {
+        change_store(to);
+        return;
+    }
+
+    if (!(c = change_new(CHANGE_RENAME, from, is_dir)))
+        return;
+    if (!(c->to = strdup(to))) {
+        perror("libwatch: alloc");
+        free(c->rel);
+        free(c);
+        return;
+    }
+    hand_over(c);
+}
+
+/*
+ * The whole tree, walked against a view that has every change handed
+ * over so far, so the walk only has to read files that really changed.
+ */
+static void change_rescan(void)
+{
+    const struct lib_view *v;
+    struct change *c;
+
+    wait_applied(0);
+    if (!(c = change_new(CHANGE_RESCAN, "", 1)))
+        return;
+
+    v = library_acquire();
+    c->scan = library_rescan_read(v);
+    library_release(v);
+
+    if (!c->scan) {
+        free(c->rel);
+        free(c);
+        return;
+    }
+    hand_over(c);
+}
+
+/* ------------------------------------------------------- */
+/*                    WATCH DESCRIPTORS                    */
+/* ------------------------------------------------------- */
+
+/* rel is dir itself or below it ("" is the whole library) */
+static int in_tree(const char *rel, const char *dir)
+{
+    size_t n = strlen(dir);
+    return n == 0 || (strncmp(rel, dir, n) == 0 && (rel[n] == '\0' || rel[n] == '/'));
+}
+
+static int watch_dir(const char *rel)
+{
+    char abs[PATH_MAX];
+    int wd;
+
+    snprintf(abs, sizeof(abs), "%s%s%s", root, rel[0] ? "/" : "", rel);
+    if ((wd = inotify_add_watch(ifd, abs, WATCH_MASK)) < 0) {
+        if (errno == ENOSPC)
+            fprintf(stderr, "libwatch: out of watches at %s "
+                    "(raise fs.inotify.max_user_watches)\n", abs);
+        return -1;
+    }
+
+    if (wd >= ndirs) {
+        int n = ndirs ? ndirs : 64;
+        while (n <= wd)
+            n *= 2;
+        char **d = realloc(dirs, (size_t)n * sizeof(*d));
+        if (!d)
+            return -1;
+        memset(d + ndirs, 0, (size_t)(n - ndirs) * sizeof(*d));
+        dirs = d;
+        ndirs = n;
+    }
+
+    free(dirs[wd]);
+    dirs[wd] = strdup(rel);
+    return wd;
+}
+
+/*
+ * Watch rel and every directory below it.  With add set, the tracks in
+ * them are added too: a directory that shows up may already be full, and
+ * files created before its watch existed raise no event.
+ */
+static int watch_tree(const char *rel, int depth, int add)
+{
+    char abs[PATH_MAX];
+    DIR *d;
+    struct dirent *e;
+
+    if (depth > WATCH_MAX_DEPTH || watch_dir(rel) < 0)
+        return -1;
+
+    snprintf(abs, sizeof(abs), "%s%s%s", root, rel[0] ? "/" : "", rel);
+    if (!(d = opendir(abs)))
+        return 0;
+
+    while ((e = readdir(d))) {
+        char sub[PATH_MAX];
+        int is_dir = e->d_type == DT_DIR;
+        int is_reg = e->d_type == DT_REG;
+
+        if (e->d_name[0] == '.')
+            continue;
+
+        if (e->d_type == DT_UNKNOWN || e->d_type == DT_LNK) {
+            struct stat st;
+            if (fstatat(dirfd(d), e->d_name, &st, 0) < 0)
+                continue;
+            is_dir = S_ISDIR(st.st_mode);
+            is_reg = S_ISREG(st.st_mode);
+        }
+
+        if (snprintf(sub, sizeof(sub), "%s%s%s", rel, rel[0] ? "/" : "",
+                     e->d_name) >= (int)sizeof(sub))
+            continue;
+
+        if (is_dir)
+            watch_tree(sub, depth + 1, add);
+        else if (is_reg && add)
+            change_store(sub);
+    }
+
+    closedir(d);
+    return 0;
+}
+
+static void unwatch_tree(const char *rel)
+{
+    for (int wd = 0; wd < ndirs; wd++) {
+        if (dirs[wd] && in_tree(dirs[wd], rel)) {
+            inotify_rm_watch(ifd, wd);
+            free(dirs[wd]);
+            dirs[wd] = NULL;
+        }
+    }
+}
+
+/* Watches follow the directory inode; only their names need updating */
+static void rename_tree(const char *from, const char *to)
+{
+    size_t n = strlen(from);
+
+    for (int wd = 0; wd < ndirs; wd++) {
+        char path[PATH_MAX];
+        char *p;
+
+        if (!dirs[wd] || !in_tree(dirs[wd], from))
+            continue;
+        snprintf(path, sizeof(path), "%s%s", to, dirs[wd] + n);
+        if ((p = strdup(path))) {
+            free(dirs[wd]);
+            dirs[wd] = p;
+        }
+    }
+}
+
+static int depth_of(const char *rel)
+{
+    int depth = rel[0] != '\0';
+
+    for (; *rel; rel++)
+        depth += *rel == '/';
+    return depth;
+}
+
+/* ------------------------------------------------------- */
+/*                         EVENTS                          */
+/* ------------------------------------------------------- */
+
+/* A move whose other half never came: it left the library */
+static void flush_moved(void)
+{
+    if (!moved.set)
+        return;
+
+    change_remove(moved.rel, moved.is_dir);
+    if (moved.is_dir)
+        unwatch_tree(moved.rel);
+    moved.set = 0;
+}
+
+static void handle_event(const struct inotify_event *e)
+{
+    char rel[PATH_MAX];
+    int is_dir = (e->mask & IN_ISDIR) != 0;
+
+    if (e->mask & IN_Q_OVERFLOW) {
+        overflowed = 1;
+        return;
+    }
+
+    if (e->wd < 0 || e->wd >= ndirs || !dirs[e->wd])
+        return;
+
+    if (e->mask & IN_IGNORED) {
+        /* Directory deleted (or unwatched): the wd is gone */
+        free(dirs[e->wd]);
+        dirs[e->wd] = NULL;
+        return;
+    }
+
+    /* Hidden directories are not part of the library, as in the scan */
+    if (!e->len || (is_dir && e->name[0] == '.'))
+        return;
+
+    if (snprintf(rel, sizeof(rel), "%s%s%s", dirs[e->wd],
+                 dirs[e->wd][0] ? "/" : "", e->name) >= (int)sizeof(rel))
+        return;
+
+    if (e->mask & IN_MOVED_FROM) {
+        flush_moved();
+        moved.set = 1;
+        moved.is_dir = is_dir;
+        moved.cookie = e->cookie;
+        snprintf(moved.rel, sizeof(moved.rel), "%s", rel);
+    } else if (e->mask & IN_MOVED_TO) {
+        if (moved.set && moved.cookie == e->cookie) {
+            change_rename(moved.rel, rel, is_dir);
+            if (is_dir)
+                rename_tree(moved.rel, rel);
+            moved.set = 0;
+        } else if (is_dir) {
+            watch_tree(rel, depth_of(rel), 1);
+        } else {
+            change_store(rel);
+        }
+    } else if (e->mask & IN_CREATE) {
+        /* Files are picked up when closed after writing */
+        if (is_dir)
+            watch_tree(rel, depth_of(rel), 1);
+    } else if (e->mask & IN_CLOSE_WRITE) {
+        change_store(rel);
+    } else if (e->mask & IN_DELETE) {
+        change_remove(rel, is_dir);
+    }
+}
+
+/* ------------------------------------------------------- */
+/*                     WATCHER THREAD                      */
+/* ------------------------------------------------------- */
+
+static void read_events(void)
+{
+    char buf[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+
+    while ((n = read(ifd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *e = (const struct inotify_event *)p;
+            handle_event(e);
+            p += sizeof(*e) + e->len;
+        }
+    }
+    flush_moved();
+}
+
+static void *watch_thread(void *arg)
+{
+    struct pollfd pfd[2] = {
+        { .fd = ifd,     .events = POLLIN },    /* Ignored while -1 */
+        { .fd = kick_fd, .events = POLLIN },
+    };
+
+    (void)arg;
+    pthread_setname_np(pthread_self(), "libwatch");
+
+    for (;;) {
+        eventfd_t kicks = 0;
+
+        if (poll(pfd, 2, -1) < 0)
+            continue;
+
+        if (pfd[1].revents & POLLIN)
+            (void)eventfd_read(kick_fd, &kicks);
+        if (pfd[0].revents & POLLIN)
+            read_events();
+
+        if (overflowed) {
+            /* Events were lost: start the watches over and re-check every file */
+            fprintf(stderr, "libwatch: event queue overflow, rescanning\n");
+            overflowed = 0;
+            unwatch_tree("");
+            watch_tree("", 0, 0);
+            kicks = 1;
+        }
+        if (kicks)
+            change_rescan();
+
+        pthread_mutex_lock(&lock);
+        if (fresh)
+            notify();
+        fresh = 0;
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------- */
+/*                     CONTROL THREAD                      */
+/* ------------------------------------------------------- */
+
+void libwatch_rescan(void)
+{
+    if (kick_fd >= 0)
+        (void)eventfd_write(kick_fd, 1);
+}
+
+int libwatch_service(void)
+{
+    struct change *c, *next;
+    unsigned n = 0;
+    int changed;
+
+    pthread_mutex_lock(&lock);
+    c = changes;
+    changes = NULL;
+    changes_tail = &changes;
+    pthread_mutex_unlock(&lock);
+
+    if (!c)
+        return 0;
+
+    for (; c; c = next, n++) {
+        next = c->next;
+        switch (c->type) {
+        case CHANGE_STORE:  library_store(c->rel, c->file); break;
+        case CHANGE_REMOVE: library_remove(c->rel, c->is_dir); break;
+        case CHANGE_RENAME: library_rename(c->rel, c->to, c->is_dir); break;
+        case CHANGE_RESCAN: library_rescan_store(c->scan); break;
+        }
+        free(c->rel);
+        free(c->to);
+        free(c->file);
+        free(c);
+    }
+    changed = library_commit();
+
+    /* Published: the watcher may compare against the library again */
+    pthread_mutex_lock(&lock);
+    nchanges -= n;
+    pthread_cond_broadcast(&applied);
+    pthread_mutex_unlock(&lock);
+    return changed;
+}
+
+/* ------------------------------------------------------- */
+/*                         SETUP                           */
+/* ------------------------------------------------------- */
+
+int libwatch_init(const char *music_dir, void (*ready)(void))
+{
+    pthread_attr_t attr;
+    pthread_t t;
+    int err, rc = 0;
+
+    snprintf(root, sizeof(root), "%s", music_dir);
+    notify = ready;
+
+    if ((kick_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+        perror("libwatch: eventfd");
+        return -1;
+    }
+
+    if ((ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        perror("libwatch: inotify_init1");
+        rc = -1;
+    } else if (watch_tree("", 0, 0) < 0) {
+        fprintf(stderr, "libwatch: cannot watch %s\n", music_dir);
+        close(ifd);
+        ifd = -1;
+        rc = -1;
+    }
+
+    rt_thread_attr(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&t, &attr, watch_thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (err) {
+        fprintf(stderr, "libwatch: pthread_create: %s\n", strerror(err));
+        close(kick_fd);
+        kick_fd = -1;
+        return -1;
+    }
+    return rc;
+}
@@ -0,0 +1,37 @@
+/*
+ * libwatch.h
+ *
+ * Keeps the library in step with the music directory while the daemon
+ * runs.  Every directory below it is watched with inotify by a thread of
+ * its own, which also reads and parses the files that changed, so the
+ * control thread never waits on the SD card.  The changes are handed over
+ * in order, and libwatch_service() applies them to the library
+ * (library.h), published as one new view per batch.
+ *
+ * Only files that were written and closed, moved or deleted are looked at:
+ * a finished copy is parsed once, a rename keeps its record untouched, and
+ * a directory moved in or out counts for every track below it.  If the
+ * kernel's event queue overflowed, the whole tree is re-checked instead;
+ * libwatch_rescan() asks for the same check, for what changed while the
+ * daemon was not running.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef LIBWATCH_H
+#define LIBWATCH_H
+
+/*
+ * Start the watcher thread on music_dir and everything below it; it calls
+ * ready() whenever changes wait for libwatch_service().  Returns -1 if
+ * inotify is unavailable; libwatch_rescan() still works then.
+ */
+int  libwatch_init(const char *music_dir, void (*ready)(void));
+
+/* Control thread: re-check the whole tree in the background */
+void libwatch_rescan(void);
+
+/* Control thread: apply the changes read so far; 1 if the library changed */
+int  libwatch_service(void);
+
+#endif /* LIBWATCH_H */
@@ -0,0 +1,443 @@
+/*
+ * mix.c
+ *
+ * NEON and scalar S16 mixing / gain-ramp kernels and S16 -> S32 widening.
+ *
+ * Per-frame gains are stepped in Q15.16 so long ramps stay smooth; every
+ * product is rounded like vqrdmulh ((x * g + 2^14) >> 15) and the two
+ * halves of a crossfade are added with saturation.  The scalar code follows
+ * the same arithmetic, so both paths produce identical output.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+/* vminvq/vmaxvq in the peak scan exist on AArch64 only */
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MIX_HAVE_NEON 1
+#endif
+
+#include "mix.h"
+#include "pcm.h"
+
+#define CURVE_STEPS 1024                /* Quarter sine resolution */
+
+static int16_t sine_q15[CURVE_STEPS + 1];
+
+/* ------------------------------------------------------- */
+/*                        HELPERS                          */
+/* ------------------------------------------------------- */
+
+static inline int16_t sat16(int32_t v)
+{
+    if (v > 32767)  return 32767;
+    if (v < -32768) return -32768;
+    return (int16_t)v;
+}
+
+/* Rounded Q15 multiply, same result as one lane of vqrdmulh */
+static inline int32_t q15_mul(int32_t x, int32_t g)
+{
+    return (x * g + (1 << 14)) >> 15;
+}
+
+/* Per-frame gain step in Q15.16 */
+static inline int32_t ramp_step(int g0, int g1, size_t frames)
+{
+    return frames ? (int32_t)(((int64_t)(g1 - g0) * 65536) / (int64_t)frames) : 0;
+}
+
+/* ------------------------------------------------------- */
+/*                    SCALAR KERNELS                       */
+/* ------------------------------------------------------- */
+
+static void xfade_scalar(int16_t *dst, const int16_t *a, const int16_t *b,
+                         size_t frames, int32_t ga, int32_t sa,
+                         int32_t gb, int32_t sb)
+{
+    for (size_t i = 0; i < frames; i++) {
+        int32_t ka = ga >> 16, kb = gb >> 16;
+
+        for (int c = 0; c < PCM_CHANNELS; c++) {
+            size_t k = i * PCM_CHANNELS + c;
+            dst[k] = sat16(q15_mul(a[k], ka) + q15_mul(b[k], kb));
+        }
+        ga += sa;
+        gb += sb;
+    }
+}
+
+static void gain_scalar(int16_t *buf, size_t frames, int32_t g, int32_t s)
+{
+    for (size_t i = 0; i < frames; i++) {
+        int32_t k = g >> 16;
+
+        for (int c = 0; c < PCM_CHANNELS; c++) {
+            size_t j = i * PCM_CHANNELS + c;
+            buf[j] = sat16(q15_mul(buf[j], k));
+        }
+        g += s;
+    }
+}
+
+void mix_xfade_s16_scalar(int16_t *dst, const int16_t *a, const int16_t *b,
+                          size_t frames, int ga0, int ga1, int gb0, int gb1)
+{
+    xfade_scalar(dst, a, b, frames,
+                 ga0 * 65536, ramp_step(ga0, ga1, frames),
+                 gb0 * 65536, ramp_step(gb0, gb1, frames));
+}
+
+void mix_gain_s16_scalar(int16_t *buf, size_t frames, int g0, int g1)
+{
+    gain_scalar(buf, frames, g0 * 65536, ramp_step(g0, g1, frames));
+}
+
+void mix_s16_to_s32_scalar(int32_t *dst, const int16_t *src, size_t samples)
+{
+    for (size_t i = 0; i < samples; i++)
+        dst[i] = (int32_t)((uint32_t)(uint16_t)src[i] << 16);
+}
+
+void mix_minmax_s16_scalar(const int16_t *src, size_t samples, int16_t *lo, int16_t *hi)
+{
+    int16_t l = *lo, h = *hi;
+
+    for (size_t i = 0; i < samples; i++) {
+        if (src[i] < l) l = src[i];
+        if (src[i] > h) h = src[i];
+    }
+    *lo = l;
+    *hi = h;
+}
+
+/* ------------------------------------------------------- */
+/*                     NEON KERNELS                        */
+/* ------------------------------------------------------- */
+
+#ifdef MIX_HAVE_NEON
+
+/* Gains of four consecutive frames, each duplicated for L and R */
+static inline int16x8_t neon_frame_gains(int32x4_t g)
+{
+    int16x4_t   g4 = vshrn_n_s32(g, 16);
+    int16x4x2_t lr = vzip_s16(g4, g4);
+    return vcombine_s16(lr.val[0], lr.val[1]);
+}
+
+static inline int32x4_t neon_ramp(int32_t g, int32_t s)
+{
+    int32x4_t base = vdupq_n_s32(g);
+    const int32_t idx[4] = { 0, 1, 2, 3 };
+    return vmlaq_n_s32(base, vld1q_s32(idx), s);
+}
+
+static void mix_xfade_s16_neon(int16_t *dst, const int16_t *a, const int16_t *b,
+                               size_t frames, int ga0, int ga1, int gb0, int gb1)
+{
+    int32_t sa = ramp_step(ga0, ga1, frames);
+    int32_t sb = ramp_step(gb0, gb1, frames);
+    int32x4_t va_g = neon_ramp(ga0 * 65536, sa);
+    int32x4_t vb_g = neon_ramp(gb0 * 65536, sb);
+    int32x4_t va_s = vdupq_n_s32(sa * 4);
+    int32x4_t vb_s = vdupq_n_s32(sb * 4);
+    size_t i = 0;
+
+    /* Four stereo frames (eight samples) per iteration */
+    for (; i + 4 <= frames; i += 4) {
+        int16x8_t x = vld1q_s16(a + i * PCM_CHANNELS);
+        int16x8_t y = vld1q_s16(b + i * PCM_CHANNELS);
+
+        x = vqrdmulhq_s16(x, neon_frame_gains(va_g));
+        y = vqrdmulhq_s16(y, neon_frame_gains(vb_g));
+        vst1q_s16(dst + i * PCM_CHANNELS, vqaddq_s16(x, y));
+
+        va_g = vaddq_s32(va_g, va_s);
+        vb_g = vaddq_s32(vb_g, vb_s);
+    }
+
+    if (i < frames)
+        xfade_scalar(dst + i * PCM_CHANNELS, a + i * PCM_CHANNELS,
+                     b + i * PCM_CHANNELS, frames - i,
+                     vgetq_lane_s32(va_g, 0), sa,
+                     vgetq_lane_s32(vb_g, 0), sb);
+}
+
+static void mix_gain_s16_neon(int16_t *buf, size_t frames, int g0, int g1)
+{
+    int32_t   s  = ramp_step(g0, g1, frames);
+    int32x4_t vg = neon_ramp(g0 * 65536, s);
+    int32x4_t vs = vdupq_n_s32(s * 4);
+    size_t i = 0;
+
+    for (; i + 4 <= frames; i += 4) {
+        int16x8_t x = vld1q_s16(buf + i * PCM_CHANNELS);
+        vst1q_s16(buf + i * PCM_CHANNELS,
+                  vqrdmulhq_s16(x, neon_frame_gains(vg)));
+        vg = vaddq_s32(vg, vs);
+    }
+
+    if (i < frames)
+        gain_scalar(buf + i * PCM_CHANNELS, frames - i,
+                    vgetq_lane_s32(vg, 0), s);
+}
+
+static void mix_s16_to_s32_neon(int32_t *dst, const int16_t *src, size_t samples)
+{
+    size_t i = 0;
+
+    /* Widening shift: sample into the top half, low half zero */
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t x = vld1q_s16(src + i);
+        vst1q_s32(dst + i,     vshll_n_s16(vget_low_s16(x), 16));
+        vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(x), 16));
+    }
+
+    if (i < samples)
+        mix_s16_to_s32_scalar(dst + i, src + i, samples - i);
+}
+
+static void mix_minmax_s16_neon(const int16_t *src, size_t samples, int16_t *lo, int16_t *hi)
+{
+    int16x8_t l0 = vdupq_n_s16(*lo), l1 = l0;
+    int16x8_t h0 = vdupq_n_s16(*hi), h1 = h0;
+    size_t i = 0;
+
+    /* Two independent accumulators per side hide the min/max latency */
+    for (; i + 16 <= samples; i += 16) {
+        int16x8_t x = vld1q_s16(src + i);
+        int16x8_t y = vld1q_s16(src + i + 8);
+        l0 = vminq_s16(l0, x);
+        h0 = vmaxq_s16(h0, x);
+        l1 = vminq_s16(l1, y);
+        h1 = vmaxq_s16(h1, y);
+    }
+
+    *lo = vminvq_s16(vminq_s16(l0, l1));
+    *hi = vmaxvq_s16(vmaxq_s16(h0, h1));
+    if (i < samples)
+        mix_minmax_s16_scalar(src + i, samples - i, lo, hi);
+}
+
+#endif /* MIX_HAVE_NEON */
+
+/* ------------------------------------------------------- */
+/*                       PUBLIC API                        */
+/* ------------------------------------------------------- */
+
+void mix_init(void)
+{
+    for (int k = 0; k <= CURVE_STEPS; k++)
+        sine_q15[k] = (int16_t)lrint(sin(M_PI / 2.0 * k / CURVE_STEPS) * MIX_UNITY);
+}
+
+void mix_xfade_s16(int16_t *dst, const int16_t *a, const int16_t *b,
+                   size_t frames, int ga0, int ga1, int gb0, int gb1)
+{
+#ifdef MIX_HAVE_NEON
+    mix_xfade_s16_neon(dst, a, b, frames, ga0, ga1, gb0, gb1);
+#else
+    mix_xfade_s16_scalar(dst, a, b, frames, ga0, ga1, gb0, gb1);
+#endif
+}
+
+void mix_gain_s16(int16_t *buf, size_t frames, int g0, int g1)
+{
+    /* Unity is bit-transparent: skip the multiply entirely */
+    if (g0 == MIX_UNITY && g1 == MIX_UNITY)
+        return;
+
+#ifdef MIX_HAVE_NEON
+    mix_gain_s16_neon(buf, frames, g0, g1);
+#else
+    mix_gain_s16_scalar(buf, frames, g0, g1);
+#endif
+}
+
+void mix_s16_to_s32(int32_t *dst, const int16_t *src, size_t samples)
+{
+#ifdef MIX_HAVE_NEON
+    mix_s16_to_s32_neon(dst, src, samples);
+#else
+    mix_s16_to_s32_scalar(dst, src, samples);
+#endif
+}
+
+void mix_minmax_s16(const int16_t *src, size_t samples, int16_t *lo, int16_t *hi)
+{
+#ifdef MIX_HAVE_NEON
+    mix_minmax_s16_neon(src, samples, lo, hi);
+#else
+    mix_minmax_s16_scalar(src, samples, lo, hi);
+#endif
+}
+
+void mix_equal_power(unsigned long pos, unsigned long len,
+                     int *g_out, int *g_in)
+{
+    if (len == 0 || pos >= len) {
+        *g_out = 0;
+        *g_in  = MIX_UNITY;
+        return;
+    }
+
+    /* Position on the quarter sine in 1/65536 steps, then interpolate */
+    unsigned long long x = (unsigned long long)pos * CURVE_STEPS * 65536 / len;
+    unsigned idx  = (unsigned)(x >> 16);
+    int      frac = (int)(x & 0xffff);
+
+    int s0 = sine_q15[idx], s1 = sine_q15[idx + 1];
+    int c0 = sine_q15[CURVE_STEPS - idx], c1 = sine_q15[CURVE_STEPS - idx - 1];
+
+    *g_in  = s0 + (int)(((long long)(s1 - s0) * frac) >> 16);
+    *g_out = c0 + (int)(((long long)(c1 - c0) * frac) >> 16);
+}
+
+/* ------------------------------------------------------- */
+/*                     MICROBENCHMARK                      */
+/* ------------------------------------------------------- */
+
+#define BENCH_FRAMES  512                   /* Same block size as the player */
+#define BENCH_SECONDS 60                    /* Audio time processed per run  */
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef void (*xfade_fn)(int16_t *, const int16_t *, const int16_t *,
+                         size_t, int, int, int, int);
+typedef void (*gain_fn)(int16_t *, size_t, int, int);
+typedef void (*widen_fn)(int32_t *, const int16_t *, size_t);
+typedef void (*minmax_fn)(const int16_t *, size_t, int16_t *, int16_t *);
+
+/* Run a 60 s equal-power crossfade and report cost relative to real time */
+static void bench_xfade(const char *name, xfade_fn fn,
+                        const int16_t *a, const int16_t *b, int16_t *out)
+{
+    unsigned long total = (unsigned long)BENCH_SECONDS * PCM_RATE;
+    double t0 = bench_now();
+
+    for (unsigned long pos = 0; pos < total; pos += BENCH_FRAMES) {
+        int ga0, gb0, ga1, gb1;
+        mix_equal_power(pos, total, &ga0, &gb0);
+        mix_equal_power(pos + BENCH_FRAMES, total, &ga1, &gb1);
+        fn(out, a, b, BENCH_FRAMES, ga0, ga1, gb0, gb1);
+    }
+
+    double dt = bench_now() - t0;
+    printf("  %-14s %8.2f ns/frame  %6.3f%% of one core\n", name,
+           dt * 1e9 / total, dt * 100.0 / BENCH_SECONDS);
+}
+
+static void bench_gain(const char *name, gain_fn fn, int16_t *buf)
+{
+    unsigned long total = (unsigned long)BENCH_SECONDS * PCM_RATE;
+    double t0 = bench_now();
+
+    for (unsigned long pos = 0; pos < total; pos += BENCH_FRAMES)
+        fn(buf, BENCH_FRAMES, 20000, 20001);    /* Non-unity, never skipped */
+
+    double dt = bench_now() - t0;
+    printf("  %-14s %8.2f ns/frame  %6.3f%% of one core\n", name,
+           dt * 1e9 / total, dt * 100.0 / BENCH_SECONDS);
+}
+
+static void bench_widen(const char *name, widen_fn fn,
+                        const int16_t *src, int32_t *dst)
+{
+    unsigned long total = (unsigned long)BENCH_SECONDS * PCM_RATE;
+    double t0 = bench_now();
+
+    for (unsigned long pos = 0; pos < total; pos += BENCH_FRAMES)
+        fn(dst, src, BENCH_FRAMES * PCM_CHANNELS);
+
+    double dt = bench_now() - t0;
+    printf("  %-14s %8.2f ns/frame  %6.3f%% of one core\n", name,
+           dt * 1e9 / total, dt * 100.0 / BENCH_SECONDS);
+}
+
+static void bench_minmax(const char *name, minmax_fn fn, const int16_t *src)
+{
+    unsigned long total = (unsigned long)BENCH_SECONDS * PCM_RATE;
+    int16_t lo = INT16_MAX, hi = INT16_MIN;
+    volatile int16_t sink;
+    double t0 = bench_now();
+
+    for (unsigned long pos = 0; pos < total; pos += BENCH_FRAMES)
+        fn(src, BENCH_FRAMES * PCM_CHANNELS, &lo, &hi);
+    sink = lo ^ hi;                             /* Or it is optimized away */
+    (void)sink;
+
+    double dt = bench_now() - t0;
+    printf("  %-14s %8.2f ns/frame  %6.3f%% of one core\n", name,
+           dt * 1e9 / total, dt * 100.0 / BENCH_SECONDS);
+}
+
+int mix_bench(void)
+{
+    static int16_t a[BENCH_FRAMES * PCM_CHANNELS], b[BENCH_FRAMES * PCM_CHANNELS];
+    static int16_t ref[BENCH_FRAMES * PCM_CHANNELS], out[BENCH_FRAMES * PCM_CHANNELS];
+    static int32_t wide_ref[BENCH_FRAMES * PCM_CHANNELS], wide[BENCH_FRAMES * PCM_CHANNELS];
+    int16_t lo_ref = INT16_MAX, hi_ref = INT16_MIN, lo = INT16_MAX, hi = INT16_MIN;
+    int mismatch = 0;
+
+    mix_init();
+
+    srand(1);
+    for (size_t i = 0; i < BENCH_FRAMES * PCM_CHANNELS; i++) {
+        a[i] = (int16_t)(rand() - RAND_MAX / 2);
+        b[i] = (int16_t)(rand() - RAND_MAX / 2);
+    }
+
+    /* Verify the dispatched kernels against the scalar reference */
+    mix_xfade_s16_scalar(ref, a, b, BENCH_FRAMES - 3, 1234, 30000, 32767, 5);
+    mix_xfade_s16(out, a, b, BENCH_FRAMES - 3, 1234, 30000, 32767, 5);
+    mismatch |= memcmp(ref, out, (BENCH_FRAMES - 3) * PCM_FRAME_BYTES) != 0;
+
+    memcpy(ref, a, sizeof(a));
+    memcpy(out, a, sizeof(a));
+    mix_gain_s16_scalar(ref, BENCH_FRAMES - 1, 100, 32000);
+    mix_gain_s16(out, BENCH_FRAMES - 1, 100, 32000);
+    mismatch |= memcmp(ref, out, (BENCH_FRAMES - 1) * PCM_FRAME_BYTES) != 0;
+
+    mix_s16_to_s32_scalar(wide_ref, a, BENCH_FRAMES * PCM_CHANNELS - 3);
+    mix_s16_to_s32(wide, a, BENCH_FRAMES * PCM_CHANNELS - 3);
+    mismatch |= memcmp(wide_ref, wide,
+                       (BENCH_FRAMES * PCM_CHANNELS - 3) * sizeof(int32_t)) != 0;
+
+    mix_minmax_s16_scalar(a, BENCH_FRAMES * PCM_CHANNELS - 5, &lo_ref, &hi_ref);
+    mix_minmax_s16(a, BENCH_FRAMES * PCM_CHANNELS - 5, &lo, &hi);
+    mismatch |= lo != lo_ref || hi != hi_ref;
+
+    printf("Mix kernel benchmark: %d s of %d Hz stereo, %d-frame blocks\n",
+           BENCH_SECONDS, PCM_RATE, BENCH_FRAMES);
+    printf("  NEON: %s, scalar/dispatch match: %s\n",
+#ifdef MIX_HAVE_NEON
+           "yes",
+#else
+           "no (scalar fallback)",
+#endif
+           mismatch ? "NO" : "yes");
+
+    bench_xfade("xfade scalar", mix_xfade_s16_scalar, a, b, out);
+    bench_xfade("xfade", mix_xfade_s16, a, b, out);
+    bench_gain("gain scalar", mix_gain_s16_scalar, out);
+    bench_gain("gain", mix_gain_s16, out);
+    bench_widen("s16->s32 scalar", mix_s16_to_s32_scalar, a, wide);
+    bench_widen("s16->s32", mix_s16_to_s32, a, wide);
+    bench_minmax("minmax scalar", mix_minmax_s16_scalar, a);
+    bench_minmax("minmax", mix_minmax_s16, a);
+
+    return mismatch;
+}
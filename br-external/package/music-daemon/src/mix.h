@@ -0,0 +1,65 @@
+/*
+ * mix.h
+ *
+ * PCM mixing and gain-ramp kernels for interleaved S16 stereo (see pcm.h).
+ *
+ * Gains are Q15 fixed point (MIX_UNITY == 1.0).  A block is processed with
+ * its gain moving linearly from g0 to g1, which removes zipper noise from
+ * fades and volume changes.  On AArch64 (Cortex-A72 on the Pi 4) the
+ * kernels use NEON; the scalar versions are bit-exact references and the
+ * fallback on other hosts, 32-bit ARM included.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef MIX_H
+#define MIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MIX_UNITY 32767     /* Q15 gain of 1.0 */
+
+/* Build the equal-power lookup table; call once before the other helpers */
+void mix_init(void);
+
+/*
+ * Crossfade two streams into dst (dst may alias a or b):
+ *   dst = sat(a * ga + b * gb), ga: ga0 -> ga1, gb: gb0 -> gb1 over frames
+ */
+void mix_xfade_s16(int16_t *dst, const int16_t *a, const int16_t *b,
+                   size_t frames, int ga0, int ga1, int gb0, int gb1);
+
+/* In-place gain ramp: buf = buf * g, g: g0 -> g1 over frames */
+void mix_gain_s16(int16_t *buf, size_t frames, int g0, int g1);
+
+/*
+ * Equal-power crossfade curve at position pos of len frames:
+ *   g_out = cos(pi/2 * pos/len), g_in = sin(pi/2 * pos/len), both Q15
+ */
+void mix_equal_power(unsigned long pos, unsigned long len,
+                     int *g_out, int *g_in);
+
+/*
+ * Widen S16 samples to left-justified S32 (x << 16), for output devices
+ * that only accept 32-bit samples.  dst must not alias src.
+ */
+void mix_s16_to_s32(int32_t *dst, const int16_t *src, size_t samples);
+
+/*
+ * Lowest and highest of samples S16 values, both channels alike, folded
+ * into *lo and *hi (start them at INT16_MAX and INT16_MIN).
+ */
+void mix_minmax_s16(const int16_t *src, size_t samples, int16_t *lo, int16_t *hi);
+
+/* Scalar reference kernels, exported for the benchmark */
+void mix_xfade_s16_scalar(int16_t *dst, const int16_t *a, const int16_t *b,
+                          size_t frames, int ga0, int ga1, int gb0, int gb1);
+void mix_gain_s16_scalar(int16_t *buf, size_t frames, int g0, int g1);
+void mix_s16_to_s32_scalar(int32_t *dst, const int16_t *src, size_t samples);
+void mix_minmax_s16_scalar(const int16_t *src, size_t samples, int16_t *lo, int16_t *hi);
+
+/* Microbenchmark for `music_daemon --bench-mix`; returns 0 if kernels agree */
+int  mix_bench(void);
+
+#endif /* MIX_H */
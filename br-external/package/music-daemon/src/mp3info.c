@@ -0,0 +1,658 @@
+/*
+ * mp3info.c
+ *
+ * ID3 tag and MPEG audio header parsing (see mp3info.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mp3info.h"
+
+#define ID3V2_MAX_UNSYNC (1024 * 1024)  /* Unsynchronised tags are read whole */
+#define ID3V2_MAX_TEXT   1024           /* Bytes read from one text frame     */
+#define SYNC_SEARCH      (64 * 1024)    /* Bytes searched for the first frame */
+#define RESYNC_SEARCH    4096           /* Bytes searched past a damaged frame */
+
+/* Source of tag bytes: the file, or a de-unsynchronised copy of the tag */
+struct src {
+    int            fd;
+    const uint8_t *mem;
+    size_t         len;
+};
+
+static int src_read(const struct src *s, size_t off, void *buf, size_t n)
+{
+    if (s->mem) {
+        if (off > s->len || n > s->len - off)
+            return -1;
+        memcpy(buf, s->mem + off, n);
+        return 0;
+    }
+    return pread(s->fd, buf, n, (off_t)off) == (ssize_t)n ? 0 : -1;
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint32_t syncsafe32(const uint8_t *p)
+{
+    return (uint32_t)(p[0] & 0x7f) << 21 | (uint32_t)(p[1] & 0x7f) << 14 |
+           (uint32_t)(p[2] & 0x7f) << 7  | (p[3] & 0x7f);
+}
+
+/* ------------------------------------------------------- */
+/*                     TEXT DECODING                       */
+/* ------------------------------------------------------- */
+
+static size_t put_utf8(char *out, size_t pos, size_t cap, uint32_t cp)
+{
+    char tmp[4];
+    size_t n;
+
+    if (cp < 0x80) {
+        tmp[0] = (char)cp; n = 1;
+    } else if (cp < 0x800) {
+        tmp[0] = (char)(0xc0 | cp >> 6);
+        tmp[1] = (char)(0x80 | (cp & 0x3f)); n = 2;
+    } else if (cp < 0x10000) {
+        tmp[0] = (char)(0xe0 | cp >> 12);
+        tmp[1] = (char)(0x80 | (cp >> 6 & 0x3f));
+        tmp[2] = (char)(0x80 | (cp & 0x3f)); n = 3;
+    } else {
+        tmp[0] = (char)(0xf0 | cp >> 18);
+        tmp[1] = (char)(0x80 | (cp >> 12 & 0x3f));
+        tmp[2] = (char)(0x80 | (cp >> 6 & 0x3f));
+        tmp[3] = (char)(0x80 | (cp & 0x3f)); n = 4;
+    }
+
+    if (pos + n >= cap)
+        return pos;         /* Drop characters that do not fit whole */
+    memcpy(out + pos, tmp, n);
+    return pos + n;
+}
+
+/* Strip trailing blanks (ID3v1 pads with spaces) */
+static void trim(char *s)
+{
+    size_t n = strlen(s);
+    while (n && (s[n - 1] == ' ' || s[n - 1] == '\t' || s[n - 1] == '\r' ||
+                 s[n - 1] == '\n'))
+        s[--n] = '\0';
+}
+
+/* Convert the first string of an ID3 text payload to UTF-8 */
+static void decode_text(int enc, const uint8_t *p, size_t n, char *out, size_t cap)
+{
+    size_t pos = 0;
+
+    if (enc == 1 || enc == 2) {
+        int le = 0;
+
+        if (enc == 1 && n >= 2) {
+            le = p[0] == 0xff && p[1] == 0xfe;
+            if ((p[0] == 0xff && p[1] == 0xfe) || (p[0] == 0xfe && p[1] == 0xff)) {
+                p += 2;
+                n -= 2;
+            }
+        }
+
+        for (size_t i = 0; i + 1 < n; i += 2) {
+            uint32_t u = le ? (uint32_t)(p[i] | p[i + 1] << 8)
+                            : (uint32_t)(p[i] << 8 | p[i + 1]);
+            if (!u)
+                break;
+            if (u >= 0xd800 && u < 0xdc00 && i + 3 < n) {
+                uint32_t lo = le ? (uint32_t)(p[i + 2] | p[i + 3] << 8)
+                                 : (uint32_t)(p[i + 2] << 8 | p[i + 3]);
+                if (lo >= 0xdc00 && lo < 0xe000) {
+                    u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+                    i += 2;
+                }
+            }
+            pos = put_utf8(out, pos, cap, u);
+        }
+    } else {
+        for (size_t i = 0; i < n && p[i]; i++) {
+            if (enc == 3) {
+                if (pos + 1 < cap)
+                    out[pos++] = (char)p[i];
+            } else {
+                pos = put_utf8(out, pos, cap, p[i]);   /* ISO-8859-1 */
+            }
+        }
+
+        /* Truncation may have split a UTF-8 sequence: drop the stub */
+        if (enc == 3 && pos) {
+            size_t lead = pos;
+            while (lead > 0 && (out[lead - 1] & 0xc0) == 0x80)
+                lead--;
+            if (lead > 0 && (out[lead - 1] & 0x80)) {
+                unsigned char c = (unsigned char)out[lead - 1];
+                size_t want = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : 2;
+                if (pos - (lead - 1) < want)
+                    pos = lead - 1;
+            }
+        }
+    }
+
+    out[pos] = '\0';
+    trim(out);
+}
+
+/* ------------------------------------------------------- */
+/*                         ID3v2                           */
+/* ------------------------------------------------------- */
+
+/* Frame IDs used here, as {v2.2, v2.3/2.4} */
+static const char *const text_frames[][2] = {
+    { "TT2", "TIT2" },      /* Title        */
+    { "TP1", "TPE1" },      /* Lead artist  */
+    { "TAL", "TALB" },      /* Album        */
+    { "TRK", "TRCK" },      /* Track number */
+    { "TYE", "TYER" },      /* Year (v2.3)  */
+    { "TDR", "TDRC" },      /* Year (v2.4)  */
+};
+
+static void store_text(struct mp3_info *info, int which, const char *text)
+{
+    switch (which) {
+    case 0: snprintf(info->title,  sizeof(info->title),  "%s", text); break;
+    case 1: snprintf(info->artist, sizeof(info->artist), "%s", text); break;
+    case 2: snprintf(info->album,  sizeof(info->album),  "%s", text); break;
+    case 3: info->track_no = (unsigned)atoi(text); break;
+    default:
+        if (!info->year)
+            info->year = (unsigned)atoi(text);
+        break;
+    }
+}
+
+/* Undo unsynchronisation (FF 00 -> FF) in place; returns the new length */
+static size_t unsync(uint8_t *p, size_t n)
+{
+    size_t o = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        p[o++] = p[i];
+        if (p[i] == 0xff && i + 1 < n && p[i + 1] == 0x00)
+            i++;
+    }
+    return o;
+}
+
+/* Walk the frames of a tag body [off, end) */
+static void id3v2_frames(const struct src *s, size_t off, size_t end,
+                         int major, struct mp3_info *info)
+{
+    size_t hdr = major == 2 ? 6 : 10;
+    uint8_t h[10];
+    uint8_t *buf = malloc(ID3V2_MAX_TEXT);
+
+    if (!buf)
+        return;
+
+    while (off + hdr <= end && src_read(s, off, h, hdr) == 0) {
+        char id[5] = { 0 };
+        size_t size;
+        int fflags = 0;
+
+        if (h[0] == 0)
+            break;                      /* Padding */
+
+        if (major == 2) {
+            memcpy(id, h, 3);
+            size = (size_t)h[3] << 16 | (size_t)h[4] << 8 | h[5];
+        } else {
+            memcpy(id, h, 4);
+            size = major == 4 ? syncsafe32(h + 4) : be32(h + 4);
+            fflags = h[9];
+        }
+
+        size_t body = off + hdr;
+        off = body + size;
+        if (off > end || size == 0)
+            break;
+
+        int which = -1;
+        for (size_t i = 0; i < sizeof(text_frames) / sizeof(text_frames[0]); i++)
+            if (strcmp(id, text_frames[i][major == 2 ? 0 : 1]) == 0)
+                which = (int)i;
+        if (which < 0)
+            continue;
+
+        /* Compressed or encrypted frames are not worth the effort here */
+        if ((major == 3 && (fflags & 0xc0)) || (major == 4 && (fflags & 0x0c)))
+            continue;
+        if (major == 3 && (fflags & 0x20)) {       /* Grouping identity */
+            body++;
+            size--;
+        }
+        if (major == 4 && (fflags & 0x01)) {       /* Data length indicator */
+            if (size <= 4)
+                continue;
+            body += 4;
+            size -= 4;
+        }
+
+        size_t n = size < ID3V2_MAX_TEXT ? size : ID3V2_MAX_TEXT;
+        if (n < 2 || src_read(s, body, buf, n) < 0)
+            continue;
+        if (major == 4 && (fflags & 0x02))
+            n = unsync(buf, n);
+
+        char text[MP3INFO_TEXT];
+        decode_text(buf[0], buf + 1, n - 1, text, sizeof(text));
+        if (text[0])
+            store_text(info, which, text);
+    }
+
+    free(buf);
+}
+
+/* Parse an ID3v2 tag at the start of the file; returns its total size */
+static size_t id3v2_read(int fd, off_t file_size, struct mp3_info *info)
+{
+    uint8_t h[10];
+
+    if (pread(fd, h, 10, 0) != 10 || memcmp(h, "ID3", 3) != 0 ||
+        h[3] < 2 || h[3] > 4 || (h[6] | h[7] | h[8] | h[9]) & 0x80)
+        return 0;
+
+    int    major = h[3];
+    int    flags = h[5];
+    size_t size  = syncsafe32(h + 6);
+    size_t total = 10 + size + ((major == 4 && (flags & 0x10)) ? 10 : 0);
+
+    if ((off_t)total > file_size)
+        return 0;
+
+    info->flags |= MP3INFO_ID3V2;
+
+    struct src s = { .fd = fd };
+    uint8_t *mem = NULL;
+    size_t off = 10, end = 10 + size;
+
+    /* Whole-tag unsynchronisation (v2.2/2.3): work on a cleaned-up copy */
+    if ((flags & 0x80) && major < 4) {
+        if (size > ID3V2_MAX_UNSYNC || !(mem = malloc(size)))
+            return total;
+        if (pread(fd, mem, size, 10) != (ssize_t)size) {
+            free(mem);
+            return total;
+        }
+        s.mem = mem;
+        s.len = unsync(mem, size);
+        off = 0;
+        end = s.len;
+    }
+
+    /* Skip the extended header */
+    if (major >= 3 && (flags & 0x40)) {
+        uint8_t x[4];
+        if (src_read(&s, off, x, 4) == 0)
+            off += major == 4 ? syncsafe32(x) : be32(x) + 4;
+    }
+
+    id3v2_frames(&s, off, end, major, info);
+    free(mem);
+    return total;
+}
+
+/* ------------------------------------------------------- */
+/*                         ID3v1                           */
+/* ------------------------------------------------------- */
+
+static void v1_field(const uint8_t *p, size_t n, char *out, size_t cap)
+{
+    size_t len = 0;
+    while (len < n && p[len])
+        len++;
+    decode_text(0, p, len, out, cap);
+}
+
+/* Returns 1 if the file ends in an ID3v1 tag; fills fields v2 left empty */
+static int id3v1_read(int fd, off_t size, struct mp3_info *info)
+{
+    uint8_t t[128];
+    char text[MP3INFO_TEXT];
+
+    if (size < 128 || pread(fd, t, 128, size - 128) != 128 ||
+        memcmp(t, "TAG", 3) != 0)
+        return 0;
+
+    info->flags |= MP3INFO_ID3V1;
+
+    if (!info->title[0])
+        v1_field(t + 3, 30, info->title, sizeof(info->title));
+    if (!info->artist[0])
+        v1_field(t + 33, 30, info->artist, sizeof(info->artist));
+    if (!info->album[0])
+        v1_field(t + 63, 30, info->album, sizeof(info->album));
+    if (!info->year) {
+        v1_field(t + 93, 4, text, sizeof(text));
+        info->year = (unsigned)atoi(text);
+    }
+    if (!info->track_no && t[125] == 0 && t[126] != 0)
+        info->track_no = t[126];            /* ID3v1.1 */
+
+    return 1;
+}
+
+/* ------------------------------------------------------- */
+/*                    MPEG FRAME HEADERS                   */
+/* ------------------------------------------------------- */
+
+struct mpeg_hdr {
+    int      version;       /* 1, 2, or 25 for MPEG 2.5 */
+    int      layer;         /* 1..3                     */
+    unsigned bitrate;       /* kbit/s                   */
+    unsigned sample_rate;
+    unsigned channels;
+    unsigned samples;       /* Per frame                */
+    unsigned length;        /* Bytes, including header  */
+};
+
+static const unsigned short bitrates[2][3][15] = {
+    {   /* MPEG 1 */
+        { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+        { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+    },
+    {   /* MPEG 2 and 2.5 */
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+    },
+};
+
+static const unsigned sample_rates[3][3] = {
+    { 44100, 48000, 32000 },    /* MPEG 1   */
+    { 22050, 24000, 16000 },    /* MPEG 2   */
+    { 11025, 12000, 8000 },     /* MPEG 2.5 */
+};
+
+/* Decode a 4-byte frame header; returns 0 if it is a plausible one */
+static int mpeg_parse(const uint8_t *p, struct mpeg_hdr *h)
+{
+    if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0)
+        return -1;
+
+    int ver   = (p[1] >> 3) & 3;    /* 0 = 2.5, 1 = reserved, 2 = 2, 3 = 1 */
+    int layer = (p[1] >> 1) & 3;    /* 0 = reserved, 1 = III, 3 = I        */
+    int bri   = p[2] >> 4;
+    int sri   = (p[2] >> 2) & 3;
+    int pad   = (p[2] >> 1) & 1;
+
+    if (ver == 1 || layer == 0 || bri == 0 || bri == 15 || sri == 3)
+        return -1;
+
+    h->version     = ver == 3 ? 1 : ver == 2 ? 2 : 25;
+    h->layer       = 4 - layer;
+    h->bitrate     = bitrates[h->version != 1][h->layer - 1][bri];
+    h->sample_rate = sample_rates[ver == 3 ? 0 : ver == 2 ? 1 : 2][sri];
+    h->channels    = (p[3] >> 6) == 3 ? 1 : 2;
+
+    if (h->layer == 1) {
+        h->samples = 384;
+        h->length  = (12 * h->bitrate * 1000 / h->sample_rate + pad) * 4;
+    } else if (h->layer == 2 || h->version == 1) {
+        h->samples = 1152;
+        h->length  = 144 * h->bitrate * 1000 / h->sample_rate + pad;
+    } else {
+        h->samples = 576;
+        h->length  = 72 * h->bitrate * 1000 / h->sample_rate + pad;
+    }
+    return h->length >= 4 ? 0 : -1;
+}
+
+/*
+ * Xing/Info or VBRI header inside the first frame: returns 1 if there is
+ * one, with its frame and byte counts (0 when absent), and stores the
+ * encoder delay and padding of a LAME tag following a Xing header.
+ */
+static int vbr_header(const uint8_t *f, size_t avail, const struct mpeg_hdr *h,
+                      uint32_t *frames, uint32_t *bytes, struct mp3_info *info)
+{
+    /* Xing sits after the side information */
+    size_t side = h->version == 1 ? (h->channels == 1 ? 17 : 32)
+                                  : (h->channels == 1 ? 9 : 17);
+    size_t x = 4 + side;
+
+    *frames = *bytes = 0;
+
+    if (x + 16 <= avail && (!memcmp(f + x, "Xing", 4) || !memcmp(f + x, "Info", 4))) {
+        uint32_t fl = be32(f + x + 4);
+        size_t o = x + 8;
+
+        if (fl & 1) {
+            *frames = be32(f + o);
+            o += 4;
+        }
+        if (fl & 2) {
+            if (o + 4 <= avail)
+                *bytes = be32(f + o);
+            o += 4;
+        }
+        o += (fl & 4 ? 100 : 0) + (fl & 8 ? 4 : 0);     /* TOC, quality */
+
+        /* LAME tag (FFmpeg writes one too): 12-bit delay and padding at 21 */
+        if (o + 24 <= avail && (!memcmp(f + o, "LAME", 4) ||
+                                !memcmp(f + o, "Lavf", 4) || !memcmp(f + o, "Lavc", 4))) {
+            info->enc_delay   = (unsigned)f[o + 21] << 4 | f[o + 22] >> 4;
+            info->enc_padding = (unsigned)(f[o + 22] & 0x0f) << 8 | f[o + 23];
+            info->flags      |= MP3INFO_GAPLESS;
+        }
+        return 1;
+    }
+
+    /* VBRI (Fraunhofer) is always 32 bytes after the header */
+    if (36 + 18 <= avail && !memcmp(f + 36, "VBRI", 4)) {
+        *bytes  = be32(f + 36 + 10);
+        *frames = be32(f + 36 + 14);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Whether the frames that follow the first one in buf change bitrate */
+static int varies(const uint8_t *buf, size_t len, size_t i, const struct mpeg_hdr *first)
+{
+    struct mpeg_hdr h;
+
+    for (i += first->length; i + 4 <= len && mpeg_parse(buf + i, &h) == 0; i += h.length)
+        if (h.bitrate != first->bitrate)
+            return 1;
+    return 0;
+}
+
+uint32_t mp3info_duration_ms(const struct mp3_info *info, uint32_t frames)
+{
+    uint64_t samples = (uint64_t)frames * info->samples_per_frame;
+    uint64_t trim = info->enc_delay + info->enc_padding;
+
+    if (!info->sample_rate)
+        return 0;
+    samples = samples > trim ? samples - trim : 0;
+    return (uint32_t)(samples * 1000 / info->sample_rate);
+}
+
+int mp3info_read(int fd, off_t size, struct mp3_info *info)
+{
+    memset(info, 0, sizeof(*info));
+
+    size_t start = id3v2_read(fd, size, info);
+    off_t  end   = size - (id3v1_read(fd, size, info) ? 128 : 0);
+
+    if ((off_t)start >= end)
+        return -1;
+
+    uint8_t *buf = malloc(SYNC_SEARCH);
+    if (!buf)
+        return -1;
+
+    ssize_t n = pread(fd, buf, SYNC_SEARCH, (off_t)start);
+    int rc = -1;
+
+    /* First header whose successor is also a header of the same stream */
+    for (ssize_t i = 0; n > 0 && i + 4 <= n; i++) {
+        struct mpeg_hdr h, h2;
+
+        if (buf[i] != 0xff || mpeg_parse(buf + i, &h) < 0)
+            continue;
+
+        size_t next = (size_t)i + h.length;
+        if (next + 4 <= (size_t)n) {
+            if (mpeg_parse(buf + next, &h2) < 0 || h2.version != h.version ||
+                h2.layer != h.layer || h2.sample_rate != h.sample_rate)
+                continue;
+        } else if ((off_t)(start + next) < end) {
+            continue;       /* Cannot confirm it within the buffer */
+        }
+
+        uint32_t frames, vbytes;
+        int has_vbr = vbr_header(buf + i, (size_t)(n - i), &h, &frames, &vbytes, info);
+
+        info->audio_offset      = (uint32_t)(start + (size_t)i);
+        info->audio_bytes       = (uint32_t)(end - (off_t)info->audio_offset);
+        info->data_offset       = info->audio_offset + (has_vbr ? h.length : 0);
+        info->sample_rate       = h.sample_rate;
+        info->channels          = h.channels;
+        info->samples_per_frame = h.samples;
+        info->bitrate           = h.bitrate;
+
+        /* VBR without a header to say so: only counting gives the length */
+        if (!has_vbr && varies(buf, (size_t)n, (size_t)i, &h)) {
+            long counted = mp3info_frames(fd, info, 0, NULL, NULL);
+            if (counted > 0)
+                frames = (uint32_t)counted;
+            vbytes = info->audio_bytes;
+        }
+
+        if (frames) {
+            uint64_t ms = (uint64_t)frames * h.samples * 1000 / h.sample_rate;
+            info->flags      |= MP3INFO_VBR;
+            info->frames      = frames;
+            info->duration_ms = mp3info_duration_ms(info, frames);
+            if (!vbytes)
+                vbytes = info->audio_bytes;
+            if (ms)
+                info->bitrate = (unsigned)((uint64_t)vbytes * 8 / ms);
+        } else {
+            info->duration_ms = (uint32_t)((uint64_t)info->audio_bytes * 8 / h.bitrate);
+        }
+
+        rc = 0;
+        break;
+    }
+
+    free(buf);
+    return rc;
+}
+
+/* ------------------------------------------------------- */
+/*                      FRAME WALK                         */
+/* ------------------------------------------------------- */
+
+/* A frame of the stream info describes, not just any header */
+static int same_stream(const uint8_t *p, const struct mp3_info *info, struct mpeg_hdr *h)
+{
+    return mpeg_parse(p, h) == 0 && h->sample_rate == info->sample_rate &&
+           h->samples == info->samples_per_frame;
+}
+
+long mp3info_frames_until(int fd, const struct mp3_info *info, unsigned step,
+                          uint32_t **offsets, unsigned *n,
+                          int (*stop)(void *arg), void *arg)
+{
+    uint64_t end = (uint64_t)info->audio_offset + info->audio_bytes;
+    uint64_t pos = info->data_offset, base = 0;
+    uint8_t *buf = malloc(SYNC_SEARCH);
+    uint32_t *offs = NULL;
+    unsigned cnt = 0, cap = 0;
+    size_t len = 0;
+    long frames = 0;
+
+    if (!buf)
+        return -1;
+
+    while (pos + 4 <= end) {
+        struct mpeg_hdr h;
+
+        /* Refill with room for a resync ahead, unless the file ends first */
+        if (pos < base || pos + 4 > base + len ||
+            (pos + RESYNC_SEARCH + 4 > base + len && base + len < end)) {
+            ssize_t r;
+
+            if (stop && stop(arg)) {
+                frames = -1;
+                break;
+            }
+            r = pread(fd, buf, SYNC_SEARCH, (off_t)pos);
+            if (r < 4) {
+                if (r < 0)
+                    frames = -1;
+                break;
+            }
+            base = pos;
+            len  = (size_t)r;
+        }
+
+        if (!same_stream(buf + (pos - base), info, &h)) {
+            /* Damaged stream: go on from the next header followed by another */
+            size_t i = (size_t)(pos - base) + 1;
+            struct mpeg_hdr h2;
+
+            for (; i + 4 <= len && i < (size_t)(pos - base) + RESYNC_SEARCH; i++)
+                if (same_stream(buf + i, info, &h) &&
+                    (i + h.length + 4 > len || same_stream(buf + i + h.length, info, &h2)))
+                    break;
+            if (i + 4 > len || i >= (size_t)(pos - base) + RESYNC_SEARCH)
+                break;
+            pos = base + i;
+        }
+
+        if (step && frames % step == 0) {
+            if (cnt == cap) {
+                uint32_t *o = realloc(offs, (cap ? cap * 2 : 256) * sizeof(*o));
+                if (!o) {
+                    frames = -1;
+                    break;
+                }
+                offs = o;
+                cap  = cap ? cap * 2 : 256;
+            }
+            offs[cnt++] = (uint32_t)pos;
+        }
+
+        frames++;
+        pos += h.length;
+    }
+
+    free(buf);
+    if (frames < 0 || !step) {
+        free(offs);
+        offs = NULL;
+        cnt = 0;
+    }
+    if (offsets) {
+        *offsets = offs;
+        *n = cnt;
+    }
+    return frames;
+}
+
+long mp3info_frames(int fd, const struct mp3_info *info, unsigned step,
+                    uint32_t **offsets, unsigned *n)
+{
+    return mp3info_frames_until(fd, info, step, offsets, n, NULL, NULL);
+}
@@ -0,0 +1,78 @@
+/*
+ * mp3info.h
+ *
+ * Metadata of one MP3 file: ID3v2.2/2.3/2.4 and ID3v1 tags, and the stream
+ * parameters of its first MPEG audio frame, including the frame count from
+ * a Xing/Info or VBRI header when the encoder wrote one and the encoder
+ * delay and padding from a LAME tag.
+ *
+ * Only the bytes that are needed are read: ID3v2 frames other than the few
+ * text frames used here (cover art in particular) are skipped by offset.
+ * The exception is a VBR stream without a VBR header, whose frames have to
+ * be counted for its duration; mp3info_frames() does that for any stream.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef MP3INFO_H
+#define MP3INFO_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define MP3INFO_TEXT 128            /* Bytes per text field, UTF-8        */
+
+#define MP3INFO_ID3V1   0x01
+#define MP3INFO_ID3V2   0x02
+#define MP3INFO_VBR     0x04        /* VBR header, or frames counted      */
+#define MP3INFO_GAPLESS 0x08        /* LAME tag: delay and padding known  */
+
+struct mp3_info {
+    char     title[MP3INFO_TEXT];   /* "" when the file has no such tag   */
+    char     artist[MP3INFO_TEXT];
+    char     album[MP3INFO_TEXT];
+    unsigned track_no;
+    unsigned year;
+
+    uint32_t audio_offset;          /* First MPEG frame                   */
+    uint32_t audio_bytes;           /* Up to the ID3v1 tag, if any        */
+    uint32_t data_offset;           /* First audio frame, past a Xing one */
+    uint32_t frames;                /* Audio frames, 0 if not known       */
+    uint32_t duration_ms;           /* Exact if frames is known, else CBR */
+    unsigned enc_delay;             /* Samples the decoder trims off the  */
+    unsigned enc_padding;           /*  start and end (MP3INFO_GAPLESS)   */
+    unsigned bitrate;               /* kbit/s, average for VBR            */
+    unsigned sample_rate;
+    unsigned channels;
+    unsigned samples_per_frame;
+    unsigned flags;                 /* MP3INFO_*                          */
+};
+
+/*
+ * Parse the open file fd of the given size.  Returns 0 when an MPEG audio
+ * stream was found, -1 otherwise (tags may still have been filled in).
+ */
+int mp3info_read(int fd, off_t size, struct mp3_info *info);
+
+/*
+ * Walk every frame header of the stream mp3info_read() found in fd; a
+ * Xing/VBRI frame is not audio and not counted.  Returns the number of
+ * audio frames, or -1 if the file could not be read.  If step is not 0,
+ * *offsets is set to a malloc()ed array of the file offsets of frames 0,
+ * step, 2 * step..., *n entries long.  Reads the whole stream.
+ */
+long mp3info_frames(int fd, const struct mp3_info *info, unsigned step,
+                    uint32_t **offsets, unsigned *n);
+
+/*
+ * mp3info_frames(), asking stop(arg) before each read: if it returns
+ * non-zero the walk is abandoned and -1 returned, as for a read error.
+ */
+long mp3info_frames_until(int fd, const struct mp3_info *info, unsigned step,
+                          uint32_t **offsets, unsigned *n,
+                          int (*stop)(void *arg), void *arg);
+
+/* Playing time of frames audio frames, less the encoder delay and padding */
+uint32_t mp3info_duration_ms(const struct mp3_info *info, uint32_t frames);
+
+#endif /* MP3INFO_H */
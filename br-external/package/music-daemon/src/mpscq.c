@@ -0,0 +1,131 @@
+/*
+ * mpscq.c
+ *
+ * Bounded MPSC message queue (see mpscq.h).
+ *
+ * Cell i starts with sequence number i.  A producer that finds
+ * seq == pos owns the cell once its CAS on enqueue_pos succeeds; it copies
+ * the message and stores seq = pos + 1.  The consumer takes the cell when
+ * seq == pos + 1 and hands it back for the next lap with
+ * seq = pos + nslots.  seq < pos means the queue is full.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "mpscq.h"
+
+struct cell {
+    _Atomic size_t seq;
+    unsigned char  data[];
+};
+
+static struct cell *cell_at(struct mpscq *q, size_t pos)
+{
+    return (struct cell *)(q->cells + (pos & q->mask) * q->cell_bytes);
+}
+
+int mpscq_init(struct mpscq *q, size_t nslots, size_t elem_bytes)
+{
+    size_t n = 1;
+
+    while (n < nslots)
+        n <<= 1;
+
+    q->elem_bytes = elem_bytes;
+    q->cell_bytes = (sizeof(struct cell) + elem_bytes + 7) & ~(size_t)7;
+    q->mask       = n - 1;
+    q->dequeue_pos = 0;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dropped, 0);
+
+    q->cells = aligned_alloc(MPSCQ_CACHELINE,
+                             (q->cell_bytes * n + MPSCQ_CACHELINE - 1) &
+                             ~(size_t)(MPSCQ_CACHELINE - 1));
+    if (!q->cells) {
+        perror("mpscq: alloc");
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++)
+        atomic_init(&cell_at(q, i)->seq, i);
+
+    q->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (q->efd < 0) {
+        perror("mpscq: eventfd");
+        return -1;
+    }
+    return 0;
+}
+
+void mpscq_destroy(struct mpscq *q)
+{
+    free(q->cells);
+    q->cells = NULL;
+    if (q->efd >= 0)
+        close(q->efd);
+    q->efd = -1;
+}
+
+int mpscq_push(struct mpscq *q, const void *msg)
+{
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    struct cell *c;
+
+    for (;;) {
+        c = cell_at(q, pos);
+        size_t   seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            atomic_fetch_add_explicit(&q->dropped, 1, memory_order_relaxed);
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    memcpy(c->data, msg, q->elem_bytes);
+    atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+
+    (void)eventfd_write(q->efd, 1);
+    return 0;
+}
+
+int mpscq_pop(struct mpscq *q, void *msg)
+{
+    size_t pos = q->dequeue_pos;
+    struct cell *c = cell_at(q, pos);
+
+    if (atomic_load_explicit(&c->seq, memory_order_acquire) != pos + 1)
+        return 0;
+
+    memcpy(msg, c->data, q->elem_bytes);
+    atomic_store_explicit(&c->seq, pos + q->mask + 1, memory_order_release);
+    q->dequeue_pos = pos + 1;
+    return 1;
+}
+
+int mpscq_fd(const struct mpscq *q)
+{
+    return q->efd;
+}
+
+void mpscq_clear_fd(struct mpscq *q)
+{
+    eventfd_t v;
+    (void)eventfd_read(q->efd, &v);
+}
@@ -0,0 +1,49 @@
+/*
+ * mpscq.h
+ *
+ * Bounded lock-free multi-producer / single-consumer queue of fixed-size
+ * messages, used for typed commands between the daemon's threads.
+ *
+ * Producers claim a cell with one compare-and-swap and publish it through
+ * the cell's sequence number (Vyukov's bounded queue); the single consumer
+ * needs no atomic read-modify-write at all.  Every push also bumps an
+ * eventfd, so the consumer can sleep in poll() next to its other fds.
+ * A full queue rejects the message instead of blocking the producer.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef MPSCQ_H
+#define MPSCQ_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define MPSCQ_CACHELINE 64
+
+struct mpscq {
+    _Alignas(MPSCQ_CACHELINE) _Atomic size_t enqueue_pos;  /* Producers */
+    _Alignas(MPSCQ_CACHELINE) size_t         dequeue_pos;  /* Consumer  */
+    _Alignas(MPSCQ_CACHELINE) _Atomic unsigned long dropped; /* Full    */
+    unsigned char *cells;
+    size_t         cell_bytes;
+    size_t         elem_bytes;
+    size_t         mask;                    /* Slots - 1, power of two  */
+    int            efd;                     /* Readable while non-empty */
+};
+
+/* nslots is rounded up to a power of two. Returns 0 on success. */
+int  mpscq_init(struct mpscq *q, size_t nslots, size_t elem_bytes);
+void mpscq_destroy(struct mpscq *q);
+
+/* Any thread: copy msg in. Returns 0, or -1 if the queue is full. */
+int  mpscq_push(struct mpscq *q, const void *msg);
+
+/* Consumer only: copy the oldest message out. Returns 1, or 0 if empty. */
+int  mpscq_pop(struct mpscq *q, void *msg);
+
+/* Consumer: fd to poll for POLLIN, and reset it before draining */
+int  mpscq_fd(const struct mpscq *q);
+void mpscq_clear_fd(struct mpscq *q);
+
+#endif /* MPSCQ_H */
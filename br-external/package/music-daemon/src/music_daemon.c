@@ -9,66 +9,88 @@
  *   - HDMI text-based UI on TTY1
  *   - HTTP remote control interface on port 8888
  *
+ * Threads:
+ *   - input   : reads /dev/music_input, debounces, posts commands
+ *   - network : accepts HTTP clients, answers them, posts commands
+ *   - control : main thread; sole owner of the playback state machine,
+ *               also drives the player, the download scheduler and child
+ *               supervision (pidfds polled next to its other fds)
+ *   - UI      : redraws the HDMI status screen
+ * Commands travel through lock-free MPSC queues (mpscq.h), so a slow
+ * client or a slow redraw never holds up button handling or playback.
+ *
  * Build/Author information for demo/debug:
  *   - FINAL STABLE VERSION – DEC 2
  *   - AUTHOR : PRUDHVI RAJ BELIDE
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <math.h>
 #include <poll.h>
 #include <time.h>
 #include <signal.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <pthread.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include "analyzer.h"
+#include "browse.h"
+#include "config.h"
+#include "decoder.h"
+#include "dlsched.h"
+#include "introcache.h"
+#include "library.h"
+#include "libwatch.h"
+#include "mix.h"
+#include "mpscq.h"
+#include "output.h"
+#include "pcm.h"
+#include "player.h"
+#include "prefetch.h"
+#include "proc.h"
+#include "queue.h"
+#include "rt.h"
+#include "screen.h"
+#include "search.h"
+#include "state.h"
+#include "timer.h"
+#include "visual.h"
+#include "waveform.h"
+
 /* ------------------------------------------------------- */
 /*                        CONSTANTS                        */
 /* ------------------------------------------------------- */
 
 #define INPUT_DEV      "/dev/music_input"   /* Character device for physical button input */
 #define MUSIC_DIR      "/usr/share/music"   /* Base directory for local MP3 files        */
-#define NUM_SONGS      5                    /* Number of local songs in the playlist     */
 #define PORT           8888                 /* HTTP control port for remote interface    */
-
-/* ------------------------------------------------------- */
-/*                   LOCAL SONG LIST                       */
-/* ------------------------------------------------------- */
-
-/* Absolute paths to local MP3 files stored on the Pi */
-static const char *playlist[] = {
-    MUSIC_DIR "/RunitUp.mp3",
-    MUSIC_DIR "/BeatIt.mp3",
-    MUSIC_DIR "/ShapeofYou.mp3",
-    MUSIC_DIR "/Gasolina.mp3",
-    MUSIC_DIR "/RapGod.mp3"
-};
-
-/* User-friendly local song titles */
-static const char *local_title[] = {
-    "Run-it-Up",
-    "Beat-it",
-    "Shape-of-You",
-    "Gasolina",
-    "Rap-God",
-};
-
-/* Local artist names matching the titles above */
-static const char *local_artist[] = {
-    "Hanumand Kind",
-    "Michael Jackson",
-    "Ed Sheeran",
-    "Yankee",
-    "Eminem",
-};
-
+#define CACHE_DIR      "/var/cache/music"   /* Downloaded cloud tracks                   */
+#define LIBRARY_INDEX  CACHE_DIR "/library.idx" /* Scanned local library (library.h)     */
+#define VISUAL_ROW     27                       /* Visualizer, below the status screen  */
+#define NUM_CLOUD      5                    /* Number of cloud tracks                    */
+#define DEBOUNCE_MS    200                  /* Minimum spacing of button events          */
+#define CONTROL_Q_SIZE 64                   /* Pending commands for the control thread   */
+#define UI_Q_SIZE      16                   /* Pending redraws for the UI thread         */
+#define UI_FRAME_MS    20                   /* Console frames at most this often         */
+#define SEEK_RUNUP     2                    /* Frames decoded before a seek target        */
+#define ANALYSIS_BATCH 32                   /* Analyzed tracks per library commit         */
+#define ANALYSIS_MS    120000               /* ... or this long after the first of them   */
+#define RESCAN_MS      15000                /* Startup: check files changed while down    */
+#define KILLALL_PATH   "/usr/bin/killall"
+#define AMIXER_PATH    "/usr/bin/amixer"
 
 /* ------------------------------------------------------- */
 /*                   CLOUD SONG LIST                       */
@@ -101,11 +123,150 @@ static const char *cloud_artist[] = {
     "The Kid LAROI & Justin Bieber"
 };
 
+/* Cache location of a cloud track: CACHE_DIR/<basename of URL> */
+static void cloud_cache_path(int idx, char *buf, size_t len)
+{
+    const char *url = cloud_url[idx % NUM_CLOUD];
+    const char *base = strrchr(url, '/');
+    snprintf(buf, len, "%s/%s", CACHE_DIR, base ? base + 1 : url);
+}
+
+/* ------------------------------------------------------- */
+/*                 COMMANDS BETWEEN THREADS                */
+/* ------------------------------------------------------- */
+
+enum cmd_type {
+    CMD_PLAYPAUSE,
+    CMD_NEXT,
+    CMD_PREV,
+    CMD_VOL_UP,
+    CMD_VOL_DOWN,
+    CMD_MUTE,
+    CMD_MODE,
+    CMD_LOCAL,                  /* arg: local track index      */
+    CMD_CROSSFADE,              /* arg: overlap in ms          */
+    CMD_QUEUE_ADD,              /* arg: track, arg2: at front  */
+    CMD_QUEUE_REMOVE,           /* arg: queue entry            */
+    CMD_QUEUE_MOVE,             /* arg: entry, arg2: before it */
+    CMD_QUEUE_CLEAR,
+    CMD_SHUFFLE,                /* arg: 0/1, -1 = toggle       */
+    CMD_SEEK,                   /* arg: ms into the track      */
+    CMD_INDEXED,                /* Seek tables measured        */
+    CMD_ANALYZED,               /* Tracks analyzed             */
+    CMD_LIBRARY,                /* Library changes read        */
+};
+
+enum cmd_source { SRC_INPUT, SRC_HTTP, SRC_COUNT };
+
+/* Input and network threads -> control thread */
+struct cmd {
+    int      type;
+    int      arg;
+    int      arg2;
+    int      source;
+    uint64_t posted_ns;         /* Queue + handling latency    */
+};
+
+/* Control thread -> UI thread: redraw, the state itself is in state.h */
+struct ui_msg {
+    uint64_t version;           /* Snapshot that triggered it  */
+    uint64_t posted_ns;
+};
+
+static struct mpscq control_q;
+static struct mpscq ui_q;
+
+/*
+ * Control thread timers.  Services run on every loop pass, so the timers
+ * that bound a service's sleep have nothing left to do when they fire.
+ */
+static void timer_wakeup(void *arg) { (void)arg; }
+
+static struct timer debounce_timer = TIMER_INIT(timer_wakeup, NULL);
+static struct timer dlsched_timer  = TIMER_INIT(timer_wakeup, NULL);
+static struct timer proc_timer     = TIMER_INIT(timer_wakeup, NULL);
+
+static void commit_analysis(void *arg);
+static struct timer analysis_timer = TIMER_INIT(commit_analysis, NULL);
+static unsigned analysis_pending;      /* Analyzed tracks not yet committed */
+
+static void startup_rescan(void *arg) { (void)arg; libwatch_rescan(); }
+static struct timer rescan_timer   = TIMER_INIT(startup_rescan, NULL);
+
+/* Latency per subsystem; each is written by one thread only */
+struct lat_stat {
+    _Atomic unsigned long count;
+    _Atomic uint64_t      sum_ns;
+    _Atomic uint64_t      max_ns;
+};
+
+static struct lat_stat cmd_lat[SRC_COUNT];  /* Posted -> handled by control */
+static struct lat_stat ui_lat;              /* Posted -> drawn by UI        */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* CPU time of the calling thread */
+static uint64_t thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void lat_record(struct lat_stat *l, uint64_t since_ns)
+{
+    uint64_t d = now_ns() - since_ns;
+
+    atomic_store_explicit(&l->sum_ns,
+                          atomic_load_explicit(&l->sum_ns, memory_order_relaxed) + d,
+                          memory_order_relaxed);
+    if (d > atomic_load_explicit(&l->max_ns, memory_order_relaxed))
+        atomic_store_explicit(&l->max_ns, d, memory_order_relaxed);
+    atomic_store_explicit(&l->count,
+                          atomic_load_explicit(&l->count, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+/* "avg/max" in microseconds */
+static void lat_format(const struct lat_stat *l, char *buf, size_t len)
+{
+    unsigned long n = atomic_load_explicit(&l->count, memory_order_acquire);
+    uint64_t sum = atomic_load_explicit(&l->sum_ns, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&l->max_ns, memory_order_relaxed);
+
+    snprintf(buf, len, "%llu/%llu",
+             n ? (unsigned long long)(sum / n / 1000) : 0ULL,
+             (unsigned long long)(max / 1000));
+}
+
+/* Any thread: hand a command with two arguments to the control thread */
+static void post_cmd2(int type, int arg, int arg2, int source)
+{
+    struct cmd c = {
+        .type = type, .arg = arg, .arg2 = arg2, .source = source,
+        .posted_ns = now_ns(),
+    };
+
+    if (mpscq_push(&control_q, &c) < 0)
+        fprintf(stderr, "control queue full, command %d dropped\n", type);
+}
+
+/* Any thread: hand a command to the control thread */
+static void post_cmd(int type, int arg, int source)
+{
+    post_cmd2(type, arg, 0, source);
+}
+
 /* ------------------------------------------------------- */
 /*                   RUNTIME STATE                         */
 /* ------------------------------------------------------- */
 
-/* Global state variables controlling playback and UI */
+/* Playback state, owned by the control thread */
 static int running = 1;                /* Main loop flag */
 static int current_song = 0;           /* Index into local/cloud playlist */
 static int current_volume = 75;        /* Volume percentage (0–100) */
@@ -116,107 +277,311 @@ static int is_playing = 0;             /* 1 = playback active, 0 = stopped */
 static int is_muted = 0;               /* Logical mute state flag */
 static int is_cloud = 0;               /* 0 = Local mode, 1 = Cloud streaming mode */
 
-static pid_t mpg_pid = -1;             /* Child process running mpg123 */
-static FILE *display_fp = NULL;        /* Output stream for HDMI text UI (TTY1 or stdout) */
+static unsigned play_gen = 0;          /* Bumped whenever playback is replaced */
+static int next_armed = 0;             /* Player holds a pre-opened next track */
+static unsigned long seen_completions; /* Cache completions seen by arm_next() */
+static int crossfade_ms = 0;           /* Track overlap, 0 = gapless */
+static int softvol = 1;                /* Volume/mute in the PCM path, not amixer */
+static int normalize = 1;              /* Play tracks at loudness_target */
+static int loudness_target = -1800;    /* 1/100 LUFS */
+static int trim_lead = 1;              /* Start tracks at their first audible sample */
+static int trim_trail = 1;             /* End them after their last one */
+static unsigned long analyzed_completions; /* Cache completions sent to the analyzer */
+static int display_fd = -1;            /* HDMI text UI: TTY1, or stdout */
+static struct screen display;          /* What the UI thread shows on it */
+static struct visual_config visual_cfg; /* Spectrum and meters below the status */
+static _Atomic unsigned long ui_frames, ui_bytes;   /* Console writes, for /stats */
 
 static int volume_before_mute = 75;    /* Volume snapshot saved when mute is enabled */
-static unsigned long last_event_ms = 0;/* Timestamp used for button debounce (ms) */
+
+/*
+ * Play order.  Queued tracks go first; the playlist then carries on from
+ * list_song, the last track that came from it, in path or shuffle order.
+ */
+static int shuffle = 0;                /* 1 = local playlist in shuffle order */
+static int list_song = 0;              /* Playlist position Next/Prev go from */
+static uint64_t shuffle_epoch;         /* Shuffle cycle list_song belongs to */
+
+struct upcoming {
+    int      track;
+    uint32_t entry;                    /* Queue entry, QUEUE_NONE: playlist */
+    uint64_t epoch;                    /* Shuffle cycle of a playlist track */
+};
+
+static struct upcoming armed;          /* What the pre-opened next track is */
 
 /* ------------------------------------------------------- */
 /*             TEXT DISPLAY ON HDMI (TTY1)                 */
 /* ------------------------------------------------------- */
 
-/* Lazily open TTY1 for display output; fallback to stdout if unavailable */
+/*
+ * UI thread: open TTY1 for display output; fallback to stdout if
+ * unavailable.  TTY1 is non-blocking: a console that stops taking output
+ * (scroll lock, a stuck framebuffer) costs frames, never the UI thread.
+ */
 static void init_display(void)
 {
-    if (!display_fp) {
-        display_fp = fopen("/dev/tty1", "w");
-        if (!display_fp)
-            display_fp = stdout;
-    }
+    display_fd = open("/dev/tty1", O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (display_fd < 0)
+        display_fd = STDOUT_FILENO;
+    screen_init(&display, display_fd);
 }
 
-/* Return the current song title based on mode and index */
-static const char *get_title(void)
+/* Return the song title based on mode and index */
+static const char *get_title(const struct lib_view *lib, const struct daemon_state *m)
 {
-    return is_cloud ? cloud_title[current_song % 5]
-                    : local_title[current_song];
+    return m->cloud ? cloud_title[m->song % NUM_CLOUD]
+                    : lib_title(lib, (unsigned)m->song);
 }
 
 /* Human-readable playback mode string */
-static const char *mode_text(void)
+static const char *mode_text(const struct daemon_state *m)
 {
-    return is_cloud ? "Cloud Mode" : "Local Mode";
+    return m->cloud ? "Cloud Mode" : "Local Mode";
 }
 
 /* Human-readable playback status string */
-static const char *status_text(void)
+static const char *status_text(const struct daemon_state *m)
 {
-    return (mpg_pid > 0) ? "Playing" : "Stopped";
+    return m->playing ? "Playing" : "Stopped";
 }
 
-/* Clear and redraw the HDMI status UI with optional extra status text */
+/* UI thread: draw the HDMI status screen into a frame */
+static void render_status(struct screen *scr, const struct daemon_state *m)
+{
+    const char *extra = m->message[0] ? m->message : NULL;
+    const struct lib_view *lib = library_acquire();
+
+    screen_puts(scr, 0, 0, "=============================================");
+    screen_puts(scr, 1, 0, "         RASPBERRY PI MUSIC PLAYER");
+    screen_puts(scr, 2, 0, "=============================================");
+
+    screen_printf(scr, 4, 0, "  SONG      : %s", get_title(lib, m));
+    screen_printf(scr, 5, 0, "  NUMBER    : %d / %u", m->song + 1,
+                  m->cloud ? NUM_CLOUD : lib_live(lib));
+    screen_printf(scr, 6, 0, "  MODE      : %s", mode_text(m));
+    screen_printf(scr, 7, 0, "  STATUS    : %s", extra ? extra : status_text(m));
+    screen_printf(scr, 8, 0, "  VOLUME    : %d%%%s", m->volume,
+                  (softvol && m->muted) ? " (muted)" : "");
+
+    if (!m->cloud)
+        screen_printf(scr, 10, 0, "  ARTIST    : %s", lib_artist(lib, (unsigned)m->song));
+    else
+        screen_printf(scr, 10, 0, "  ARTIST    : %s", cloud_artist[m->song % NUM_CLOUD]);
+
+    screen_printf(scr, 12, 0, "  INFO      : %s", extra ? extra : build_tag);
+
+    screen_puts(scr, 14, 0, "---------------------------------------------");
+    screen_puts(scr, 15, 0, "  CONTROLS (PHYSICAL)");
+    screen_puts(scr, 16, 0, "   P = Play/Pause");
+    screen_puts(scr, 17, 0, "   N = Next Song");
+    screen_puts(scr, 18, 0, "   R = Previous Song");
+    screen_puts(scr, 19, 0, "   U = Volume Up");
+    screen_puts(scr, 20, 0, "   D = Volume Down");
+    screen_puts(scr, 21, 0, "   M = Mute Toggle");
+    screen_puts(scr, 22, 0, "   C = Cloud/Local Toggle");
+    screen_puts(scr, 23, 0, "---------------------------------------------");
+
+    screen_printf(scr, 24, 0, "  REMOTE:  http://<pi-ip>:%d", PORT);
+    screen_puts(scr, 25, 0, "---------------------------------------------");
+
+    library_release(lib);
+}
+
+/*
+ * Control thread: publish the current state as a new snapshot, with an
+ * optional status line (NULL keeps the default lines), and return its
+ * version.
+ */
+static uint64_t publish_state(const char *extra)
+{
+    struct daemon_state st = {
+        .song         = current_song,
+        .cloud        = is_cloud,
+        .playing      = is_playing,
+        .volume       = current_volume,
+        .muted        = is_muted,
+        .crossfade_ms = crossfade_ms,
+        .play_gen     = play_gen,
+        .shuffle      = shuffle,
+        .queue_len    = queue_length(),
+    };
+    uint32_t e = queue_head();
+
+    for (int i = 0; i < STATE_QUEUE_SHOWN && e != QUEUE_NONE; i++, e = queue_next(e)) {
+        st.queue[i].entry = e;
+        st.queue[i].track = queue_track(e);
+    }
+
+    if (extra)
+        snprintf(st.message, sizeof(st.message), "%s", extra);
+    state_publish(&st);
+    return state_version();
+}
+
+/* Control thread: publish the state and ask the UI thread to redraw it */
 static void draw_status(const char *extra)
 {
-    init_display();
+    struct ui_msg m = {
+        .version   = publish_state(extra),
+        .posted_ns = now_ns(),
+    };
 
-    fprintf(display_fp, "\033[2J\033[H");  /* Clear screen and move cursor home */
+    (void)mpscq_push(&ui_q, &m);
+}
+
+/*
+ * UI thread: compose one frame from the snapshot, with a visualizer update
+ * if one is due, and send the console what changed since the last one.
+ */
+static void ui_frame(const struct daemon_state *st, int visual)
+{
+    uint64_t cpu = thread_cpu_ns();
+    long n;
 
-    fprintf(display_fp, "=============================================\n");
-    fprintf(display_fp, "         RASPBERRY PI MUSIC PLAYER           \n");
-    fprintf(display_fp, "=============================================\n\n");
+    if (visual)
+        visual_update(st->playing);
 
-    fprintf(display_fp, "  SONG      : %s\n", get_title());
-    fprintf(display_fp, "  NUMBER    : %d / %d\n", current_song + 1, NUM_SONGS);
-    fprintf(display_fp, "  MODE      : %s\n", mode_text());
-    fprintf(display_fp, "  STATUS    : %s\n", extra ? extra : status_text());
-    fprintf(display_fp, "  VOLUME    : %d%%\n\n", current_volume);
+    screen_begin(&display);
+    render_status(&display, st);
+    visual_draw(&display);
+    n = screen_flush(&display);
 
-    if (!is_cloud)
-        fprintf(display_fp, "  ARTIST    : %s\n", local_artist[current_song]);
-    else
-        fprintf(display_fp, "  ARTIST    : %s\n", cloud_artist[current_song % 5]);
+    if (n > 0) {
+        atomic_fetch_add_explicit(&ui_frames, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ui_bytes, (unsigned long)n, memory_order_relaxed);
+    }
+    if (visual)
+        visual_frame_done(thread_cpu_ns() - cpu);
+}
 
-    fprintf(display_fp, "\n  INFO      : %s\n\n", extra ? extra : build_tag);
+/*
+ * UI thread: draws from the newest snapshot only, and no more often than
+ * every UI_FRAME_MS, so a burst of updates (e.g. holding volume up) costs
+ * one frame, and a frame costs the bytes of what changed.  In between it
+ * wakes up for the visualizer frames, if there is a console to draw on.
+ * While the console has not taken the last frame, no new ones are drawn;
+ * the next one is drawn from the state when it has.
+ */
+static void *ui_thread(void *arg)
+{
+    struct pollfd pfd[2] = {
+        { .fd = mpscq_fd(&ui_q), .events = POLLIN },
+        { .fd = -1,              .events = POLLOUT },
+    };
+    uint64_t drawn = 0, posted = 0, last = 0;
+    int timeout = -1;
+
+    (void)arg;
+    pthread_setname_np(pthread_self(), "ui");
+
+    init_display();
+    if (display_fd != STDOUT_FILENO)
+        visual_init(&visual_cfg, VISUAL_ROW);
+
+    for (;;) {
+        struct ui_msg m;
+        struct daemon_state st;
+        uint64_t now;
+        int wait, vis;
+
+        pfd[1].fd = screen_pending(&display) ? display_fd : -1;
+        if (poll(pfd, 2, timeout) < 0)
+            continue;
+
+        /* Oldest request not yet drawn, for the latency figure */
+        mpscq_clear_fd(&ui_q);
+        while (mpscq_pop(&ui_q, &m))
+            if (!posted)
+                posted = m.posted_ns;
+
+        /* Console still busy with the last frame: wait until it is not */
+        if (screen_pending(&display)) {
+            long n = screen_flush(&display);
+            if (n > 0)
+                atomic_fetch_add_explicit(&ui_bytes, (unsigned long)n, memory_order_relaxed);
+            if (screen_pending(&display)) {
+                timeout = -1;
+                continue;
+            }
+        }
 
-    fprintf(display_fp, "---------------------------------------------\n");
-    fprintf(display_fp, "  CONTROLS (PHYSICAL)\n");
-    fprintf(display_fp, "   P = Play/Pause\n");
-    fprintf(display_fp, "   N = Next Song\n");
-    fprintf(display_fp, "   R = Previous Song\n");
-    fprintf(display_fp, "   U = Volume Up\n");
-    fprintf(display_fp, "   D = Volume Down\n");
-    fprintf(display_fp, "   M = Mute Toggle\n");
-    fprintf(display_fp, "   C = Cloud/Local Toggle\n");
-    fprintf(display_fp, "---------------------------------------------\n");
+        state_read(&st);
+        now  = now_ns();
+        wait = now < last + UI_FRAME_MS * 1000000ULL
+             ? (int)((last + UI_FRAME_MS * 1000000ULL - now + 999999) / 1000000) : 0;
+        vis  = visual_due(st.playing);
+
+        if (wait == 0 && (st.version != drawn || vis == 0)) {
+            ui_frame(&st, vis == 0);
+            if (st.version != drawn && posted) {
+                lat_record(&ui_lat, posted);
+                posted = 0;
+            }
+            drawn = st.version;
+            last  = now;
+            wait  = UI_FRAME_MS;
+            vis   = visual_due(st.playing);
+        }
 
-    fprintf(display_fp, "  REMOTE:  http://<pi-ip>:%d\n", PORT);
-    fprintf(display_fp, "---------------------------------------------\n");
+        timeout = st.version != drawn ? wait
+                : vis < 0             ? -1
+                : vis > wait          ? vis : wait;
+    }
 
-    fflush(display_fp);
+    return NULL;
 }
 
 /* ------------------------------------------------------- */
 /*                INTERNAL AUDIO HELPERS                   */
 /* ------------------------------------------------------- */
 
-/* Best-effort kill of any mpg123 processes that might still be running */
+/*
+ * Best-effort kill of mpg123 processes left over from a previous instance.
+ * Startup only: everything this instance starts is supervised by proc.c.
+ */
 static void kill_all_players(void)
 {
-    (void)system("killall -q mpg123 2>/dev/null || true");
+    char *const argv[] = { "killall", "-q", "mpg123", NULL };
+    struct proc_spec spec = { .path = KILLALL_PATH, .argv = argv,
+                              .in_fd = -1, .out_fd = -1 };
+    pid_t pid = proc_spawn(&spec);
+
+    if (pid > 0 && proc_wait(pid, 1000) < 0)
+        proc_terminate(pid);
 }
 
-/* Clamp and apply volume to ALSA via amixer, then update UI */
-static void set_volume(int v)
+/*
+ * Clamp and apply volume.  With the software gain stage this is an
+ * in-process store that the player ramps to; otherwise the hardware 'PCM'
+ * control is set through amixer.
+ */
+static void apply_volume(int v)
 {
     if (v < 0) v = 0;
     if (v > 100) v = 100;
     current_volume = v;
 
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "amixer -c 0 sset 'PCM' %d%% >/dev/null", v);
-    (void)system(cmd);
+    if (softvol) {
+        player_set_volume(v);
+    } else {
+        /* Latest setting wins: a still-running amixer is superseded */
+        static pid_t amixer_pid = -1;
+        char pct[8];
+        char *const argv[] = { "amixer", "-q", "-c", "0", "sset", "PCM", pct, NULL };
+        struct proc_spec spec = { .path = AMIXER_PATH, .argv = argv,
+                                  .in_fd = -1, .out_fd = -1 };
+
+        snprintf(pct, sizeof(pct), "%d%%", v);
+        proc_terminate(amixer_pid);
+        amixer_pid = proc_spawn(&spec);
+    }
+}
 
+/* Apply volume, then update UI */
+static void set_volume(int v)
+{
+    apply_volume(v);
     draw_status("Volume changed");
 }
 
@@ -227,13 +592,21 @@ static void volume_down(void) { set_volume(current_volume - 5); }
 /* Toggle mute while remembering the previous volume level */
 static void toggle_mute(void)
 {
+    /* Software mute ramps the gain; the volume setting itself is kept */
+    if (softvol) {
+        is_muted = !is_muted;
+        player_set_mute(is_muted);
+        draw_status(is_muted ? "Muted" : "Unmuted");
+        return;
+    }
+
     if (!is_muted) {
         volume_before_mute = current_volume;
-        set_volume(0);
+        apply_volume(0);
         is_muted = 1;
         draw_status("Muted");
     } else {
-        set_volume(volume_before_mute);
+        apply_volume(volume_before_mute);
         is_muted = 0;
         draw_status("Unmuted");
     }
@@ -243,215 +616,1501 @@ static void toggle_mute(void)
 /*                    PLAYBACK CONTROL                     */
 /* ------------------------------------------------------- */
 
-/* Stop current playback process (if any) and clean up state */
-static void stop_playback(void)
+/* Number of tracks in the active playlist */
+static int num_tracks(void)
 {
-    if (mpg_pid > 0) {
-        kill(mpg_pid, SIGTERM);
-        waitpid(mpg_pid, NULL, 0);
-        mpg_pid = -1;
-    }
-    kill_all_players();
-    is_playing = 0;
-    draw_status("Stopped");
+    return is_cloud ? NUM_CLOUD : (int)lib_count(library_view());
 }
 
-/* Fork and start mpg123 for either local or cloud audio source */
-static void start_playback(void)
+/* Removed local files keep their slot until the next restart: skip them */
+static int playable(int idx)
 {
-    if (mpg_pid > 0)
-        return;
-
-    kill_all_players();
+    return is_cloud || lib_track(library_view(), (unsigned)idx);
+}
 
-    mpg_pid = fork();
-    if (mpg_pid == 0) {
+/*
+ * Track dir (+1 or -1) steps away from idx in playlist order, wrapping
+ * around.  In shuffle order the wrap moves to the next (or previous)
+ * cycle, whose permutation is a different one; *epoch follows it.
+ */
+static int step_index(int idx, int dir, uint64_t *epoch)
+{
+    unsigned n = (unsigned)num_tracks();
+    unsigned pos;
+
+    if (!shuffle || is_cloud) {
+        for (int k = 1; k < (int)n; k++) {
+            int t = ((idx + dir * k) % (int)n + (int)n) % (int)n;
+            if (playable(t))
+                return t;
+        }
+        return n ? ((idx + dir) % (int)n + (int)n) % (int)n : 0;
+    }
 
-        /* Child process: audio playback only, close inherited FDs */
-        for (int i = 3; i < 256; i++)
-            close(i);
+    pos = shuffle_pos(*epoch, (unsigned)idx, n);
+    for (unsigned k = 0; k < n; k++) {
+        int t;
 
-        (void)freopen("/dev/null", "r", stdin);
+        if (dir > 0 && ++pos == n) {
+            pos = 0;
+            (*epoch)++;
+        } else if (dir < 0 && pos-- == 0) {
+            pos = n - 1;
+            (*epoch)--;
+        }
+        if (playable(t = (int)shuffle_at(*epoch, pos, n)))
+            return t;
+    }
+    return idx;
+}
 
-        if (!is_cloud) {
-            execl("/usr/bin/mpg123", "mpg123", "-q",
-                  playlist[current_song], NULL);
-        } else {
-            draw_status("Downloading from GitHub…");
+/* The track to play after the current one: the queue's head, else the playlist's */
+static struct upcoming upcoming(void)
+{
+    struct upcoming u = { .entry = QUEUE_NONE, .epoch = shuffle_epoch };
 
-            /* Stream MP3 over HTTP using wget and pipe into mpg123 */
-            char cmd[600];
-            snprintf(cmd, sizeof(cmd),
-                     "/usr/bin/wget -qO- \"%s\" | /usr/bin/mpg123 -q -",
-                     cloud_url[current_song % 5]);
+    /* Queued tracks whose file has gone are dropped */
+    while (!is_cloud && (u.entry = queue_head()) != QUEUE_NONE) {
+        if (playable(u.track = queue_track(u.entry)))
+            return u;
+        queue_remove(u.entry);
+    }
 
-            execl("/bin/sh", "sh", "-c", cmd, NULL);
-        }
+    u.entry = QUEUE_NONE;
+    u.track = step_index(list_song, 1, &u.epoch);
+    return u;
+}
 
-        perror("exec failed");
-        _exit(1);
+/* u is now playing: take it off the queue, or move the playlist on */
+static void take_upcoming(const struct upcoming *u)
+{
+    if (u->entry != QUEUE_NONE) {
+        queue_remove(u->entry);
+    } else {
+        list_song = u->track;
+        shuffle_epoch = u->epoch;
     }
+}
 
-    is_playing = 1;
-    draw_status("Playing");
+/* Intro cache key of a local track: its id, changed by a rewrite of the file */
+static uint64_t intro_key(const struct lib_track *t)
+{
+    return t ? t->id ^ (t->size * 0x9e3779b97f4a7c15ULL) ^ (uint64_t)t->mtime : 0;
 }
 
-/* Play/pause toggle used by both buttons and HTTP API */
-static void handle_playpause(void)
+/*
+ * Normalization gain in 1/100 dB for a measured loudness.  Gains are Q15,
+ * so tracks louder than the target are turned down and quieter ones are
+ * left as they are.
+ */
+static int norm_gain(int loudness)
 {
-    if (is_playing)
-        stop_playback();
-    else
-        start_playback();
+    if (!normalize || loudness == LIB_LOUDNESS_NONE || loudness <= loudness_target)
+        return 0;
+    return loudness_target - loudness;
 }
 
-/* Advance to the next track in the list and start playback */
-static void handle_next(void)
+static int track_gain(const struct lib_track *t)
 {
-    stop_playback();
-    current_song = (current_song + 1) % NUM_SONGS;
-    start_playback();
+    return t && (t->flags & LIB_ANALYZED) ? norm_gain(t->loudness) : 0;
 }
 
-/* Go back to the previous track and start playback */
-static void handle_prev(void)
+/*
+ * Have a decoder started at the top of a track skip its leading silence
+ * and stop at its trailing silence, so the player starts sound at once and
+ * moves on to the next track (or starts the crossfade) as soon as the music
+ * ends.  A track that is silent throughout plays as it is.
+ */
+static void trim_silence(struct decoder *d, unsigned lead_ms, unsigned trail_ms,
+                         unsigned length_ms)
 {
-    stop_playback();
-    current_song = (current_song == 0) ? NUM_SONGS - 1 : current_song - 1;
-    start_playback();
+    if (!trim_lead)
+        lead_ms = 0;
+    if (!trim_trail)
+        trail_ms = 0;
+    if (lead_ms + trail_ms >= length_ms)
+        return;
+
+    d->skip     = PCM_MS_TO_FRAMES(lead_ms) * PCM_FRAME_BYTES;
+    d->start_ms = lead_ms;
+    if (trail_ms)
+        d->limit = PCM_MS_TO_FRAMES(length_ms - lead_ms - trail_ms) * PCM_FRAME_BYTES;
 }
 
-/* Toggle between local and cloud mode and keep index in range */
-static void toggle_mode(void)
+/*
+ * Open a decoder for track idx of the current mode.  Local files and cached
+ * cloud tracks decode straight from disk.  Otherwise, if allow_stream is
+ * set, the track is streamed through the download scheduler.
+ */
+static int open_track(struct decoder *d, int idx, int allow_stream)
 {
-    is_cloud = !is_cloud;
+    char cache[256];
+    int feed[2];
+
+    if (!is_cloud) {
+        char path[512];
+        int fd = prefetch_take(idx);
+        int r;
+
+        /* Prefetched: the decoder reads the warm descriptor, no lookup */
+        if (fd >= 0)
+            r = decoder_open(d, NULL, fd, idx, play_gen);
+        else if (lib_path(library_view(), (unsigned)idx, path, sizeof(path)) == 0)
+            r = decoder_open(d, path, -1, idx, play_gen);
+        else
+            return -1;
+
+        const struct lib_track *t = lib_track(library_view(), (unsigned)idx);
+        d->key     = intro_key(t);
+        d->gain_mb = track_gain(t);
+        if (r == 0 && t && (t->flags & LIB_ANALYZED))
+            trim_silence(d, t->lead_ms, t->trail_ms, t->duration_ms);
+        return r;
+    }
 
-    stop_playback();
+    /* Cached cloud tracks play like local files, no network needed */
+    cloud_cache_path(idx, cache, sizeof(cache));
+    if (access(cache, R_OK) == 0) {
+        int r = decoder_open(d, cache, -1, idx, play_gen);
+        struct lib_analysis a;
 
-    if (is_cloud)
-        current_song = current_song % 5;
-    else
-        current_song = current_song % NUM_SONGS;
+        if (r == 0 && analyzer_read_file(cache, &a) == 0) {
+            d->gain_mb = norm_gain(a.loudness);
+            trim_silence(d, a.lead_ms, a.trail_ms, a.length_ms);
+        }
+        return r;
+    }
 
-    start_playback();
+    if (!allow_stream || pipe2(feed, O_CLOEXEC) < 0)
+        return -1;
 
-    draw_status("Mode changed");
+    /* Cloud stream: decoder stdin is fed by the download scheduler */
+    if (decoder_open(d, NULL, feed[0], idx, play_gen) < 0) {
+        close(feed[1]);
+        return -1;
+    }
+    return dlsched_submit(DL_ACTIVE, cloud_url[idx], cache, feed[1]);
 }
 
-/* ------------------------------------------------------- */
-/*              SOCKET PROGRAMMING: HTTP SERVER            */
-/* ------------------------------------------------------- */
+/* The track that plays after u, had u just started */
+static int upcoming_after(const struct upcoming *u)
+{
+    uint64_t epoch = u->epoch;
+    uint32_t e;
+
+    if (u->entry != QUEUE_NONE) {
+        for (e = queue_next(u->entry); e != QUEUE_NONE; e = queue_next(e))
+            if (playable(queue_track(e)))
+                return queue_track(e);
+        return step_index(list_song, 1, &epoch);
+    }
+    return step_index(u->track, 1, &epoch);
+}
 
-static int server_fd = -1;
+/*
+ * Warm the page cache for where a skip can go from here: the next track,
+ * the one after it and the previous one (as handle_prev() picks it).
+ */
+static void prefetch_around(void)
+{
+    uint64_t epoch = shuffle_epoch;
+    int tracks[3];
 
-/* Send a simple text-based HTTP 200 response with CORS enabled */
-static void send_response(int fd, const char *msg)
+    if (is_cloud)
+        return;
+
+    tracks[0] = armed.track;
+    tracks[1] = upcoming_after(&armed);
+    tracks[2] = current_song == list_song ? step_index(list_song, -1, &epoch) : list_song;
+    prefetch_want(tracks, 3);
+
+    /* The playing track is being read anyway: measure it for seeking */
+    unsigned nseek;
+    if (!lib_seek_table(library_view(), (unsigned)current_song, &nseek))
+        prefetch_index(current_song);
+
+    /*
+     * The next track is already decoding; pre-decode the intro of the
+     * first of the others that is not cached, so skipping there is instant.
+     */
+    for (int i = 1; i < 3 && introcache_slot_bytes(); i++) {
+        const struct lib_view *lib = library_view();
+        uint64_t key = intro_key(lib_track(lib, (unsigned)tracks[i]));
+        struct decoder d;
+        char path[512];
+
+        if (!key || introcache_has(key) || tracks[i] == current_song)
+            continue;
+        if (lib_path(lib, (unsigned)tracks[i], path, sizeof(path)) == 0 &&
+            decoder_open(&d, path, -1, tracks[i], play_gen) == 0) {
+            d.key = key;
+            player_warm(&d);
+        }
+        break;
+    }
+}
+
+/*
+ * Pre-open the track after current_song so the player can splice it in
+ * at end-of-track.  Uncached cloud tracks are not streamed twice; they get
+ * armed once their prefetch lands in the cache.
+ */
+static void arm_next(void)
 {
-    char header[512];
-    snprintf(header, sizeof(header),
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: text/plain\r\n"
-        "Access-Control-Allow-Origin: *\r\n"
-        "Content-Length: %zu\r\n\r\n%s",
-        strlen(msg), msg);
-    send(fd, header, strlen(header), 0);
+    struct decoder next;
+
+    seen_completions = dlsched_completions();
+    armed = upcoming();
+    next_armed = (open_track(&next, armed.track, 0) == 0);
+    if (next_armed)
+        player_set_next(&next);
+    prefetch_around();
 }
 
-/* Serve a minimal HTML control page for testing in a browser */
-static void send_html(int fd)
+/* Stop current playback (if any) and clean up state */
+static void stop_playback(void)
 {
-    const char *html =
-        "<html><body><h1>Pi Music Remote</h1>"
-        "<button onclick='fetch(\"/play\")'>Play/Pause</button><br>"
-        "<button onclick='fetch(\"/next\")'>Next</button><br>"
-        "<button onclick='fetch(\"/prev\")'>Prev</button><br>"
-        "<button onclick='fetch(\"/vol_up\")'>Vol +</button><br>"
-        "<button onclick='fetch(\"/vol_down\")'>Vol -</button><br>"
-        "<button onclick='fetch(\"/mute\")'>Mute</button><br>"
-        "<button onclick='fetch(\"/mode\")'>Toggle Local/Cloud</button><br>"
-        "</body></html>";
+    /* Drop the active download first so the decoder isn't fed any more */
+    dlsched_cancel_class(DL_ACTIVE);
 
-    char resp[3000];
-    snprintf(resp, sizeof(resp),
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: text/html\r\n"
-        "Access-Control-Allow-Origin: *\r\n"
-        "Content-Length:%zu\r\n\r\n%s",
-        strlen(html), html);
+    player_stop();
+    play_gen++;             /* Anything the player still reports is stale */
+    next_armed = 0;
+    is_playing = 0;
+    draw_status("Stopped");
+}
 
-    send(fd, resp, strlen(resp), 0);
+/*
+ * Queue the next cloud track as a prefetch and the rest of the catalog as
+ * background fill.  Tracks already cached or in flight are skipped.
+ */
+static void schedule_cloud_prefetch(void)
+{
+    char cache[256];
+
+    for (int k = 1; k < NUM_CLOUD; k++) {
+        int idx = (current_song + k) % NUM_CLOUD;
+        cloud_cache_path(idx, cache, sizeof(cache));
+        if (access(cache, R_OK) == 0)
+            continue;
+
+        dlsched_submit(k == 1 ? DL_PREFETCH : DL_FILL,
+                       cloud_url[idx], cache, -1);
+    }
 }
 
-/* Basic HTTP parser that maps paths to player control actions */
-static void handle_http_request(int fd)
+/*
+ * Jump to track idx.  The output is kept open, so this only costs the
+ * decoder start-up, never a device close/reopen.
+ */
+static void switch_track(int idx)
 {
-    char buf[1024];
-    int n = recv(fd, buf, sizeof(buf) - 1, 0);
-    if (n <= 0)
-        return;
+    struct decoder cur;
 
-    buf[n] = '\0';
+    dlsched_cancel_class(DL_ACTIVE);
+    play_gen++;
+    next_armed = 0;
+    current_song = idx;
 
-    /* Lightweight debug endpoint to test connectivity */
-    if (strncmp(buf, "GET /test", 9) == 0) {
-        send_response(fd, "OK\n");
+    if (open_track(&cur, current_song, 1) < 0) {
+        player_stop();
+        is_playing = 0;
+        draw_status("Playback error");
         return;
     }
 
-    /* Map HTTP paths to transport and playback operations */
-    if (strncmp(buf, "GET /play", 9) == 0)          handle_playpause();
-    else if (strncmp(buf, "GET /pause", 10) == 0)    handle_playpause();
-    else if (strncmp(buf, "GET /next", 9) == 0)      handle_next();
-    else if (strncmp(buf, "GET /prev", 9) == 0)      handle_prev();
-    else if (strncmp(buf, "GET /vol_up", 11) == 0)   volume_up();
-    else if (strncmp(buf, "GET /vol_down", 13) == 0) volume_down();
-    else if (strncmp(buf, "GET /mute", 9) == 0)      toggle_mute();
-    else if (strncmp(buf, "GET /mode", 9) == 0)      toggle_mode();
+    player_play(&cur);
+    is_playing = 1;
+    arm_next();
 
-    /*
-     * HTTP endpoint: /local?song=N
-     * Switches to local mode and starts playing the requested track index N.
-     * Demonstrates socket-based control that integrates cleanly with
-     * the existing state machine (buttons + HTTP share the same path).
+    if (is_cloud)
+        schedule_cloud_prefetch();
+
+    draw_status("Playing");
+}
+
+/* Start the current track if nothing is playing */
+static void start_playback(void)
+{
+    if (is_playing)
+        return;
+
+    switch_track(current_song);
+}
+
+/* Play/pause toggle used by both buttons and HTTP API */
+static void handle_playpause(void)
+{
+    if (is_playing)
+        stop_playback();
+    else
+        start_playback();
+}
+
+/* Advance to the next track in the list and start playback */
+static void handle_next(void)
+{
+    /*
+     * Next track already decoding: hand over without touching the output.
+     * The player's ADVANCED event updates current_song and the display.
      */
-  else if (strncmp(buf, "GET /local", 10) == 0) {
-    int id = 0;
-    char *p = strstr(buf, "song=");
+    if (is_playing && next_armed) {
+        dlsched_cancel_class(DL_ACTIVE);
+        next_armed = 0;
+        player_skip(current_song);
+        return;
+    }
 
-    if (p) {
-        id = atoi(p + 5);
-        if (id < 0 || id >= NUM_SONGS)
-            id = 0;
+    struct upcoming u = upcoming();
+    take_upcoming(&u);
+    switch_track(u.track);
+}
+
+/*
+ * Go back to the previous track and start playback.  From a queued track
+ * that is the playlist track it interrupted.
+ */
+static void handle_prev(void)
+{
+    if (current_song == list_song)
+        list_song = step_index(list_song, -1, &shuffle_epoch);
+    switch_track(list_song);
+}
+
+/*
+ * Jump to ms into the current local track.  Its seek table names the
+ * frame to start decoding at, a few frames early so the bit reservoir
+ * fills; the player drops the output up to the exact sample and stops
+ * where a decoder started at the top would have trimmed the padding, or
+ * the trailing silence.
+ */
+static void seek_track(unsigned ms)
+{
+    const struct lib_view *lib = library_view();
+    const struct lib_track *t = lib_track(lib, (unsigned)current_song);
+    struct decoder d;
+    char path[512];
+    unsigned n;
+    const uint32_t *tab = lib_seek_table(lib, (unsigned)current_song, &n);
+    int fd = -1;
+
+    if (is_cloud || !is_playing || !t || !tab || !t->frame_samples) {
+        draw_status("Cannot seek here");
+        return;
     }
 
-    /* Treat /local as a normal local playback request through the daemon */
-    is_cloud = 0;          /* Force local mode (SD-card / local playlist)     */
-    current_song = id;     /* Update internal index so physical controls work */
-    last_event_ms = 0;     /* Reset debounce window for immediate response    */
+    /* Where the music ends, trailing silence trimmed as at normal playback */
+    unsigned end_ms = t->duration_ms;
+    int      cut    = trim_trail && (t->flags & LIB_ANALYZED) &&
+                      t->trail_ms && t->trail_ms < end_ms;
+    if (cut)
+        end_ms -= t->trail_ms;
+    if (ms >= end_ms) {
+        handle_next();
+        return;
+    }
+
+    /* Sample positions in the decoder's untrimmed output */
+    uint64_t spf    = t->frame_samples;
+    uint64_t lead   = t->flags & LIB_GAPLESS ? t->enc_delay + DECODER_DELAY : 0;
+    uint64_t target = (uint64_t)ms * t->sample_rate / 1000 + lead;
+    uint64_t frame  = target / spf > SEEK_RUNUP ? target / spf - SEEK_RUNUP : 0;
+    unsigned e      = (unsigned)(frame / LIB_SEEK_STEP) < n ? (unsigned)(frame / LIB_SEEK_STEP)
+                                                            : n - 1;
+    uint64_t from   = (uint64_t)e * LIB_SEEK_STEP * spf;
+    int64_t  end    = (int64_t)t->frames * (int64_t)spf;
+    int64_t  stop   = (int64_t)((uint64_t)end_ms * t->sample_rate / 1000 + lead);
+    int      limit  = (t->flags & LIB_GAPLESS) != 0;
+
+    if (t->flags & LIB_GAPLESS)
+        end -= (int64_t)t->enc_padding - DECODER_DELAY;
+    if (cut && stop < end) {
+        end   = stop;
+        limit = 1;
+    }
+
+    if (lib_path(lib, (unsigned)current_song, path, sizeof(path)) < 0 ||
+        (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 ||
+        lseek(fd, tab[e], SEEK_SET) < 0) {
+        if (fd >= 0)
+            close(fd);
+        draw_status("Seek failed");
+        return;
+    }
+
+    play_gen++;
+    next_armed = 0;
+    if (decoder_open(&d, NULL, fd, current_song, play_gen) < 0) {
+        player_stop();
+        is_playing = 0;
+        draw_status("Playback error");
+        return;
+    }
+
+    /* Resampled to PCM_RATE when the file has another rate */
+    d.skip     = (target - from) * PCM_RATE / t->sample_rate * PCM_FRAME_BYTES;
+    d.limit    = limit && end > (int64_t)target
+                 ? (uint64_t)(end - (int64_t)target) * PCM_RATE / t->sample_rate * PCM_FRAME_BYTES
+                 : 0;
+    d.start_ms = ms;
+    d.gain_mb  = track_gain(t);
+
+    player_play(&d);
+    arm_next();
+    draw_status("Playing");
+}
+
+/* React to track changes reported by the player thread */
+static void handle_player_events(void)
+{
+    struct player_event ev;
+
+    while (player_read_event(&ev)) {
+        if (ev.gen != play_gen)
+            continue;       /* Belongs to a track we already replaced */
+
+        if (ev.type == PLAYER_EV_ADVANCED) {
+            /* Gapless auto-advance (or skip) onto the pre-opened track */
+            if (ev.track == armed.track)
+                take_upcoming(&armed);
+            else
+                list_song = ev.track;
+            current_song = ev.track;
+            arm_next();
+            if (is_cloud)
+                schedule_cloud_prefetch();
+            draw_status("Playing");
+        } else if (ev.type == PLAYER_EV_FAILED) {
+            /* Nothing can be heard: stop rather than skip through the list */
+            stop_playback();
+            draw_status("Audio output error");
+        } else if (!ev.played) {
+            /* Decoder produced nothing: don't spin through the list */
+            stop_playback();
+            draw_status("Playback error");
+        } else {
+            /* Track ended before a next one could be armed: cold start */
+            struct upcoming u = upcoming();
+            take_upcoming(&u);
+            switch_track(u.track);
+        }
+    }
+}
+
+/* The queue, the order or the library changed: re-arm if the next track did */
+static void rearm_next(void)
+{
+    struct upcoming u;
+
+    if (!is_playing || is_cloud)
+        return;
+
+    u = upcoming();
+    if (!next_armed || u.track != armed.track || u.entry != armed.entry)
+        arm_next();
+}
+
+/* Watcher thread: changes are ready for update_library() */
+static void library_changes_ready(void)
+{
+    post_cmd(CMD_LIBRARY, 0, -1);
+}
+
+/*
+ * Apply changes below the music directory.  Slots never move, but the
+ * track after the current one may have come or gone: re-arm it then.
+ */
+static void update_library(void)
+{
+    if (!libwatch_service())
+        return;
+
+    analyzer_kick();
+    rearm_next();
+    draw_status("Library updated");
+}
+
+/* Prefetch thread: a seek table is ready for store_seek_tables() */
+static void seek_table_ready(void)
+{
+    post_cmd(CMD_INDEXED, 0, -1);
+}
+
+/* Put the tracks the prefetch thread measured into the library */
+static void store_seek_tables(void)
+{
+    struct prefetch_index ix;
+
+    while (prefetch_indexed(&ix)) {
+        library_set_seek((unsigned)ix.track, ix.size, ix.mtime, ix.frames,
+                         ix.duration_ms, ix.offsets, ix.n);
+        free(ix.offsets);
+    }
+    library_commit();
+}
+
+/* Analyzer thread: a track is ready for store_analysis() */
+static void analysis_ready(void)
+{
+    post_cmd(CMD_ANALYZED, 0, -1);
+}
+
+/* Publish the analysis results collected so far */
+static void commit_analysis(void *arg)
+{
+    (void)arg;
+    timer_cancel(&analysis_timer);
+    analysis_pending = 0;
+    library_commit_lazy();
+}
+
+/*
+ * Put what the analyzer measured into the library.  A track takes about
+ * two seconds, so results (and the seek tables measured with them) are
+ * committed in batches: every commit copies a segment and eventually
+ * rewrites the index.
+ */
+static void store_analysis(void)
+{
+    struct analyzer_result r;
+
+    while (analyzer_result(&r)) {
+        int stored = 0;
+
+        if (r.offsets)
+            stored |= library_set_seek((unsigned)r.track, r.size, r.mtime, r.frames,
+                                       r.duration_ms, r.offsets, r.nseek) == 0;
+        if (r.decoded)
+            stored |= library_set_analysis((unsigned)r.track, r.size, r.mtime, &r.a) == 0;
+        analysis_pending += stored;
+        free(r.offsets);
+    }
+
+    if (analysis_pending >= ANALYSIS_BATCH)
+        commit_analysis(NULL);
+    else if (analysis_pending && !timer_pending(&analysis_timer))
+        timer_arm(&analysis_timer, ANALYSIS_MS, ANALYSIS_MS / 4);
+}
+
+/* Cached cloud tracks without an analysis sidecar go to the analyzer */
+static void analyze_cloud_cache(void)
+{
+    char cache[256];
+    struct lib_analysis a;
+
+    analyzed_completions = dlsched_completions();
+    for (int i = 0; i < NUM_CLOUD; i++) {
+        cloud_cache_path(i, cache, sizeof(cache));
+        if (access(cache, R_OK) == 0 &&
+            analyzer_read_file(cache, &a) < 0)
+            analyzer_add_file(cache);
+    }
+}
+
+/* Toggle between local and cloud mode and keep index in range */
+static void toggle_mode(void)
+{
+    is_cloud = !is_cloud;
 
-    /* Use the existing stop/start helpers for a clean transition */
     stop_playback();
+
+    if (num_tracks())
+        current_song = current_song % num_tracks();
+    else
+        current_song = 0;
+    list_song = current_song;
+
     start_playback();
 
+    draw_status("Mode changed");
+}
+
+/* Switch to local mode and play track id (HTTP /local) */
+static void play_local(int id)
+{
+    is_cloud = 0;          /* Force local mode (SD-card / local playlist)     */
+    current_song = id;     /* Update internal index so physical controls work */
+    list_song = id;        /* Next/Prev carry on from here                    */
+
+    /* Reuse the track-change path so the output stays open */
+    switch_track(id);
+
     /* Indicate on HDMI that this action was triggered via HTTP socket */
     draw_status("SOCKET: Playing local song via /local");
+}
+
+/*
+ * Shuffle on, off (0/1) or toggled (-1).  A new permutation starts at the
+ * track playing now, so every other track comes before it comes again.
+ */
+static void set_shuffle(int on)
+{
+    shuffle = on < 0 ? !shuffle : on != 0;
+    if (shuffle) {
+        shuffle_reset(now_ns() ^ (uint64_t)getpid() << 32, (unsigned)list_song,
+                      lib_count(library_view()));
+        shuffle_epoch = 0;
+    }
+
+    rearm_next();
+    draw_status(shuffle ? "Shuffle on" : "Shuffle off");
+}
+
+/* Queue edits from HTTP; entries are the handles /queue lists */
+static void edit_queue(const struct cmd *c)
+{
+    switch (c->type) {
+    case CMD_QUEUE_ADD:
+        if (!lib_track(library_view(), (unsigned)c->arg))
+            return;
+        if (queue_push((unsigned)c->arg, c->arg2) == QUEUE_NONE) {
+            draw_status("Queue full");
+            return;
+        }
+        break;
+    case CMD_QUEUE_REMOVE:
+        if (queue_remove((uint32_t)c->arg) < 0)
+            return;
+        break;
+    case CMD_QUEUE_MOVE:
+        if (queue_move((uint32_t)c->arg, (uint32_t)c->arg2) < 0)
+            return;
+        break;
+    default:
+        queue_clear();
+        break;
+    }
+
+    rearm_next();
+    draw_status("Queue updated");
+}
+
+/* Control thread: apply one command from the input or network thread */
+static void handle_command(const struct cmd *c)
+{
+    /* Button debounce: ignore presses while the previous one's timer runs */
+    if (c->source == SRC_INPUT) {
+        if (timer_pending(&debounce_timer))
+            return;
+        timer_arm(&debounce_timer, DEBOUNCE_MS, 0);
+    }
+
+    switch (c->type) {
+    case CMD_PLAYPAUSE: handle_playpause(); break;
+    case CMD_NEXT:      handle_next(); break;
+    case CMD_PREV:      handle_prev(); break;
+    case CMD_VOL_UP:    volume_up(); break;
+    case CMD_VOL_DOWN:  volume_down(); break;
+    case CMD_MUTE:      toggle_mute(); break;
+    case CMD_MODE:      toggle_mode(); break;
+    case CMD_LOCAL:     play_local(c->arg); break;
+    case CMD_CROSSFADE:
+        crossfade_ms = c->arg;
+        player_set_crossfade(crossfade_ms);
+        publish_state(NULL);
+        break;
+    case CMD_QUEUE_ADD:
+    case CMD_QUEUE_REMOVE:
+    case CMD_QUEUE_MOVE:
+    case CMD_QUEUE_CLEAR:
+        edit_queue(c);
+        break;
+    case CMD_SHUFFLE:   set_shuffle(c->arg); break;
+    case CMD_SEEK:      seek_track((unsigned)c->arg); break;
+    case CMD_INDEXED:   store_seek_tables(); break;
+    case CMD_ANALYZED:  store_analysis(); break;
+    case CMD_LIBRARY:   update_library(); break;
+    default:
+        break;
+    }
+
+    if (c->source >= 0 && c->source < SRC_COUNT)
+        lat_record(&cmd_lat[c->source], c->posted_ns);
+}
+
+/* ------------------------------------------------------- */
+/*                BUTTON INPUT THREAD                      */
+/* ------------------------------------------------------- */
+
+/* Map a /dev/music_input event character to a command, -1 if unknown */
+static int button_cmd(char ev)
+{
+    switch (ev) {
+    case 'P': return CMD_PLAYPAUSE;
+    case 'N': return CMD_NEXT;
+    case 'R': return CMD_PREV;
+    case 'U': return CMD_VOL_UP;
+    case 'D': return CMD_VOL_DOWN;
+    case 'M': return CMD_MUTE;
+    case 'C': return CMD_MODE;
+    default:  return -1;
+    }
+}
+
+/* Blocking reads of button events; debounced and handled by control */
+static void *input_thread(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+
+    pthread_setname_np(pthread_self(), "input");
+
+    for (;;) {
+        char ev;
+        ssize_t n = read(fd, &ev, 1);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            perror("read /dev/music_input");
+            break;
+        }
+
+        int type = button_cmd(ev);
+        if (type >= 0)
+            post_cmd(type, 0, SRC_INPUT);
+    }
+
+    return NULL;
+}
+
+/* ------------------------------------------------------- */
+/*              SOCKET PROGRAMMING: HTTP SERVER            */
+/* ------------------------------------------------------- */
+
+static int server_fd = -1;
+
+/* Send a simple text-based HTTP 200 response with CORS enabled */
+static void send_response(int fd, const char *msg)
+{
+    char header[1024];
+    snprintf(header, sizeof(header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Content-Length: %zu\r\n\r\n%s",
+        strlen(msg), msg);
+    send(fd, header, strlen(header), 0);
+}
+
+/* Send a 404 for a path that names nothing */
+static void send_not_found(int fd)
+{
+    static const char resp[] =
+        "HTTP/1.1 404 Not Found\r\n"
+        "Content-Type: text/plain\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Content-Length: 10\r\n\r\nNot found\n";
+
+    send(fd, resp, sizeof(resp) - 1, 0);
+}
+
+/* Serve a minimal HTML control page for testing in a browser */
+static void send_html(int fd)
+{
+    const char *html =
+        "<html><body><h1>Pi Music Remote</h1>"
+        "<button onclick='fetch(\"/play\")'>Play/Pause</button><br>"
+        "<button onclick='fetch(\"/next\")'>Next</button><br>"
+        "<button onclick='fetch(\"/prev\")'>Prev</button><br>"
+        "<button onclick='fetch(\"/vol_up\")'>Vol +</button><br>"
+        "<button onclick='fetch(\"/vol_down\")'>Vol -</button><br>"
+        "<button onclick='fetch(\"/mute\")'>Mute</button><br>"
+        "<button onclick='fetch(\"/mode\")'>Toggle Local/Cloud</button><br>"
+        "<button onclick='fetch(\"/shuffle\")'>Shuffle</button><br>"
+        "</body></html>";
+
+    char resp[3000];
+    snprintf(resp, sizeof(resp),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/html\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Content-Length:%zu\r\n\r\n%s",
+        strlen(html), html);
+
+    send(fd, resp, strlen(resp), 0);
+}
+
+/* Send a body of len bytes and the given content type as a 200 response */
+static void send_body(int fd, const char *type, const void *body, size_t len)
+{
+    char header[256];
+    int n = snprintf(header, sizeof(header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Content-Length: %zu\r\n\r\n", type, len);
+
+    send(fd, header, (size_t)n, MSG_MORE);
+    send(fd, body, len, 0);
+}
+
+static void send_json(int fd, const char *body, size_t len)
+{
+    send_body(fd, "application/json", body, len);
+}
+
+/*
+ * Query parameter name of the request line in req, %XX- and '+'-decoded
+ * into out.  Returns 0, or -1 if the parameter is missing.
+ */
+static int url_param(const char *req, const char *name, char *out, size_t len)
+{
+    const char *path = strchr(req, ' ');
+    const char *stop = path ? strchr(path + 1, ' ') : NULL;
+    const char *p = stop ? memchr(path, '?', (size_t)(stop - path)) : NULL;
+    size_t nlen = strlen(name), n = 0;
+
+    for (; p && p < stop; p = memchr(p + 1, '&', (size_t)(stop - p - 1))) {
+        if (strncmp(p + 1, name, nlen) != 0 || p[1 + nlen] != '=')
+            continue;
+
+        for (p += 2 + nlen; p < stop && *p != '&' && n + 1 < len; p++) {
+            unsigned hex;
+            if (*p == '+') {
+                out[n++] = ' ';
+            } else if (*p == '%' && sscanf(p + 1, "%2x", &hex) == 1) {
+                out[n++] = (char)hex;
+                p += 2;
+            } else {
+                out[n++] = *p;
+            }
+        }
+        out[n] = '\0';
+        return 0;
+    }
+    return -1;
+}
+
+/* s as the contents of a JSON string (no quotes), truncated to fit */
+static const char *json_escape(const char *s, char *out, size_t len)
+{
+    size_t n = 0;
+
+    for (; *s && n + 7 < len; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            out[n++] = '\\';
+            out[n++] = (char)c;
+        } else if (c < 0x20) {
+            n += (size_t)snprintf(out + n, len - n, "\\u%04x", c);
+        } else {
+            out[n++] = (char)c;
+        }
+    }
+    out[n] = '\0';
+    return out;
+}
+
+/* /search?q=...&limit=N: ranked local tracks as JSON, for typeahead */
+static void send_search(int fd, const char *req)
+{
+    static char body[SEARCH_MAX_RESULTS * 1024];
+    char q[256], lim[16], e1[512], e2[512], e3[512];
+    struct search_hit hits[SEARCH_MAX_RESULTS];
+    int limit = 20, n, len;
+
+    if (url_param(req, "q", q, sizeof(q)) < 0)
+        q[0] = '\0';
+    if (url_param(req, "limit", lim, sizeof(lim)) == 0)
+        limit = atoi(lim);
+    if (limit < 1 || limit > SEARCH_MAX_RESULTS)
+        limit = SEARCH_MAX_RESULTS;
+
+    const struct lib_view *lib = library_acquire();
+    n = search_query(lib, q, hits, limit);
+
+    len = snprintf(body, sizeof(body), "{\"query\":\"%s\",\"results\":[",
+                   json_escape(q, e1, sizeof(e1)));
+
+    /* One hit takes well under 2 KiB even with every field escaped */
+    for (int i = 0; i < n && len + 2048 < (int)sizeof(body); i++) {
+        const struct lib_track *t = lib_track(lib, hits[i].idx);
+        len += snprintf(body + len, sizeof(body) - (size_t)len,
+                        "%s{\"song\":%u,\"id\":\"%016llx\",\"score\":%d,"
+                        "\"title\":\"%s\",\"artist\":\"%s\",\"album\":\"%s\","
+                        "\"duration_ms\":%u}",
+                        i ? "," : "", hits[i].idx, (unsigned long long)t->id,
+                        hits[i].score,
+                        json_escape(lib_title(lib, hits[i].idx), e1, sizeof(e1)),
+                        json_escape(lib_str(lib, hits[i].idx, t->artist), e2, sizeof(e2)),
+                        json_escape(lib_str(lib, hits[i].idx, t->album), e3, sizeof(e3)),
+                        t->duration_ms);
+    }
+    library_release(lib);
+
+    len += snprintf(body + len, sizeof(body) - (size_t)len, "]}\n");
+    send_json(fd, body, (size_t)len);
+}
+
+/*
+ * Chunked JSON response, for listings whose size is not known up front:
+ * items are formatted into buf and each full buffer goes out as a chunk,
+ * so memory stays bounded however large the page.
+ */
+struct http_stream {
+    int    fd;
+    size_t len;
+    char   buf[4096];
+};
+
+static void stream_begin(struct http_stream *s, int fd)
+{
+    static const char header[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Transfer-Encoding: chunked\r\n\r\n";
+
+    s->fd = fd;
+    s->len = 0;
+    send(fd, header, sizeof(header) - 1, MSG_MORE);
+}
+
+static void stream_flush(struct http_stream *s)
+{
+    char size[16];
+    struct iovec iov[3];
+
+    if (!s->len)
+        return;
+
+    iov[0].iov_base = size;
+    iov[0].iov_len = (size_t)snprintf(size, sizeof(size), "%zx\r\n", s->len);
+    iov[1].iov_base = s->buf;
+    iov[1].iov_len = s->len;
+    iov[2].iov_base = "\r\n";
+    iov[2].iov_len = 2;
+    if (writev(s->fd, iov, 3) < 0)
+        s->fd = -1;
+    s->len = 0;
+}
+
+static void stream_printf(struct http_stream *s, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (s->fd < 0)
+        return;
+
+    va_start(ap, fmt);
+    n = vsnprintf(s->buf + s->len, sizeof(s->buf) - s->len, fmt, ap);
+    va_end(ap);
+
+    if (n >= 0 && (size_t)n >= sizeof(s->buf) - s->len) {
+        /* Did not fit: send what is there and format it again */
+        stream_flush(s);
+        va_start(ap, fmt);
+        n = vsnprintf(s->buf, sizeof(s->buf), fmt, ap);
+        va_end(ap);
+        if (n >= (int)sizeof(s->buf))
+            n = (int)sizeof(s->buf) - 1;
+    }
+    if (n > 0)
+        s->len += (size_t)n;
+}
+
+static void stream_end(struct http_stream *s)
+{
+    stream_flush(s);
+    if (s->fd >= 0)
+        send(s->fd, "0\r\n\r\n", 5, 0);
+}
+
+struct browse_page {
+    struct http_stream    *s;
+    const struct lib_view *lib;
+    unsigned               n;
+};
+
+/* One listing item as a JSON object */
+static void send_browse_item(const struct browse_item *it, void *arg)
+{
+    struct browse_page *pg = arg;
+    char e1[512], e2[512], e3[512], e4[512];
+
+    if (!it->name) {
+        const struct lib_view *lib = pg->lib;
+        const struct lib_track *t = lib_track(lib, it->idx);
+
+        stream_printf(pg->s,
+                      "%s{\"type\":\"track\",\"song\":%u,\"id\":\"%016llx\","
+                      "\"title\":\"%s\",\"artist\":\"%s\",\"album\":\"%s\","
+                      "\"track\":%u,\"year\":%u,\"duration_ms\":%u,\"path\":\"%s\"}",
+                      pg->n ? "," : "", it->idx, (unsigned long long)t->id,
+                      json_escape(lib_title(lib, it->idx), e1, sizeof(e1)),
+                      json_escape(lib_str(lib, it->idx, t->artist), e2, sizeof(e2)),
+                      json_escape(lib_str(lib, it->idx, t->album), e3, sizeof(e3)),
+                      t->track_no, t->year, t->duration_ms,
+                      json_escape(lib_relpath(lib, it->idx), e4, sizeof(e4)));
+    } else if (it->artist) {
+        stream_printf(pg->s, "%s{\"type\":\"album\",\"name\":\"%s\",\"artist\":\"%s\","
+                      "\"tracks\":%u}",
+                      pg->n ? "," : "", json_escape(it->name, e1, sizeof(e1)),
+                      json_escape(it->artist, e2, sizeof(e2)), it->tracks);
+    } else if (it->albums) {
+        stream_printf(pg->s, "%s{\"type\":\"artist\",\"name\":\"%s\",\"albums\":%u,"
+                      "\"tracks\":%u}",
+                      pg->n ? "," : "", json_escape(it->name, e1, sizeof(e1)),
+                      it->albums, it->tracks);
+    } else {
+        stream_printf(pg->s, "%s{\"type\":\"folder\",\"name\":\"%s\",\"tracks\":%u}",
+                      pg->n ? "," : "", json_escape(it->name, e1, sizeof(e1)),
+                      it->tracks);
+    }
+    pg->n++;
+}
+
+/*
+ * /library/artists, /library/albums?artist=, /library/tracks?artist=&album=
+ * and /library/folder?path=, each paged with offset= and limit=.  The total
+ * comes last: the listing only knows it once the page has been sent.
+ */
+static void send_library(int fd, const char *req)
+{
+    char what[16], artist[256], album[256], path[1024], num[16];
+    unsigned offset = 0, limit = 50, total;
+    struct http_stream s;
+    struct browse_page pg = { &s, NULL, 0 };
+
+    if (sscanf(req, "GET /library/%15[a-z]", what) != 1 ||
+        (strcmp(what, "artists") != 0 && strcmp(what, "albums") != 0 &&
+         strcmp(what, "tracks") != 0 && strcmp(what, "folder") != 0)) {
+        send_not_found(fd);
+        return;
+    }
+
+    if (url_param(req, "offset", num, sizeof(num)) == 0)
+        offset = (unsigned)strtoul(num, NULL, 10);
+    if (url_param(req, "limit", num, sizeof(num)) == 0)
+        limit = (unsigned)strtoul(num, NULL, 10);
+    if (limit < 1 || limit > 500)
+        limit = 500;
+    if (url_param(req, "artist", artist, sizeof(artist)) < 0)
+        artist[0] = '\0';
+    if (url_param(req, "album", album, sizeof(album)) < 0)
+        album[0] = '\0';
+    if (url_param(req, "path", path, sizeof(path)) < 0)
+        path[0] = '\0';
+
+    pg.lib = library_acquire();
+    stream_begin(&s, fd);
+    stream_printf(&s, "{\"offset\":%u,\"limit\":%u,\"items\":[", offset, limit);
+
+    if (strcmp(what, "artists") == 0)
+        total = browse_artists(pg.lib, offset, limit, send_browse_item, &pg);
+    else if (strcmp(what, "albums") == 0)
+        total = browse_albums(pg.lib, artist[0] ? artist : NULL, offset, limit,
+                              send_browse_item, &pg);
+    else if (strcmp(what, "tracks") == 0)
+        total = browse_tracks(pg.lib, artist[0] ? artist : NULL, album[0] ? album : NULL,
+                              offset, limit, send_browse_item, &pg);
+    else
+        total = browse_folder(pg.lib, path, offset, limit, send_browse_item, &pg);
+
+    library_release(pg.lib);
+    stream_printf(&s, "],\"total\":%u}\n", total);
+    stream_end(&s);
+}
+
+/* /queue: shuffle flag, queue length and the tracks at its head, as JSON */
+static void send_queue(int fd)
+{
+    char e1[512], e2[512];
+    struct daemon_state st;
+    struct http_stream s;
+    const struct lib_view *lib = library_acquire();
+
+    state_read(&st);
+    stream_begin(&s, fd);
+    stream_printf(&s, "{\"shuffle\":%s,\"length\":%u,\"items\":[",
+                  st.shuffle ? "true" : "false", st.queue_len);
+
+    for (unsigned i = 0, n = 0; i < st.queue_len && i < STATE_QUEUE_SHOWN; i++) {
+        unsigned idx = (unsigned)st.queue[i].track;
+        const struct lib_track *t = lib_track(lib, idx);
+
+        if (!t)
+            continue;
+        stream_printf(&s, "%s{\"entry\":%u,\"song\":%u,\"id\":\"%016llx\","
+                      "\"title\":\"%s\",\"artist\":\"%s\",\"duration_ms\":%u}",
+                      n++ ? "," : "", st.queue[i].entry, idx, (unsigned long long)t->id,
+                      json_escape(lib_title(lib, idx), e1, sizeof(e1)),
+                      json_escape(lib_str(lib, idx, t->artist), e2, sizeof(e2)),
+                      t->duration_ms);
+    }
+    library_release(lib);
+
+    stream_printf(&s, "]}\n");
+    stream_end(&s);
+}
+
+/*
+ * /waveform?id=<hex>[&format=bin]: the track's peak overview, as JSON
+ * arrays of WAVEFORM_BUCKETS lows and highs (127 = full scale), or as the
+ * raw pairs of signed bytes, low first.  404 if the track is unknown or
+ * has not been analyzed yet.
+ */
+static void send_waveform(int fd, const char *req)
+{
+    static struct waveform w;           /* Only the HTTP thread serves it */
+    char arg[32];
+    const struct lib_view *lib = library_acquire();
+    const struct lib_track *t = NULL;
+    uint64_t id = 0;
+    int idx = -1, bin, found;
+
+    if (url_param(req, "id", arg, sizeof(arg)) == 0)
+        idx = browse_find(lib, strtoull(arg, NULL, 16));
+    if (idx >= 0 && (t = lib_track(lib, (unsigned)idx)))
+        id = t->id;
+    found = t && (t->flags & LIB_WAVEFORM) &&
+            waveform_load(id, t->size, t->mtime, &w) == 0;
+    library_release(lib);
+
+    /* No track, or no overview of it yet: either way nothing to draw */
+    if (!found) {
+        send_not_found(fd);
+        return;
+    }
+
+    bin = url_param(req, "format", arg, sizeof(arg)) == 0 && strcmp(arg, "bin") == 0;
+    if (bin) {
+        send_body(fd, "application/octet-stream", w.peak, sizeof(w.peak));
+        return;
+    }
+
+    struct http_stream s;
+
+    stream_begin(&s, fd);
+    stream_printf(&s, "{\"id\":\"%016llx\",\"duration_ms\":%u,\"buckets\":%d,\"min\":[",
+                  (unsigned long long)id, w.duration_ms, WAVEFORM_BUCKETS);
+    for (int k = 0; k < WAVEFORM_BUCKETS; k++)
+        stream_printf(&s, "%s%d", k ? "," : "", w.peak[k][0]);
+    stream_printf(&s, "],\"max\":[");
+    for (int k = 0; k < WAVEFORM_BUCKETS; k++)
+        stream_printf(&s, "%s%d", k ? "," : "", w.peak[k][1]);
+    stream_printf(&s, "]}\n");
+    stream_end(&s);
+}
+
+/*
+ * /queue/add?id=<hex>|song=N[&next=1], /queue/remove?entry=E,
+ * /queue/move?entry=E[&before=F] (default: to the end) and /queue/clear.
+ * The control thread applies them; /queue shows the result.
+ */
+static void handle_queue_request(int fd, const char *req)
+{
+    char arg[32], resp[320];
+    int  arg2 = 0;
+
+    if (strncmp(req, "GET /queue/add", 14) == 0) {
+        const struct lib_view *lib = library_acquire();
+        int idx = -1;
+
+        if (url_param(req, "id", arg, sizeof(arg)) == 0)
+            idx = browse_find(lib, strtoull(arg, NULL, 16));
+        else if (url_param(req, "song", arg, sizeof(arg)) == 0 &&
+                 lib_track(lib, (unsigned)atoi(arg)))
+            idx = atoi(arg);
+        if (url_param(req, "next", arg, sizeof(arg)) == 0)
+            arg2 = atoi(arg) != 0;
+
+        if (idx >= 0) {
+            post_cmd2(CMD_QUEUE_ADD, idx, arg2, SRC_HTTP);
+            snprintf(resp, sizeof(resp), "Queued %s\n", lib_title(lib, (unsigned)idx));
+        } else {
+            snprintf(resp, sizeof(resp), "Unknown track\n");
+        }
+        library_release(lib);
+        send_response(fd, resp);
+        return;
+    }
+
+    if (strncmp(req, "GET /queue/clear", 16) == 0) {
+        post_cmd(CMD_QUEUE_CLEAR, 0, SRC_HTTP);
+        send_response(fd, "Queue cleared\n");
+        return;
+    }
+
+    if (url_param(req, "entry", arg, sizeof(arg)) < 0) {
+        send_response(fd, "Missing entry\n");
+        return;
+    }
+
+    if (strncmp(req, "GET /queue/remove", 17) == 0) {
+        post_cmd(CMD_QUEUE_REMOVE, (int)strtoul(arg, NULL, 10), SRC_HTTP);
+    } else {
+        int entry = (int)strtoul(arg, NULL, 10);
+        arg2 = url_param(req, "before", arg, sizeof(arg)) == 0
+             ? (int)strtoul(arg, NULL, 10) : (int)QUEUE_NONE;
+        post_cmd2(CMD_QUEUE_MOVE, entry, arg2, SRC_HTTP);
+    }
+    send_response(fd, "OK\n");
+}
+
+/* Basic HTTP parser that maps paths to player control actions */
+static void handle_http_request(int fd)
+{
+    char buf[1024];
+    int n = recv(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return;
+
+    buf[n] = '\0';
+
+    /* Lightweight debug endpoint to test connectivity */
+    if (strncmp(buf, "GET /test", 9) == 0) {
+        send_response(fd, "OK\n");
+        return;
+    }
+
+    /* /play?id=<hex>: play a browsed track by its stable id */
+    if (strncmp(buf, "GET /play?id=", 13) == 0) {
+        char resp[320];
+        const struct lib_view *lib = library_acquire();
+        int idx = browse_find(lib, strtoull(buf + 13, NULL, 16));
+
+        if (idx >= 0) {
+            post_cmd(CMD_LOCAL, idx, SRC_HTTP);
+            snprintf(resp, sizeof(resp), "Playing %s\n", lib_title(lib, (unsigned)idx));
+        } else {
+            snprintf(resp, sizeof(resp), "Unknown track id\n");
+        }
+        library_release(lib);
+        send_response(fd, resp);
+        return;
+    }
+
+    /* Map HTTP paths to transport and playback operations */
+    if (strncmp(buf, "GET /play", 9) == 0)          post_cmd(CMD_PLAYPAUSE, 0, SRC_HTTP);
+    else if (strncmp(buf, "GET /pause", 10) == 0)    post_cmd(CMD_PLAYPAUSE, 0, SRC_HTTP);
+    else if (strncmp(buf, "GET /next", 9) == 0)      post_cmd(CMD_NEXT, 0, SRC_HTTP);
+    else if (strncmp(buf, "GET /prev", 9) == 0)      post_cmd(CMD_PREV, 0, SRC_HTTP);
+    else if (strncmp(buf, "GET /vol_up", 11) == 0)   post_cmd(CMD_VOL_UP, 0, SRC_HTTP);
+    else if (strncmp(buf, "GET /vol_down", 13) == 0) post_cmd(CMD_VOL_DOWN, 0, SRC_HTTP);
+    else if (strncmp(buf, "GET /mute", 9) == 0)      post_cmd(CMD_MUTE, 0, SRC_HTTP);
+    else if (strncmp(buf, "GET /mode", 9) == 0)      post_cmd(CMD_MODE, 0, SRC_HTTP);
+
+    /* /status: consistent snapshot of the player state, lock-free */
+    else if (strncmp(buf, "GET /status", 11) == 0) {
+        char resp[640];
+        struct daemon_state st;
+        const struct lib_view *lib = library_acquire();
+        const struct lib_track *t;
+        unsigned pos_ms = 0;
+
+        state_read(&st);
+        t = st.cloud ? NULL : lib_track(lib, (unsigned)st.song);
+        if (!st.playing || player_position(&pos_ms) != st.song)
+            pos_ms = 0;
+        snprintf(resp, sizeof(resp),
+                 "version: %llu\n"
+                 "mode: %s\n"
+                 "song: %d\n"
+                 "title: %s\n"
+                 "playing: %d\n"
+                 "position_ms: %u\n"
+                 "duration_ms: %u\n"
+                 "volume: %d\n"
+                 "muted: %d\n"
+                 "crossfade_ms: %d\n"
+                 "shuffle: %d\n"
+                 "queue: %u\n"
+                 "message: %s\n"
+                 "library: %u tracks, generation %llu\n",
+                 (unsigned long long)st.version,
+                 st.cloud ? "cloud" : "local",
+                 st.song,
+                 get_title(lib, &st),
+                 st.playing,
+                 pos_ms,
+                 t ? t->duration_ms : 0,
+                 st.volume,
+                 st.muted,
+                 st.crossfade_ms,
+                 st.shuffle,
+                 st.queue_len,
+                 st.message,
+                 lib_live(lib), (unsigned long long)lib_generation(lib));
+        library_release(lib);
+        send_response(fd, resp);
+        return;
+    }
+
+    /* /stats reports output backend, buffer sizing, xrun and ring telemetry */
+    else if (strncmp(buf, "GET /stats", 10) == 0) {
+        char resp[896];
+        char lat_in[48], lat_http[48], lat_ui[48];
+        struct output_stats st;
+        struct player_stats ps;
+        struct introcache_stats ic;
+        struct analyzer_stats as;
+        struct visual_stats vs;
+
+        output_get_stats(&st);
+        player_get_stats(&ps);
+        introcache_get_stats(&ic);
+        analyzer_get_stats(&as);
+        visual_get_stats(&vs);
+        lat_format(&cmd_lat[SRC_INPUT], lat_in, sizeof(lat_in));
+        lat_format(&cmd_lat[SRC_HTTP], lat_http, sizeof(lat_http));
+        lat_format(&ui_lat, lat_ui, sizeof(lat_ui));
+        snprintf(resp, sizeof(resp),
+                 "backend: %s\n"
+                 "period_frames: %lu\n"
+                 "buffer_frames: %lu\n"
+                 "buffer_ms: %lu\n"
+                 "delay_ms: %ld\n"
+                 "xruns: %lu\n"
+                 "resizes: %lu\n"
+                 "ring_frames: %lu/%lu\n"
+                 "ring_underruns: %lu\n"
+                 "input_cmd_us: %s\n"
+                 "http_cmd_us: %s\n"
+                 "ui_frame_us: %s\n"
+                 "cmd_dropped: %lu\n"
+                 "intro_cache: %u/%u intros of %u ms, %lu hits, %lu misses\n"
+                 "loudness: %lu analyzed, %lu failed%s\n"
+                 "visualizer: %u.%u fps, %u.%u%% cpu\n"
+                 "console: %lu frames, %lu bytes\n",
+                 st.native ? "alsa" : "aplay",
+                 st.period_frames,
+                 st.buffer_frames,
+                 st.buffer_frames * 1000 / PCM_RATE,
+                 st.delay_frames < 0 ? -1L : st.delay_frames * 1000 / PCM_RATE,
+                 st.xruns,
+                 st.resizes,
+                 ps.ring_frames, ps.ring_capacity,
+                 ps.ring_underruns,
+                 lat_in, lat_http, lat_ui,
+                 atomic_load(&control_q.dropped),
+                 ic.ready, ic.slots, ic.intro_ms, ic.hits, ic.misses,
+                 as.analyzed, as.failed, as.busy ? ", decoding" : "",
+                 vs.fps_x10 / 10, vs.fps_x10 % 10, vs.cpu_x10 / 10, vs.cpu_x10 % 10,
+                 atomic_load_explicit(&ui_frames, memory_order_relaxed),
+                 atomic_load_explicit(&ui_bytes, memory_order_relaxed));
+        send_response(fd, resp);
+        return;
+    }
+
+    /* /seek?ms=N jumps to N ms into the current local track */
+    else if (strncmp(buf, "GET /seek", 9) == 0) {
+        char ms[16];
+
+        if (url_param(buf, "ms", ms, sizeof(ms)) < 0) {
+            send_response(fd, "Usage: /seek?ms=<position>\n");
+            return;
+        }
+        post_cmd(CMD_SEEK, (int)strtoul(ms, NULL, 10), SRC_HTTP);
+        send_response(fd, "Seeking\n");
+        return;
+    }
+
+    /* /crossfade?s=N sets the track overlap in seconds (0 = gapless) */
+    else if (strncmp(buf, "GET /crossfade", 14) == 0) {
+        char resp[128], arg[32];
+        double sec = 0.0;
+        int ms;
+
+        if (url_param(buf, "s", arg, sizeof(arg)) == 0)
+            sec = strtod(arg, NULL);
+        if (isnan(sec)) {
+            send_response(fd, "Usage: /crossfade?s=<seconds>\n");
+            return;
+        }
+
+        /* Clamped before the conversion: huge or infinite values stay defined */
+        if (sec < 0.0)
+            sec = 0.0;
+        if (sec > PLAYER_MAX_CROSSFADE_MS / 1000.0)
+            sec = PLAYER_MAX_CROSSFADE_MS / 1000.0;
+        ms = (int)lrint(sec * 1000.0);
+        post_cmd(CMD_CROSSFADE, ms, SRC_HTTP);
+
+        snprintf(resp, sizeof(resp), "Crossfade: %d ms\n", ms);
+        send_response(fd, resp);
+        return;
+    }
+
+    /*
+     * HTTP endpoint: /local?song=N
+     * Switches to local mode and starts playing the requested track index N.
+     * Demonstrates socket-based control that integrates cleanly with
+     * the existing state machine (buttons + HTTP share the same path).
+     */
+  else if (strncmp(buf, "GET /local", 10) == 0) {
+    int id = 0;
+    char *p = strstr(buf, "song=");
+    const struct lib_view *lib = library_acquire();
+
+    if (p)
+        id = atoi(p + 5);
+
+    /* A removed slot or an empty library: nothing to fall back to */
+    if (id < 0 || !lib_track(lib, (unsigned)id)) {
+        library_release(lib);
+        send_not_found(fd);
+        return;
+    }
+
+    /* Treat /local as a normal local playback request through the daemon */
+    post_cmd(CMD_LOCAL, id, SRC_HTTP);
 
     char resp[256];
    snprintf(resp, sizeof(resp),
     "TCP SOCKET SUCCESS:\n"
     " → Raspberry Pi is now playing LOCAL track %d (%s).\n"
     " → Triggered via /local?song=%d over HTTP.\n",
-    current_song,
-    local_title[current_song],
-    current_song);
+    id,
+    lib_title(lib, (unsigned)id),
+    id);
 
+  library_release(lib);
   send_response(fd, resp);
 
 
     return;
 }
 
- 
+    /* /search?q=: typeahead over titles, artists and albums */
+    else if (strncmp(buf, "GET /search", 11) == 0) {
+        send_search(fd, buf);
+        return;
+    }
+
+    /* /queue/...: play queue edits, /queue: its contents */
+    else if (strncmp(buf, "GET /queue/", 11) == 0) {
+        handle_queue_request(fd, buf);
+        return;
+    }
+
+    else if (strncmp(buf, "GET /queue", 10) == 0) {
+        send_queue(fd);
+        return;
+    }
+
+    /* /shuffle?on=0|1 (or toggle without a value) */
+    else if (strncmp(buf, "GET /shuffle", 12) == 0) {
+        char on[8];
+
+        post_cmd(CMD_SHUFFLE, url_param(buf, "on", on, sizeof(on)) == 0 ? atoi(on) != 0 : -1,
+                 SRC_HTTP);
+        send_response(fd, "OK\n");
+        return;
+    }
+
+    /* /waveform?id=: peak overview for a scrub bar */
+    else if (strncmp(buf, "GET /waveform", 13) == 0) {
+        send_waveform(fd, buf);
+        return;
+    }
+
+    /* /library/...: artist, album and folder listings, paged */
+    else if (strncmp(buf, "GET /library/", 13) == 0) {
+        send_library(fd, buf);
+        return;
+    }
 
     else if (strncmp(buf, "GET / ", 6) == 0) {
         send_html(fd);
@@ -477,88 +2136,269 @@ static void start_http_server(void)
     addr.sin_addr.s_addr = INADDR_ANY;
     addr.sin_port = htons(PORT);
 
-    if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
-        { perror("bind"); return; }
-
-    if (listen(server_fd, 5) < 0)
-        { perror("listen"); return; }
+    if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(server_fd, 5) < 0) {
+        perror("bind/listen");
+        close(server_fd);
+        server_fd = -1;     /* No network thread without a socket */
+        return;
+    }
 
     printf("HTTP server running on port %d\n", PORT);
 }
 
+/* One client at a time; commands go to the control thread, never waited on */
+static void *network_thread(void *arg)
+{
+    (void)arg;
+    pthread_setname_np(pthread_self(), "network");
+
+    /* Search index: built once here, then only for changed segments */
+    const struct lib_view *lib = library_acquire();
+    search_refresh(lib);
+    library_release(lib);
+
+    for (;;) {
+        int cfd = accept4(server_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED)
+                perror("accept");
+            continue;
+        }
+
+        handle_http_request(cfd);
+        close(cfd);
+    }
+
+    return NULL;
+}
+
+/* Start a helper thread with the daemon's small, fixed stack size */
+static int start_thread(void *(*fn)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    pthread_t t;
+    int err;
+
+    rt_thread_attr(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&t, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+
+    if (err) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
 /* ------------------------------------------------------- */
 /*                          MAIN                           */
 /* ------------------------------------------------------- */
 
-int main(void)
+int main(int argc, char **argv)
 {
+    /* Kernel microbenchmark, runs without any hardware attached */
+    if (argc > 1 && strcmp(argv[1], "--bench-mix") == 0)
+        return mix_bench();
+
+    /* Optional settings; built-in defaults apply when the file is missing */
+    if (config_load(CONFIG_PATH) < 0)
+        perror(CONFIG_PATH);
+
+    struct rt_config rcfg = {
+        .enable          = (int)config_int("rt_mode", 0),
+        .audio_priority  = (int)config_int("rt_priority", 80),
+        .player_priority = (int)config_int("rt_player_priority", 0),
+        .audio_cpu       = (int)config_int("rt_audio_cpu", 3),
+    };
+    rt_configure(&rcfg);
+
+    /* Wakeup latency of the audio thread's settings, no hardware needed */
+    if (argc > 1 && strcmp(argv[1], "--rt-latency") == 0)
+        return rt_latency_test(argc > 2 ? atoi(argv[2]) : 10);
+
+    crossfade_ms = (int)config_int("crossfade_ms", 0);
+    softvol = (int)config_int("softvol", 1);
+    normalize = (int)config_int("normalize", 1);
+    loudness_target = (int)config_int("loudness_target", -18) * 100;
+    trim_lead = (int)config_int("trim_lead", 1);
+    trim_trail = (int)config_int("trim_trail", 1);
+    visual_cfg.enable  = (int)config_int("visualizer", 1);
+    visual_cfg.fps     = (unsigned)config_int("visualizer_fps", 25);
+    visual_cfg.cpu_pct = (unsigned)config_int("visualizer_cpu", 5);
+
+    struct output_config ocfg = {
+        .device    = config_str("alsa_device", "default"),
+        .profile   = strcmp(config_str("output_profile", "robust"), "low_latency") == 0
+                         ? OUTPUT_LOW_LATENCY : OUTPUT_ROBUST,
+        .period_us = (unsigned)config_int("period_us", 0),
+        .buffer_us = (unsigned)config_int("buffer_us", 0),
+        .adaptive  = (int)config_int("output_adaptive", 1),
+    };
+    output_configure(&ocfg);
+
+    /* Local library: map the index, scanning only if there is none yet */
+    const char *music_dir = config_str("music_dir", MUSIC_DIR);
+    const char *lib_index = config_str("library_index", LIBRARY_INDEX);
+    int rescan = argc > 1 && strcmp(argv[1], "--scan") == 0;
+
+    if (library_load(music_dir, lib_index, rescan) < 0 && rescan)
+        return 1;
+    if (rescan)
+        return 0;
+
     /* Open the input device that delivers physical button events */
     int fd = open(INPUT_DEV, O_RDONLY);
     if (fd < 0) { perror("open /dev/music_input"); return 1; }
 
-    /* Allow default handling for SIGINT/SIGTERM (systemd or shell can stop us) */
-    signal(SIGINT, SIG_DFL);
-    signal(SIGTERM, SIG_DFL);
+    /*
+     * SIGINT/SIGTERM (systemd or shell) end the control loop, so the
+     * shutdown below still commits and saves the library.  Blocked before
+     * any thread starts, so they only ever arrive through sig_fd.
+     */
+    sigset_t stop_sigs;
+    sigemptyset(&stop_sigs);
+    sigaddset(&stop_sigs, SIGINT);
+    sigaddset(&stop_sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_sigs, NULL);
+    int sig_fd = signalfd(-1, &stop_sigs, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (sig_fd < 0) { perror("signalfd"); return 1; }
+
+    /* A decoder or HTTP client closing early must not kill the daemon */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Lock memory and leave the audio core to the writer thread */
+    rt_setup_process();
+
+    /* Cloud tracks are fetched and cached by the download scheduler */
+    dlsched_init(CACHE_DIR);
+
+    /* All timed work of the control thread hangs off one timerfd */
+    if (timerwheel_init() < 0) return 1;
+
+    /* Upcoming local tracks are read into the page cache in the background */
+    prefetch_init(seek_table_ready);
+
+    /* Queues between the input/network/UI threads and this (control) thread */
+    if (mpscq_init(&control_q, CONTROL_Q_SIZE, sizeof(struct cmd)) < 0 ||
+        mpscq_init(&ui_q, UI_Q_SIZE, sizeof(struct ui_msg)) < 0)
+        return 1;
+
+    /* Decoded intros of recent and upcoming tracks, so skips start from RAM */
+    introcache_init((size_t)config_int("intro_cache_kb", 16384) * 1024,
+                    (unsigned)config_int("intro_ms", 4000));
+
+    /* Decoders are owned by the player; clear out leftovers, then start it */
+    kill_all_players();
+    if (player_init() < 0) return 1;
+    player_set_crossfade(crossfade_ms);
+
+    /* Loudness, silence and overviews of tracks and downloads, idle priority */
+    if (config_int("waveforms", 1))
+        waveform_init(lib_index);
+    analyzer_init(analysis_ready, (int)config_int("silence_db", -60));
+    analyze_cloud_cache();
+
+    /*
+     * Library changes from here on are picked up as they happen, and those
+     * made while the daemon was down once startup has settled
+     */
+    libwatch_init(music_dir, library_changes_ready);
+    timer_arm(&rescan_timer, RESCAN_MS, 1000);
 
     /* Initialize audio and user interface state */
+    if (start_thread(ui_thread, NULL) < 0) return 1;
     set_volume(current_volume);
     draw_status("Idle");
 
-    /* Spin up the HTTP control server (non-blocking via poll) */
+    /* Buttons and the HTTP control port get a thread each */
+    if (start_thread(input_thread, (void *)(intptr_t)fd) < 0) return 1;
     start_http_server();
+    if (server_fd >= 0 && start_thread(network_thread, NULL) < 0) return 1;
 
-    struct pollfd pfd[2];
-    pfd[0].fd = fd;
+    struct pollfd pfd[4 + PROC_MAX + DL_MAX_POLLFDS];
+    pfd[0].fd = mpscq_fd(&control_q);
     pfd[0].events = POLLIN;
-    pfd[1].fd = server_fd;
+    pfd[1].fd = player_event_fd();
     pfd[1].events = POLLIN;
+    pfd[2].fd = timerwheel_fd();
+    pfd[2].events = POLLIN;
+    pfd[3].fd = sig_fd;
+    pfd[3].events = POLLIN;
 
-    char ev;
-
+    /* This thread is the control thread: it alone touches playback state */
     while (running) {
-        /* Wait for either a button press or an incoming HTTP connection */
-        int r = poll(pfd, 2, 200);
+        /* Timed work of the services becomes timers; idle means no wakeups */
+        int timeout = dlsched_timeout_ms();
+        if (timeout >= 0)
+            timer_arm(&dlsched_timer, (uint64_t)timeout, 10);
+        else
+            timer_cancel(&dlsched_timer);
+
+        timeout = proc_timeout_ms();
+        if (timeout >= 0)
+            timer_arm(&proc_timer, (uint64_t)timeout, 100);
+        else
+            timer_cancel(&proc_timer);
+
+        /* Child pidfds, then download pipes, follow the fixed fds */
+        int nproc = proc_pollfds(&pfd[4], PROC_MAX);
+        int ndl = dlsched_pollfds(&pfd[4 + nproc], DL_MAX_POLLFDS);
+
+        /* Sleep until a command, player event, child exit, data or timer */
+        int r = poll(pfd, 4 + nproc + ndl, -1);
         if (r < 0) continue;
 
-        /* Handle physical button input from /dev/music_input */
-        if (pfd[0].revents & POLLIN) {
-            if (read(fd, &ev, 1) == 1) {
-
-                struct timespec ts;
-                clock_gettime(CLOCK_MONOTONIC, &ts);
-                unsigned long now = ts.tv_sec * 1000 + ts.tv_nsec/1000000UL;
-
-                /* Simple software debounce: ignore events that are too close */
-                if (now - last_event_ms < 200) continue;
-                last_event_ms = now;
-
-                switch (ev) {
-                    case     'P': handle_playpause(); break;
-                    case     'N': handle_next(); break;
-                    case     'R': handle_prev(); break;
-                    case     'U': volume_up(); break;
-                    case     'D': volume_down(); break;
-                    case     'M': toggle_mute(); break;
-                    case     'C': toggle_mode(); break;
-                    default:      break;
-                }
-            }
+        /* Asked to stop: finish this pass, then shut down */
+        if (pfd[3].revents & POLLIN) {
+            struct signalfd_siginfo si;
+            while (read(sig_fd, &si, sizeof(si)) == (ssize_t)sizeof(si))
+                running = 0;
         }
 
-        /* Handle new HTTP clients on the control port */
-        if (pfd[1].revents & POLLIN) {
-            int cfd = accept(server_fd, NULL, NULL);
-            if (cfd >= 0) {
-                handle_http_request(cfd);
-                close(cfd);
-            }
+        if (pfd[2].revents & POLLIN)
+            timerwheel_run();
+
+        /* Reap exited children; their callbacks update download jobs */
+        proc_service(&pfd[4], nproc);
+
+        /* Move download data first so controls below see fresh job state */
+        dlsched_service(&pfd[4 + nproc], ndl);
+
+        /* A prefetch just landed in the cache: it can be armed now */
+        if (is_playing && !next_armed &&
+            dlsched_completions() != seen_completions)
+            arm_next();
+
+        /* A download landed in the cache: analyze it */
+        if (dlsched_completions() != analyzed_completions)
+            analyze_cloud_cache();
+
+        /* Track ended or advanced inside the player thread */
+        if (pfd[1].revents & POLLIN)
+            handle_player_events();
+
+        /* Commands from the input and network threads */
+        if (pfd[0].revents & POLLIN) {
+            struct cmd c;
+
+            mpscq_clear_fd(&control_q);
+            while (mpscq_pop(&control_q, &c))
+                handle_command(&c);
         }
     }
 
     /* Clean shutdown: stop playback, close devices, and release resources */
     stop_playback();
+    player_shutdown();
+    dlsched_shutdown();
+    proc_reap_all();
+    commit_analysis(NULL);
+    library_sync();
     close(fd);
-    if (display_fp != stdout) fclose(display_fp);
+    close(sig_fd);
+    if (display_fd > STDOUT_FILENO) close(display_fd);
 
     return 0;
 }
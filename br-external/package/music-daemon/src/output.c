@@ -0,0 +1,489 @@
+/*
+ * output.c
+ *
+ * Output stage: native ALSA PCM when built with alsa-lib (HAVE_ALSA),
+ * otherwise a long-lived aplay child reading raw PCM on stdin.  Only the
+ * player's writer thread calls in here.  Devices without S16_LE are fed
+ * S32_LE through the NEON widening kernel in mix.c.
+ *
+ * Buffer sizing:
+ *   - OUTPUT_LOW_LATENCY uses a short buffer so Next/Stop/volume are heard
+ *     within a few tens of milliseconds.
+ *   - OUTPUT_ROBUST keeps several hundred milliseconds queued.
+ *   - With adaptation enabled, every xrun doubles the buffer (up to
+ *     ADAPT_MAX_BUFFER_US).  Only a running stream that was starved of
+ *     data counts: the device running dry across a track change or
+ *     before the first start is expected and just re-prepared.  After a
+ *     quiet period the size steps back towards the configured value the
+ *     next time the output is opened, so a shrink never interrupts a
+ *     running stream.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include "output.h"
+#include "mix.h"
+#include "pcm.h"
+#include "proc.h"
+
+#define APLAY_PATH               "/usr/bin/aplay"
+#define OUTPUT_PIPE_BYTES        (16 * 1024)   /* aplay: bounds player request latency */
+#define OUTPUT_DRAIN_WAIT_MS     2000          /* aplay: longest buffer play-out       */
+
+#define LOW_LATENCY_PERIOD_US    5000          /* 4 x 5 ms                */
+#define LOW_LATENCY_BUFFER_US    20000
+#define ROBUST_PERIOD_US         50000         /* 8 x 50 ms               */
+#define ROBUST_BUFFER_US         400000
+#define ADAPT_MAX_BUFFER_US      1000000
+#define ADAPT_SHRINK_AFTER_SEC   300           /* xrun-free time before shrinking */
+
+/* Configuration (control loop, before the first open) */
+static char     device[64] = "default";
+static unsigned cfg_period_us = ROBUST_PERIOD_US;
+static unsigned cfg_buffer_us = ROBUST_BUFFER_US;
+static int      adaptive = 1;
+
+/* Effective sizes, grown by adaptation (player thread) */
+static unsigned cur_period_us = ROBUST_PERIOD_US;
+static unsigned cur_buffer_us = ROBUST_BUFFER_US;
+static time_t   last_xrun;
+
+/* Telemetry, written by the player thread, read by anyone */
+static _Atomic unsigned long st_xruns;
+static _Atomic unsigned long st_resizes;
+static _Atomic long          st_delay = -1;
+static _Atomic unsigned long st_period;
+static _Atomic unsigned long st_buffer;
+
+static unsigned long us_to_frames(unsigned us)
+{
+    return (unsigned long)us * PCM_RATE / 1000000UL;
+}
+
+/* On open: step back towards the configured size after a quiet period */
+static void adapt_shrink(void)
+{
+    if (!adaptive || cur_buffer_us <= cfg_buffer_us)
+        return;
+    if (time(NULL) - last_xrun < ADAPT_SHRINK_AFTER_SEC)
+        return;
+
+    cur_buffer_us /= 2;
+    cur_period_us /= 2;
+    if (cur_buffer_us < cfg_buffer_us) {
+        cur_buffer_us = cfg_buffer_us;
+        cur_period_us = cfg_period_us;
+    }
+    last_xrun = time(NULL);     /* One step per quiet period */
+    atomic_fetch_add(&st_resizes, 1);
+}
+
+#ifdef HAVE_ALSA
+
+/* ------------------------------------------------------- */
+/*                   NATIVE ALSA BACKEND                   */
+/* ------------------------------------------------------- */
+
+#define WIDE_FRAMES 1024    /* Conversion chunk for S32-only devices */
+
+static snd_pcm_t *pcm;
+static int        wide;     /* Device takes S32_LE: widen with mix_s16_to_s32 */
+static int        primed;   /* Running, and no dry spell announced since */
+static int32_t    wide_buf[WIDE_FRAMES * PCM_CHANNELS];
+
+/* Double the buffer (and period, keeping the period count) after an xrun */
+static void adapt_grow(void)
+{
+    last_xrun = time(NULL);
+    atomic_fetch_add(&st_xruns, 1);
+
+    if (!adaptive || cur_buffer_us >= ADAPT_MAX_BUFFER_US)
+        return;
+
+    cur_buffer_us *= 2;
+    cur_period_us *= 2;
+    if (cur_buffer_us > ADAPT_MAX_BUFFER_US) {
+        cur_period_us = cur_period_us * ADAPT_MAX_BUFFER_US / cur_buffer_us;
+        cur_buffer_us = ADAPT_MAX_BUFFER_US;
+    }
+    atomic_fetch_add(&st_resizes, 1);
+}
+
+static int alsa_open(void)
+{
+    snd_pcm_hw_params_t *hw;
+    snd_pcm_sw_params_t *sw;
+    snd_pcm_uframes_t period, buffer;
+    unsigned rate = PCM_RATE;
+    unsigned period_us = cur_period_us, buffer_us = cur_buffer_us;
+    int err;
+
+    if ((err = snd_pcm_open(&pcm, device, SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
+        fprintf(stderr, "output: open %s: %s\n", device, snd_strerror(err));
+        pcm = NULL;
+        return -1;
+    }
+
+    snd_pcm_hw_params_alloca(&hw);
+    if ((err = snd_pcm_hw_params_any(pcm, hw)) < 0 ||
+        (err = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+        fprintf(stderr, "output: hw params: %s\n", snd_strerror(err));
+        goto fail;
+    }
+
+    /* Some I2S DACs only take 32-bit samples on hw: devices */
+    wide = 0;
+    if (snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S16_LE) < 0) {
+        if ((err = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S32_LE)) < 0) {
+            fprintf(stderr, "output: no S16_LE/S32_LE on %s: %s\n",
+                    device, snd_strerror(err));
+            goto fail;
+        }
+        wide = 1;
+    }
+
+    if ((err = snd_pcm_hw_params_set_channels(pcm, hw, PCM_CHANNELS)) < 0 ||
+        (err = snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, NULL)) < 0 ||
+        (err = snd_pcm_hw_params_set_buffer_time_near(pcm, hw, &buffer_us, NULL)) < 0 ||
+        (err = snd_pcm_hw_params_set_period_time_near(pcm, hw, &period_us, NULL)) < 0 ||
+        (err = snd_pcm_hw_params(pcm, hw)) < 0) {
+        fprintf(stderr, "output: hw params: %s\n", snd_strerror(err));
+        goto fail;
+    }
+
+    if (rate != PCM_RATE)
+        fprintf(stderr, "output: %s runs at %u Hz, expected %d\n",
+                device, rate, PCM_RATE);
+
+    snd_pcm_hw_params_get_period_size(hw, &period, NULL);
+    snd_pcm_hw_params_get_buffer_size(hw, &buffer);
+
+    /* Start once the buffer is nearly full; wake the writer per period */
+    snd_pcm_sw_params_alloca(&sw);
+    if ((err = snd_pcm_sw_params_current(pcm, sw)) < 0 ||
+        (err = snd_pcm_sw_params_set_start_threshold(pcm, sw, buffer - period)) < 0 ||
+        (err = snd_pcm_sw_params_set_avail_min(pcm, sw, period)) < 0 ||
+        (err = snd_pcm_sw_params(pcm, sw)) < 0) {
+        fprintf(stderr, "output: sw params: %s\n", snd_strerror(err));
+        goto fail;
+    }
+
+    atomic_store(&st_period, (unsigned long)period);
+    atomic_store(&st_buffer, (unsigned long)buffer);
+    primed = 0;
+    return 0;
+
+fail:
+    snd_pcm_close(pcm);
+    pcm = NULL;
+    return -1;
+}
+
+static void alsa_close(int drain)
+{
+    if (!pcm)
+        return;
+
+    if (drain)
+        snd_pcm_drain(pcm);
+    else
+        snd_pcm_drop(pcm);
+
+    snd_pcm_close(pcm);
+    pcm = NULL;
+    atomic_store(&st_delay, -1);
+}
+
+/* Write frames in the device's sample format, recovering from xruns */
+static int alsa_write_frames(const void *buf, snd_pcm_uframes_t frames)
+{
+    const char *p = buf;
+    size_t frame_bytes = wide ? PCM_CHANNELS * sizeof(int32_t) : PCM_FRAME_BYTES;
+
+    while (frames > 0) {
+        snd_pcm_sframes_t n = snd_pcm_writei(pcm, p, frames);
+
+        if (n == -EAGAIN || n == -EINTR)
+            continue;
+
+        if (n == -EPIPE && !primed) {
+            /* Ran dry where no data was due (track change, cold start) */
+            if (snd_pcm_prepare(pcm) < 0) {
+                alsa_close(0);
+                return -1;
+            }
+            continue;
+        }
+
+        if (n == -EPIPE) {
+            /* Underrun: reopen with a bigger buffer, the stream broke anyway */
+            unsigned before = cur_buffer_us;
+            adapt_grow();
+            if (cur_buffer_us != before) {
+                alsa_close(0);
+                if (alsa_open() < 0)
+                    return -1;
+                continue;
+            }
+        }
+
+        if (n < 0) {
+            if (snd_pcm_recover(pcm, (int)n, 1) < 0) {
+                alsa_close(0);
+                return -1;
+            }
+            continue;
+        }
+
+        p += n * frame_bytes;
+        frames -= (snd_pcm_uframes_t)n;
+    }
+    return 0;
+}
+
+static int alsa_write(const void *buf, size_t len)
+{
+    const int16_t *p = buf;
+    size_t frames = len / PCM_FRAME_BYTES;
+    snd_pcm_sframes_t delay;
+
+    if (!pcm)
+        return -1;
+
+    if (!wide) {
+        if (alsa_write_frames(p, frames) < 0)
+            return -1;
+    } else {
+        while (frames > 0) {
+            size_t n = frames < WIDE_FRAMES ? frames : WIDE_FRAMES;
+
+            mix_s16_to_s32(wide_buf, p, n * PCM_CHANNELS);
+            if (alsa_write_frames(wide_buf, n) < 0)
+                return -1;
+            p      += n * PCM_CHANNELS;
+            frames -= n;
+        }
+    }
+
+    if (snd_pcm_state(pcm) == SND_PCM_STATE_RUNNING)
+        primed = 1;
+    if (snd_pcm_delay(pcm, &delay) == 0)
+        atomic_store(&st_delay, (long)delay);
+    return 0;
+}
+
+#else /* !HAVE_ALSA */
+
+/* ------------------------------------------------------- */
+/*                    APLAY FALLBACK                       */
+/* ------------------------------------------------------- */
+
+static pid_t out_pid   = -1;
+static int   out_fd    = -1;
+static pid_t drain_pid = -1;    /* Previous aplay still playing out its buffer */
+
+static int aplay_open(void)
+{
+    int p[2];
+    char rate[16], chans[8], period[16], buffer[16];
+
+    /*
+     * The device is exclusive: let a draining instance finish first, but
+     * never wait on it for longer than its buffer can take to play out.
+     */
+    if (drain_pid > 0) {
+        if (proc_wait(drain_pid, OUTPUT_DRAIN_WAIT_MS) < 0) {
+            fprintf(stderr, "output: aplay did not drain, terminating it\n");
+            proc_terminate(drain_pid);
+            (void)proc_wait(drain_pid, PROC_KILL_TIMEOUT_MS);
+        }
+        drain_pid = -1;
+    }
+
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        perror("output: pipe");
+        return -1;
+    }
+
+    snprintf(rate, sizeof(rate), "%d", PCM_RATE);
+    snprintf(chans, sizeof(chans), "%d", PCM_CHANNELS);
+    snprintf(period, sizeof(period), "%u", cur_period_us);
+    snprintf(buffer, sizeof(buffer), "%u", cur_buffer_us);
+
+    char *const argv[] = {
+        "aplay", "-q", "-D", device,
+        "-t", "raw", "-f", "S16_LE", "-r", rate, "-c", chans,
+        "-F", period, "-B", buffer, "-", NULL
+    };
+    struct proc_spec spec = {
+        .path   = APLAY_PATH,
+        .argv   = argv,
+        .in_fd  = p[0],
+        .out_fd = -1,
+    };
+
+    pid_t pid = proc_spawn(&spec);
+    if (pid < 0) {
+        close(p[0]);
+        close(p[1]);
+        return -1;
+    }
+
+    close(p[0]);
+
+    /*
+     * aplay keeps its own device buffer; a small pipe in front of it keeps
+     * the player thread from sitting in write() for long.
+     */
+    fcntl(p[1], F_SETPIPE_SZ, OUTPUT_PIPE_BYTES);
+
+    out_pid = pid;
+    out_fd  = p[1];
+
+    atomic_store(&st_period, us_to_frames(cur_period_us));
+    atomic_store(&st_buffer, us_to_frames(cur_buffer_us));
+    return 0;
+}
+
+static void aplay_close(int drain)
+{
+    if (out_fd >= 0) {
+        close(out_fd);
+        out_fd = -1;
+    }
+
+    if (out_pid <= 0)
+        return;
+
+    if (drain) {
+        /* EOF on stdin: aplay plays what it has buffered, then exits */
+        drain_pid = out_pid;
+    } else {
+        proc_terminate(out_pid);
+    }
+    out_pid = -1;
+}
+
+static int aplay_write(const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    if (out_fd < 0)
+        return -1;
+
+    while (len > 0) {
+        ssize_t n = write(out_fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            aplay_close(0);     /* aplay died; reopened on next play */
+            return -1;
+        }
+        p   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+#endif /* HAVE_ALSA */
+
+/* ------------------------------------------------------- */
+/*                       PUBLIC API                        */
+/* ------------------------------------------------------- */
+
+void output_configure(const struct output_config *cfg)
+{
+    if (cfg->device && *cfg->device)
+        snprintf(device, sizeof(device), "%s", cfg->device);
+
+    if (cfg->profile == OUTPUT_LOW_LATENCY) {
+        cfg_period_us = LOW_LATENCY_PERIOD_US;
+        cfg_buffer_us = LOW_LATENCY_BUFFER_US;
+    } else {
+        cfg_period_us = ROBUST_PERIOD_US;
+        cfg_buffer_us = ROBUST_BUFFER_US;
+    }
+
+    if (cfg->period_us)
+        cfg_period_us = cfg->period_us;
+    if (cfg->buffer_us)
+        cfg_buffer_us = cfg->buffer_us;
+    if (cfg_period_us * 2 > cfg_buffer_us)
+        cfg_period_us = cfg_buffer_us / 2;
+
+    adaptive      = cfg->adaptive;
+    cur_period_us = cfg_period_us;
+    cur_buffer_us = cfg_buffer_us;
+
+    atomic_store(&st_period, us_to_frames(cur_period_us));
+    atomic_store(&st_buffer, us_to_frames(cur_buffer_us));
+}
+
+int output_open(void)
+{
+#ifdef HAVE_ALSA
+    if (pcm)
+        return 0;
+    adapt_shrink();
+    return alsa_open();
+#else
+    if (out_fd >= 0)
+        return 0;
+    adapt_shrink();
+    return aplay_open();
+#endif
+}
+
+int output_write(const void *buf, size_t len)
+{
+#ifdef HAVE_ALSA
+    return alsa_write(buf, len);
+#else
+    return aplay_write(buf, len);
+#endif
+}
+
+void output_gap(void)
+{
+#ifdef HAVE_ALSA
+    primed = 0;
+#endif
+}
+
+void output_close(int drain)
+{
+#ifdef HAVE_ALSA
+    alsa_close(drain);
+#else
+    aplay_close(drain);
+#endif
+}
+
+void output_get_stats(struct output_stats *st)
+{
+#ifdef HAVE_ALSA
+    st->native = 1;
+#else
+    st->native = 0;
+#endif
+    st->xruns         = atomic_load(&st_xruns);
+    st->resizes       = atomic_load(&st_resizes);
+    st->delay_frames  = atomic_load(&st_delay);
+    st->period_frames = atomic_load(&st_period);
+    st->buffer_frames = atomic_load(&st_buffer);
+}
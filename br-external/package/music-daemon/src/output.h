@@ -0,0 +1,67 @@
+/*
+ * output.h
+ *
+ * Audio output stage.  The player thread writes PCM (see pcm.h) here.
+ * The output stays open across track changes so the device never drains
+ * between consecutive tracks.
+ *
+ * With alsa-lib available (HAVE_ALSA) the daemon drives the PCM device
+ * itself with a configurable period/buffer size, counts xruns and grows
+ * the buffer when they happen.  Without it, audio goes through an aplay
+ * child and only the configured sizes are honoured.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+enum output_profile {
+    OUTPUT_ROBUST = 0,          /* Large buffer, survives scheduling hiccups */
+    OUTPUT_LOW_LATENCY,         /* Small buffer, controls respond at once    */
+};
+
+struct output_config {
+    const char         *device;     /* ALSA PCM name, e.g. "default"         */
+    enum output_profile profile;
+    unsigned            period_us;  /* 0 = profile default                   */
+    unsigned            buffer_us;  /* 0 = profile default                   */
+    int                 adaptive;   /* Grow the buffer after xruns           */
+};
+
+/* Telemetry, safe to read from any thread */
+struct output_stats {
+    int           native;           /* 1 = alsa-lib, 0 = aplay fallback      */
+    unsigned long xruns;            /* Underruns since startup               */
+    unsigned long resizes;          /* Buffer changes made by adaptation     */
+    long          delay_frames;     /* Queued in the device, -1 = unknown    */
+    unsigned long period_frames;
+    unsigned long buffer_frames;
+};
+
+/* Apply settings; takes effect the next time the output is opened */
+void output_configure(const struct output_config *cfg);
+
+/* Open the output if it is not open yet. Returns 0 on success. */
+int  output_open(void);
+
+/* Blocking write of whole frames; returns 0 on success, -1 on error */
+int  output_write(const void *buf, size_t len);
+
+/*
+ * The stream may run dry next (track change): an underrun there is
+ * expected, neither counted as an xrun nor a reason to grow the buffer.
+ */
+void output_gap(void);
+
+/*
+ * Close the output.  drain != 0 lets already written audio (e.g. a fade-out)
+ * play to the end; otherwise playback stops immediately.
+ */
+void output_close(int drain);
+
+void output_get_stats(struct output_stats *st);
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,22 @@
+/*
+ * pcm.h
+ *
+ * PCM format shared by the decoder, the player thread and the output stage.
+ * Every decoder is told to produce this format, so tracks can be spliced
+ * back to back without reopening the output device.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef PCM_H
+#define PCM_H
+
+#define PCM_RATE         44100              /* Hz                        */
+#define PCM_CHANNELS     2                  /* Interleaved L/R           */
+#define PCM_SAMPLE_BYTES 2                  /* Signed 16-bit, native LE  */
+#define PCM_FRAME_BYTES  (PCM_CHANNELS * PCM_SAMPLE_BYTES)
+
+/* Convert a duration in milliseconds to a frame count */
+#define PCM_MS_TO_FRAMES(ms) ((unsigned long)(ms) * PCM_RATE / 1000)
+
+#endif /* PCM_H */
@@ -0,0 +1,156 @@
+/*
+ * pcmring.c
+ *
+ * SPSC PCM block ring (see pcmring.h).
+ *
+ * Indices are free-running counters; the slot is index & (nslots - 1), so
+ * tail - head is the number of filled slots.  The waiter flags and the
+ * indices use sequentially consistent accesses: a side that is about to
+ * sleep publishes its flag and then re-checks the index, while the other
+ * side publishes the index and then checks the flag, so one of the two
+ * always sees the other and no wakeup is lost.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "pcmring.h"
+#include "pcm.h"
+
+static struct pcm_block *slot_at(struct pcm_ring *r, unsigned long idx)
+{
+    return (struct pcm_block *)(r->slots + (idx & (r->nslots - 1)) * r->slot_bytes);
+}
+
+/* Sleep until the other side signals; spurious returns are harmless */
+static void ring_sleep(int fd)
+{
+    eventfd_t v;
+    (void)eventfd_read(fd, &v);
+}
+
+static void ring_wake(_Atomic int *waiting, int fd)
+{
+    if (atomic_load(waiting) && atomic_exchange(waiting, 0))
+        (void)eventfd_write(fd, 1);
+}
+
+int pcmring_init(struct pcm_ring *r, unsigned nslots, unsigned block_frames)
+{
+    unsigned n = 1;
+    size_t bytes;
+
+    while (n < nslots)
+        n <<= 1;
+
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->consumer_waiting, 0);
+    atomic_init(&r->producer_waiting, 0);
+    atomic_init(&r->underruns, 0);
+    atomic_init(&r->fill_frames, 0);
+
+    bytes = sizeof(struct pcm_block) + (size_t)block_frames * PCM_FRAME_BYTES;
+    r->slot_bytes   = (bytes + PCMRING_CACHELINE - 1) & ~(size_t)(PCMRING_CACHELINE - 1);
+    r->nslots       = n;
+    r->block_frames = block_frames;
+
+    r->slots = aligned_alloc(PCMRING_CACHELINE, r->slot_bytes * n);
+    if (!r->slots) {
+        perror("pcmring: alloc");
+        return -1;
+    }
+    memset(r->slots, 0, r->slot_bytes * n);    /* Fault the pages in now */
+
+    r->data_fd  = eventfd(0, EFD_CLOEXEC);
+    r->space_fd = eventfd(0, EFD_CLOEXEC);
+    if (r->data_fd < 0 || r->space_fd < 0) {
+        perror("pcmring: eventfd");
+        pcmring_destroy(r);     /* Slots, and whichever eventfd opened */
+        return -1;
+    }
+    return 0;
+}
+
+void pcmring_destroy(struct pcm_ring *r)
+{
+    free(r->slots);
+    r->slots = NULL;
+    if (r->data_fd >= 0)
+        close(r->data_fd);
+    if (r->space_fd >= 0)
+        close(r->space_fd);
+    r->data_fd = r->space_fd = -1;
+}
+
+/* ------------------------------------------------------- */
+/*                       PRODUCER                          */
+/* ------------------------------------------------------- */
+
+struct pcm_block *pcmring_reserve(struct pcm_ring *r)
+{
+    unsigned long tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    for (;;) {
+        if (tail - atomic_load_explicit(&r->head, memory_order_acquire) < r->nslots)
+            break;
+
+        atomic_store(&r->producer_waiting, 1);
+        if (tail - atomic_load(&r->head) >= r->nslots)
+            ring_sleep(r->space_fd);
+        atomic_store(&r->producer_waiting, 0);
+    }
+
+    struct pcm_block *b = slot_at(r, tail);
+    b->frames = 0;
+    b->flags  = 0;
+    return b;
+}
+
+void pcmring_commit(struct pcm_ring *r)
+{
+    unsigned long tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&r->fill_frames, slot_at(r, tail)->frames,
+                              memory_order_relaxed);
+    atomic_store(&r->tail, tail + 1);
+    ring_wake(&r->consumer_waiting, r->data_fd);
+}
+
+/* ------------------------------------------------------- */
+/*                       CONSUMER                          */
+/* ------------------------------------------------------- */
+
+struct pcm_block *pcmring_peek(struct pcm_ring *r)
+{
+    unsigned long head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    for (;;) {
+        if (atomic_load_explicit(&r->tail, memory_order_acquire) != head)
+            break;
+
+        atomic_store(&r->consumer_waiting, 1);
+        if (atomic_load(&r->tail) == head)
+            ring_sleep(r->data_fd);
+        atomic_store(&r->consumer_waiting, 0);
+    }
+
+    return slot_at(r, head);
+}
+
+void pcmring_release(struct pcm_ring *r)
+{
+    unsigned long head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    atomic_fetch_sub_explicit(&r->fill_frames, slot_at(r, head)->frames,
+                              memory_order_relaxed);
+    atomic_store(&r->head, head + 1);
+    ring_wake(&r->producer_waiting, r->space_fd);
+}
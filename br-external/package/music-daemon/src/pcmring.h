@@ -0,0 +1,89 @@
+/*
+ * pcmring.h
+ *
+ * Lock-free single-producer / single-consumer ring of PCM blocks between
+ * the player thread (producer) and the audio writer thread (consumer).
+ *
+ * Each slot carries up to block_frames frames (see pcm.h) plus flags that
+ * tell the writer to open, drain or close the output, so device control
+ * travels in order with the audio.  The producer fills a slot in place
+ * between pcmring_reserve() and pcmring_commit(); the consumer reads it in
+ * place between pcmring_peek() and pcmring_release().  Head, tail and the
+ * counters sit on separate cache lines so the two threads do not bounce
+ * a line on every block.
+ *
+ * Blocking is only done by the waiting side, through an eventfd that the
+ * other side signals when it sees the waiter flag; while neither side
+ * waits, a block costs a few atomic operations and no system call.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef PCMRING_H
+#define PCMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define PCMRING_CACHELINE 64
+
+/* Block flags, acted on by the writer in this order */
+#define PCMRING_OPEN   0x1      /* Open the output before these frames    */
+#define PCMRING_CLOSE  0x2      /* Close the output after these frames    */
+#define PCMRING_DRAIN  0x4      /* With CLOSE: let queued audio play out  */
+#define PCMRING_QUIT   0x8      /* Writer thread exits                    */
+#define PCMRING_GAP    0x10     /* Track change: a dry ring is expected   */
+
+struct pcm_block {
+    unsigned frames;
+    unsigned flags;
+    int16_t  pcm[];             /* block_frames * PCM_CHANNELS samples    */
+};
+
+struct pcm_ring {
+    /* Consumer side */
+    _Alignas(PCMRING_CACHELINE) _Atomic unsigned long head;
+    _Atomic int           consumer_waiting;
+    _Atomic unsigned long underruns;        /* Ran dry after having been full */
+
+    /* Producer side */
+    _Alignas(PCMRING_CACHELINE) _Atomic unsigned long tail;
+    _Atomic int           producer_waiting;
+
+    /* Shared, read-mostly */
+    _Alignas(PCMRING_CACHELINE) _Atomic unsigned long fill_frames;
+    unsigned char *slots;
+    size_t         slot_bytes;
+    unsigned       nslots;                  /* Power of two */
+    unsigned       block_frames;
+    int            data_fd;                 /* eventfd: consumer wakeups */
+    int            space_fd;                /* eventfd: producer wakeups */
+};
+
+/* nslots is rounded up to a power of two. Returns 0 on success. */
+int  pcmring_init(struct pcm_ring *r, unsigned nslots, unsigned block_frames);
+void pcmring_destroy(struct pcm_ring *r);
+
+/* Producer: next free slot, blocking while the ring is full */
+struct pcm_block *pcmring_reserve(struct pcm_ring *r);
+void pcmring_commit(struct pcm_ring *r);
+
+/* Consumer: oldest filled slot, blocking while the ring is empty */
+struct pcm_block *pcmring_peek(struct pcm_ring *r);
+void pcmring_release(struct pcm_ring *r);
+
+/* Non-blocking checks for the consumer, used to count underruns */
+static inline int pcmring_empty(struct pcm_ring *r)
+{
+    return atomic_load_explicit(&r->head, memory_order_relaxed) ==
+           atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+static inline int pcmring_full(struct pcm_ring *r)
+{
+    return atomic_load_explicit(&r->tail, memory_order_acquire) -
+           atomic_load_explicit(&r->head, memory_order_relaxed) >= r->nslots;
+}
+
+#endif /* PCMRING_H */
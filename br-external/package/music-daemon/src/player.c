@@ -0,0 +1,1168 @@
+/*
+ * player.c
+ *
+ * Playback thread and its request queue.
+ *
+ * Requests from the control loop go through a lock-free queue (mpscq.h)
+ * whose eventfd wakes the thread.  The control loop never waits for room:
+ * a request the full queue cannot take is held back until the thread
+ * reports that it drained the queue, and a held request that a later one
+ * makes pointless (a stop or next track replaced by a new track) is
+ * dropped instead of delivered.  Events travel back over a pipe that the
+ * control loop polls, so the control loop never waits on audio I/O.
+ *
+ * Each decoder is read into a per-stream read-ahead ring.  Decoding runs
+ * much faster than real time, so the ring of the playing track stays about
+ * one crossfade length ahead of the output.  When the decoder reports
+ * end-of-stream and the remaining audio fits in the crossfade window, the
+ * queued next track is faded in against that tail with an equal-power
+ * curve.  A crossfade of 0 is a plain gapless splice.
+ *
+ * A stream whose intro is in the intro cache plays the cached PCM at once
+ * and drops the same amount of decoder output when it arrives, so the
+ * decoder takes over sample-exactly; other streams record their first
+ * seconds into the cache as they are read.  A separate warm-up decoder
+ * can fill the cache for a track that has not played yet.  A decoder
+ * started mid-track for a seek is dropped from the same way up to the
+ * exact sample, and cut off where the decoder would trim the padding;
+ * a track's leading and trailing silence are cut the same way.
+ *
+ * Rendered blocks go through a lock-free SPSC ring (pcmring.h) to a
+ * separate writer thread, the only thread that touches the output device.
+ * Opening, draining and closing the output travel through the ring as block
+ * flags, so the writer never takes a lock and control requests can never
+ * stall the device.  The writer applies the software volume: volume and
+ * mute are plain atomic stores from the control loop, and the writer ramps
+ * towards the new gain within a few milliseconds so changes never click.
+ * The player thread itself only shapes the envelope: playback fades in on
+ * start and fades out on stop or when a track is replaced.  A track's
+ * loudness normalization gain is folded into that same multiply (or into
+ * the crossfade gains of its side of a fade), so it costs no extra pass.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "player.h"
+#include "mpscq.h"
+#include "introcache.h"
+#include "output.h"
+#include "mix.h"
+#include "pcm.h"
+#include "pcmring.h"
+#include "rt.h"
+
+#define PLAYER_BLOCK      512                   /* Frames per output write (~12 ms) */
+#define PLAYER_LOOKAHEAD  PCM_MS_TO_FRAMES(500) /* Read-ahead beyond the fade       */
+#define STREAM_FRAMES     (PCM_MS_TO_FRAMES(PLAYER_MAX_CROSSFADE_MS) + \
+                           PLAYER_LOOKAHEAD + PLAYER_BLOCK)
+#define STREAM_BYTES      (STREAM_FRAMES * PCM_FRAME_BYTES)
+#define OPQ_SIZE          16
+#define EV_ROOM           0     /* Internal event: the request queue drained */
+#define RING_BLOCKS       8     /* ~93 ms between the threads, like the old pipe */
+#define TAP_FRAMES        65536 /* Rendered audio kept for player_heard() (~1.5 s) */
+
+#define GAIN_RAMP_MS      5     /* Volume and mute changes                   */
+#define GAIN_FADE_MS      30    /* Fade in on play, out on stop/track jump   */
+#define VOLUME_RANGE_DB   60.0  /* 1% .. 100% maps to -60 dB .. 0 dB         */
+
+enum op_type { OP_PLAY, OP_SET_NEXT, OP_SKIP, OP_STOP, OP_CROSSFADE, OP_WARM, OP_QUIT };
+
+struct op {
+    enum op_type   type;
+    struct decoder dec;         /* OP_PLAY / OP_SET_NEXT / OP_WARM */
+    int            arg;         /* OP_SKIP: track expected to play */
+                                /* OP_CROSSFADE: length in ms      */
+};
+
+/* Linear Q15 gain ramp, retargeted without jumps */
+struct ramp {
+    int           cur;          /* Gain at end of last block */
+    int           from, to;
+    unsigned long len, pos;
+};
+
+/* A decoder plus the PCM read ahead from it */
+struct stream {
+    struct decoder dec;
+    unsigned char *buf;         /* Byte ring, STREAM_BYTES long    */
+    size_t head;                /* Oldest unplayed byte            */
+    size_t len;                 /* Bytes buffered                  */
+    int    eof;                 /* Decoder has finished            */
+    int    played;              /* Any PCM delivered yet           */
+    int    intro;               /* Cache slot played first, or -1  */
+    size_t intro_len, intro_pos;
+    size_t skip;                /* Decoder bytes the intro covered */
+                                /*  or the seek runs up with       */
+    uint64_t left;              /* Decoder bytes still to play     */
+    uint64_t taken;             /* Frames delivered                */
+    int    rec;                 /* Cache slot being filled, or -1  */
+    size_t rec_len;
+    int    gain;                /* Loudness normalization, Q15     */
+};
+
+/* Request queue (control loop -> player thread) */
+static struct mpscq    opq;
+static struct op       held[OPQ_SIZE];          /* Not taken yet, oldest first */
+static int             nheld;
+static _Atomic int     held_waiting;            /* Report when opq drains      */
+
+static int event_pipe[2] = { -1, -1 };
+static pthread_t thread, writer;
+static int thread_started;
+
+/* Player thread -> writer thread */
+static struct pcm_ring ring;
+
+/* Owned by the player thread */
+static struct stream  cur_s, in_s;              /* Playing / fading in      */
+static struct stream *cur = &cur_s, *in = &in_s;
+static struct decoder next = DECODER_NONE;      /* Pre-opened, not started  */
+static unsigned long  fade_frames;              /* Configured length        */
+static unsigned long  fade_len, fade_pos;       /* Crossfade in progress    */
+static int            fading;
+static int16_t        mix_tmp[PLAYER_BLOCK * PCM_CHANNELS];
+static struct ramp    env;                      /* Fade in/out envelope     */
+static int            block_gain;               /* Normalization of the block rendered last */
+static int            output_live;              /* Output opened via ring   */
+static unsigned       output_opens;             /* PCMRING_OPENs posted     */
+static unsigned       live_gen;                 /* Generation that opened it */
+static int            gap_pending;              /* Track ended, tell writer */
+static struct decoder warm = DECODER_NONE;      /* Filling a cache slot only */
+static int            warm_rec = -1;
+static size_t         warm_len;
+static unsigned char  discard[16384];           /* Decoder output the intro covered */
+
+/* Track heard (+1) << 32 | ms into it; 0 until something plays */
+static _Atomic uint64_t position;
+
+/*
+ * Copy of the blocks sent to the writer, one stereo frame per word.  The
+ * words are relaxed atomics, so a reader racing the player thread only
+ * ever gets a copy it throws away (see player_heard()).
+ */
+static _Atomic uint32_t      tap[TAP_FRAMES];
+static _Atomic unsigned long tap_written;
+
+/* Gain stage: targets written by the control loop, no locks or syscalls */
+static _Atomic int volume_q15 = MIX_UNITY;
+static _Atomic int muted;
+
+/* Gain stage state, owned by the writer thread */
+static struct ramp    vol;
+
+/* Writer -> player: the output opened by the n-th PCMRING_OPEN failed */
+static _Atomic unsigned failed_open;
+
+/* ------------------------------------------------------- */
+/*                     STREAM HELPERS                      */
+/* ------------------------------------------------------- */
+
+static int stream_active(const struct stream *s)
+{
+    return decoder_active(&s->dec);
+}
+
+static size_t stream_frames(const struct stream *s)
+{
+    return s->len / PCM_FRAME_BYTES;
+}
+
+/* Let go of the stream's cache slots; an unfinished recording is dropped */
+static void stream_release(struct stream *s)
+{
+    if (s->intro >= 0)
+        introcache_unpin(s->intro);
+    if (s->rec >= 0)
+        introcache_abort(s->rec);
+    s->intro = s->rec = -1;
+}
+
+/*
+ * A decoder starts at the top of its track, unless it was started for a
+ * seek.  With the intro cached, the intro plays first and the same number
+ * of bytes of decoder output is dropped as it arrives; otherwise the output
+ * is recorded as the intro.  Seeks never use the cache (their key is 0).
+ * The intro always holds the top of the track: leading silence the decoder
+ * is told to skip is skipped inside the intro, and still recorded.
+ */
+static void stream_attach(struct stream *s, const struct decoder *d)
+{
+    stream_release(s);
+    decoder_close(&s->dec);
+    s->dec    = *d;
+    s->head   = 0;
+    s->len    = 0;
+    s->eof    = 0;
+    s->played = 0;
+    s->intro_pos = s->rec_len = 0;
+    s->skip  = d->skip;
+    s->left  = d->limit ? d->limit : UINT64_MAX;
+    s->taken = 0;
+    s->gain  = d->gain_mb < 0 ? (int)lrint(MIX_UNITY * pow(10.0, d->gain_mb / 2000.0))
+                              : MIX_UNITY;
+
+    if (!decoder_active(&s->dec))
+        return;
+
+    fcntl(s->dec.fd, F_SETFL, O_NONBLOCK);
+    if ((s->intro = introcache_find(d->key, &s->intro_len)) < 0) {
+        s->rec = introcache_record(d->key);
+        return;
+    }
+
+    if (d->skip >= s->intro_len) {
+        s->intro_pos = s->intro_len;
+        return;
+    }
+    s->intro_pos = d->skip;
+    s->skip      = s->intro_len;
+
+    /* The cached part counts against the limit, and may end the track */
+    if (d->limit) {
+        if (s->intro_len - s->intro_pos > d->limit)
+            s->intro_len = s->intro_pos + d->limit;
+        s->left -= s->intro_len - s->intro_pos;
+    }
+}
+
+/* Append n bytes to the stream's ring (the caller checked the room) */
+static void stream_put(struct stream *s, const unsigned char *src, size_t n)
+{
+    while (n) {
+        size_t tail   = (s->head + s->len) % STREAM_BYTES;
+        size_t contig = STREAM_BYTES - tail;
+        if (contig > n)
+            contig = n;
+        memcpy(s->buf + tail, src, contig);
+        s->len += contig;
+        src += contig;
+        n -= contig;
+    }
+}
+
+/* Copy decoder output into the slot being recorded; full means done */
+static int record(int slot, size_t *len, const unsigned char *src, size_t n)
+{
+    size_t room = introcache_slot_bytes() - *len;
+
+    if (n > room)
+        n = room;
+    memcpy(introcache_pcm(slot) + *len, src, n);
+    *len += n;
+
+    if (*len < introcache_slot_bytes())
+        return 0;
+    introcache_done(slot, *len);
+    return 1;
+}
+
+static void stream_reset(struct stream *s)
+{
+    struct decoder none = DECODER_NONE;
+    stream_attach(s, &none);
+}
+
+/* Pull whatever the decoder has ready, up to the read-ahead limit */
+static void stream_fill(struct stream *s)
+{
+    size_t limit = (fade_frames + PLAYER_LOOKAHEAD) * PCM_FRAME_BYTES;
+
+    /* The cached intro is there at once, whatever the decoder is doing */
+    if (s->intro >= 0 && s->intro_pos < s->intro_len && s->len < limit) {
+        size_t n = s->intro_len - s->intro_pos;
+        if (n > limit - s->len)
+            n = limit - s->len;
+        stream_put(s, introcache_pcm(s->intro) + s->intro_pos, n);
+        s->intro_pos += n;
+    }
+
+    while (stream_active(s) && !s->eof && s->len < limit) {
+        size_t tail   = (s->head + s->len) % STREAM_BYTES;
+        size_t contig = STREAM_BYTES - tail;
+        ssize_t n;
+
+        if (s->skip) {
+            /* Catching up with the intro or the seek target */
+            n = read(s->dec.fd, discard, s->skip < sizeof(discard) ? s->skip : sizeof(discard));
+            if (n > 0 && s->rec >= 0 && record(s->rec, &s->rec_len, discard, (size_t)n))
+                s->rec = -1;
+            if (n > 0)
+                s->skip -= (size_t)n;
+            else if (n == 0)
+                s->skip = 0;    /* Track is no longer than its intro */
+            else if (errno != EINTR)
+                break;
+            continue;
+        }
+        if (s->intro >= 0 && s->intro_pos < s->intro_len)
+            break;              /* Rest of the intro goes first */
+
+        if (contig > limit - s->len)
+            contig = limit - s->len;
+        if (contig > s->left)
+            contig = (size_t)s->left;
+
+        n = contig ? read(s->dec.fd, s->buf + tail, contig) : 0;
+        if (n > 0) {
+            if (s->rec >= 0 && record(s->rec, &s->rec_len, s->buf + tail, (size_t)n))
+                s->rec = -1;
+            s->len  += (size_t)n;
+            s->left -= (size_t)n;
+        } else if (n == 0) {
+            /* Shorter than an intro: the whole track is cached */
+            if (s->rec >= 0)
+                introcache_done(s->rec, s->rec_len);
+            s->rec = -1;
+            s->eof = 1;
+        } else if (errno != EINTR) {
+            if (errno != EAGAIN)
+                s->eof = 1;
+            break;
+        }
+    }
+}
+
+/* Copy up to frames out of the ring; short reads are padded with silence */
+static void stream_take(struct stream *s, int16_t *dst, size_t frames)
+{
+    size_t want = frames * PCM_FRAME_BYTES;
+    size_t have = stream_frames(s) * PCM_FRAME_BYTES;
+    size_t n    = want < have ? want : have;
+    unsigned char *out = (unsigned char *)dst;
+
+    for (size_t done = 0; done < n; ) {
+        size_t contig = STREAM_BYTES - s->head;
+        if (contig > n - done)
+            contig = n - done;
+        memcpy(out + done, s->buf + s->head, contig);
+        s->head = (s->head + contig) % STREAM_BYTES;
+        done += contig;
+    }
+
+    s->len -= n;
+    s->taken += n / PCM_FRAME_BYTES;
+    if (n)
+        s->played = 1;
+    if (n < want)
+        memset(out + n, 0, want - n);
+}
+
+/* Stop filling the cache from the warm-up decoder */
+static void warm_stop(void)
+{
+    if (warm_rec >= 0)
+        introcache_abort(warm_rec);
+    warm_rec = -1;
+    decoder_close(&warm);
+}
+
+/* Read the warm-up decoder straight into its cache slot, then drop it */
+static void warm_fill(void)
+{
+    while (warm_rec >= 0) {
+        size_t room = introcache_slot_bytes() - warm_len;
+        ssize_t n = read(warm.fd, introcache_pcm(warm_rec) + warm_len, room);
+
+        if (n > 0) {
+            warm_len += (size_t)n;
+            if (warm_len < introcache_slot_bytes())
+                continue;
+        } else if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return;
+            warm_stop();
+            return;
+        }
+
+        /* Slot full, or the whole track fitted */
+        introcache_done(warm_rec, warm_len);
+        warm_rec = -1;
+    }
+    decoder_close(&warm);
+}
+
+/* Enough audio buffered to produce a block, or nothing more will come */
+static int stream_ready(const struct stream *s, size_t frames)
+{
+    return s->eof || stream_frames(s) >= frames;
+}
+
+/* ------------------------------------------------------- */
+/*                      GAIN STAGE                         */
+/* ------------------------------------------------------- */
+
+static int gain_target(void)
+{
+    if (atomic_load_explicit(&muted, memory_order_relaxed))
+        return 0;
+    return atomic_load_explicit(&volume_q15, memory_order_relaxed);
+}
+
+/* Q15 gain g scaled by k; unity stays exact so mix_gain_s16() can skip it */
+static int gain_scale(int g, int k)
+{
+    return k == MIX_UNITY ? g : (int)(((long long)g * k + (1 << 14)) >> 15);
+}
+
+static void ramp_start(struct ramp *r, int target, unsigned long frames)
+{
+    r->from = r->cur;
+    r->to   = target;
+    r->len  = frames;
+    r->pos  = 0;
+}
+
+static int ramp_gain_at(const struct ramp *r, unsigned long pos)
+{
+    return r->from + (int)((long long)(r->to - r->from) * (long long)pos /
+                           (long long)r->len);
+}
+
+/*
+ * Apply a ramp, scaled by a static gain, to one block; after its end the
+ * target gain holds.
+ */
+static void ramp_apply(struct ramp *r, int16_t *buf, size_t n, int scale)
+{
+    size_t done = 0;
+
+    if (r->pos < r->len) {
+        size_t k = r->len - r->pos;
+        if (k > n)
+            k = n;
+
+        int g0 = ramp_gain_at(r, r->pos);
+        int g1 = ramp_gain_at(r, r->pos + k);
+        mix_gain_s16(buf, k, gain_scale(g0, scale), gain_scale(g1, scale));
+
+        r->pos += k;
+        r->cur  = g1;
+        done    = k;
+    }
+
+    if (done < n) {
+        r->cur = r->to;
+        mix_gain_s16(buf + done * PCM_CHANNELS, n - done,
+                     gain_scale(r->cur, scale), gain_scale(r->cur, scale));
+    }
+}
+
+/* Writer thread: volume/mute, ramping towards the latest target */
+static void gain_apply(int16_t *buf, size_t n)
+{
+    int target = gain_target();
+
+    if (target != vol.to)
+        ramp_start(&vol, target, PCM_MS_TO_FRAMES(GAIN_RAMP_MS));
+    ramp_apply(&vol, buf, n, MIX_UNITY);
+}
+
+/* ------------------------------------------------------- */
+/*                     WRITER THREAD                       */
+/* ------------------------------------------------------- */
+
+/*
+ * Sole owner of the output device.  Consumes blocks in place and acts on
+ * their flags; never touches the request queue or any lock.
+ */
+static void *writer_thread(void *arg)
+{
+    int open = 0, primed = 0;
+    unsigned opens = 0;
+
+    (void)arg;
+    pthread_setname_np(pthread_self(), "audio-writer");
+    rt_enter_audio_thread();
+
+    for (;;) {
+        /*
+         * The ring fills up whenever the player is ahead.  Running dry
+         * after that, outside a track change, means it fell behind.
+         */
+        if (open && pcmring_full(&ring))
+            primed = 1;
+        if (primed && pcmring_empty(&ring)) {
+            atomic_fetch_add_explicit(&ring.underruns, 1, memory_order_relaxed);
+            primed = 0;
+        }
+
+        struct pcm_block *b = pcmring_peek(&ring);
+        unsigned flags = b->flags;
+
+        if (flags & PCMRING_GAP) {
+            primed = 0;
+            if (open)
+                output_gap();
+        }
+
+        /*
+         * A failed output is reported rather than written around: the
+         * player stops feeding it, and the next play opens it again.
+         */
+        if (flags & PCMRING_OPEN) {
+            opens++;
+            if (!open && !(open = (output_open() == 0)))
+                atomic_store_explicit(&failed_open, opens, memory_order_release);
+        }
+
+        if (open && b->frames) {
+            gain_apply(b->pcm, b->frames);
+            if (output_write(b->pcm, b->frames * PCM_FRAME_BYTES) < 0) {
+                open = primed = 0;
+                atomic_store_explicit(&failed_open, opens, memory_order_release);
+            }
+        }
+
+        if ((flags & PCMRING_CLOSE) && open) {
+            output_close(flags & PCMRING_DRAIN);
+            open = primed = 0;
+        }
+
+        pcmring_release(&ring);
+        if (flags & PCMRING_QUIT)
+            break;
+    }
+
+    if (open)
+        output_close(0);
+    return NULL;
+}
+
+/* ------------------------------------------------------- */
+/*                   PLAYER THREAD SIDE                    */
+/* ------------------------------------------------------- */
+
+/* Queue a block that only carries writer flags */
+static void ring_post_flags(unsigned flags)
+{
+    struct pcm_block *b = pcmring_reserve(&ring);
+    b->flags = flags;
+    pcmring_commit(&ring);
+}
+
+static void post_event(int type, const struct decoder *d, int played)
+{
+    struct player_event ev = {
+        .type = type, .track = d->track, .gen = d->gen, .played = played,
+    };
+
+    /* Smaller than PIPE_BUF, so the write is atomic */
+    (void)write(event_pipe[1], &ev, sizeof(ev));
+}
+
+/*
+ * The writer gave up on the output this session opened: without it the
+ * player would decode at full speed into nothing and run through the
+ * library.  Drop everything and let the control loop report it.
+ */
+static void check_output(void)
+{
+    struct player_event ev = { .type = PLAYER_EV_FAILED, .track = -1 };
+
+    if (!output_live ||
+        atomic_load_explicit(&failed_open, memory_order_acquire) != output_opens)
+        return;
+
+    ev.gen = live_gen;
+    output_live = 0;
+    fading = 0;
+    gap_pending = 0;
+    stream_reset(cur);
+    stream_reset(in);
+    decoder_close(&next);
+    (void)write(event_pipe[1], &ev, sizeof(ev));
+}
+
+/*
+ * Hand over to the pre-opened next track, fading over len frames of the
+ * current one (0 = immediate gapless splice).
+ */
+static void begin_transition(unsigned long len)
+{
+    struct stream *t;
+
+    stream_attach(in, &next);
+    next = DECODER_NONE;
+    post_event(PLAYER_EV_ADVANCED, &in->dec, 0);
+
+    if (len == 0) {
+        stream_reset(cur);
+        t = cur; cur = in; in = t;
+        return;
+    }
+
+    fading   = 1;
+    fade_len = len;
+    fade_pos = 0;
+}
+
+/* Fade finished (or was cut short): the incoming stream becomes current */
+static void end_transition(void)
+{
+    struct stream *t;
+
+    stream_reset(cur);
+    t = cur; cur = in; in = t;
+    fading = 0;
+}
+
+static size_t render_block(int16_t *buf, int16_t *tmp);
+
+static void tap_put(const int16_t *pcm, size_t frames)
+{
+    unsigned long w = atomic_load_explicit(&tap_written, memory_order_relaxed);
+
+    for (size_t i = 0; i < frames; i++) {
+        uint32_t v;
+        memcpy(&v, pcm + i * PCM_CHANNELS, sizeof(v));
+        atomic_store_explicit(&tap[(w + i) & (TAP_FRAMES - 1)], v, memory_order_relaxed);
+    }
+    atomic_store_explicit(&tap_written, w + frames, memory_order_release);
+}
+
+/*
+ * Ramp whatever is playing down to silence over the next frames and write
+ * it out, so stopping or replacing a track never cuts a waveform mid-swing.
+ */
+static void fade_out(unsigned long frames)
+{
+    unsigned long pos = 0;
+    int from = env.cur;
+
+    while (output_live && pos < frames) {
+        struct pcm_block *b = pcmring_reserve(&ring);
+        size_t n = render_block(b->pcm, mix_tmp);
+        if (n == 0)
+            break;          /* Decoder not ready: nothing left to fade */
+        if (n > frames - pos)
+            n = frames - pos;
+
+        int g0 = from - (int)((long long)from * pos / frames);
+        int g1 = from - (int)((long long)from * (pos + n) / frames);
+        mix_gain_s16(b->pcm, n, gain_scale(g0, block_gain), gain_scale(g1, block_gain));
+        b->frames = n;
+        tap_put(b->pcm, n);
+        pcmring_commit(&ring);
+        pos += n;
+    }
+
+    env.cur = 0;
+    ramp_start(&env, 0, 0);
+}
+
+/* Apply queued requests; returns 1 when the thread should exit */
+static int apply_ops(void)
+{
+    mpscq_clear_fd(&opq);
+
+    for (;;) {
+        struct op o;
+
+        if (!mpscq_pop(&opq, &o)) {
+            /* Drained: the control loop may be holding requests back */
+            atomic_thread_fence(memory_order_seq_cst);
+            if (atomic_exchange(&held_waiting, 0)) {
+                struct player_event ev = { .type = EV_ROOM, .track = -1 };
+                (void)write(event_pipe[1], &ev, sizeof(ev));
+            }
+            return 0;
+        }
+
+        switch (o.type) {
+        case OP_PLAY:
+            /* Jumping while playing: short dip instead of a hard cut */
+            if (output_live) {
+                fade_out(PCM_MS_TO_FRAMES(GAIN_RAMP_MS));
+                ring_post_flags(PCMRING_GAP);
+            }
+            if (fading)
+                end_transition();
+            live_gen = o.dec.gen;
+            stream_attach(cur, &o.dec);
+            decoder_close(&next);
+
+            if (!output_live) {
+                ring_post_flags(PCMRING_OPEN);
+                output_opens++;
+                output_live = 1;
+                env.cur = 0;
+                ramp_start(&env, MIX_UNITY, PCM_MS_TO_FRAMES(GAIN_FADE_MS));
+            } else {
+                ramp_start(&env, MIX_UNITY, PCM_MS_TO_FRAMES(GAIN_RAMP_MS));
+            }
+            break;
+
+        case OP_SET_NEXT:
+            decoder_close(&next);
+            next = o.dec;
+            break;
+
+        case OP_SKIP:
+            /* Skipping during a fade drops the outgoing track at once */
+            if (fading)
+                end_transition();
+
+            /* The track may have ended on its own in the meantime */
+            if (stream_active(cur) && cur->dec.track == o.arg &&
+                decoder_active(&next))
+                begin_transition(fade_frames);
+            break;
+
+        case OP_CROSSFADE:
+            fade_frames = PCM_MS_TO_FRAMES(o.arg);
+            break;
+
+        case OP_WARM:
+            warm_stop();
+            warm = o.dec;
+            warm_len = 0;
+            if ((warm_rec = introcache_record(warm.key)) >= 0)
+                fcntl(warm.fd, F_SETFL, O_NONBLOCK);
+            else
+                decoder_close(&warm);
+            break;
+
+        case OP_STOP:
+        case OP_QUIT:
+            fade_out(PCM_MS_TO_FRAMES(GAIN_FADE_MS));
+            fading = 0;
+            stream_reset(cur);
+            stream_reset(in);
+            decoder_close(&next);
+
+            /* Let the output play out the fade rather than cut it */
+            if (output_live)
+                ring_post_flags(PCMRING_CLOSE | PCMRING_DRAIN);
+            output_live = 0;
+            if (o.type == OP_QUIT) {
+                warm_stop();
+                ring_post_flags(PCMRING_QUIT);
+                return 1;
+            }
+            break;
+        }
+    }
+}
+
+/* Nothing can be produced yet: sleep until a decoder or request is ready */
+static void wait_for_input(void)
+{
+    struct pollfd pfd[4];
+    int n = 0;
+
+    pfd[n].fd = mpscq_fd(&opq);
+    pfd[n++].events = POLLIN;
+
+    if (stream_active(cur) && !cur->eof) {
+        pfd[n].fd = cur->dec.fd;
+        pfd[n++].events = POLLIN;
+    }
+    if (fading && stream_active(in) && !in->eof) {
+        pfd[n].fd = in->dec.fd;
+        pfd[n++].events = POLLIN;
+    }
+    if (warm_rec >= 0) {
+        pfd[n].fd = warm.fd;
+        pfd[n++].events = POLLIN;
+    }
+
+    (void)poll(pfd, n, -1);
+}
+
+/*
+ * Produce the next block of output into buf.  Returns the frame count,
+ * 0 if the thread has to wait for input first.
+ */
+static size_t render_block(int16_t *buf, int16_t *tmp)
+{
+    if (fading) {
+        unsigned long n = fade_len - fade_pos;
+        int ga0, gb0, ga1, gb1;
+
+        if (n > PLAYER_BLOCK)
+            n = PLAYER_BLOCK;
+        if (!stream_ready(cur, n) || !stream_ready(in, n))
+            return 0;
+
+        stream_take(cur, buf, n);
+        stream_take(in, tmp, n);
+
+        /* Each side normalized on the way through the mix */
+        mix_equal_power(fade_pos, fade_len, &ga0, &gb0);
+        mix_equal_power(fade_pos + n, fade_len, &ga1, &gb1);
+        mix_xfade_s16(buf, buf, tmp, n,
+                      gain_scale(ga0, cur->gain), gain_scale(ga1, cur->gain),
+                      gain_scale(gb0, in->gain), gain_scale(gb1, in->gain));
+        block_gain = MIX_UNITY;
+
+        fade_pos += n;
+        if (fade_pos >= fade_len)
+            end_transition();
+        return n;
+    }
+
+    if (!stream_active(cur))
+        return 0;
+
+    /* Tail of the track fits the crossfade window: start the transition */
+    if (cur->eof && decoder_active(&next) && stream_frames(cur) <= fade_frames) {
+        begin_transition(stream_frames(cur));
+        return render_block(buf, tmp);
+    }
+
+    size_t avail = stream_frames(cur);
+    if (avail == 0) {
+        if (cur->eof) {
+            /* Ran out with nothing queued: let the control loop decide */
+            post_event(PLAYER_EV_ENDED, &cur->dec, cur->played);
+            stream_reset(cur);
+            gap_pending = 1;
+        }
+        return 0;
+    }
+
+    size_t n = avail < PLAYER_BLOCK ? avail : PLAYER_BLOCK;
+    stream_take(cur, buf, n);
+    block_gain = cur->gain;
+    return n;
+}
+
+static void *player_thread(void *arg)
+{
+    (void)arg;
+    pthread_setname_np(pthread_self(), "player");
+    rt_enter_player_thread();
+
+    for (;;) {
+        if (apply_ops())
+            break;
+        check_output();
+
+        stream_fill(cur);
+        if (fading)
+            stream_fill(in);
+        warm_fill();
+
+        /* Render in place; blocks while the ring is full */
+        struct pcm_block *b = pcmring_reserve(&ring);
+        size_t n = render_block(b->pcm, mix_tmp);
+        if (n == 0) {
+            if (gap_pending && output_live)
+                ring_post_flags(PCMRING_GAP);
+            gap_pending = 0;
+            wait_for_input();
+            continue;
+        }
+
+        /* Without an open output the block is dropped (slot reused) */
+        if (output_live) {
+            ramp_apply(&env, b->pcm, n, block_gain);
+            b->frames = n;
+            tap_put(b->pcm, n);
+            pcmring_commit(&ring);
+        }
+
+        const struct stream *heard = fading ? in : cur;
+        uint64_t ms = heard->dec.start_ms + heard->taken * 1000 / PCM_RATE;
+        atomic_store_explicit(&position, (uint64_t)(heard->dec.track + 1) << 32 | (uint32_t)ms,
+                              memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+/* ------------------------------------------------------- */
+/*                   CONTROL LOOP SIDE                     */
+/* ------------------------------------------------------- */
+
+/* A request that is not delivered still owns its decoder */
+static void op_release(struct op *o)
+{
+    if (o->type == OP_PLAY || o->type == OP_SET_NEXT || o->type == OP_WARM)
+        decoder_close(&o->dec);
+}
+
+/* Drop the held requests that o makes pointless */
+static void supersede(const struct op *o)
+{
+    int last_skip = -1, keep = 0;
+
+    for (int i = 0; i < nheld; i++)
+        if (held[i].type == OP_SKIP)
+            last_skip = i;
+
+    for (int i = 0; i < nheld; i++) {
+        struct op *h = &held[i];
+        int gone = 0;
+
+        switch (o->type) {
+        case OP_PLAY:
+        case OP_STOP:
+            /* Whatever was to play or skip to is replaced */
+            gone = h->type != OP_CROSSFADE && h->type != OP_WARM;
+            break;
+        case OP_QUIT:
+            gone = 1;
+            break;
+        case OP_SET_NEXT:
+            /* Unless a held skip is still to use it */
+            gone = h->type == OP_SET_NEXT && i > last_skip;
+            break;
+        case OP_CROSSFADE:
+        case OP_WARM:
+            gone = h->type == o->type;
+            break;
+        case OP_SKIP:
+            break;
+        }
+
+        if (gone)
+            op_release(h);
+        else
+            held[keep++] = *h;
+    }
+    nheld = keep;
+}
+
+/* Hand held requests to the thread, oldest first, as far as they fit */
+static void flush_held(void)
+{
+    int done = 0;
+
+    while (done < nheld) {
+        if (mpscq_push(&opq, &held[done]) < 0) {
+            /* Ask for EV_ROOM, then retry in case the queue drained already */
+            atomic_store(&held_waiting, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+            if (mpscq_push(&opq, &held[done]) < 0)
+                break;
+        }
+        done++;
+    }
+
+    memmove(held, held + done, (size_t)(nheld - done) * sizeof(held[0]));
+    nheld -= done;
+}
+
+static void post(const struct op *o)
+{
+    struct op dropped = *o;
+
+    supersede(o);
+    if (nheld == OPQ_SIZE) {
+        /* A thread stuck for a whole queue of skips: lose this one */
+        fprintf(stderr, "player: request queue full, request dropped\n");
+        op_release(&dropped);
+        return;
+    }
+    held[nheld++] = *o;
+    flush_held();
+}
+
+int player_init(void)
+{
+    mix_init();
+
+    cur_s.dec = DECODER_NONE;
+    in_s.dec  = DECODER_NONE;
+    cur_s.intro = cur_s.rec = -1;
+    in_s.intro  = in_s.rec  = -1;
+    cur_s.buf = malloc(STREAM_BYTES);
+    in_s.buf  = malloc(STREAM_BYTES);
+    if (!cur_s.buf || !in_s.buf) {
+        perror("player: malloc");
+        return -1;
+    }
+
+    if (mpscq_init(&opq, OPQ_SIZE, sizeof(struct op)) < 0)
+        return -1;
+
+    if (pipe2(event_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        perror("player: pipe");
+        return -1;
+    }
+
+    if (pcmring_init(&ring, RING_BLOCKS, PLAYER_BLOCK) < 0)
+        return -1;
+
+    env.cur = env.to = MIX_UNITY;
+    vol.cur = vol.to = gain_target();
+
+    pthread_attr_t attr;
+    rt_thread_attr(&attr);
+
+    if (pthread_create(&writer, &attr, writer_thread, NULL) != 0 ||
+        pthread_create(&thread, &attr, player_thread, NULL) != 0) {
+        perror("player: pthread_create");
+        pthread_attr_destroy(&attr);
+        return -1;
+    }
+    pthread_attr_destroy(&attr);
+
+    thread_started = 1;
+    return 0;
+}
+
+void player_shutdown(void)
+{
+    struct op o = { .type = OP_QUIT };
+
+    if (!thread_started)
+        return;
+
+    /* The one request that has to get through: wait for room if need be */
+    post(&o);
+    while (nheld) {
+        struct pollfd pfd = { .fd = event_pipe[0], .events = POLLIN };
+        struct player_event ev;
+
+        (void)poll(&pfd, 1, -1);
+        while (player_read_event(&ev))
+            ;
+    }
+    pthread_join(thread, NULL);
+    pthread_join(writer, NULL);
+    thread_started = 0;
+
+    mpscq_destroy(&opq);
+    pcmring_destroy(&ring);
+    free(cur_s.buf);
+    free(in_s.buf);
+}
+
+int player_event_fd(void)
+{
+    return event_pipe[0];
+}
+
+int player_read_event(struct player_event *ev)
+{
+    while (read(event_pipe[0], ev, sizeof(*ev)) == (ssize_t)sizeof(*ev)) {
+        if (ev->type != EV_ROOM)
+            return 1;
+        flush_held();
+    }
+    return 0;
+}
+
+void player_play(const struct decoder *d)
+{
+    struct op o = { .type = OP_PLAY, .dec = *d };
+    post(&o);
+}
+
+void player_set_next(const struct decoder *d)
+{
+    struct op o = { .type = OP_SET_NEXT, .dec = *d };
+    post(&o);
+}
+
+void player_warm(const struct decoder *d)
+{
+    struct op o = { .type = OP_WARM, .dec = *d };
+    post(&o);
+}
+
+void player_skip(int from_track)
+{
+    struct op o = { .type = OP_SKIP, .arg = from_track };
+    post(&o);
+}
+
+void player_stop(void)
+{
+    struct op o = { .type = OP_STOP };
+    post(&o);
+}
+
+void player_set_crossfade(int ms)
+{
+    struct op o = { .type = OP_CROSSFADE };
+
+    if (ms < 0)
+        ms = 0;
+    if (ms > PLAYER_MAX_CROSSFADE_MS)
+        ms = PLAYER_MAX_CROSSFADE_MS;
+
+    o.arg = ms;
+    post(&o);
+}
+
+void player_set_volume(int percent)
+{
+    int g = 0;
+
+    if (percent >= 100)
+        g = MIX_UNITY;
+    else if (percent > 0)
+        g = (int)lrint(MIX_UNITY * pow(10.0, (percent - 100) * VOLUME_RANGE_DB / 2000.0));
+
+    atomic_store_explicit(&volume_q15, g, memory_order_relaxed);
+}
+
+void player_set_mute(int on)
+{
+    atomic_store_explicit(&muted, on ? 1 : 0, memory_order_relaxed);
+}
+
+int player_position(unsigned *ms)
+{
+    uint64_t p = atomic_load_explicit(&position, memory_order_relaxed);
+
+    *ms = (uint32_t)p;
+    return (int)(p >> 32) - 1;
+}
+
+int player_heard(int16_t *out, size_t frames)
+{
+    unsigned long w = atomic_load_explicit(&tap_written, memory_order_acquire);
+    unsigned long lag = atomic_load_explicit(&ring.fill_frames, memory_order_relaxed);
+    unsigned long start;
+    struct output_stats os;
+
+    /* Still to be played: what waits in the ring and in the device */
+    output_get_stats(&os);
+    if (os.delay_frames > 0)
+        lag += (unsigned long)os.delay_frames;
+    if (frames > TAP_FRAMES / 4)
+        return -1;
+    if (lag > TAP_FRAMES / 2)
+        lag = TAP_FRAMES / 2;
+    if (w < lag + frames)
+        return -1;
+
+    start = w - lag - frames;
+    for (size_t i = 0; i < frames; i++) {
+        uint32_t v = atomic_load_explicit(&tap[(start + i) & (TAP_FRAMES - 1)],
+                                          memory_order_relaxed);
+        memcpy(out + i * PCM_CHANNELS, &v, sizeof(v));
+    }
+
+    /* Overwritten while being copied: only if this thread was preempted */
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&tap_written, memory_order_relaxed) - start > TAP_FRAMES)
+        return -1;
+    return 0;
+}
+
+void player_get_stats(struct player_stats *st)
+{
+    st->ring_frames    = atomic_load_explicit(&ring.fill_frames, memory_order_relaxed);
+    st->ring_capacity  = (unsigned long)ring.nslots * ring.block_frames;
+    st->ring_underruns = atomic_load_explicit(&ring.underruns, memory_order_relaxed);
+}
@@ -0,0 +1,101 @@
+/*
+ * player.h
+ *
+ * Playback threads: the player thread pulls PCM from the current decoder
+ * and hands it through a lock-free ring to a writer thread that owns the
+ * output stage.  A second, pre-opened decoder for the next track can be
+ * queued; when the current track reaches end-of-stream the player switches
+ * to it without closing the output, so album transitions are gapless.
+ * With a crossfade configured, the two tracks overlap instead.
+ *
+ * All functions except the event helpers are called from the control loop
+ * and only post a request; the player thread applies it asynchronously.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef PLAYER_H
+#define PLAYER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder.h"
+
+#define PLAYER_MAX_CROSSFADE_MS 12000
+
+enum player_event_type {
+    PLAYER_EV_ADVANCED = 1,     /* Queued next track is now playing      */
+    PLAYER_EV_ENDED,            /* Track ended and no next was queued    */
+    PLAYER_EV_FAILED,           /* Output failed; playback was dropped   */
+};
+
+/* Lock-free telemetry of the player -> writer ring */
+struct player_stats {
+    unsigned long ring_frames;      /* Frames queued for the writer          */
+    unsigned long ring_capacity;
+    unsigned long ring_underruns;   /* Ring ran dry after audio had started  */
+};
+
+struct player_event {
+    int      type;
+    int      track;             /* New track (ADVANCED) or ended track   */
+                                /*  (-1 for FAILED)                      */
+    unsigned gen;               /* Generation of that decoder            */
+    int      played;            /* ENDED: track produced any audio       */
+};
+
+int  player_init(void);
+void player_shutdown(void);
+
+/* Readable whenever player_read_event() has something to return */
+int  player_event_fd(void);
+int  player_read_event(struct player_event *ev);
+
+/* Replace whatever is playing; the output stays open. Takes ownership. */
+void player_play(const struct decoder *cur);
+
+/* Queue (or replace) the pre-opened next track. Takes ownership. */
+void player_set_next(const struct decoder *next);
+
+/*
+ * Decode the intro of a track into the intro cache without playing it
+ * (see introcache.h); replaces an earlier warm-up.  Takes ownership.
+ */
+void player_warm(const struct decoder *d);
+
+/* Switch to the queued next track now, if from_track is still playing */
+void player_skip(int from_track);
+
+/* Stop playback and close the output */
+void player_stop(void);
+
+/* Equal-power crossfade length for skips and auto-advance, 0 = gapless */
+void player_set_crossfade(int ms);
+
+/*
+ * Software volume (0-100 %, logarithmic) and mute.  These only store the
+ * new target; the player ramps to it on its next block.  No locks and no
+ * system calls, so they are safe to call at any rate.
+ */
+void player_set_volume(int percent);
+void player_set_mute(int on);
+
+/* Safe from any thread at any rate */
+void player_get_stats(struct player_stats *st);
+
+/*
+ * Any thread: the track being heard (the incoming one during a crossfade)
+ * and how far into it the player is in *ms, or -1 if nothing played yet.
+ */
+int  player_position(unsigned *ms);
+
+/*
+ * Any thread: the last frames (at most ~0.35 s) of audio leaving the
+ * speaker now, that is the rendered audio less what still waits in the
+ * ring and the device buffer.  Volume is not applied yet.  Returns 0, or
+ * -1 if not that much has played since startup.
+ */
+int  player_heard(int16_t *out, size_t frames);
+
+#endif /* PLAYER_H */
@@ -0,0 +1,318 @@
+/*
+ * prefetch.c
+ *
+ * Page-cache warming of upcoming local tracks (see prefetch.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "prefetch.h"
+#include "library.h"
+#include "mp3info.h"
+#include "rt.h"
+
+struct held {
+    int     track;
+    int     fd;
+    off_t   size;               /* At open: a replaced file is not used */
+    int64_t mtime;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wake = PTHREAD_COND_INITIALIZER;
+static int             want[PREFETCH_MAX];
+static int             nwant;
+static _Atomic unsigned want_seq;       /* Bumped by every prefetch_want() */
+static struct held     held[PREFETCH_MAX];
+static int             nheld;
+static int             started;
+
+/* Seek table measurements: asked for, and done but not collected yet */
+static int                   to_index[PREFETCH_MAX];
+static int                   nto_index;
+static struct prefetch_index indexed[PREFETCH_MAX];
+static int                   nindexed;
+static void                (*notify)(void);
+
+/* ------------------------------------------------------- */
+/*                     PREFETCH THREAD                     */
+/* ------------------------------------------------------- */
+
+static int held_index(int track)
+{
+    for (int i = 0; i < nheld; i++)
+        if (held[i].track == track)
+            return i;
+    return -1;
+}
+
+/* Open track and get the kernel reading it in; blocks on the SD card */
+static int warm(int track, struct held *h)
+{
+    char path[PATH_MAX];
+    const struct lib_view *v = library_acquire();
+    int ok = lib_path(v, (unsigned)track, path, sizeof(path)) == 0;
+    struct stat st;
+
+    library_release(v);
+    if (!ok || (h->fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+
+    if (fstat(h->fd, &st) < 0) {
+        close(h->fd);
+        return -1;
+    }
+
+    h->track = track;
+    h->size = st.st_size;
+    h->mtime = st.st_mtime;
+
+    /* Doubles the readahead window for the decoder that will read it */
+    posix_fadvise(h->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(h->fd, 0, st.st_size < PREFETCH_BYTES ? st.st_size : PREFETCH_BYTES,
+                  POSIX_FADV_WILLNEED);
+    return 0;
+}
+
+/* A prefetch_want() came in since the thread last looked at the list */
+static int want_changed(void *seen)
+{
+    return want_seq != *(const unsigned *)seen;
+}
+
+/*
+ * Walk track's frames for its seek table; reads the whole file, so it
+ * gives way to tracks to warm as soon as any are named.  Returns 0, or -1
+ * if it stopped for them and the track should be measured again later.
+ */
+static int measure(int track, unsigned seen)
+{
+    char path[PATH_MAX];
+    const struct lib_view *v = library_acquire();
+    int ok = lib_path(v, (unsigned)track, path, sizeof(path)) == 0;
+    struct prefetch_index r = { .track = track };
+    struct mp3_info mi;
+    struct stat st;
+    long frames;
+    int fd, kept;
+
+    library_release(v);
+    if (!ok || (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return 0;
+
+    if (fstat(fd, &st) < 0 || mp3info_read(fd, st.st_size, &mi) < 0 ||
+        (frames = mp3info_frames_until(fd, &mi, LIB_SEEK_STEP, &r.offsets, &r.n,
+                                       want_changed, &seen)) <= 0) {
+        close(fd);
+        return want_changed(&seen) ? -1 : 0;
+    }
+    close(fd);
+
+    r.size        = (uint64_t)st.st_size;
+    r.mtime       = st.st_mtime;
+    r.frames      = (uint32_t)frames;
+    r.duration_ms = mp3info_duration_ms(&mi, r.frames);
+
+    pthread_mutex_lock(&lock);
+    if ((kept = nindexed < PREFETCH_MAX))
+        indexed[nindexed++] = r;
+    pthread_mutex_unlock(&lock);
+
+    if (kept)
+        notify();
+    else
+        free(r.offsets);
+    return 0;
+}
+
+static void *prefetch_thread(void *arg)
+{
+    unsigned seen = 0;
+
+    (void)arg;
+
+    for (;;) {
+        int list[PREFETCH_MAX], n, drop[PREFETCH_MAX], ndrop = 0;
+
+        pthread_mutex_lock(&lock);
+        while (want_seq == seen && !nto_index)
+            pthread_cond_wait(&wake, &lock);
+
+        /* Measurements wait until the tracks to warm are open */
+        if (want_seq == seen) {
+            int track = to_index[0];
+            memmove(to_index, to_index + 1, --nto_index * sizeof(to_index[0]));
+            pthread_mutex_unlock(&lock);
+
+            /* Interrupted: warm first, then walk it again from the top */
+            if (measure(track, seen) < 0) {
+                int dup = 0;
+
+                pthread_mutex_lock(&lock);
+                for (int k = 0; k < nto_index; k++)
+                    dup |= to_index[k] == track;
+                if (!dup && nto_index < PREFETCH_MAX) {
+                    memmove(to_index + 1, to_index, nto_index++ * sizeof(to_index[0]));
+                    to_index[0] = track;
+                }
+                pthread_mutex_unlock(&lock);
+            }
+            continue;
+        }
+        seen = want_seq;
+        n = nwant;
+        memcpy(list, want, sizeof(list));
+
+        /* Close what is no longer wanted */
+        for (int i = 0; i < nheld; ) {
+            int keep = 0;
+            for (int k = 0; k < n; k++)
+                keep |= held[i].track == list[k];
+            if (keep) {
+                i++;
+                continue;
+            }
+            drop[ndrop++] = held[i].fd;
+            held[i] = held[--nheld];
+        }
+        pthread_mutex_unlock(&lock);
+
+        for (int i = 0; i < ndrop; i++)
+            close(drop[i]);
+
+        /* Most likely first; start over if the list changes meanwhile */
+        for (int k = 0; k < n && want_seq == seen; k++) {
+            struct held h;
+            int have;
+
+            pthread_mutex_lock(&lock);
+            have = held_index(list[k]) >= 0;
+            pthread_mutex_unlock(&lock);
+
+            if (have || warm(list[k], &h) < 0)
+                continue;
+
+            pthread_mutex_lock(&lock);
+            if (nheld < PREFETCH_MAX && held_index(h.track) < 0) {
+                held[nheld++] = h;
+                h.fd = -1;
+            }
+            pthread_mutex_unlock(&lock);
+
+            if (h.fd >= 0)
+                close(h.fd);
+        }
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------- */
+/*                     CONTROL THREAD                      */
+/* ------------------------------------------------------- */
+
+void prefetch_want(const int *tracks, int n)
+{
+    if (!started)
+        return;
+
+    pthread_mutex_lock(&lock);
+    nwant = 0;
+    for (int i = 0; i < n && nwant < PREFETCH_MAX; i++) {
+        int dup = tracks[i] < 0;
+        for (int k = 0; k < nwant; k++)
+            dup |= want[k] == tracks[i];
+        if (!dup)
+            want[nwant++] = tracks[i];
+    }
+    want_seq++;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+int prefetch_take(int track)
+{
+    const struct lib_track *t = lib_track(library_view(), (unsigned)track);
+    struct held h = { .fd = -1 };
+    int i;
+
+    pthread_mutex_lock(&lock);
+    if ((i = held_index(track)) >= 0) {
+        h = held[i];
+        held[i] = held[--nheld];
+    }
+    pthread_mutex_unlock(&lock);
+
+    /* Rewritten since it was opened: let the decoder open it afresh */
+    if (h.fd >= 0 && (!t || (uint64_t)h.size != t->size || h.mtime != t->mtime)) {
+        close(h.fd);
+        return -1;
+    }
+    return h.fd;
+}
+
+void prefetch_index(int track)
+{
+    int dup = 0;
+
+    if (!started)
+        return;
+
+    pthread_mutex_lock(&lock);
+    for (int k = 0; k < nto_index; k++)
+        dup |= to_index[k] == track;
+    if (!dup && nto_index < PREFETCH_MAX) {
+        to_index[nto_index++] = track;
+        pthread_cond_signal(&wake);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+int prefetch_indexed(struct prefetch_index *out)
+{
+    int got = 0;
+
+    pthread_mutex_lock(&lock);
+    if (nindexed) {
+        *out = indexed[0];
+        memmove(indexed, indexed + 1, --nindexed * sizeof(indexed[0]));
+        got = 1;
+    }
+    pthread_mutex_unlock(&lock);
+    return got;
+}
+
+/* ------------------------------------------------------- */
+/*                         SETUP                           */
+/* ------------------------------------------------------- */
+
+int prefetch_init(void (*indexed_fn)(void))
+{
+    pthread_attr_t attr;
+    pthread_t t;
+    int err;
+
+    notify = indexed_fn;
+    rt_thread_attr(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&t, &attr, prefetch_thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (err) {
+        fprintf(stderr, "prefetch: pthread_create: %s\n", strerror(err));
+        return -1;
+    }
+    started = 1;
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * prefetch.h
+ *
+ * Page-cache warming of the local tracks likely to play next.
+ *
+ * The control thread names the tracks a skip could land on (next, the one
+ * after it, previous); a prefetch thread opens each of them, hints
+ * POSIX_FADV_SEQUENTIAL and starts readahead of its first PREFETCH_BYTES
+ * with POSIX_FADV_WILLNEED, and keeps the descriptor.  When one of them is
+ * played, open_track() takes that descriptor and hands it to the decoder,
+ * so neither the path lookup nor the first reads go to the SD card at
+ * track start.  Tracks that drop out of the set are closed; their pages
+ * stay cached until the kernel needs the memory.
+ *
+ * The same thread measures tracks for the library's seek tables: it walks
+ * every frame header of a file that is playing (so its pages are being
+ * read anyway) and hands the frame count and the offset of every
+ * LIB_SEEK_STEP-th frame back to the control thread, which stores them
+ * with library_set_seek().  Warming comes first: a walk checks for a new
+ * prefetch_want() before every read, and if there is one it stops, warms
+ * those tracks and walks again from the start, mostly from the page cache.
+ *
+ * The slow calls (open, fadvise, the frame walk) happen on the prefetch
+ * thread only; the control thread just swaps small lists under a mutex.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdint.h>
+
+#define PREFETCH_MAX    4               /* Tracks held open at once       */
+#define PREFETCH_BYTES  (16 << 20)      /* Readahead per track            */
+
+/* A measured track, see library_set_seek() */
+struct prefetch_index {
+    int       track;
+    uint64_t  size;                     /* File at the time of the walk   */
+    int64_t   mtime;
+    uint32_t  frames;
+    uint32_t  duration_ms;
+    uint32_t *offsets;                  /* malloc()ed seek table          */
+    unsigned  n;
+};
+
+/*
+ * Start the prefetch thread; it calls indexed() whenever a measurement is
+ * ready for prefetch_indexed().  Returns 0, or -1 if it could not start.
+ */
+int  prefetch_init(void (*indexed)(void));
+
+/* Control thread: the tracks (library slots) worth having cached, by priority */
+void prefetch_want(const int *tracks, int n);
+
+/*
+ * Control thread: a descriptor of track, open at offset 0 with readahead
+ * under way, or -1 if it has not been prefetched.  The caller owns it.
+ */
+int  prefetch_take(int track);
+
+/* Control thread: measure track once the tracks to warm are taken care of */
+void prefetch_index(int track);
+
+/* Control thread: the next finished measurement, 0 if there is none */
+int  prefetch_indexed(struct prefetch_index *out);
+
+#endif /* PREFETCH_H */
@@ -0,0 +1,411 @@
+/*
+ * proc.c
+ *
+ * Child process supervision (see proc.h).
+ *
+ * Children live in a small table guarded by a mutex, because the player
+ * and audio-writer threads spawn and terminate them too.  Whichever thread
+ * reaps a child only records its status; exit callbacks are delivered and
+ * table slots freed by proc_service() on the control thread.  A pidfd stays
+ * readable after its process was reaped, so the control loop still wakes
+ * up for a child that proc_wait() collected on another thread.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "proc.h"
+
+#define PROC_SCAN_MS 200    /* WNOHANG scan period without pidfd support */
+
+enum child_state {
+    CHILD_FREE = 0,
+    CHILD_SPAWNING,         /* Slot reserved, fork in progress           */
+    CHILD_RUNNING,
+    CHILD_EXITED,           /* Reaped, callback not yet delivered        */
+};
+
+struct child {
+    enum child_state state;
+    pid_t    pid;
+    int      pidfd;         /* -1 when pidfd_open is unavailable         */
+    int      status;
+    uint64_t kill_at_ms;    /* SIGKILL deadline, 0 = not terminating     */
+    void   (*on_exit)(pid_t pid, int status, void *arg);
+    void    *arg;
+};
+
+static struct child     children[PROC_MAX];
+static pthread_mutex_t  proc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+/* Caller holds proc_lock */
+static struct child *find_child(pid_t pid)
+{
+    for (int i = 0; i < PROC_MAX; i++)
+        if (children[i].state >= CHILD_RUNNING && children[i].pid == pid)
+            return &children[i];
+    return NULL;
+}
+
+/* Caller holds proc_lock; returns 1 once the child has been reaped */
+static int try_reap(struct child *c)
+{
+    int status;
+
+    if (c->state == CHILD_EXITED)
+        return 1;
+
+    pid_t r = waitpid(c->pid, &status, WNOHANG);
+    if (r == 0)
+        return 0;
+
+    /* ECHILD: somebody else reaped it; treat it as gone all the same */
+    c->status = r == c->pid ? status : 0;
+    c->state  = CHILD_EXITED;
+    return 1;
+}
+
+/* Signal the child's process group, or the child if the group is gone */
+static void signal_group(pid_t pid, int sig)
+{
+    if (kill(-pid, sig) < 0)
+        (void)kill(pid, sig);
+}
+
+/* ------------------------------------------------------- */
+/*                        SPAWNING                         */
+/* ------------------------------------------------------- */
+
+/*
+ * Child side of a fork: close every descriptor above stderr.  Only system
+ * calls from here on; another thread may have held the malloc or stdio
+ * lock at fork time.
+ */
+static void close_from_3(void)
+{
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, 3, ~0U, 0) == 0)
+        return;
+#endif
+    /* Older kernels: list the open ones in /proc, whatever their number */
+    int dir = open("/proc/self/fd", O_RDONLY | O_DIRECTORY);
+    if (dir >= 0) {
+        char buf[1024];
+        long n;
+
+        while ((n = syscall(SYS_getdents64, dir, buf, sizeof(buf))) > 0) {
+            for (long off = 0; off < n; ) {
+                const char *name = buf + off + 19;      /* d_name */
+                unsigned short reclen;
+                int fd = 0;
+
+                memcpy(&reclen, buf + off + 16, sizeof(reclen));
+                off += reclen;
+                if (name[0] < '0' || name[0] > '9')
+                    continue;
+                for (; *name >= '0' && *name <= '9'; name++)
+                    fd = fd * 10 + (*name - '0');
+                if (fd > 2 && fd != dir)
+                    close(fd);
+            }
+        }
+        close(dir);
+        return;
+    }
+
+    /* No /proc either: everything below the descriptor limit */
+    struct rlimit rl;
+    int max = getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+            ? (int)rl.rlim_cur : 1024;
+    for (int i = 3; i < max; i++)
+        close(i);
+}
+
+pid_t proc_spawn(const struct proc_spec *spec)
+{
+    struct child *c = NULL;
+
+    pthread_mutex_lock(&proc_lock);
+    for (int i = 0; i < PROC_MAX && !c; i++)
+        if (children[i].state == CHILD_FREE)
+            c = &children[i];
+    if (c)
+        c->state = CHILD_SPAWNING;
+    pthread_mutex_unlock(&proc_lock);
+
+    if (!c) {
+        fprintf(stderr, "proc: too many children, not starting %s\n",
+                spec->path);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("proc: fork");
+        pthread_mutex_lock(&proc_lock);
+        c->state = CHILD_FREE;
+        pthread_mutex_unlock(&proc_lock);
+        return -1;
+    }
+
+    if (pid == 0) {
+        /* Own process group, so termination reaches any grandchildren */
+        setpgid(0, 0);
+
+        /*
+         * The daemon ignores SIGPIPE and takes SIGINT/SIGTERM through a
+         * signalfd; its children should get the defaults of both
+         */
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        signal(SIGPIPE, SIG_DFL);
+
+        int null_fd = open("/dev/null", O_RDWR);
+        dup2(spec->in_fd  >= 0 ? spec->in_fd  : null_fd, STDIN_FILENO);
+        dup2(spec->out_fd >= 0 ? spec->out_fd : null_fd, STDOUT_FILENO);
+
+        close_from_3();
+        execv(spec->path, spec->argv);
+
+        /* No stdio: its lock may be held by a thread that did not fork */
+        static const char msg[] = ": exec failed\n";
+        (void)write(STDERR_FILENO, spec->path, strlen(spec->path));
+        (void)write(STDERR_FILENO, msg, sizeof(msg) - 1);
+        _exit(127);
+    }
+
+    /* Also set it here: whichever side runs first, the group exists */
+    setpgid(pid, pid);
+
+    pthread_mutex_lock(&proc_lock);
+    c->pid        = pid;
+    c->pidfd      = open_pidfd(pid);
+    c->status     = 0;
+    c->kill_at_ms = 0;
+    c->on_exit    = spec->on_exit;
+    c->arg        = spec->arg;
+    c->state      = CHILD_RUNNING;
+    pthread_mutex_unlock(&proc_lock);
+
+    return pid;
+}
+
+void proc_terminate(pid_t pid)
+{
+    if (pid <= 0)
+        return;
+
+    pthread_mutex_lock(&proc_lock);
+    struct child *c = find_child(pid);
+    if (c) {
+        c->on_exit = NULL;
+        if (c->state == CHILD_RUNNING && !c->kill_at_ms) {
+            signal_group(pid, SIGTERM);
+            c->kill_at_ms = now_ms() + PROC_KILL_TIMEOUT_MS;
+        }
+    }
+    pthread_mutex_unlock(&proc_lock);
+}
+
+/* ------------------------------------------------------- */
+/*                        WAITING                          */
+/* ------------------------------------------------------- */
+
+int proc_wait(pid_t pid, int timeout_ms)
+{
+    uint64_t deadline = now_ms() + (uint64_t)timeout_ms;
+
+    for (;;) {
+        int fd = -1, done;
+
+        pthread_mutex_lock(&proc_lock);
+        struct child *c = find_child(pid);
+        done = !c || try_reap(c);
+        if (!done && c->pidfd >= 0)
+            fd = fcntl(c->pidfd, F_DUPFD_CLOEXEC, 0);  /* Outlives the slot */
+        pthread_mutex_unlock(&proc_lock);
+
+        if (done)
+            return 0;
+
+        uint64_t now = now_ms();
+        if (now >= deadline) {
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+
+        int wait_ms = (int)(deadline - now);
+        if (fd >= 0) {
+            struct pollfd p = { .fd = fd, .events = POLLIN };
+            (void)poll(&p, 1, wait_ms);
+            close(fd);
+        } else {
+            usleep((wait_ms < 10 ? wait_ms : 10) * 1000);
+        }
+    }
+}
+
+/* ------------------------------------------------------- */
+/*                   CONTROL LOOP SERVICE                  */
+/* ------------------------------------------------------- */
+
+int proc_pollfds(struct pollfd *pfd, int max)
+{
+    int n = 0;
+
+    pthread_mutex_lock(&proc_lock);
+    for (int i = 0; i < PROC_MAX && n < max; i++) {
+        if (children[i].state < CHILD_RUNNING || children[i].pidfd < 0)
+            continue;
+        pfd[n].fd      = children[i].pidfd;
+        pfd[n].events  = POLLIN;
+        pfd[n].revents = 0;
+        n++;
+    }
+    pthread_mutex_unlock(&proc_lock);
+
+    return n;
+}
+
+static int pidfd_ready(const struct pollfd *pfd, int n, int fd)
+{
+    for (int i = 0; i < n; i++)
+        if (pfd[i].fd == fd)
+            return pfd[i].revents != 0;
+    return 0;
+}
+
+void proc_service(const struct pollfd *pfd, int n)
+{
+    struct {
+        void (*fn)(pid_t, int, void *);
+        pid_t pid;
+        int   status;
+        void *arg;
+    } done[PROC_MAX];
+    int ndone = 0;
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&proc_lock);
+    for (int i = 0; i < PROC_MAX; i++) {
+        struct child *c = &children[i];
+
+        if (c->state == CHILD_RUNNING) {
+            /* Only touch children that signalled, or that we cannot watch */
+            if (c->pidfd < 0 || c->kill_at_ms || pidfd_ready(pfd, n, c->pidfd))
+                try_reap(c);
+
+            if (c->state == CHILD_RUNNING && c->kill_at_ms &&
+                now >= c->kill_at_ms) {
+                fprintf(stderr, "proc: pid %d ignored SIGTERM, killing\n",
+                        (int)c->pid);
+                signal_group(c->pid, SIGKILL);
+                c->kill_at_ms = now + PROC_KILL_TIMEOUT_MS;
+            }
+        }
+
+        if (c->state != CHILD_EXITED)
+            continue;
+
+        if (c->on_exit) {
+            done[ndone].fn     = c->on_exit;
+            done[ndone].pid    = c->pid;
+            done[ndone].status = c->status;
+            done[ndone].arg    = c->arg;
+            ndone++;
+        }
+
+        if (c->pidfd >= 0)
+            close(c->pidfd);
+        memset(c, 0, sizeof(*c));
+        c->pidfd = -1;
+    }
+    pthread_mutex_unlock(&proc_lock);
+
+    /* Outside the lock: callbacks may spawn or terminate children */
+    for (int i = 0; i < ndone; i++)
+        done[i].fn(done[i].pid, done[i].status, done[i].arg);
+}
+
+int proc_timeout_ms(void)
+{
+    int timeout = -1;
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&proc_lock);
+    for (int i = 0; i < PROC_MAX; i++) {
+        const struct child *c = &children[i];
+        int t;
+
+        if (c->state != CHILD_RUNNING)
+            continue;
+
+        if (c->kill_at_ms)
+            t = c->kill_at_ms > now ? (int)(c->kill_at_ms - now) : 0;
+        else if (c->pidfd < 0)
+            t = PROC_SCAN_MS;
+        else
+            continue;
+
+        if (timeout < 0 || t < timeout)
+            timeout = t;
+    }
+    pthread_mutex_unlock(&proc_lock);
+
+    return timeout;
+}
+
+void proc_reap_all(void)
+{
+    pthread_mutex_lock(&proc_lock);
+    for (int i = 0; i < PROC_MAX; i++) {
+        struct child *c = &children[i];
+        if (c->state == CHILD_RUNNING && !c->kill_at_ms) {
+            signal_group(c->pid, SIGTERM);
+            c->kill_at_ms = now_ms() + PROC_KILL_TIMEOUT_MS;
+        }
+    }
+    pthread_mutex_unlock(&proc_lock);
+
+    /* proc_service() escalates to SIGKILL; give up on anything unkillable */
+    for (int t = 0; t < 3 * PROC_KILL_TIMEOUT_MS / 10 && proc_timeout_ms() >= 0; t++) {
+        proc_service(NULL, 0);
+        usleep(10 * 1000);
+    }
+    proc_service(NULL, 0);
+}
@@ -0,0 +1,67 @@
+/*
+ * proc.h
+ *
+ * Child process supervision shared by the decoder, the output stage, the
+ * download scheduler and the control loop.
+ *
+ * Every child is started through proc_spawn() (fork + exec, no shell) as
+ * the leader of its own process group and tracked with a pidfd.  The
+ * control loop polls those pidfds next to its other fds; proc_service()
+ * reaps whatever exited with WNOHANG and runs the child's exit callback,
+ * so nobody ever blocks in waitpid().  proc_terminate() signals the whole
+ * group and escalates to SIGKILL if it has not exited within
+ * PROC_KILL_TIMEOUT_MS.  Kernels without pidfd_open fall back to a
+ * periodic WNOHANG scan.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef PROC_H
+#define PROC_H
+
+#include <poll.h>
+#include <sys/types.h>
+
+#define PROC_MAX             32     /* Children tracked at once           */
+#define PROC_KILL_TIMEOUT_MS 2000   /* SIGTERM -> SIGKILL                 */
+
+struct proc_spec {
+    const char  *path;              /* Executable, absolute path          */
+    char *const *argv;
+    int          in_fd;             /* Child stdin,  -1 = /dev/null       */
+    int          out_fd;            /* Child stdout, -1 = /dev/null       */
+
+    /* Called from proc_service() once the child has been reaped */
+    void       (*on_exit)(pid_t pid, int status, void *arg);
+    void        *arg;
+};
+
+/* Start a supervised child. Thread-safe. Returns its pid or -1. */
+pid_t proc_spawn(const struct proc_spec *spec);
+
+/*
+ * Ask the child's process group to exit (SIGTERM now, SIGKILL after the
+ * timeout).  Its exit callback is dropped.  Thread-safe, never blocks.
+ */
+void  proc_terminate(pid_t pid);
+
+/*
+ * Wait up to timeout_ms for a child to exit; returns 0 once it has been
+ * reaped, -1 on timeout.  For the rare places that must wait (exclusive
+ * device hand-over, startup); never used from the control loop.
+ */
+int   proc_wait(pid_t pid, int timeout_ms);
+
+/* Control loop: pidfds to poll for POLLIN; returns how many were filled */
+int   proc_pollfds(struct pollfd *pfd, int max);
+
+/* Control loop: reap, run exit callbacks, escalate overdue terminations */
+void  proc_service(const struct pollfd *pfd, int n);
+
+/* Control loop: ms until proc_service() has timed work to do, -1 = none */
+int   proc_timeout_ms(void);
+
+/* Shutdown: terminate and reap everything still tracked (blocking) */
+void  proc_reap_all(void);
+
+#endif /* PROC_H */
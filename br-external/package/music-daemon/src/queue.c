@@ -0,0 +1,241 @@
+/*
+ * queue.c
+ *
+ * Play queue and shuffle order (see queue.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+
+#include "queue.h"
+
+#define SLOT_BITS   12                  /* log2(QUEUE_MAX)                */
+#define SEQ_MASK    0x7ffffu            /* Keeps handles off QUEUE_NONE   */
+#define ROUNDS      4
+
+/* ------------------------------------------------------- */
+/*                       PLAY QUEUE                        */
+/* ------------------------------------------------------- */
+
+static uint32_t nxt[QUEUE_MAX];         /* Slot links, QUEUE_NONE at ends */
+static uint32_t prv[QUEUE_MAX];
+static uint32_t track_of[QUEUE_MAX];
+static uint32_t seq[QUEUE_MAX];         /* Bumped when the slot is freed  */
+static uint8_t  used[QUEUE_MAX];
+static uint32_t head = QUEUE_NONE, tail = QUEUE_NONE;
+static uint32_t free_slot = QUEUE_NONE;
+static unsigned len;
+static int      inited;
+
+static uint32_t handle_of(uint32_t slot)
+{
+    return seq[slot] << SLOT_BITS | slot;
+}
+
+/* Slot of a live entry, or QUEUE_NONE */
+static uint32_t slot_of(uint32_t entry)
+{
+    uint32_t slot = entry & (QUEUE_MAX - 1);
+
+    if (entry == QUEUE_NONE || !used[slot] || handle_of(slot) != entry)
+        return QUEUE_NONE;
+    return slot;
+}
+
+static void unlink_slot(uint32_t slot)
+{
+    if (prv[slot] != QUEUE_NONE)
+        nxt[prv[slot]] = nxt[slot];
+    else
+        head = nxt[slot];
+    if (nxt[slot] != QUEUE_NONE)
+        prv[nxt[slot]] = prv[slot];
+    else
+        tail = prv[slot];
+}
+
+/* Link slot in front of before, or at the end */
+static void link_slot(uint32_t slot, uint32_t before)
+{
+    uint32_t after = before == QUEUE_NONE ? tail : prv[before];
+
+    prv[slot] = after;
+    nxt[slot] = before;
+    if (after != QUEUE_NONE)
+        nxt[after] = slot;
+    else
+        head = slot;
+    if (before != QUEUE_NONE)
+        prv[before] = slot;
+    else
+        tail = slot;
+}
+
+uint32_t queue_push(unsigned track, int front)
+{
+    uint32_t slot;
+
+    if (!inited) {
+        for (uint32_t i = 0; i < QUEUE_MAX; i++)
+            nxt[i] = i + 1 < QUEUE_MAX ? i + 1 : QUEUE_NONE;
+        free_slot = 0;
+        inited = 1;
+    }
+
+    if ((slot = free_slot) == QUEUE_NONE)
+        return QUEUE_NONE;
+    free_slot = nxt[slot];
+
+    used[slot] = 1;
+    track_of[slot] = track;
+    link_slot(slot, front ? head : QUEUE_NONE);
+    len++;
+    return handle_of(slot);
+}
+
+int queue_remove(uint32_t entry)
+{
+    uint32_t slot = slot_of(entry);
+
+    if (slot == QUEUE_NONE)
+        return -1;
+
+    unlink_slot(slot);
+    used[slot] = 0;
+    seq[slot] = (seq[slot] + 1) & SEQ_MASK;
+    nxt[slot] = free_slot;
+    free_slot = slot;
+    len--;
+    return 0;
+}
+
+int queue_move(uint32_t entry, uint32_t before)
+{
+    uint32_t slot = slot_of(entry);
+    uint32_t at = slot_of(before);
+
+    if (slot == QUEUE_NONE || (before != QUEUE_NONE && at == QUEUE_NONE))
+        return -1;
+    if (slot == at)
+        return 0;
+
+    unlink_slot(slot);
+    link_slot(slot, at);
+    return 0;
+}
+
+void queue_clear(void)
+{
+    while (head != QUEUE_NONE)
+        queue_remove(handle_of(head));
+}
+
+uint32_t queue_head(void)
+{
+    return head == QUEUE_NONE ? QUEUE_NONE : handle_of(head);
+}
+
+uint32_t queue_next(uint32_t entry)
+{
+    uint32_t slot = slot_of(entry);
+
+    if (slot == QUEUE_NONE || nxt[slot] == QUEUE_NONE)
+        return QUEUE_NONE;
+    return handle_of(nxt[slot]);
+}
+
+int queue_track(uint32_t entry)
+{
+    uint32_t slot = slot_of(entry);
+    return slot == QUEUE_NONE ? -1 : (int)track_of[slot];
+}
+
+unsigned queue_length(void)
+{
+    return len;
+}
+
+/* ------------------------------------------------------- */
+/*                         SHUFFLE                         */
+/* ------------------------------------------------------- */
+
+static uint64_t key;
+static unsigned start;                  /* Offset that puts 'first' at 0  */
+
+/* splitmix64 finalizer */
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* One pass of the network over 2 * h bits, forwards or backwards */
+static uint32_t feistel(uint64_t epoch, uint32_t x, unsigned h, int inverse)
+{
+    uint32_t mask = (1u << h) - 1;
+    uint32_t l = x >> h, r = x & mask;
+    uint64_t k = key ^ mix(epoch + 1);
+
+    for (int i = 0; i < ROUNDS; i++) {
+        uint64_t rk = k + (uint64_t)(inverse ? ROUNDS - 1 - i : i) * 0x9e3779b97f4a7c15ULL;
+        uint32_t t;
+
+        if (!inverse) {
+            t = l ^ ((uint32_t)mix(rk ^ r) & mask);
+            l = r;
+            r = t;
+        } else {
+            t = r ^ ((uint32_t)mix(rk ^ l) & mask);
+            r = l;
+            l = t;
+        }
+    }
+    return l << h | r;
+}
+
+/*
+ * Permutation of 0 .. n-1: walk the cycle of x in the larger domain until
+ * it lands below n again.  The domain is under 4n, so that takes a few
+ * steps on average.
+ */
+static unsigned permute(uint64_t epoch, unsigned x, unsigned n, int inverse)
+{
+    unsigned h = 1;
+
+    if (n <= 1)
+        return 0;
+    while (h < 16 && (1ULL << (2 * h)) < n)
+        h++;
+
+    do
+        x = feistel(epoch, x, h, inverse);
+    while (x >= n);
+    return x;
+}
+
+void shuffle_reset(uint64_t k, unsigned first, unsigned n)
+{
+    key = k;
+    start = n ? permute(0, first % n, n, 1) : 0;
+}
+
+unsigned shuffle_at(uint64_t epoch, unsigned pos, unsigned n)
+{
+    if (!n)
+        return 0;
+    return permute(epoch, (unsigned)(((uint64_t)pos + start) % n), n, 0);
+}
+
+unsigned shuffle_pos(uint64_t epoch, unsigned track, unsigned n)
+{
+    if (!n)
+        return 0;
+    return (unsigned)(((uint64_t)permute(epoch, track % n, n, 1) + n - start % n) % n);
+}
@@ -0,0 +1,61 @@
+/*
+ * queue.h
+ *
+ * Play queue and shuffle order of the local playlist.
+ *
+ * The queue is a doubly linked list threaded through a fixed pool of
+ * QUEUE_MAX entries, so enqueue, dequeue, removal and moving an entry
+ * anywhere are O(1) and never allocate.  Entries are named by handles that
+ * carry a sequence number: a handle whose entry has since been played or
+ * removed is refused rather than hitting whatever reuses the slot.
+ *
+ * Shuffle is a keyed permutation of the track numbers 0 .. n-1, computed on
+ * the fly with a 4-round Feistel network over the smallest power of four
+ * >= n, cycle-walking back into range.  Position -> track and track
+ * -> position are both a handful of multiplies; nothing is stored, so
+ * shuffling 100k tracks takes no memory and every track plays once per
+ * cycle.  Each cycle (epoch) gets its own permutation.
+ *
+ * Not thread-safe: only the control thread uses it.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdint.h>
+
+#define QUEUE_MAX   4096            /* Entries; a power of two            */
+#define QUEUE_NONE  0xffffffffu     /* No entry / end of the queue        */
+
+/* Add track at the end (or the front); returns its handle, QUEUE_NONE if full */
+uint32_t queue_push(unsigned track, int front);
+
+/* Take entry out of the queue. Returns 0, or -1 for a stale handle. */
+int      queue_remove(uint32_t entry);
+
+/* Put entry in front of before (QUEUE_NONE: at the end). Returns 0 or -1. */
+int      queue_move(uint32_t entry, uint32_t before);
+
+void     queue_clear(void);
+
+/* First entry and the one after entry, QUEUE_NONE at the end */
+uint32_t queue_head(void);
+uint32_t queue_next(uint32_t entry);
+
+/* Track of entry, or -1 for a stale handle */
+int      queue_track(uint32_t entry);
+
+unsigned queue_length(void);
+
+/* New permutations, with track first at position 0 of epoch 0 */
+void     shuffle_reset(uint64_t key, unsigned first, unsigned n);
+
+/* Track at position pos of epoch's permutation of 0 .. n-1 */
+unsigned shuffle_at(uint64_t epoch, unsigned pos, unsigned n);
+
+/* Position of track in epoch's permutation (the inverse of shuffle_at) */
+unsigned shuffle_pos(uint64_t epoch, unsigned track, unsigned n);
+
+#endif /* QUEUE_H */
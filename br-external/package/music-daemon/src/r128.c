@@ -0,0 +1,298 @@
+/*
+ * r128.c
+ *
+ * EBU R128 integrated loudness and true peak (see r128.h).
+ *
+ * The filter coefficients are derived for PCM_RATE from the analogue
+ * prototypes of BS.1770 the same way libebur128 does, so the result
+ * matches it to within the 0.1 LU of the histogram.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <math.h>
+
+/* float64x2_t and the across-vector sums are AArch64-only */
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define R128_HAVE_NEON 1
+#endif
+
+#include "r128.h"
+#include "pcm.h"
+
+#define SUB_FRAMES   PCM_MS_TO_FRAMES(100)  /* Gating block = 4 of these */
+#define ABS_GATE     -70.0                  /* LUFS                      */
+#define REL_GATE     -10.0                  /* LU below the ungated mean */
+
+static inline double energy_lufs(double e)
+{
+    return -0.691 + 10.0 * log10(e);
+}
+
+/* ------------------------------------------------------- */
+/*                    SCALAR KERNELS                       */
+/* ------------------------------------------------------- */
+
+/* K-weight frames and return the sum of squares of both channels */
+static double kweight_scalar(struct r128 *m, const int16_t *pcm, size_t frames)
+{
+    double sum = 0.0;
+
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < PCM_CHANNELS; c++) {
+            double x = pcm[i * PCM_CHANNELS + c] / 32768.0;
+
+            for (int s = 0; s < 2; s++) {
+                const double *k = m->coef[s];
+                double y = k[0] * x + m->z[s][0][c];
+                m->z[s][0][c] = k[1] * x - k[3] * y + m->z[s][1][c];
+                m->z[s][1][c] = k[2] * x - k[4] * y;
+                x = y;
+            }
+            sum += x * x;
+        }
+    }
+    return sum;
+}
+
+static void peak_scalar(struct r128 *m, const int16_t *pcm, size_t frames)
+{
+    float peak = m->peak;
+    unsigned pos = m->tp_pos;
+
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < PCM_CHANNELS; c++) {
+            float *buf = m->tp_buf[c];
+            float x = pcm[i * PCM_CHANNELS + c] / 32768.0f;
+
+            buf[pos] = buf[pos + R128_TP_TAPS] = x;
+            for (int p = 0; p < 4; p++) {
+                float y = 0.0f;
+                for (int k = 0; k < R128_TP_TAPS; k++)
+                    y += buf[pos + 1 + k] * m->tp_coef[k][p];
+                if (fabsf(y) > peak)
+                    peak = fabsf(y);
+            }
+        }
+        if (++pos == R128_TP_TAPS)
+            pos = 0;
+    }
+
+    m->peak = peak;
+    m->tp_pos = pos;
+}
+
+/* ------------------------------------------------------- */
+/*                     NEON KERNELS                        */
+/* ------------------------------------------------------- */
+
+#ifdef R128_HAVE_NEON
+
+/* Left and right in the two lanes of every register */
+static double kweight_neon(struct r128 *m, const int16_t *pcm, size_t frames)
+{
+    float64x2_t b0[2], b1[2], b2[2], a1[2], a2[2], z1[2], z2[2];
+    float64x2_t sum = vdupq_n_f64(0.0);
+    const float64x2_t scale = vdupq_n_f64(1.0 / 32768.0);
+
+    for (int s = 0; s < 2; s++) {
+        b0[s] = vdupq_n_f64(m->coef[s][0]);
+        b1[s] = vdupq_n_f64(m->coef[s][1]);
+        b2[s] = vdupq_n_f64(m->coef[s][2]);
+        a1[s] = vdupq_n_f64(m->coef[s][3]);
+        a2[s] = vdupq_n_f64(m->coef[s][4]);
+        z1[s] = vld1q_f64(m->z[s][0]);
+        z2[s] = vld1q_f64(m->z[s][1]);
+    }
+
+    for (size_t i = 0; i < frames; i++) {
+        float64x2_t x = { pcm[i * PCM_CHANNELS], pcm[i * PCM_CHANNELS + 1] };
+
+        x = vmulq_f64(x, scale);
+
+        for (int s = 0; s < 2; s++) {
+            float64x2_t y = vfmaq_f64(z1[s], b0[s], x);
+            z1[s] = vfmsq_f64(vfmaq_f64(z2[s], b1[s], x), a1[s], y);
+            z2[s] = vfmsq_f64(vmulq_f64(b2[s], x), a2[s], y);
+            x = y;
+        }
+        sum = vfmaq_f64(sum, x, x);
+    }
+
+    for (int s = 0; s < 2; s++) {
+        vst1q_f64(m->z[s][0], z1[s]);
+        vst1q_f64(m->z[s][1], z2[s]);
+    }
+    return vaddvq_f64(sum);
+}
+
+/* The four oversampled phases of one sample in the four lanes */
+static void peak_neon(struct r128 *m, const int16_t *pcm, size_t frames)
+{
+    float32x4_t coef[R128_TP_TAPS];
+    float32x4_t peak = vdupq_n_f32(m->peak);
+    unsigned pos = m->tp_pos;
+
+    for (int k = 0; k < R128_TP_TAPS; k++)
+        coef[k] = vld1q_f32(m->tp_coef[k]);
+
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < PCM_CHANNELS; c++) {
+            float *buf = m->tp_buf[c];
+            float32x4_t y = vdupq_n_f32(0.0f);
+
+            buf[pos] = buf[pos + R128_TP_TAPS] = pcm[i * PCM_CHANNELS + c] / 32768.0f;
+            for (int k = 0; k < R128_TP_TAPS; k++)
+                y = vfmaq_n_f32(y, coef[k], buf[pos + 1 + k]);
+            peak = vmaxq_f32(peak, vabsq_f32(y));
+        }
+        if (++pos == R128_TP_TAPS)
+            pos = 0;
+    }
+
+    m->peak = vmaxvq_f32(peak);
+    m->tp_pos = pos;
+}
+
+#endif /* R128_HAVE_NEON */
+
+/* ------------------------------------------------------- */
+/*                        GATING                           */
+/* ------------------------------------------------------- */
+
+/* A 100 ms block is complete: gate the 400 ms block it ends */
+static void end_sub_block(struct r128 *m)
+{
+    double e = 0.0, l;
+    int bin;
+
+    m->sub[m->nsub++ % 4] = m->acc / SUB_FRAMES;
+    m->acc = 0.0;
+    m->acc_frames = 0;
+    if (m->nsub < 4)
+        return;
+
+    for (int k = 0; k < 4; k++)
+        e += m->sub[k];
+    e /= 4;
+
+    if (e <= 0.0 || (l = energy_lufs(e)) < ABS_GATE)
+        return;
+
+    bin = (int)((l - ABS_GATE) * 10.0);
+    if (bin >= R128_HIST_BINS)
+        bin = R128_HIST_BINS - 1;
+    m->hist_energy[bin] += e;
+    m->hist_count[bin]++;
+}
+
+/* ------------------------------------------------------- */
+/*                       PUBLIC API                        */
+/* ------------------------------------------------------- */
+
+void r128_init(struct r128 *m)
+{
+    double f0, q, k, vh, vb, a0, sum[4] = { 0 };
+    float h[4 * R128_TP_TAPS];
+
+    memset(m, 0, sizeof(*m));
+
+    /* Stage 1: high shelf, +4 dB above ~1.7 kHz (head diffraction) */
+    f0 = 1681.974450955533;
+    q  = 0.7071752369554196;
+    k  = tan(M_PI * f0 / PCM_RATE);
+    vh = pow(10.0, 3.999843853973347 / 20.0);
+    vb = pow(vh, 0.4996667741545416);
+    a0 = 1.0 + k / q + k * k;
+    m->coef[0][0] = (vh + vb * k / q + k * k) / a0;
+    m->coef[0][1] = 2.0 * (k * k - vh) / a0;
+    m->coef[0][2] = (vh - vb * k / q + k * k) / a0;
+    m->coef[0][3] = 2.0 * (k * k - 1.0) / a0;
+    m->coef[0][4] = (1.0 - k / q + k * k) / a0;
+
+    /* Stage 2: RLB high-pass at ~38 Hz */
+    f0 = 38.13547087602444;
+    q  = 0.5003270373238773;
+    k  = tan(M_PI * f0 / PCM_RATE);
+    a0 = 1.0 + k / q + k * k;
+    m->coef[1][0] = 1.0;
+    m->coef[1][1] = -2.0;
+    m->coef[1][2] = 1.0;
+    m->coef[1][3] = 2.0 * (k * k - 1.0) / a0;
+    m->coef[1][4] = (1.0 - k / q + k * k) / a0;
+
+    /* 4x interpolator: Hann-windowed sinc cut off at the input Nyquist */
+    for (int n = 0; n < 4 * R128_TP_TAPS; n++) {
+        double t = (n - (4 * R128_TP_TAPS - 1) / 2.0) / 4.0;
+        double w = 0.5 - 0.5 * cos(2.0 * M_PI * (n + 1) / (4 * R128_TP_TAPS + 1));
+        h[n] = (float)(w * (t == 0.0 ? 1.0 : sin(M_PI * t) / (M_PI * t)));
+        sum[n % 4] += h[n];
+    }
+
+    /* Each phase at unity DC gain; newest input meets tap 0 of the phase */
+    for (int j = 0; j < R128_TP_TAPS; j++)
+        for (int p = 0; p < 4; p++)
+            m->tp_coef[R128_TP_TAPS - 1 - j][p] = (float)(h[4 * j + p] / sum[p]);
+}
+
+void r128_feed(struct r128 *m, const int16_t *pcm, size_t frames)
+{
+    while (frames) {
+        size_t n = SUB_FRAMES - m->acc_frames;
+        if (n > frames)
+            n = frames;
+
+#ifdef R128_HAVE_NEON
+        m->acc += kweight_neon(m, pcm, n);
+        peak_neon(m, pcm, n);
+#else
+        m->acc += kweight_scalar(m, pcm, n);
+        peak_scalar(m, pcm, n);
+#endif
+
+        m->acc_frames += n;
+        if (m->acc_frames == SUB_FRAMES)
+            end_sub_block(m);
+
+        pcm += n * PCM_CHANNELS;
+        frames -= n;
+    }
+}
+
+int r128_result(const struct r128 *m, double *lufs, double *peak_dbtp)
+{
+    double e = 0.0, rel;
+    unsigned long n = 0;
+    int first;
+
+    *peak_dbtp = m->peak > 0.0f ? 20.0 * log10(m->peak) : -96.0;
+
+    for (int b = 0; b < R128_HIST_BINS; b++) {
+        e += m->hist_energy[b];
+        n += m->hist_count[b];
+    }
+    if (!n) {
+        *lufs = ABS_GATE;
+        return -1;
+    }
+
+    /* Relative gate: every bin whose blocks lie above it */
+    rel = energy_lufs(e / n) + REL_GATE;
+    first = (int)ceil((rel - ABS_GATE) * 10.0);
+    if (first < 0)
+        first = 0;
+
+    e = 0.0;
+    n = 0;
+    for (int b = first; b < R128_HIST_BINS; b++) {
+        e += m->hist_energy[b];
+        n += m->hist_count[b];
+    }
+
+    *lufs = n ? energy_lufs(e / n) : ABS_GATE;
+    return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * r128.h
+ *
+ * EBU R128 loudness meter (ITU-R BS.1770-4) for interleaved S16 stereo at
+ * PCM_RATE: gated integrated loudness and 4x oversampled true peak.
+ *
+ * The K-weighting chain (high shelf, then the RLB high-pass) runs both
+ * channels through each biquad at once as the two lanes of a vector, and
+ * the true-peak interpolator computes the four oversampled phases of a
+ * sample as one vector.  On AArch64 both use NEON, the filter in double
+ * lanes since its 38 Hz pole sits too close to 1 for single precision; the
+ * scalar versions are the reference and the fallback on other hosts.
+ *
+ * Block loudness goes into a 0.1 LU histogram rather than a list, so a
+ * meter has a fixed size however long the track is.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef R128_H
+#define R128_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define R128_HIST_BINS 750          /* -70 .. +5 LUFS in 0.1 LU steps     */
+#define R128_TP_TAPS   12           /* Per phase of the 4x interpolator   */
+
+struct r128 {
+    double   coef[2][5];            /* b0 b1 b2 a1 a2 of the two biquads  */
+    double   z[2][2][2];            /* [stage][delay][channel]            */
+    float    tp_coef[R128_TP_TAPS][4];      /* Oldest input first, 4 phases */
+    float    tp_buf[2][2 * R128_TP_TAPS];   /* Inputs, written twice       */
+    unsigned tp_pos;
+    float    peak;                  /* Of the oversampled signal, 1 = FS  */
+    double   sub[4];                /* Energy of the last 100 ms blocks   */
+    double   acc;                   /* Energy of the block being filled   */
+    unsigned acc_frames;
+    unsigned nsub;                  /* 100 ms blocks completed            */
+    double   hist_energy[R128_HIST_BINS];
+    unsigned hist_count[R128_HIST_BINS];
+};
+
+void r128_init(struct r128 *m);
+
+/* Measure frames more frames */
+void r128_feed(struct r128 *m, const int16_t *pcm, size_t frames);
+
+/*
+ * Integrated loudness in LUFS and true peak in dBTP of everything fed so
+ * far.  Returns -1 (and -70 LUFS) if nothing was above the -70 LUFS gate.
+ */
+int  r128_result(const struct r128 *m, double *lufs, double *peak_dbtp);
+
+#endif /* R128_H */
@@ -0,0 +1,248 @@
+/*
+ * rt.c
+ *
+ * Real-time scheduling, memory locking, core pinning and the wakeup
+ * latency measurement (see rt.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+
+#define RT_PREFAULT_BYTES (64 * 1024)   /* Stack touched up front        */
+#define LAT_PERIOD_US     1000          /* Timer period of the test      */
+
+static struct rt_config cfg = {
+    .enable          = 0,
+    .audio_priority  = 80,
+    .player_priority = 0,
+    .audio_cpu       = 3,               /* Last core of the Pi 4         */
+};
+
+/* ------------------------------------------------------- */
+/*                        HELPERS                          */
+/* ------------------------------------------------------- */
+
+static int online_cpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+/* Pinning only makes sense when other cores are left for everything else */
+static int audio_cpu_usable(void)
+{
+    return cfg.audio_cpu >= 0 && cfg.audio_cpu < online_cpus() &&
+           online_cpus() > 1;
+}
+
+static void set_fifo(int priority, const char *who)
+{
+    struct sched_param sp = { .sched_priority = priority };
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+
+    if (err)
+        fprintf(stderr, "rt: SCHED_FIFO %d for %s: %s\n",
+                priority, who, strerror(err));
+}
+
+/* Touch the stack now so the first deep call in the loop cannot fault */
+static __attribute__((noinline)) void prefault_stack(void)
+{
+    volatile unsigned char buf[RT_PREFAULT_BYTES];
+
+    for (size_t i = 0; i < sizeof(buf); i += 4096)
+        buf[i] = 0;
+}
+
+/* ------------------------------------------------------- */
+/*                       PUBLIC API                        */
+/* ------------------------------------------------------- */
+
+void rt_configure(const struct rt_config *c)
+{
+    cfg = *c;
+
+    if (cfg.audio_priority < 1)
+        cfg.audio_priority = 1;
+    if (cfg.audio_priority > 99)
+        cfg.audio_priority = 99;
+    if (cfg.player_priority < 0)
+        cfg.player_priority = 0;
+    if (cfg.player_priority >= cfg.audio_priority)
+        cfg.player_priority = cfg.audio_priority - 1;
+}
+
+void rt_setup_process(void)
+{
+    if (!cfg.enable)
+        return;
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        perror("rt: mlockall");
+
+    /* Keep the heap resident: no trimming, no per-allocation mmap */
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    /* Threads and children started from here on inherit this mask */
+    if (audio_cpu_usable()) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        for (int i = 0; i < online_cpus(); i++)
+            if (i != cfg.audio_cpu)
+                CPU_SET(i, &set);
+
+        if (sched_setaffinity(0, sizeof(set), &set) < 0)
+            perror("rt: sched_setaffinity");
+    }
+}
+
+void rt_thread_attr(pthread_attr_t *attr)
+{
+    pthread_attr_init(attr);
+    pthread_attr_setstacksize(attr, RT_STACK_BYTES);
+}
+
+void rt_enter_audio_thread(void)
+{
+    if (!cfg.enable)
+        return;
+
+    if (audio_cpu_usable()) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(cfg.audio_cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            fprintf(stderr, "rt: cannot pin audio thread to CPU %d\n",
+                    cfg.audio_cpu);
+    }
+
+    set_fifo(cfg.audio_priority, "audio writer");
+    prefault_stack();
+}
+
+void rt_enter_player_thread(void)
+{
+    if (!cfg.enable)
+        return;
+
+    if (cfg.player_priority > 0)
+        set_fifo(cfg.player_priority, "player");
+    prefault_stack();
+}
+
+/* ------------------------------------------------------- */
+/*                  LATENCY MEASUREMENT                    */
+/* ------------------------------------------------------- */
+
+static const long lat_bounds_us[] = { 10, 20, 50, 100, 200, 500, 1000 };
+#define LAT_BUCKETS (sizeof(lat_bounds_us) / sizeof(lat_bounds_us[0]) + 1)
+
+struct lat_result {
+    long          loops;
+    long          min_us, max_us;
+    long long     sum_us;
+    unsigned long hist[LAT_BUCKETS];
+    int           policy, priority, cpu;
+};
+
+static long long ts_ns(const struct timespec *t)
+{
+    return (long long)t->tv_sec * 1000000000LL + t->tv_nsec;
+}
+
+static void *latency_thread(void *arg)
+{
+    struct lat_result *r = arg;
+    struct timespec next, now;
+    struct sched_param sp;
+
+    rt_enter_audio_thread();
+    pthread_getschedparam(pthread_self(), &r->policy, &sp);
+    r->priority = sp.sched_priority;
+    r->cpu      = sched_getcpu();
+    r->min_us   = -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (long i = 0; i < r->loops; i++) {
+        next.tv_nsec += LAT_PERIOD_US * 1000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            ;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        long us = (long)((ts_ns(&now) - ts_ns(&next)) / 1000);
+        size_t b = 0;
+
+        while (b < LAT_BUCKETS - 1 && us >= lat_bounds_us[b])
+            b++;
+        r->hist[b]++;
+        r->sum_us += us;
+        if (r->min_us < 0 || us < r->min_us)
+            r->min_us = us;
+        if (us > r->max_us)
+            r->max_us = us;
+    }
+
+    return NULL;
+}
+
+int rt_latency_test(int seconds)
+{
+    struct lat_result r = { 0 };
+    pthread_attr_t attr;
+    pthread_t t;
+
+    if (seconds <= 0)
+        seconds = 10;
+    r.loops = (long)seconds * (1000000L / LAT_PERIOD_US);
+
+    rt_setup_process();
+    rt_thread_attr(&attr);
+
+    printf("RT wakeup latency: %d s, %d us timer, rt_mode %s\n",
+           seconds, LAT_PERIOD_US, cfg.enable ? "on" : "off");
+
+    if (pthread_create(&t, &attr, latency_thread, &r) != 0) {
+        perror("rt: pthread_create");
+        return 1;
+    }
+    pthread_join(t, NULL);
+    pthread_attr_destroy(&attr);
+
+    printf("  thread: %s prio %d, CPU %d\n",
+           r.policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_OTHER",
+           r.priority, r.cpu);
+    printf("  samples %ld  min %ld us  avg %lld us  max %ld us\n",
+           r.loops, r.min_us, r.sum_us / r.loops, r.max_us);
+
+    for (size_t b = 0; b < LAT_BUCKETS; b++) {
+        if (b < LAT_BUCKETS - 1)
+            printf("  < %5ld us  %lu\n", lat_bounds_us[b], r.hist[b]);
+        else
+            printf("  >=%5ld us  %lu\n", lat_bounds_us[b - 1], r.hist[b]);
+    }
+
+    return 0;
+}
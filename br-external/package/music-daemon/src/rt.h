@@ -0,0 +1,52 @@
+/*
+ * rt.h
+ *
+ * Real-time profile for the audio path.
+ *
+ * When enabled, the process locks its memory (mlockall), the audio writer
+ * thread runs SCHED_FIFO on a core of its own with a prefaulted stack, and
+ * every other thread - and every child it forks (mpg123, wget, amixer) -
+ * is kept on the remaining cores.  Priorities and the audio core come from
+ * /etc/music_daemon.conf.  Without the privileges for any step a warning
+ * is printed and the daemon carries on with normal scheduling.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef RT_H
+#define RT_H
+
+#include <pthread.h>
+
+#define RT_STACK_BYTES    (256 * 1024)  /* Stack of every rt_thread_attr() thread */
+
+struct rt_config {
+    int enable;             /* 0 = leave scheduling and memory alone      */
+    int audio_priority;     /* SCHED_FIFO priority of the writer thread   */
+    int player_priority;    /* SCHED_FIFO priority of the player, 0 = off */
+    int audio_cpu;          /* Core reserved for the writer, -1 = no pin  */
+};
+
+/* Store settings; call before rt_setup_process() */
+void rt_configure(const struct rt_config *cfg);
+
+/* Lock memory and move the calling (main) thread off the audio core */
+void rt_setup_process(void);
+
+/*
+ * Attributes for every thread the daemon starts, not just the audio ones:
+ * a fixed stack size, so mlockall stays small
+ */
+void rt_thread_attr(pthread_attr_t *attr);
+
+/* Called at the top of the writer / player threads */
+void rt_enter_audio_thread(void);
+void rt_enter_player_thread(void);
+
+/*
+ * `music_daemon --rt-latency [seconds]`: run a periodic timer thread with
+ * the audio thread's settings and report its worst-case wakeup latency.
+ */
+int  rt_latency_test(int seconds);
+
+#endif /* RT_H */
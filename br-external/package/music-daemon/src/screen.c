@@ -0,0 +1,200 @@
+/*
+ * screen.c
+ *
+ * Diffing text screen model for the HDMI console (see screen.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "screen.h"
+
+#define BLANK    ((uint32_t)' ')
+#define JOIN_GAP 4      /* Unchanged cells cheaper to rewrite than skip */
+
+void screen_init(struct screen *s, int fd)
+{
+    s->fd = fd;
+    s->valid = 0;
+    s->out_done = s->out_len = 0;
+    screen_begin(s);
+}
+
+void screen_begin(struct screen *s)
+{
+    for (int r = 0; r < SCREEN_ROWS; r++)
+        for (int c = 0; c < SCREEN_COLS; c++)
+            s->cell[r][c] = BLANK;
+}
+
+void screen_invalidate(struct screen *s)
+{
+    s->valid = 0;
+}
+
+int screen_pending(const struct screen *s)
+{
+    return s->out_done < s->out_len;
+}
+
+/* ------------------------------------------------------- */
+/*                        DRAWING                          */
+/* ------------------------------------------------------- */
+
+/* Length of the UTF-8 sequence starting with byte b, 0 if b cannot start one */
+static int utf8_len(unsigned char b)
+{
+    if (b < 0x80) return 1;
+    if ((b & 0xe0) == 0xc0) return 2;
+    if ((b & 0xf0) == 0xe0) return 3;
+    if ((b & 0xf8) == 0xf0) return 4;
+    return 0;
+}
+
+int screen_puts(struct screen *s, int row, int col, const char *text)
+{
+    const unsigned char *p = (const unsigned char *)text;
+
+    while (*p) {
+        int len = utf8_len(*p), ok = len > 0;
+        uint32_t v = 0;
+
+        for (int k = 1; ok && k < len; k++)
+            ok = (p[k] & 0xc0) == 0x80;
+
+        if (!ok) {
+            v = '?';            /* Not UTF-8: one byte, one placeholder */
+            len = 1;
+        } else if (*p < 0x20 || *p == 0x7f) {
+            v = BLANK;          /* Control characters would move the cursor */
+        } else {
+            for (int k = 0; k < len; k++)
+                v |= (uint32_t)p[k] << (8 * k);
+        }
+        p += len;
+
+        if (row >= 0 && row < SCREEN_ROWS && col >= 0 && col < SCREEN_COLS)
+            s->cell[row][col] = v;
+        col++;
+    }
+    return col;
+}
+
+int screen_printf(struct screen *s, int row, int col, const char *fmt, ...)
+{
+    char text[SCREEN_COLS * 4 + 1];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+    return screen_puts(s, row, col, text);
+}
+
+void screen_putc(struct screen *s, int row, int col, char c)
+{
+    if (row >= 0 && row < SCREEN_ROWS && col >= 0 && col < SCREEN_COLS)
+        s->cell[row][col] = (unsigned char)c;
+}
+
+/* ------------------------------------------------------- */
+/*                        OUTPUT                           */
+/* ------------------------------------------------------- */
+
+static size_t put_cell(char *out, uint32_t v)
+{
+    size_t n = 0;
+
+    do {
+        out[n++] = (char)(v & 0xff);
+        v >>= 8;
+    } while (v && n < 4);
+    return n;
+}
+
+/* Write out[] on from out_done; returns the bytes written, or -1 */
+static long send_out(struct screen *s)
+{
+    size_t start = s->out_done;
+
+    while (s->out_done < s->out_len) {
+        ssize_t w = write(s->fd, s->out + s->out_done, s->out_len - s->out_done);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;              /* The rest goes when the console takes it */
+        if (w <= 0) {
+            s->out_done = s->out_len = 0;
+            s->valid = 0;       /* Console state unknown: start over */
+            return -1;
+        }
+        s->out_done += (size_t)w;
+    }
+    return (long)(s->out_done - start);
+}
+
+long screen_flush(struct screen *s)
+{
+    size_t n = 0;
+    long sent = 0, w;
+
+    /* The previous frame first; this one is dropped if that cannot finish */
+    if (screen_pending(s)) {
+        sent = send_out(s);
+        if (sent < 0 || screen_pending(s))
+            return sent;
+    }
+
+    if (!s->valid) {
+        /* Clear, hide the cursor, and take the blank screen as shown */
+        static const char clear[] = "\033[2J\033[?25l";
+        memcpy(s->out, clear, sizeof(clear) - 1);
+        n = sizeof(clear) - 1;
+        for (int r = 0; r < SCREEN_ROWS; r++)
+            for (int c = 0; c < SCREEN_COLS; c++)
+                s->shown[r][c] = BLANK;
+        s->valid = 1;
+    }
+
+    for (int r = 0; r < SCREEN_ROWS; r++) {
+        const uint32_t *cell = s->cell[r];
+        uint32_t *shown = s->shown[r];
+
+        for (int c = 0; c < SCREEN_COLS; ) {
+            int end, last;
+
+            if (cell[c] == shown[c]) {
+                c++;
+                continue;
+            }
+
+            /* A run of changes, joined across short unchanged gaps */
+            last = c;
+            for (end = c + 1; end < SCREEN_COLS && end - last <= JOIN_GAP; end++)
+                if (cell[end] != shown[end])
+                    last = end;
+
+            n += (size_t)sprintf(s->out + n, "\033[%d;%dH", r + 1, c + 1);
+            for (int k = c; k <= last; k++) {
+                n += put_cell(s->out + n, cell[k]);
+                shown[k] = cell[k];
+            }
+            c = last + 1;
+        }
+    }
+
+    if (!n)
+        return sent;
+
+    s->out_done = 0;
+    s->out_len  = n;
+    w = send_out(s);
+    return w < 0 ? -1 : sent + w;
+}
@@ -0,0 +1,73 @@
+/*
+ * screen.h
+ *
+ * Text screen model for the HDMI console.
+ *
+ * A frame is composed into a grid of cells from scratch each time, as if
+ * the whole screen were drawn; screen_flush() then compares it with what
+ * the console shows and writes only the cells that differ, in runs, each
+ * run behind one cursor-address escape, as a single write().  A frame that
+ * changes one number costs a dozen bytes, and a frame that changes nothing
+ * costs no system call at all.  Runs separated by only a few unchanged
+ * cells are joined, since rewriting those is cheaper than a new escape.
+ *
+ * On a non-blocking fd, what the console does not take at once is kept
+ * and sent first by the following flushes; until it has gone, flushes
+ * take no new frame, so a stalled console costs frames, not a stalled
+ * thread, and the frame shown when it recovers is the newest.
+ *
+ * Each cell holds one UTF-8 character, assumed one column wide; text past
+ * the right edge is cut off.
+ *
+ * Not thread-safe: a screen belongs to the thread that draws it.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCREEN_ROWS 45
+#define SCREEN_COLS 100
+
+struct screen {
+    int      fd;
+    int      valid;                     /* shown[] is what the console has */
+    uint32_t cell[SCREEN_ROWS][SCREEN_COLS];    /* UTF-8 bytes, low first  */
+    uint32_t shown[SCREEN_ROWS][SCREEN_COLS];
+    char     out[SCREEN_ROWS * SCREEN_COLS * 8];
+    size_t   out_done, out_len;             /* Sent, and to send, of out[] */
+};
+
+/* Draw on fd; the first flush clears the console and writes every cell */
+void screen_init(struct screen *s, int fd);
+
+/* Start a frame: every cell blank */
+void screen_begin(struct screen *s);
+
+/* Text at row, col (0-based); returns the column after it */
+int  screen_puts(struct screen *s, int row, int col, const char *text);
+int  screen_printf(struct screen *s, int row, int col, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+/* One ASCII character */
+void screen_putc(struct screen *s, int row, int col, char c);
+
+/*
+ * Bring the console up to date with the frame.  Returns the bytes
+ * written, 0 if nothing changed, or -1 if the write failed (the next
+ * flush then redraws everything).  While an earlier frame is still being
+ * sent, sends more of that instead and drops this one.
+ */
+long screen_flush(struct screen *s);
+
+/* Bytes of a frame still waiting for the console (fd not writable) */
+int  screen_pending(const struct screen *s);
+
+/* The console was disturbed: redraw everything on the next flush */
+void screen_invalidate(struct screen *s);
+
+#endif /* SCREEN_H */
@@ -0,0 +1,560 @@
+/*
+ * search.c
+ *
+ * Per-segment word and trigram indexes of the library (see search.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "search.h"
+
+#define WORD_MAX    32              /* Longer words are cut here          */
+#define QUERY_WORDS 8               /* One bit each in a uint8_t mask     */
+#define QUERY_TRIS  64
+#define SEG_MASK    (LIB_SEG_SIZE - 1)
+#define FIELD_SHIFT 10              /* Postings: slot | field << 10       */
+
+/* Match bonus per field (title, artist, album); whole words count double */
+static const int field_bonus[3] = { 30, 20, 10 };
+
+/* Index of one segment; postings are slots within it */
+struct seg_index {
+    uint64_t  serial;               /* lib_seg_serial() it was built from */
+    unsigned  ntri;
+    uint32_t *tri;                  /* Sorted distinct trigrams           */
+    uint32_t *tri_off;              /* ntri + 1 offsets into tri_post     */
+    uint16_t *tri_post;
+    unsigned  nword;
+    uint32_t *word;                 /* Offsets into words, string order   */
+    uint32_t *word_off;             /* nword + 1 offsets into word_post   */
+    uint16_t *word_post;            /* Slot | field << FIELD_SHIFT        */
+    char     *words;
+};
+
+static struct seg_index **segs;     /* By segment number                  */
+static unsigned           nsegs, segs_cap;
+
+/* ------------------------------------------------------- */
+/*                     NORMALIZATION                       */
+/* ------------------------------------------------------- */
+
+/* U+00C0..U+00FF (UTF-8 C3 80..C3 BF) without accents; ' ' for × and ÷ */
+static const char latin1_fold[] =
+    "aaaaaaaceeeeiiiidnooooo ouuuuyts"
+    "aaaaaaaceeeeiiiidnooooo ouuuuyty";
+
+/*
+ * Lowercase words of s, separated by single spaces.  Apostrophes vanish
+ * ("don't" is one word), other punctuation separates words, and bytes of
+ * non-Latin-1 UTF-8 are kept as they are.  Returns the length.
+ */
+static size_t normalize(const char *s, char *out, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    size_t n = 0;
+
+    while (*p && n + 1 < len) {
+        unsigned char c = *p++;
+        char o;
+
+        if (c >= 'A' && c <= 'Z')
+            o = (char)(c - 'A' + 'a');
+        else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+            o = (char)c;
+        else if (c == '\'')
+            continue;
+        else if (c == 0xC3 && *p >= 0x80 && *p <= 0xBF)
+            o = latin1_fold[*p++ - 0x80];
+        else if (c >= 0x80)
+            o = (char)c;
+        else
+            o = ' ';
+
+        if (o != ' ')
+            out[n++] = o;
+        else if (n && out[n - 1] != ' ')
+            out[n++] = ' ';
+    }
+
+    while (n && out[n - 1] == ' ')
+        n--;
+    out[n] = '\0';
+    return n;
+}
+
+/* Trigram j of w padded with a space on both sides; j < len */
+static uint32_t trigram(const char *w, unsigned len, unsigned j)
+{
+    unsigned char a = j ? (unsigned char)w[j - 1] : ' ';
+    unsigned char b = (unsigned char)w[j];
+    unsigned char c = j + 1 < len ? (unsigned char)w[j + 1] : ' ';
+
+    return (uint32_t)a << 16 | (uint32_t)b << 8 | c;
+}
+
+/* ------------------------------------------------------- */
+/*                        BUILDING                         */
+/* ------------------------------------------------------- */
+
+static int grow(void *pp, size_t *cap, size_t need, size_t size)
+{
+    void **p = pp;
+
+    if (need <= *cap)
+        return 0;
+
+    size_t n = *cap ? *cap : 1024;
+    while (n < need)
+        n *= 2;
+
+    void *q = realloc(*p, n * size);
+    if (!q)
+        return -1;
+    *p = q;
+    *cap = n;
+    return 0;
+}
+
+struct wentry {
+    uint32_t off;                   /* Word in the build arena            */
+    uint16_t post;
+};
+
+static const char *sort_arena;
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_wentry(const void *a, const void *b)
+{
+    const struct wentry *x = a, *y = b;
+    int c = strcmp(sort_arena + x->off, sort_arena + y->off);
+    return c ? c : (int)x->post - (int)y->post;
+}
+
+static void index_free(struct seg_index *x)
+{
+    if (!x)
+        return;
+    free(x->tri);
+    free(x->tri_off);
+    free(x->tri_post);
+    free(x->word);
+    free(x->word_off);
+    free(x->word_post);
+    free(x->words);
+    free(x);
+}
+
+static struct seg_index *index_build(const struct lib_view *v, unsigned k)
+{
+    unsigned base = k * LIB_SEG_SIZE;
+    unsigned n = lib_count(v) - base;
+    struct seg_index *x = calloc(1, sizeof(*x));
+    uint64_t *tp = NULL;            /* trigram << 16 | slot               */
+    struct wentry *wp = NULL;
+    char *arena = NULL;
+    size_t ntp = 0, tp_cap = 0, nwp = 0, wp_cap = 0, alen = 0, a_cap = 0;
+
+    if (n > LIB_SEG_SIZE)
+        n = LIB_SEG_SIZE;
+    if (!x)
+        return NULL;
+
+    for (unsigned i = 0; i < n; i++) {
+        const struct lib_track *t = lib_track(v, base + i);
+        uint32_t fields[3];
+
+        if (!t)
+            continue;
+        fields[0] = t->title;
+        fields[1] = t->artist;
+        fields[2] = t->album;
+
+        for (unsigned f = 0; f < 3; f++) {
+            char text[512];
+            char *w = text;
+
+            if (!normalize(lib_str(v, base + i, fields[f]), text, sizeof(text)))
+                continue;
+
+            while (*w) {
+                unsigned len = (unsigned)strcspn(w, " ");
+                unsigned wl = len < WORD_MAX ? len : WORD_MAX - 1;
+
+                if (grow(&tp, &tp_cap, ntp + wl, sizeof(*tp)) < 0 ||
+                    grow(&wp, &wp_cap, nwp + 1, sizeof(*wp)) < 0 ||
+                    grow(&arena, &a_cap, alen + wl + 1, 1) < 0)
+                    goto fail;
+
+                for (unsigned j = 0; j < wl; j++)
+                    tp[ntp++] = (uint64_t)trigram(w, wl, j) << 16 | i;
+
+                memcpy(arena + alen, w, wl);
+                arena[alen + wl] = '\0';
+                wp[nwp].off  = (uint32_t)alen;
+                wp[nwp].post = (uint16_t)(i | f << FIELD_SHIFT);
+                nwp++;
+                alen += wl + 1;
+
+                w += len;
+                if (*w == ' ')
+                    w++;
+            }
+        }
+    }
+
+    /* Trigrams: sort, drop repeats within a track, then group */
+    if (ntp)
+        qsort(tp, ntp, sizeof(*tp), cmp_u64);
+
+    size_t nposts = 0, tcap = 0, tocap = 0;
+    for (size_t j = 0; j < ntp; j++) {
+        if (nposts && tp[j] == tp[nposts - 1])
+            continue;
+        if (!nposts || tp[j] >> 16 != x->tri[x->ntri - 1]) {
+            if (grow(&x->tri, &tcap, x->ntri + 1, sizeof(*x->tri)) < 0 ||
+                grow(&x->tri_off, &tocap, x->ntri + 2, sizeof(*x->tri_off)) < 0)
+                goto fail;
+            x->tri[x->ntri] = (uint32_t)(tp[j] >> 16);
+            x->tri_off[x->ntri++] = (uint32_t)nposts;
+        }
+        tp[nposts++] = tp[j];       /* Compact in place */
+    }
+    if (!(x->tri_post = malloc((nposts ? nposts : 1) * sizeof(*x->tri_post))) ||
+        (!x->tri_off && !(x->tri_off = malloc(sizeof(*x->tri_off)))))
+        goto fail;
+    for (size_t j = 0; j < nposts; j++)
+        x->tri_post[j] = (uint16_t)(tp[j] & 0xffff);
+    x->tri_off[x->ntri] = (uint32_t)nposts;
+
+    /* Words: sorted by string, postings by slot and field */
+    sort_arena = arena;
+    if (nwp)
+        qsort(wp, nwp, sizeof(*wp), cmp_wentry);
+
+    size_t wlen = 0, wposts = 0, wcap = 0, ocap = 0;
+    if (!(x->word_post = malloc((nwp ? nwp : 1) * sizeof(*x->word_post))) ||
+        !(x->words = malloc(alen ? alen : 1)))
+        goto fail;
+
+    for (size_t j = 0; j < nwp; j++) {
+        const char *w = arena + wp[j].off;
+        int same = j && strcmp(w, arena + wp[j - 1].off) == 0;
+
+        if (same && wp[j].post == wp[j - 1].post)
+            continue;
+        if (!same) {
+            if (grow(&x->word, &wcap, x->nword + 1, sizeof(*x->word)) < 0 ||
+                grow(&x->word_off, &ocap, x->nword + 2, sizeof(*x->word_off)) < 0)
+                goto fail;
+            size_t l = strlen(w) + 1;
+            memcpy(x->words + wlen, w, l);
+            x->word[x->nword] = (uint32_t)wlen;
+            x->word_off[x->nword++] = (uint32_t)wposts;
+            wlen += l;
+        }
+        x->word_post[wposts++] = wp[j].post;
+    }
+    if (!x->word_off && !(x->word_off = malloc(sizeof(*x->word_off))))
+        goto fail;
+    x->word_off[x->nword] = (uint32_t)wposts;
+
+    free(tp);
+    free(wp);
+    free(arena);
+    return x;
+
+fail:
+    perror("search: index");
+    free(tp);
+    free(wp);
+    free(arena);
+    index_free(x);
+    return NULL;
+}
+
+void search_refresh(const struct lib_view *v)
+{
+    unsigned n = lib_nsegs(v);
+
+    if (n > segs_cap) {
+        struct seg_index **s = realloc(segs, n * sizeof(*s));
+        if (!s)
+            return;
+        memset(s + segs_cap, 0, (n - segs_cap) * sizeof(*s));
+        segs = s;
+        segs_cap = n;
+    }
+
+    for (unsigned k = 0; k < n; k++) {
+        uint64_t serial = lib_seg_serial(v, k);
+
+        if (segs[k] && segs[k]->serial == serial)
+            continue;
+        index_free(segs[k]);
+        if ((segs[k] = index_build(v, k)))
+            segs[k]->serial = serial;
+    }
+
+    for (unsigned k = n; k < nsegs; k++) {
+        index_free(segs[k]);
+        segs[k] = NULL;
+    }
+    nsegs = n;
+}
+
+/* ------------------------------------------------------- */
+/*                        QUERIES                          */
+/* ------------------------------------------------------- */
+
+struct qword {
+    char     w[WORD_MAX];
+    unsigned len;
+    int      prefix;                /* Still being typed                  */
+    int      tri, ntri;             /* Its trigrams in query.tri          */
+};
+
+struct query {
+    struct qword word[QUERY_WORDS];
+    int          nword;
+    uint32_t     tri[QUERY_TRIS];
+    int          ntri;
+};
+
+/* Per-slot scratch for one segment, reset after use */
+static uint8_t  seen[LIB_SEG_SIZE];
+static uint8_t  tri_hits[LIB_SEG_SIZE];
+static uint8_t  wmask[LIB_SEG_SIZE];
+static uint8_t  wbest[LIB_SEG_SIZE];
+static int16_t  bonus[LIB_SEG_SIZE];
+static uint16_t touched[LIB_SEG_SIZE];
+static uint16_t wtouched[LIB_SEG_SIZE];
+
+static void parse_query(const char *q, struct query *qr)
+{
+    char text[256];
+    char *w = text;
+    size_t qlen = strlen(q);
+    unsigned char last = qlen ? (unsigned char)q[qlen - 1] : ' ';
+    int open = (last >= 0x80) || (last >= '0' && last <= '9') ||
+               ((last | 0x20) >= 'a' && (last | 0x20) <= 'z');
+
+    memset(qr, 0, sizeof(*qr));
+    normalize(q, text, sizeof(text));
+
+    while (*w && qr->nword < QUERY_WORDS) {
+        struct qword *qw = &qr->word[qr->nword++];
+        unsigned len = (unsigned)strcspn(w, " ");
+
+        qw->len = len < WORD_MAX ? len : WORD_MAX - 1;
+        memcpy(qw->w, w, qw->len);
+        w += len;
+        if (*w == ' ')
+            w++;
+        qw->prefix = open && !*w;
+
+        /* A word being typed has no end yet: no trailing-space trigram */
+        qw->tri = qr->ntri;
+        for (unsigned j = 0; j + (qw->prefix ? 1 : 0) < qw->len; j++) {
+            uint32_t t = trigram(qw->w, qw->len, j);
+            int dup = 0;
+
+            for (int k = qw->tri; k < qr->ntri && !dup; k++)
+                dup = qr->tri[k] == t;
+            if (!dup && qr->ntri < QUERY_TRIS)
+                qr->tri[qr->ntri++] = t;
+        }
+        qw->ntri = qr->ntri - qw->tri;
+    }
+}
+
+/* Keep hits sorted best first; ties keep library order */
+static void add_hit(struct search_hit *hits, int *n, int max, unsigned idx, int score)
+{
+    int i;
+
+    if (*n == max && score <= hits[max - 1].score)
+        return;
+
+    i = *n < max ? (*n)++ : max - 1;
+    while (i > 0 && hits[i - 1].score < score) {
+        hits[i] = hits[i - 1];
+        i--;
+    }
+    hits[i].idx = idx;
+    hits[i].score = score;
+}
+
+/* Words of x matching qw: [*lo, return value), exact match first */
+static unsigned word_range(const struct seg_index *x, const struct qword *qw,
+                           unsigned *lo)
+{
+    unsigned l = 0, h = x->nword, j;
+
+    while (l < h) {
+        unsigned mid = (l + h) / 2;
+        if (strcmp(x->words + x->word[mid], qw->w) < 0)
+            l = mid + 1;
+        else
+            h = mid;
+    }
+
+    for (j = l; j < x->nword; j++) {
+        const char *w = x->words + x->word[j];
+        if (strncmp(w, qw->w, qw->len) != 0 || (!qw->prefix && w[qw->len]))
+            break;
+    }
+    *lo = l;
+    return j;
+}
+
+/*
+ * Every query word must occur in a hit, as a whole word or, while being
+ * typed, as a prefix.  Words that do not occur in the segment at all are
+ * probably misspelt: those are matched by trigrams, and a track needs a
+ * third of them (one typo in a short word leaves little more).  Found
+ * words are intersected rarest first, so common ones ("the", an artist on
+ * every track) only test tracks already in the race.
+ */
+static void query_segment(const struct seg_index *x, unsigned base,
+                          const struct query *qr,
+                          struct search_hit *hits, int *nhits, int max)
+{
+    unsigned lo[QUERY_WORDS], hi[QUERY_WORDS], nt = 0;
+    uint32_t cost[QUERY_WORDS];
+    int order[QUERY_WORDS], nfound = 0, fuzzy_tris = 0;
+    uint8_t need = 0;
+
+    for (int qi = 0; qi < qr->nword; qi++) {
+        hi[qi] = word_range(x, &qr->word[qi], &lo[qi]);
+        cost[qi] = lo[qi] < hi[qi] ? x->word_off[hi[qi]] - x->word_off[lo[qi]] : 0;
+        if (!cost[qi]) {
+            fuzzy_tris += qr->word[qi].ntri;
+            continue;
+        }
+
+        int k = nfound++;
+        while (k > 0 && cost[order[k - 1]] > cost[qi]) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = qi;
+        need |= (uint8_t)(1u << qi);
+    }
+
+    if (!nfound && !fuzzy_tris)
+        return;
+
+    for (int r = 0; r < nfound; r++) {
+        int qi = order[r];
+        unsigned nw = 0;
+
+        for (unsigned j = lo[qi]; j < hi[qi]; j++) {
+            int exact = x->words[x->word[j] + qr->word[qi].len] == '\0';
+
+            for (uint32_t p = x->word_off[j]; p < x->word_off[j + 1]; p++) {
+                unsigned i = x->word_post[p] & SEG_MASK;
+                int b = field_bonus[x->word_post[p] >> FIELD_SHIFT] * (exact ? 2 : 1);
+
+                if (!seen[i]) {
+                    if (r)
+                        continue;       /* Missed a rarer word already */
+                    seen[i] = 1;
+                    touched[nt++] = (uint16_t)i;
+                }
+                if (!(wmask[i] & (1u << qi))) {
+                    wmask[i] |= (uint8_t)(1u << qi);
+                    wtouched[nw++] = (uint16_t)i;
+                }
+                if (b > wbest[i])
+                    wbest[i] = (uint8_t)b;
+            }
+        }
+
+        /* Best field per query word, not one bonus per matching word */
+        for (unsigned k = 0; k < nw; k++) {
+            bonus[wtouched[k]] += wbest[wtouched[k]];
+            wbest[wtouched[k]] = 0;
+        }
+    }
+
+    for (int qi = 0; qi < qr->nword; qi++) {
+        if (cost[qi])
+            continue;
+
+        for (int t = qr->word[qi].tri; t < qr->word[qi].tri + qr->word[qi].ntri; t++) {
+            unsigned l = 0, h = x->ntri;
+
+            while (l < h) {
+                unsigned mid = (l + h) / 2;
+                if (x->tri[mid] < qr->tri[t])
+                    l = mid + 1;
+                else
+                    h = mid;
+            }
+            if (l == x->ntri || x->tri[l] != qr->tri[t])
+                continue;
+
+            for (uint32_t p = x->tri_off[l]; p < x->tri_off[l + 1]; p++) {
+                unsigned i = x->tri_post[p];
+
+                if (!seen[i]) {
+                    if (nfound)
+                        continue;
+                    seen[i] = 1;
+                    touched[nt++] = (uint16_t)i;
+                }
+                tri_hits[i]++;
+            }
+        }
+    }
+
+    /* Found words weigh 1000 each, misspelt ones up to 800 by overlap */
+    for (unsigned k = 0; k < nt; k++) {
+        unsigned i = touched[k];
+
+        if ((wmask[i] & need) == need &&
+            (!fuzzy_tris || tri_hits[i] * 3 >= fuzzy_tris)) {
+            int fuzzy = qr->nword - nfound;
+            int score = (nfound * 1000 + bonus[i] +
+                         (fuzzy ? fuzzy * 800 * tri_hits[i] / fuzzy_tris : 0)) /
+                        qr->nword;
+            add_hit(hits, nhits, max, base + i, score);
+        }
+
+        seen[i] = tri_hits[i] = wmask[i] = 0;
+        bonus[i] = 0;
+    }
+}
+
+int search_query(const struct lib_view *v, const char *query,
+                 struct search_hit *hits, int max)
+{
+    struct query qr;
+    int n = 0;
+
+    if (max <= 0)
+        return 0;
+
+    parse_query(query, &qr);
+    if (!qr.nword)
+        return 0;
+
+    search_refresh(v);
+
+    for (unsigned k = 0; k < nsegs; k++)
+        if (segs[k])
+            query_segment(segs[k], k * LIB_SEG_SIZE, &qr, hits, &n, max);
+    return n;
+}
@@ -0,0 +1,44 @@
+/*
+ * search.h
+ *
+ * Typeahead search over the titles, artists and albums of the local
+ * library.
+ *
+ * Every library segment (LIB_SEG_SIZE tracks, see library.h) gets a small
+ * index of its own: the words of its tracks, sorted for prefix lookups,
+ * and the trigrams of those words with the tracks they occur in.  Segments
+ * never change once published, so an index stays valid until its segment
+ * is replaced; after a library change only the new segments are indexed
+ * again, by the next query.
+ *
+ * A query matches whole words, prefixes (the last word while it is being
+ * typed) and, to survive typos, words sharing most of their trigrams.
+ * Case and Latin-1 accents are ignored.  Hits rank by the share of query
+ * words found, then trigram overlap, then where they matched: title before
+ * artist before album, whole words before prefixes.
+ *
+ * Not thread-safe: the network thread owns the indexes.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "library.h"
+
+#define SEARCH_MAX_RESULTS 50
+
+struct search_hit {
+    unsigned idx;               /* Library slot */
+    int      score;
+};
+
+/* Index the segments of v that changed since the last call */
+void search_refresh(const struct lib_view *v);
+
+/* Best hits for query in v, best first; returns how many (0..max) */
+int  search_query(const struct lib_view *v, const char *query,
+                  struct search_hit *hits, int max);
+
+#endif /* SEARCH_H */
@@ -0,0 +1,262 @@
+/*
+ * spectrum.c
+ *
+ * FFT spectrum and level meters (see spectrum.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* vfmaq_f32 and the across-vector reductions are AArch64-only */
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SPECTRUM_HAVE_NEON 1
+#endif
+
+#include "spectrum.h"
+#include "pcm.h"
+
+static float to_db(float power)
+{
+    return power > 0.0f ? 10.0f * log10f(power) : SPECTRUM_FLOOR_DB;
+}
+
+/* ------------------------------------------------------- */
+/*                    SCALAR KERNELS                       */
+/* ------------------------------------------------------- */
+
+/* Mono mix of the window, windowed, into re in natural order */
+static void window_scalar(struct spectrum *s, const int16_t *pcm)
+{
+    for (int i = 0; i < SPECTRUM_N; i++)
+        s->re[i] = (float)(pcm[2 * i] + pcm[2 * i + 1]) * s->window[i];
+}
+
+/* Butterflies of the stages with h up to (not including) end pairs per group */
+static void stages_scalar(struct spectrum *s, unsigned h, unsigned end)
+{
+    float *re = s->re, *im = s->im;
+
+    for (; h < end; h *= 2) {
+        const float *wr = s->tw_re + h - 1, *wi = s->tw_im + h - 1;
+
+        for (unsigned base = 0; base < SPECTRUM_N; base += 2 * h) {
+            for (unsigned j = 0; j < h; j++) {
+                unsigned a = base + j, b = a + h;
+                float tr = re[b] * wr[j] - im[b] * wi[j];
+                float ti = re[b] * wi[j] + im[b] * wr[j];
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+/* Power of bins 0 .. n-1, into re */
+static void power_scalar(struct spectrum *s, unsigned n)
+{
+    for (unsigned k = 0; k < n; k++)
+        s->re[k] = s->re[k] * s->re[k] + s->im[k] * s->im[k];
+}
+
+/* Highest magnitude and sum of squares of each channel */
+static void levels_scalar(const int16_t *pcm, int peak[2], double sum[2])
+{
+    for (int i = 0; i < SPECTRUM_N; i++) {
+        for (int c = 0; c < PCM_CHANNELS; c++) {
+            int x = pcm[i * PCM_CHANNELS + c];
+            if (abs(x) > peak[c])
+                peak[c] = abs(x);
+            sum[c] += (double)x * x;
+        }
+    }
+}
+
+/* ------------------------------------------------------- */
+/*                     NEON KERNELS                        */
+/* ------------------------------------------------------- */
+
+#ifdef SPECTRUM_HAVE_NEON
+
+static void window_neon(struct spectrum *s, const int16_t *pcm)
+{
+    for (int i = 0; i < SPECTRUM_N; i += 8) {
+        int16x8x2_t x = vld2q_s16(pcm + 2 * i);
+        int32x4_t lo = vaddl_s16(vget_low_s16(x.val[0]), vget_low_s16(x.val[1]));
+        int32x4_t hi = vaddl_s16(vget_high_s16(x.val[0]), vget_high_s16(x.val[1]));
+
+        vst1q_f32(s->re + i, vmulq_f32(vcvtq_f32_s32(lo), vld1q_f32(s->window + i)));
+        vst1q_f32(s->re + i + 4, vmulq_f32(vcvtq_f32_s32(hi), vld1q_f32(s->window + i + 4)));
+    }
+}
+
+/* Four butterflies of a group at a time; needs h >= 4 */
+static void stages_neon(struct spectrum *s, unsigned h)
+{
+    float *re = s->re, *im = s->im;
+
+    for (; h < SPECTRUM_N; h *= 2) {
+        const float *wr = s->tw_re + h - 1, *wi = s->tw_im + h - 1;
+
+        for (unsigned base = 0; base < SPECTRUM_N; base += 2 * h) {
+            for (unsigned j = 0; j < h; j += 4) {
+                unsigned a = base + j, b = a + h;
+                float32x4_t br = vld1q_f32(re + b), bi = vld1q_f32(im + b);
+                float32x4_t ar = vld1q_f32(re + a), ai = vld1q_f32(im + a);
+                float32x4_t cr = vld1q_f32(wr + j), ci = vld1q_f32(wi + j);
+                float32x4_t tr = vfmsq_f32(vmulq_f32(br, cr), bi, ci);
+                float32x4_t ti = vfmaq_f32(vmulq_f32(br, ci), bi, cr);
+
+                vst1q_f32(re + b, vsubq_f32(ar, tr));
+                vst1q_f32(im + b, vsubq_f32(ai, ti));
+                vst1q_f32(re + a, vaddq_f32(ar, tr));
+                vst1q_f32(im + a, vaddq_f32(ai, ti));
+            }
+        }
+    }
+}
+
+static void power_neon(struct spectrum *s, unsigned n)
+{
+    unsigned k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        float32x4_t r = vld1q_f32(s->re + k), i = vld1q_f32(s->im + k);
+        vst1q_f32(s->re + k, vfmaq_f32(vmulq_f32(r, r), i, i));
+    }
+    for (; k < n; k++)
+        s->re[k] = s->re[k] * s->re[k] + s->im[k] * s->im[k];
+}
+
+/* Squares summed in float lanes: exact enough for a meter over 1024 frames */
+static void levels_neon(const int16_t *pcm, int peak[2], double sum[2])
+{
+    int16x8_t pk[2] = { vdupq_n_s16(0), vdupq_n_s16(0) };
+    float32x4_t acc[2] = { vdupq_n_f32(0.0f), vdupq_n_f32(0.0f) };
+
+    for (int i = 0; i < SPECTRUM_N; i += 8) {
+        int16x8x2_t x = vld2q_s16(pcm + 2 * i);
+
+        for (int c = 0; c < 2; c++) {
+            float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(x.val[c])));
+            float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(x.val[c])));
+
+            pk[c]  = vmaxq_s16(pk[c], vqabsq_s16(x.val[c]));
+            acc[c] = vfmaq_f32(vfmaq_f32(acc[c], lo, lo), hi, hi);
+        }
+    }
+
+    for (int c = 0; c < 2; c++) {
+        int p = vmaxvq_s16(pk[c]);
+        if (p > peak[c])
+            peak[c] = p;
+        sum[c] += vaddvq_f32(acc[c]);
+    }
+}
+
+#endif /* SPECTRUM_HAVE_NEON */
+
+/* ------------------------------------------------------- */
+/*                       PUBLIC API                        */
+/* ------------------------------------------------------- */
+
+void spectrum_init(struct spectrum *s, unsigned nbands, float f_lo, float f_hi)
+{
+    unsigned bits = 0, half = SPECTRUM_N / 2;
+
+    memset(s, 0, sizeof(*s));
+    while ((1u << bits) < SPECTRUM_N)
+        bits++;
+
+    /*
+     * Periodic Hann, times 1/2 for the mono mix and 4/N for the window's
+     * coherent gain and the one-sided spectrum: a full-scale sine is 1.0
+     */
+    for (int i = 0; i < SPECTRUM_N; i++) {
+        unsigned r = 0;
+        for (unsigned b = 0; b < bits; b++)
+            r |= ((i >> b) & 1u) << (bits - 1 - b);
+        s->rev[i] = (uint16_t)r;
+        s->window[i] = (float)((0.5 - 0.5 * cos(2.0 * M_PI * i / SPECTRUM_N)) *
+                               0.5 / 32768.0 * 4.0 / SPECTRUM_N);
+    }
+
+    for (unsigned h = 1; h < SPECTRUM_N; h *= 2) {
+        for (unsigned j = 0; j < h; j++) {
+            s->tw_re[h - 1 + j] = (float)cos(-M_PI * j / h);
+            s->tw_im[h - 1 + j] = (float)sin(-M_PI * j / h);
+        }
+    }
+
+    /* Log-spaced edges; every band gets at least one bin of its own */
+    if (nbands > SPECTRUM_BANDS_MAX)
+        nbands = SPECTRUM_BANDS_MAX;
+    s->nbands = nbands;
+    for (unsigned b = 0; b <= nbands; b++) {
+        double f = f_lo * pow(f_hi / f_lo, (double)b / nbands);
+        unsigned k = (unsigned)lrint(f * SPECTRUM_N / PCM_RATE);
+
+        if (b && k <= s->band[b - 1])
+            k = s->band[b - 1] + 1u;
+        if (k > half)
+            k = half;
+        s->band[b] = (uint16_t)k;
+    }
+}
+
+void spectrum_run(struct spectrum *s, const int16_t *pcm, float *bands,
+                  struct spectrum_levels *lv)
+{
+    int peak[2] = { 0, 0 };
+    double sum[2] = { 0.0, 0.0 };
+
+#ifdef SPECTRUM_HAVE_NEON
+    window_neon(s, pcm);
+    levels_neon(pcm, peak, sum);
+#else
+    window_scalar(s, pcm);
+    levels_scalar(pcm, peak, sum);
+#endif
+
+    /* Into bit-reversed order; the input is real */
+    for (int i = 0; i < SPECTRUM_N; i++) {
+        int r = s->rev[i];
+        if (r > i) {
+            float t = s->re[i];
+            s->re[i] = s->re[r];
+            s->re[r] = t;
+        }
+    }
+    memset(s->im, 0, sizeof(s->im));
+
+    /* The first two stages have fewer than four pairs per group */
+#ifdef SPECTRUM_HAVE_NEON
+    stages_scalar(s, 1, 4);
+    stages_neon(s, 4);
+    power_neon(s, SPECTRUM_N / 2 + 1);
+#else
+    stages_scalar(s, 1, SPECTRUM_N);
+    power_scalar(s, SPECTRUM_N / 2 + 1);
+#endif
+
+    for (unsigned b = 0; b < s->nbands; b++) {
+        float p = 0.0f;
+        for (unsigned k = s->band[b]; k < s->band[b + 1]; k++)
+            if (s->re[k] > p)
+                p = s->re[k];
+        bands[b] = to_db(p);
+    }
+
+    /* RMS + 3 dB, as in AES17: a sine reads the same on both */
+    for (int c = 0; c < 2; c++) {
+        lv->peak[c] = peak[c] ? 20.0f * log10f(peak[c] / 32768.0f) : SPECTRUM_FLOOR_DB;
+        lv->rms[c]  = to_db((float)(2.0 * sum[c] / SPECTRUM_N / (32768.0 * 32768.0)));
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * spectrum.h
+ *
+ * Spectrum and level meter analysis of a window of interleaved S16 stereo
+ * for the HDMI visualizer (visual.h).
+ *
+ * The window is mixed to mono, Hann-windowed and run through a radix-2
+ * complex FFT of SPECTRUM_N points; the power of the bins is then gathered
+ * into log-spaced bands.  The peak and RMS level of each channel come from
+ * the same window.  On AArch64 the windowing, the butterflies of every
+ * stage from the third on, the power sums and the meters use NEON, four
+ * lanes at a time; the scalar versions are the reference and the fallback
+ * on other hosts.
+ *
+ * Levels are in dB relative to full scale: a full-scale sine reads 0 dB
+ * in its band and on both meters' peaks.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <stdint.h>
+
+#define SPECTRUM_N         1024         /* FFT length in frames (~23 ms)   */
+#define SPECTRUM_BANDS_MAX 64
+#define SPECTRUM_FLOOR_DB  -96.0f       /* Reported for digital silence    */
+
+struct spectrum_levels {
+    float peak[2];                      /* dBFS, left and right            */
+    float rms[2];
+};
+
+struct spectrum {
+    float    window[SPECTRUM_N];        /* Hann, scaled to read dBFS       */
+    uint16_t rev[SPECTRUM_N];           /* Bit-reversed index              */
+    float    tw_re[SPECTRUM_N];         /* Twiddles of stage h at h - 1    */
+    float    tw_im[SPECTRUM_N];
+    float    re[SPECTRUM_N];
+    float    im[SPECTRUM_N];
+    unsigned nbands;
+    uint16_t band[SPECTRUM_BANDS_MAX + 1];  /* First bin of each band      */
+};
+
+/* nbands (at most SPECTRUM_BANDS_MAX) log-spaced from f_lo to f_hi Hz */
+void spectrum_init(struct spectrum *s, unsigned nbands, float f_lo, float f_hi);
+
+/*
+ * Analyze SPECTRUM_N frames of pcm: the level of each band in dB into
+ * bands[nbands], the meters into *lv.
+ */
+void spectrum_run(struct spectrum *s, const int16_t *pcm, float *bands,
+                  struct spectrum_levels *lv);
+
+#endif /* SPECTRUM_H */
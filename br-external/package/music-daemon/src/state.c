@@ -0,0 +1,78 @@
+/*
+ * state.c
+ *
+ * Seqlock around the published daemon state (see state.h).
+ *
+ * The sequence counter is odd while a publish is in progress.  A reader
+ * samples it, copies the payload, and accepts the copy only if the counter
+ * was even and unchanged.  The payload is stored as relaxed atomic words,
+ * so a torn read is merely discarded rather than being a data race.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "state.h"
+
+#define STATE_WORDS ((sizeof(struct daemon_state) + 3) / 4)
+
+static _Atomic uint64_t seq;
+static _Atomic uint32_t words[STATE_WORDS];
+
+void state_publish(const struct daemon_state *s)
+{
+    union {
+        struct daemon_state st;
+        uint32_t            w[STATE_WORDS];
+    } u;
+    uint64_t v = atomic_load_explicit(&seq, memory_order_relaxed);
+
+    memset(&u, 0, sizeof(u));
+    u.st = *s;
+    u.st.version = v / 2 + 1;
+
+    /* Odd: readers back off until the copy is complete */
+    atomic_store_explicit(&seq, v + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (size_t i = 0; i < STATE_WORDS; i++)
+        atomic_store_explicit(&words[i], u.w[i], memory_order_relaxed);
+
+    atomic_store_explicit(&seq, v + 2, memory_order_release);
+}
+
+void state_read(struct daemon_state *out)
+{
+    union {
+        struct daemon_state st;
+        uint32_t            w[STATE_WORDS];
+    } u;
+
+    for (;;) {
+        uint64_t s1 = atomic_load_explicit(&seq, memory_order_acquire);
+
+        if (s1 & 1) {
+            sched_yield();      /* Writer mid-publish; it is never long */
+            continue;
+        }
+
+        for (size_t i = 0; i < STATE_WORDS; i++)
+            u.w[i] = atomic_load_explicit(&words[i], memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&seq, memory_order_relaxed) == s1)
+            break;
+    }
+
+    *out = u.st;
+}
+
+uint64_t state_version(void)
+{
+    return atomic_load_explicit(&seq, memory_order_acquire) / 2;
+}
@@ -0,0 +1,50 @@
+/*
+ * state.h
+ *
+ * Published daemon state: one versioned snapshot behind a seqlock.
+ *
+ * The control thread is the only writer and calls state_publish() after
+ * every change it makes.  Any thread (HTTP, UI, metrics) can call
+ * state_read() at any rate; it never takes a lock and never delays the
+ * writer, it simply retries if it raced with a publish.  Every publish
+ * bumps version, so readers can tell whether anything changed since they
+ * last looked.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+
+#define STATE_QUEUE_SHOWN 32        /* Queue entries carried in a snapshot */
+
+struct daemon_state {
+    uint64_t version;       /* Set by state_publish(), starts at 1       */
+    int      song;          /* Index into the active playlist            */
+    int      cloud;         /* 0 = local files, 1 = cloud tracks         */
+    int      playing;
+    int      volume;        /* 0-100 %                                   */
+    int      muted;
+    int      crossfade_ms;
+    unsigned play_gen;      /* Bumped whenever playback is replaced      */
+    int      shuffle;       /* Local playlist in shuffled order          */
+    unsigned queue_len;     /* Tracks waiting in the play queue          */
+    struct {
+        uint32_t entry;     /* Handle for /queue/remove and /queue/move  */
+        int      track;
+    } queue[STATE_QUEUE_SHOWN];         /* Head of the queue, in order   */
+    char     message[64];   /* Last status line, "" = none               */
+};
+
+/* Control thread only: copy s in as the new snapshot (s->version ignored) */
+void     state_publish(const struct daemon_state *s);
+
+/* Any thread: consistent copy of the latest snapshot */
+void     state_read(struct daemon_state *out);
+
+/* Any thread: version of the latest snapshot, 0 before the first publish */
+uint64_t state_version(void);
+
+#endif /* STATE_H */
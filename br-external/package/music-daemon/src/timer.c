@@ -0,0 +1,269 @@
+/*
+ * timer.c
+ *
+ * Hierarchical timer wheel on one timerfd (see timer.h).
+ *
+ * clk is the first wheel tick not yet processed.  A timer goes to the
+ * lowest level L whose 64 slots, each 8^L ms wide, reach its deadline
+ * rounded up to that width; its slot then lies between 0 and 63 steps
+ * ahead of the level's current position, so a rotated bitmap scan gives
+ * the next deadline per level.  timerwheel_run() jumps clk straight to the
+ * earliest such deadline and empties every slot that falls due there,
+ * which keeps it cheap however long the loop has slept.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "timer.h"
+
+#define LVL_BITS     6
+#define LVL_SIZE     (1 << LVL_BITS)
+#define LVL_MASK     (LVL_SIZE - 1)
+#define LVL_SHIFT(l) (3 * (l))          /* Each level 8x coarser          */
+#define NO_DEADLINE  UINT64_MAX
+#define EXPIRING     (TIMER_LEVELS * LVL_SIZE)  /* Taken off a slot, to run */
+
+static struct timer *slots[TIMER_LEVELS * LVL_SIZE + 1];
+static uint64_t      occupied[TIMER_LEVELS];    /* Non-empty slot bitmaps */
+static uint64_t      clk;
+static uint64_t      armed_at = NO_DEADLINE;    /* Programmed into the fd */
+static uint64_t      epoch_ns;
+static int           tfd = -1;
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t timer_now_ms(void)
+{
+    return (mono_ns() - epoch_ns) / 1000000;
+}
+
+/* ------------------------------------------------------- */
+/*                      SLOT LISTS                         */
+/* ------------------------------------------------------- */
+
+static void slot_add(struct timer *t, int slot)
+{
+    t->slot = slot;
+    t->prev = NULL;
+    t->next = slots[slot];
+    if (t->next)
+        t->next->prev = t;
+    slots[slot] = t;
+    occupied[slot / LVL_SIZE] |= 1ULL << (slot & LVL_MASK);
+}
+
+static void slot_del(struct timer *t)
+{
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        slots[t->slot] = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+
+    if (!slots[t->slot] && t->slot != EXPIRING)
+        occupied[t->slot / LVL_SIZE] &= ~(1ULL << (t->slot & LVL_MASK));
+
+    t->next = t->prev = NULL;
+    t->slot = -1;
+}
+
+/* File t by its deadline; past deadlines fire on the next tick */
+static void enqueue(struct timer *t)
+{
+    uint64_t when = t->expires < clk ? clk : t->expires;
+    int level;
+    uint64_t idx = 0;
+
+    for (level = 0; level < TIMER_LEVELS; level++) {
+        int sh = LVL_SHIFT(level);
+        idx = (when + (1ULL << sh) - 1) >> sh;
+        if (idx - (clk >> sh) < LVL_SIZE)
+            break;
+    }
+
+    /* Beyond the top level: park in its last slot and re-file on expiry */
+    if (level == TIMER_LEVELS) {
+        level = TIMER_LEVELS - 1;
+        idx = (clk >> LVL_SHIFT(level)) + LVL_SIZE - 1;
+    }
+
+    slot_add(t, level * LVL_SIZE + (int)(idx & LVL_MASK));
+}
+
+/* Earliest tick at which some slot falls due */
+static uint64_t next_deadline(void)
+{
+    uint64_t best = NO_DEADLINE;
+
+    for (int level = 0; level < TIMER_LEVELS; level++) {
+        uint64_t bm = occupied[level];
+        if (!bm)
+            continue;
+
+        int sh = LVL_SHIFT(level);
+        uint64_t pos = clk >> sh;
+        int rot = (int)(pos & LVL_MASK);
+
+        if (rot)
+            bm = (bm >> rot) | (bm << (LVL_SIZE - rot));
+
+        uint64_t due = (pos + (uint64_t)__builtin_ctzll(bm)) << sh;
+        if (due < best)
+            best = due;
+    }
+
+    return best;
+}
+
+/* ------------------------------------------------------- */
+/*                       TIMERFD                           */
+/* ------------------------------------------------------- */
+
+static void program_fd(uint64_t deadline)
+{
+    struct itimerspec its;
+
+    if (deadline == armed_at)
+        return;
+    armed_at = deadline;
+
+    memset(&its, 0, sizeof(its));
+    if (deadline != NO_DEADLINE) {
+        uint64_t ns = epoch_ns + deadline * 1000000ULL;
+        its.it_value.tv_sec  = (time_t)(ns / 1000000000ULL);
+        its.it_value.tv_nsec = (long)(ns % 1000000000ULL);
+        if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+            its.it_value.tv_nsec = 1;   /* All-zero would disarm it */
+    }
+
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        perror("timer: timerfd_settime");
+}
+
+int timerwheel_init(void)
+{
+    epoch_ns = mono_ns();
+    clk = 0;
+
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (tfd < 0) {
+        perror("timer: timerfd_create");
+        return -1;
+    }
+    return 0;
+}
+
+int timerwheel_fd(void)
+{
+    return tfd;
+}
+
+void timerwheel_run(void)
+{
+    uint64_t expirations;
+    uint64_t now = timer_now_ms();
+
+    (void)read(tfd, &expirations, sizeof(expirations));
+
+    for (;;) {
+        uint64_t due = next_deadline();
+        if (due == NO_DEADLINE || due > now)
+            break;
+
+        /* Anything armed from a callback lands after this tick */
+        clk = due + 1;
+
+        for (int level = 0; level < TIMER_LEVELS; level++) {
+            int sh = LVL_SHIFT(level);
+            if (due & ((1ULL << sh) - 1))
+                break;      /* Coarser levels have no boundary here either */
+
+            /*
+             * Empty the slot first: a callback may arm a timer that hashes
+             * straight back into it (exactly one turn ahead), and draining
+             * the slot itself would then never end.  Timers still on the
+             * expiring list can be cancelled by callbacks as usual.
+             */
+            int slot = level * LVL_SIZE + (int)((due >> sh) & LVL_MASK);
+            for (struct timer *t = slots[slot]; t; t = t->next)
+                t->slot = EXPIRING;
+            slots[EXPIRING] = slots[slot];
+            slots[slot] = NULL;
+            occupied[level] &= ~(1ULL << (slot & LVL_MASK));
+
+            while (slots[EXPIRING]) {
+                struct timer *t = slots[EXPIRING];
+                slot_del(t);
+
+                if (t->expires > due)
+                    enqueue(t);     /* Parked beyond the wheel's reach */
+                else
+                    t->fn(t->arg);
+            }
+        }
+    }
+
+    if (clk <= now)
+        clk = now + 1;
+
+    program_fd(next_deadline());
+}
+
+/* ------------------------------------------------------- */
+/*                        TIMERS                           */
+/* ------------------------------------------------------- */
+
+void timer_arm(struct timer *t, uint64_t delay_ms, unsigned slack_ms)
+{
+    uint64_t now  = timer_now_ms();
+    uint64_t when = now + delay_ms;
+
+    if (t->slot >= 0)
+        slot_del(t);
+
+    /*
+     * After an idle stretch clk lags behind; with nothing due before now
+     * it can move up, so the new timer is filed relative to the present.
+     */
+    if (clk < now && next_deadline() >= now)
+        clk = now;
+
+    /* Round up to the largest power of two within the allowed slack */
+    if (slack_ms > 1) {
+        uint64_t g = 1ULL << (63 - __builtin_clzll(slack_ms));
+        when = (when + g - 1) & ~(g - 1);
+    }
+
+    t->expires = when;
+    enqueue(t);
+
+    uint64_t next = next_deadline();
+    if (next < armed_at)
+        program_fd(next);
+}
+
+void timer_cancel(struct timer *t)
+{
+    /* The fd may now fire early; timerwheel_run() then just re-arms it */
+    if (t->slot >= 0)
+        slot_del(t);
+}
+
+int timer_pending(const struct timer *t)
+{
+    return t->slot >= 0;
+}
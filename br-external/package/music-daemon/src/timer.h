@@ -0,0 +1,58 @@
+/*
+ * timer.h
+ *
+ * One-shot timers for the control thread, kept in a hierarchical timer
+ * wheel and driven by a single timerfd polled next to the loop's other fds.
+ *
+ * The wheel has TIMER_LEVELS levels of 64 slots.  Level 0 counts
+ * milliseconds and every level above is 8 times coarser, so a timer is
+ * filed, without cascading, in the first level whose span covers its delay.
+ * Arming and cancelling are a list insert or unlink; the next deadline
+ * comes from one bitmap scan per level.  A timer fires no earlier than
+ * requested and at most about 1/8 of its delay later; callers that can take
+ * more slack say so, and deadlines that round to the same tick share one
+ * wakeup.  With nothing armed the timerfd is disarmed and the loop sleeps.
+ *
+ * Not thread-safe: only the control thread arms, cancels and runs timers.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#define TIMER_LEVELS 5      /* 1, 8, 64, 512, 4096 ms ticks: ~4.4 min reach */
+
+struct timer {
+    struct timer *next, *prev;      /* Slot list while armed              */
+    uint64_t      expires;          /* Requested deadline, wheel ms       */
+    int           slot;             /* -1 while idle                      */
+    void        (*fn)(void *arg);
+    void         *arg;
+};
+
+#define TIMER_INIT(fn, arg) { NULL, NULL, 0, -1, (fn), (arg) }
+
+/* Create the timerfd. Returns 0 on success. */
+int      timerwheel_init(void);
+
+/* fd to poll for POLLIN; readable when a deadline has passed */
+int      timerwheel_fd(void);
+
+/* Run every expired callback, then re-arm the timerfd for the next one */
+void     timerwheel_run(void);
+
+/* Milliseconds on the wheel's monotonic clock */
+uint64_t timer_now_ms(void);
+
+/*
+ * (Re)arm t to fire after delay_ms.  slack_ms > 0 allows rounding the
+ * deadline up to a multiple of that many ms, so unrelated timers coalesce.
+ */
+void     timer_arm(struct timer *t, uint64_t delay_ms, unsigned slack_ms);
+void     timer_cancel(struct timer *t);
+int      timer_pending(const struct timer *t);
+
+#endif /* TIMER_H */
@@ -0,0 +1,221 @@
+/*
+ * visual.c
+ *
+ * Spectrum bars and level meters on the HDMI console (see visual.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include "visual.h"
+#include "spectrum.h"
+#include "player.h"
+#include "pcm.h"
+
+#define BAR_FLOOR_DB   -60.0f           /* Bottom of the bars              */
+#define BAR_FALL_DB    30.0f            /* Per second, bars and RMS        */
+#define PEAK_FALL_DB   15.0f            /* Per second, meter peaks         */
+#define METER_CELLS    48               /* One per dB, -48 .. 0 dBFS       */
+#define STATS_NS       2000000000ULL
+
+static int            enabled;
+static int            top;              /* First row of the bars           */
+static uint64_t       frame_ns;         /* At the configured rate          */
+static unsigned       cpu_pct;
+
+/* Levels shown, falling slowly */
+static float          bar_db[VISUAL_BANDS];
+static float          peak_db[2], rms_db[2];
+static int            at_rest;          /* Stopped, and all fallen         */
+
+static struct spectrum sp;
+static int16_t        pcm[SPECTRUM_N * PCM_CHANNELS];
+static uint64_t       next_ns, last_ns;
+static uint64_t       cost_ns;          /* Thread CPU per frame, averaged  */
+
+static uint64_t       win_start, win_cpu;
+static unsigned       win_frames;
+static _Atomic unsigned stat_fps, stat_cpu;
+
+static uint64_t clock_ns(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ------------------------------------------------------- */
+/*                        LEVELS                           */
+/* ------------------------------------------------------- */
+
+static float fall(float shown, float now, float rate, float dt)
+{
+    float held = shown - rate * dt;
+    return now > held ? now : held;
+}
+
+static int bar_height(float db)
+{
+    int h = (int)((db - BAR_FLOOR_DB) * VISUAL_HEIGHT / -BAR_FLOOR_DB);
+
+    return h < 0 ? 0 : h > VISUAL_HEIGHT ? VISUAL_HEIGHT : h;
+}
+
+int visual_due(int playing)
+{
+    uint64_t now;
+
+    if (!enabled)
+        return -1;
+    if (at_rest && !playing)
+        return -1;
+
+    now = clock_ns(CLOCK_MONOTONIC);
+    if (at_rest) {
+        /* Playback started again: a frame now, and a new stats window */
+        at_rest    = 0;
+        next_ns    = now;
+        win_start  = now;
+        win_frames = 0;
+        win_cpu    = 0;
+    }
+    return now >= next_ns ? 0 : (int)((next_ns - now + 999999) / 1000000);
+}
+
+void visual_update(int playing)
+{
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    float dt = last_ns ? (float)(now - last_ns) / 1e9f : 0.0f;
+    float bands[VISUAL_BANDS];
+    struct spectrum_levels lv;
+    int rest = 1;
+
+    if (!playing || player_heard(pcm, SPECTRUM_N) < 0)
+        memset(pcm, 0, sizeof(pcm));
+    spectrum_run(&sp, pcm, bands, &lv);
+    last_ns = now;
+
+    /* Levels fall by the time since the last frame, however long ago */
+    for (int b = 0; b < VISUAL_BANDS; b++) {
+        bar_db[b] = fall(bar_db[b], bands[b], BAR_FALL_DB, dt);
+        rest &= bar_height(bar_db[b]) == 0;
+    }
+    for (int c = 0; c < 2; c++) {
+        peak_db[c] = fall(peak_db[c], lv.peak[c], PEAK_FALL_DB, dt);
+        rms_db[c]  = fall(rms_db[c], lv.rms[c], BAR_FALL_DB, dt);
+        if (peak_db[c] < SPECTRUM_FLOOR_DB)
+            peak_db[c] = SPECTRUM_FLOOR_DB;
+        if (rms_db[c] < SPECTRUM_FLOOR_DB)
+            rms_db[c] = SPECTRUM_FLOOR_DB;
+        rest &= peak_db[c] + METER_CELLS <= 0.0f;
+    }
+
+    /* At rest: the next frame starts afresh when playback does */
+    if (!playing && rest) {
+        at_rest = 1;
+        last_ns = 0;
+        atomic_store_explicit(&stat_fps, 0, memory_order_relaxed);
+        atomic_store_explicit(&stat_cpu, 0, memory_order_relaxed);
+    }
+}
+
+static void account(uint64_t now, uint64_t spent)
+{
+    win_frames++;
+    win_cpu += spent;
+    if (now - win_start < STATS_NS)
+        return;
+
+    atomic_store_explicit(&stat_fps, (unsigned)(win_frames * 10000000000ULL / (now - win_start)),
+                          memory_order_relaxed);
+    atomic_store_explicit(&stat_cpu, (unsigned)(win_cpu * 1000 / (now - win_start)),
+                          memory_order_relaxed);
+    win_start  = now;
+    win_frames = 0;
+    win_cpu    = 0;
+}
+
+void visual_frame_done(uint64_t cpu_ns)
+{
+    uint64_t now = clock_ns(CLOCK_MONOTONIC), interval;
+
+    /* Slower than the configured rate when a frame costs more than the budget */
+    cost_ns  = cost_ns ? (cost_ns * 7 + cpu_ns) / 8 : cpu_ns;
+    interval = cost_ns * 100 / cpu_pct;
+    if (interval < frame_ns)
+        interval = frame_ns;
+    next_ns = now + interval;
+    if (!at_rest)
+        account(now, cpu_ns);
+}
+
+/* ------------------------------------------------------- */
+/*                        DRAWING                          */
+/* ------------------------------------------------------- */
+
+/* Meter c: RMS as '#', up to the peak as '=', then the peak in dB */
+static void draw_meter(struct screen *scr, int row, int c)
+{
+    int rms  = (int)(rms_db[c] + METER_CELLS);
+    int peak = (int)(peak_db[c] + METER_CELLS);
+    int col  = screen_puts(scr, row, 2, c ? "R [" : "L [");
+
+    for (int k = 0; k < METER_CELLS; k++)
+        screen_putc(scr, row, col + k, k < rms ? '#' : k < peak ? '=' : ' ');
+    if (peak > 0)
+        screen_printf(scr, row, col + METER_CELLS, "] %4.0f dB", peak_db[c]);
+    else
+        screen_puts(scr, row, col + METER_CELLS, "]   -- dB");
+}
+
+void visual_draw(struct screen *scr)
+{
+    if (!enabled)
+        return;
+
+    for (int b = 0; b < VISUAL_BANDS; b++) {
+        int h = bar_height(bar_db[b]);
+        for (int level = 0; level < h; level++)
+            screen_putc(scr, top + VISUAL_HEIGHT - 1 - level, 2 + 2 * b, '#');
+        screen_puts(scr, top + VISUAL_HEIGHT, 2 + 2 * b, "--");
+    }
+
+    draw_meter(scr, top + VISUAL_HEIGHT + 1, 0);
+    draw_meter(scr, top + VISUAL_HEIGHT + 2, 1);
+}
+
+void visual_get_stats(struct visual_stats *st)
+{
+    st->fps_x10 = atomic_load_explicit(&stat_fps, memory_order_relaxed);
+    st->cpu_x10 = atomic_load_explicit(&stat_cpu, memory_order_relaxed);
+}
+
+/* ------------------------------------------------------- */
+/*                         SETUP                           */
+/* ------------------------------------------------------- */
+
+int visual_init(const struct visual_config *cfg, int top_row)
+{
+    if (!cfg->enable)
+        return -1;
+
+    top      = top_row;
+    frame_ns = 1000000000ULL / (cfg->fps ? cfg->fps : 1);
+    cpu_pct  = cfg->cpu_pct ? cfg->cpu_pct : 1;
+    spectrum_init(&sp, VISUAL_BANDS, 40.0f, 16000.0f);
+
+    for (int b = 0; b < VISUAL_BANDS; b++)
+        bar_db[b] = SPECTRUM_FLOOR_DB;
+    for (int c = 0; c < 2; c++)
+        peak_db[c] = rms_db[c] = SPECTRUM_FLOOR_DB;
+
+    at_rest = 1;
+    enabled = 1;
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * visual.h
+ *
+ * Live spectrum and level meters below the status screen on the HDMI
+ * console.
+ *
+ * When a frame is due, the window of audio now leaving the speaker
+ * (player_heard()) goes through the spectrum analyzer (spectrum.h) and the
+ * shown levels are updated; bars fall back slowly rather than flicker.
+ * The bars and meters are drawn into the UI thread's screen model
+ * (screen.h) with every frame it composes, so only cells that changed
+ * reach the console.  Once playback stops and everything has fallen to
+ * the floor, no more frames are asked for.
+ *
+ * Drawing on the framebuffer console is the expensive part, and it runs in
+ * the writing thread.  So the UI thread reports the thread CPU time of
+ * every frame, and frames come further apart than the configured rate
+ * whenever that is needed to keep the visualizer within its share of one
+ * core; it can slow down, but never take time from the audio threads.
+ *
+ * Only the UI thread may call these, except visual_get_stats().
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef VISUAL_H
+#define VISUAL_H
+
+#include <stdint.h>
+
+#include "screen.h"
+
+#define VISUAL_BANDS  32                /* Spectrum bars, 40 Hz .. 16 kHz  */
+#define VISUAL_HEIGHT 10                /* Rows of the bars                */
+#define VISUAL_ROWS   (VISUAL_HEIGHT + 3)   /* Plus a baseline and 2 meters */
+
+struct visual_config {
+    int      enable;
+    unsigned fps;                       /* Frame rate while playing        */
+    unsigned cpu_pct;                   /* Share of one core at most       */
+};
+
+struct visual_stats {
+    unsigned fps_x10;                   /* Frames drawn over the last ~2 s */
+    unsigned cpu_x10;                   /* Per mille of one core, same     */
+};
+
+/* Draw from screen row top (0-based) on; returns -1 if disabled */
+int  visual_init(const struct visual_config *cfg, int top);
+
+/*
+ * Milliseconds until the next frame is due, 0 if it is due now, or -1 if
+ * none is (disabled, or stopped and all fallen).
+ */
+int  visual_due(int playing);
+
+/* Take the levels of the audio playing now; call when a frame is due */
+void visual_update(int playing);
+
+/* Draw the levels into a frame being composed */
+void visual_draw(struct screen *scr);
+
+/* A frame with an update took cpu_ns of thread CPU time to compose and write */
+void visual_frame_done(uint64_t cpu_ns);
+
+/* Any thread */
+void visual_get_stats(struct visual_stats *st);
+
+#endif /* VISUAL_H */
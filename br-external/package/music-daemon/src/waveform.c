@@ -0,0 +1,232 @@
+/*
+ * waveform.c
+ *
+ * Min/max peak overviews of library tracks (see waveform.h).
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "waveform.h"
+#include "mix.h"
+#include "pcm.h"
+
+#define WAVEFORM_MAGIC "MDWF"
+
+/* On disk: this header, then the pairs of struct waveform */
+struct waveform_file {
+    char     magic[4];
+    uint32_t buckets;
+    uint32_t duration_ms;
+    uint32_t reserved;
+    uint64_t size;                      /* Of the track it was made from   */
+    int64_t  mtime;
+};
+
+static char wave_dir[PATH_MAX];         /* Empty: overviews are not stored */
+static atomic_int stopped;              /* Saving failed for good          */
+
+/* ------------------------------------------------------- */
+/*                        BUILDING                         */
+/* ------------------------------------------------------- */
+
+void waveform_begin(struct waveform_builder *b)
+{
+    b->nblocks      = 0;
+    b->block_frames = WAVEFORM_BLOCK;
+    b->fill         = 0;
+    b->lo           = INT16_MAX;
+    b->hi           = INT16_MIN;
+    b->frames       = 0;
+}
+
+static void end_block(struct waveform_builder *b)
+{
+    /* Full: merge neighbours, and blocks from here on are twice as long */
+    if (b->nblocks == WAVEFORM_BLOCKS) {
+        for (unsigned i = 0; i < WAVEFORM_BLOCKS / 2; i++) {
+            const int16_t *x = b->block[2 * i], *y = b->block[2 * i + 1];
+            b->block[i][0] = x[0] < y[0] ? x[0] : y[0];
+            b->block[i][1] = x[1] > y[1] ? x[1] : y[1];
+        }
+        b->nblocks = WAVEFORM_BLOCKS / 2;
+        b->block_frames *= 2;
+    }
+
+    b->block[b->nblocks][0] = b->lo;
+    b->block[b->nblocks][1] = b->hi;
+    b->nblocks++;
+    b->fill = 0;
+    b->lo   = INT16_MAX;
+    b->hi   = INT16_MIN;
+}
+
+void waveform_feed(struct waveform_builder *b, const int16_t *pcm, size_t frames)
+{
+    b->frames += frames;
+
+    while (frames) {
+        size_t n = b->block_frames - b->fill;
+        if (n > frames)
+            n = frames;
+
+        mix_minmax_s16(pcm, n * PCM_CHANNELS, &b->lo, &b->hi);
+        b->fill += n;
+        if (b->fill == b->block_frames)
+            end_block(b);
+
+        pcm += n * PCM_CHANNELS;
+        frames -= n;
+    }
+}
+
+int waveform_end(struct waveform_builder *b, struct waveform *w)
+{
+    unsigned n;
+
+    if (b->fill)
+        end_block(b);
+    if (!(n = b->nblocks))
+        return -1;
+
+    /* Shorter than WAVEFORM_BUCKETS blocks: a block spans several buckets */
+    for (unsigned k = 0; k < WAVEFORM_BUCKETS; k++) {
+        unsigned first = (unsigned)((uint64_t)k * n / WAVEFORM_BUCKETS);
+        unsigned end   = (unsigned)((uint64_t)(k + 1) * n / WAVEFORM_BUCKETS);
+        int16_t lo = INT16_MAX, hi = INT16_MIN;
+
+        if (end <= first)
+            end = first + 1;
+        for (unsigned i = first; i < end; i++) {
+            if (b->block[i][0] < lo) lo = b->block[i][0];
+            if (b->block[i][1] > hi) hi = b->block[i][1];
+        }
+        w->peak[k][0] = (int8_t)(lo >> 8);
+        w->peak[k][1] = (int8_t)(hi >> 8);
+    }
+
+    w->duration_ms = (uint32_t)(b->frames * 1000 / PCM_RATE);
+    return 0;
+}
+
+/* ------------------------------------------------------- */
+/*                         STORAGE                         */
+/* ------------------------------------------------------- */
+
+static void wave_path(char *out, size_t len, uint64_t id)
+{
+    snprintf(out, len, "%s/%016llx.wf", wave_dir, (unsigned long long)id);
+}
+
+int waveform_save(uint64_t id, uint64_t size, int64_t mtime,
+                  const struct waveform *w)
+{
+    struct waveform_file h = {
+        .magic       = WAVEFORM_MAGIC,
+        .buckets     = WAVEFORM_BUCKETS,
+        .duration_ms = w->duration_ms,
+        .size        = size,
+        .mtime       = mtime,
+    };
+    char path[PATH_MAX + 24], tmp[PATH_MAX + 32];
+    FILE *f;
+    int ok, err;
+
+    if (!waveform_enabled())
+        return -1;
+
+    wave_path(path, sizeof(path), id);
+    snprintf(tmp, sizeof(tmp), "%s.part", path);
+    if (!(f = fopen(tmp, "we"))) {
+        err = errno;
+        perror("waveform: create");
+        goto fail;
+    }
+
+    ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+         fwrite(w->peak, sizeof(w->peak), 1, f) == 1;
+    err = errno;
+
+    /* Written whole or not at all */
+    if (fclose(f) != 0 || !ok || rename(tmp, path) < 0) {
+        if (ok)
+            err = errno;
+        perror("waveform: write");
+        unlink(tmp);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    /*
+     * A full, read-only or vanished directory fails for every track: stop
+     * asking for overviews, or each library change would decode them all
+     */
+    if (err == ENOSPC || err == EDQUOT || err == EROFS || err == EACCES ||
+        err == EPERM || err == ENOENT) {
+        atomic_store(&stopped, 1);
+        fprintf(stderr, "waveform: no more overviews until restart\n");
+    }
+    return -1;
+}
+
+int waveform_load(uint64_t id, uint64_t size, int64_t mtime,
+                  struct waveform *w)
+{
+    struct waveform_file h;
+    char path[PATH_MAX + 24];
+    FILE *f;
+    int ok;
+
+    if (!wave_dir[0])
+        return -1;
+
+    wave_path(path, sizeof(path), id);
+    if (!(f = fopen(path, "re")))
+        return -1;
+    ok = fread(&h, sizeof(h), 1, f) == 1 &&
+         fread(w->peak, sizeof(w->peak), 1, f) == 1;
+    fclose(f);
+
+    /* Made by another build, or for an older version of the file */
+    if (!ok || memcmp(h.magic, WAVEFORM_MAGIC, sizeof(h.magic)) != 0 ||
+        h.buckets != WAVEFORM_BUCKETS || h.size != size || h.mtime != mtime)
+        return -1;
+
+    w->duration_ms = h.duration_ms;
+    return 0;
+}
+
+/* ------------------------------------------------------- */
+/*                         SETUP                           */
+/* ------------------------------------------------------- */
+
+int waveform_init(const char *index_path)
+{
+    const char *slash = strrchr(index_path, '/');
+    int dlen = slash ? (int)(slash - index_path) : 1;
+
+    snprintf(wave_dir, sizeof(wave_dir), "%.*s/%s", dlen,
+             slash ? index_path : ".", WAVEFORM_DIR);
+
+    if (mkdir(wave_dir, 0755) < 0 && errno != EEXIST) {
+        perror("waveform: mkdir");
+        wave_dir[0] = '\0';
+        return -1;
+    }
+    return 0;
+}
+
+int waveform_enabled(void)
+{
+    return wave_dir[0] != '\0' && !atomic_load(&stopped);
+}
@@ -0,0 +1,80 @@
+/*
+ * waveform.h
+ *
+ * Min/max peak overviews of library tracks for drawing scrub bars.
+ *
+ * An overview is WAVEFORM_BUCKETS pairs of the lowest and highest sample of
+ * an equal slice of the track, both channels together, in 8 bits.  The
+ * analyzer (analyzer.h) builds one during the decode it does anyway, with
+ * mix_minmax_s16() reducing each block of PCM, and stores it as a small
+ * file named after the track id in a directory next to the library index.
+ * The file records the size and modification time of the track it was
+ * made from, so one left over from an older version is never served.
+ *
+ * While building, the min/max of every WAVEFORM_BLOCK frames is kept;
+ * when the list fills up, neighbours are merged and blocks get twice as
+ * long, so a builder has a fixed size however long the track is.
+ *
+ * AUTHOR : PRUDHVI RAJ BELIDE
+ */
+
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WAVEFORM_BUCKETS 1000           /* Pairs in an overview            */
+#define WAVEFORM_BLOCK   1024           /* Frames per block to begin with  */
+#define WAVEFORM_BLOCKS  8192           /* Blocks a builder holds          */
+#define WAVEFORM_DIR     "waveforms"    /* Next to the library index       */
+
+struct waveform {
+    uint32_t duration_ms;
+    int8_t   peak[WAVEFORM_BUCKETS][2]; /* Min, max; 127 = full scale      */
+};
+
+struct waveform_builder {
+    int16_t  block[WAVEFORM_BLOCKS][2];
+    unsigned nblocks;                   /* Complete                        */
+    size_t   block_frames;
+    size_t   fill;                      /* Frames in the block being built */
+    int16_t  lo, hi;
+    uint64_t frames;
+};
+
+/*
+ * Create the overview directory next to index_path.  Returns 0, or -1 if
+ * overviews cannot be stored.
+ */
+int  waveform_init(const char *index_path);
+
+/*
+ * Overviews can be stored: waveform_init() succeeded, and no save has
+ * failed since in a way that would fail for every track (no space, no
+ * permission, a read-only or removed directory).  Stored ones are still
+ * served after that.
+ */
+int  waveform_enabled(void);
+
+void waveform_begin(struct waveform_builder *b);
+void waveform_feed(struct waveform_builder *b, const int16_t *pcm, size_t frames);
+
+/* The overview of everything fed; returns -1 if that was nothing */
+int  waveform_end(struct waveform_builder *b, struct waveform *w);
+
+/*
+ * Store the overview of track id, made from a file of size and mtime.
+ * Returns 0, or -1 if it could not be written.
+ */
+int  waveform_save(uint64_t id, uint64_t size, int64_t mtime,
+                   const struct waveform *w);
+
+/*
+ * Any thread: the stored overview of track id, if it was made from the
+ * file as it is now (size, mtime).  Returns 0, or -1 if there is none.
+ */
+int  waveform_load(uint64_t id, uint64_t size, int64_t mtime,
+                   struct waveform *w);
+
+#endif /* WAVEFORM_H */